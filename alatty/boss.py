@@ -82,6 +82,7 @@
     set_options,
     set_os_window_chrome,
     set_os_window_size,
+    stop_zygote,
     thread_write,
     toggle_fullscreen,
     toggle_maximized,
@@ -1169,6 +1170,7 @@ def callback(timer_id: Optional[int]) -> None:
 
     def destroy(self) -> None:
         self.shutting_down = True
+        stop_zygote()
         self.child_monitor.shutdown_monitor()
         del self.child_monitor
         for tm in self.os_window_map.values():
@@ -1249,6 +1251,11 @@ def paste_from_buffer(self, buffer_name: str) -> None:
         if text:
             self.paste_to_active_window(text)
 
+    def paste_from_file(self, path: str) -> None:
+        w = self.active_window
+        if w is not None and path:
+            w.paste_file(os.path.expanduser(path))
+
     def goto_tab(self, tab_num: int) -> None:
         tm = self.active_tab_manager
         if tm is not None:
@@ -1509,15 +1516,12 @@ def move_tab_backward(self) -> None:
             tm.move_tab(-1)
 
     def apply_new_options(self, opts: Options) -> None:
-        from .fonts.box_drawing import set_scale
-
         # Update options storage
         set_options(opts, is_wayland(), self.args.debug_font_fallback)
         apply_options_update()
         set_layout_options(opts)
         set_default_env(opts.env.copy())
         # Update font data
-        set_scale(opts.box_drawing_scale)
         from .fonts.render import set_font_family
 
         set_font_family(opts)
@@ -0,0 +1,1042 @@
+/*
+ * box-drawing.c
+ * Copyright (C) 2017 Kovid Goyal <kovid at kovidgoyal.net>
+ *
+ * Distributed under terms of the GPL3 license.
+ */
+
+#include "box-drawing.h"
+#include "state.h"
+#include <math.h>
+#include <limits.h>
+
+// NOTE: to add a new glyph, add a case to render_box_char() below, then
+// update the functions `font_for_cell` and `box_glyph_id` in `fonts.c`.
+//
+// This is a port of the old fonts/box_drawing.py and matches it pixel for pixel,
+// except in cells too small for the heavy and double lines (U+2500 - U+257F) they
+// contain, e.g. cells 10px wide or less at 192dpi. There the Python code either
+// raised IndexError or drew a few pixels differently, while fill_rect() here clips
+// everything to the cell.
+
+#define SUPERSAMPLE_FACTOR 4
+#define HOLE_FACTOR 8
+#define BEZIER_SAMPLES_PER_ROW 8
+
+typedef struct Canvas {
+    uint8_t *mask;
+    int width, height, supersample_factor;
+    double dpi;
+} Canvas;
+
+typedef enum Side { LEFT, RIGHT, TOP, BOTTOM, BOTH_SIDES } Side;
+typedef enum Corner { TOP_LEFT, TOP_RIGHT, BOTTOM_LEFT, BOTTOM_RIGHT } Corner;
+typedef struct Point { int x, y; } Point;
+typedef struct Limit { double upper, lower; } Limit;
+
+static int
+thickness(const Canvas *self, unsigned level) {
+    return (int)ceil(OPT(box_drawing_scale)[level] * (self->dpi / 72.0));
+}
+
+static void
+fill_rect(Canvas *self, int x1, int x2, int y1, int y2, uint8_t val) {
+    x1 = MAX(0, x1); x2 = MIN(self->width, x2);
+    y1 = MAX(0, y1); y2 = MIN(self->height, y2);
+    for (int y = y1; y < y2; y++) {
+        uint8_t *row = self->mask + y * self->width;
+        for (int x = x1; x < x2; x++) row[x] = val;
+    }
+}
+
+static void
+mirror_horizontally(Canvas *dest, const Canvas *src) {
+    for (int y = 0; y < src->height; y++) {
+        const uint8_t *s = src->mask + y * src->width;
+        uint8_t *d = dest->mask + y * dest->width;
+        for (int x = 0; x < src->width; x++) d[src->width - 1 - x] = s[x];
+    }
+}
+
+// Straight lines {{{
+
+static void
+draw_hline(Canvas *self, int x1, int x2, int y, unsigned level) {
+    // Draw a horizontal line between [x1, x2) centered at y with the thickness given by level
+    int sz = thickness(self, level), start = y - sz / 2;
+    fill_rect(self, x1, x2, start, start + sz, 255);
+}
+
+static void
+draw_vline(Canvas *self, int y1, int y2, int x, unsigned level) {
+    // Draw a vertical line between [y1, y2) centered at x with the thickness given by level
+    int sz = thickness(self, level), start = x - sz / 2;
+    fill_rect(self, start, start + sz, y1, y2, 255);
+}
+
+static void
+half_hline(Canvas *self, unsigned level, Side which, int extend_by) {
+    if (which == LEFT) draw_hline(self, 0, extend_by + self->width / 2, self->height / 2, level);
+    else draw_hline(self, self->width / 2 - extend_by, self->width, self->height / 2, level);
+}
+
+static void
+half_vline(Canvas *self, unsigned level, Side which, int extend_by) {
+    if (which == TOP) draw_vline(self, 0, self->height / 2 + extend_by, self->width / 2, level);
+    else draw_vline(self, self->height / 2 - extend_by, self->height, self->width / 2, level);
+}
+
+static void
+hline(Canvas *self, unsigned level) {
+    half_hline(self, level, LEFT, 0); half_hline(self, level, RIGHT, 0);
+}
+
+static void
+vline(Canvas *self, unsigned level) {
+    half_vline(self, level, TOP, 0); half_vline(self, level, BOTTOM, 0);
+}
+
+static void
+add_holes(Canvas *self, bool horizontal, unsigned level, int num) {
+    const int sz = horizontal ? self->width : self->height;
+    const int line_sz = thickness(self, level);
+    const int hole_sz = sz / HOLE_FACTOR;
+    const int start = (horizontal ? self->height : self->width) / 2 - line_sz / 2;
+    const int individual_block_size = (sz - (num + 1) * hole_sz) / (num + 1);
+    int pos = -(hole_sz / 2);
+    while (pos < sz) {
+        int left = MAX(0, pos), right = MIN(sz, pos + hole_sz);
+        if (right > left) {
+            if (horizontal) fill_rect(self, left, right, start, start + line_sz, 0);
+            else fill_rect(self, start, start + line_sz, left, right, 0);
+        }
+        int next = right + individual_block_size;
+        if (next <= pos) break;
+        pos = next;
+    }
+}
+
+static void
+hholes(Canvas *self, unsigned level, int num) {
+    hline(self, level); add_holes(self, true, level, num);
+}
+
+static void
+vholes(Canvas *self, unsigned level, int num) {
+    vline(self, level); add_holes(self, false, level, num);
+}
+
+static void
+corner(Canvas *self, unsigned hlevel, unsigned vlevel, Corner which) {
+    // which is the position of the corner in the cell, so ┌ is TOP_LEFT
+    half_hline(self, hlevel, (which == TOP_LEFT || which == BOTTOM_LEFT) ? RIGHT : LEFT, thickness(self, vlevel) / 2);
+    half_vline(self, vlevel, (which == BOTTOM_LEFT || which == BOTTOM_RIGHT) ? TOP : BOTTOM, 0);
+}
+
+static void
+vert_t(Canvas *self, unsigned a, unsigned b, unsigned c, Side which) {
+    half_vline(self, a, TOP, 0);
+    half_hline(self, b, which, 0);
+    half_vline(self, c, BOTTOM, 0);
+}
+
+static void
+horz_t(Canvas *self, unsigned a, unsigned b, unsigned c, Side which) {
+    half_hline(self, a, LEFT, 0);
+    half_hline(self, b, RIGHT, 0);
+    half_vline(self, c, which, 0);
+}
+
+static void
+cross(Canvas *self, unsigned a, unsigned b, unsigned c, unsigned d) {
+    half_hline(self, a, LEFT, 0);
+    half_hline(self, b, RIGHT, 0);
+    half_vline(self, c, TOP, 0);
+    half_vline(self, d, BOTTOM, 0);
+}
+
+// }}}
+
+// Double lines {{{
+
+static int
+half_dhline(Canvas *self, unsigned level, Side which, Side only, int *other) {
+    int x1 = which == LEFT ? 0 : self->width / 2, x2 = which == LEFT ? self->width / 2 : self->width;
+    int gap = thickness(self, level + 1);
+    if (only != BOTTOM) draw_hline(self, x1, x2, self->height / 2 - gap, level);
+    if (only != TOP) draw_hline(self, x1, x2, self->height / 2 + gap, level);
+    if (other) *other = self->height / 2 + gap;
+    return self->height / 2 - gap;
+}
+
+static int
+half_dvline(Canvas *self, unsigned level, Side which, Side only, int *other) {
+    int y1 = which == TOP ? 0 : self->height / 2, y2 = which == TOP ? self->height / 2 : self->height;
+    int gap = thickness(self, level + 1);
+    if (only != RIGHT) draw_vline(self, y1, y2, self->width / 2 - gap, level);
+    if (only != LEFT) draw_vline(self, y1, y2, self->width / 2 + gap, level);
+    if (other) *other = self->width / 2 + gap;
+    return self->width / 2 - gap;
+}
+
+static int
+dvline(Canvas *self, Side only, unsigned level, int *other) {
+    half_dvline(self, level, TOP, only, NULL);
+    return half_dvline(self, level, BOTTOM, only, other);
+}
+
+static int
+dhline(Canvas *self, Side only, unsigned level, int *other) {
+    half_dhline(self, level, LEFT, only, NULL);
+    return half_dhline(self, level, RIGHT, only, other);
+}
+
+static void
+dvcorner(Canvas *self, unsigned level, Corner which) {
+    half_dhline(self, level, (which == TOP_LEFT || which == BOTTOM_LEFT) ? RIGHT : LEFT, BOTH_SIDES, NULL);
+    int gap = thickness(self, level + 1);
+    half_vline(self, level, (which == BOTTOM_LEFT || which == BOTTOM_RIGHT) ? TOP : BOTTOM, gap / 2 + thickness(self, level));
+}
+
+static void
+dhcorner(Canvas *self, unsigned level, Corner which) {
+    half_dvline(self, level, (which == BOTTOM_LEFT || which == BOTTOM_RIGHT) ? TOP : BOTTOM, BOTH_SIDES, NULL);
+    int gap = thickness(self, level + 1);
+    half_hline(self, level, (which == TOP_LEFT || which == BOTTOM_LEFT) ? RIGHT : LEFT, gap / 2 + thickness(self, level));
+}
+
+static void
+dcorner(Canvas *self, unsigned level, Corner which) {
+    const bool hleft = which == TOP_RIGHT || which == BOTTOM_RIGHT, vtop = which == BOTTOM_LEFT || which == BOTTOM_RIGHT;
+    const int hgap = thickness(self, level + 1), vgap = hgap;
+    int x1 = hleft ? 0 : self->width / 2, x2 = hleft ? self->width / 2 : self->width;
+    const int ydelta = vtop ? hgap : -hgap;
+    if (hleft) x2 += vgap; else x1 -= vgap;
+    draw_hline(self, x1, x2, self->height / 2 + ydelta, level);
+    if (hleft) x2 -= 2 * vgap; else x1 += 2 * vgap;
+    draw_hline(self, x1, x2, self->height / 2 - ydelta, level);
+    int y1 = vtop ? 0 : self->height / 2, y2 = vtop ? self->height / 2 : self->height;
+    const int xdelta = hleft ? -vgap : vgap;
+    const int yd = thickness(self, level) / 2;
+    if (vtop) y2 += hgap + yd; else y1 -= hgap + yd;
+    draw_vline(self, y1, y2, self->width / 2 - xdelta, level);
+    if (vtop) y2 -= 2 * hgap; else y1 += 2 * hgap;
+    draw_vline(self, y1, y2, self->width / 2 + xdelta, level);
+}
+
+static void
+dpip(Canvas *self, unsigned level, Side which) {
+    // which is the side of the cell the single line extends towards
+    int first, second;
+    switch (which) {
+        case LEFT: case RIGHT:
+            first = dvline(self, BOTH_SIDES, 1, &second);
+            if (which == LEFT) draw_hline(self, 0, first, self->height / 2, level);
+            else draw_hline(self, second, self->width, self->height / 2, level);
+            break;
+        default:
+            first = dhline(self, BOTH_SIDES, 1, &second);
+            if (which == TOP) draw_vline(self, 0, first, self->width / 2, level);
+            else draw_vline(self, second, self->height, self->width / 2, level);
+            break;
+    }
+}
+
+static void
+inner_corner(Canvas *self, unsigned level, Corner which) {
+    const bool left = which == TOP_LEFT || which == BOTTOM_LEFT, top = which == TOP_LEFT || which == TOP_RIGHT;
+    const int hgap = thickness(self, level + 1), vgap = hgap;
+    const int vthick = thickness(self, level) / 2;
+    if (left) draw_hline(self, 0, self->width / 2 - hgap + vthick + 1, self->height / 2 + (top ? -vgap : vgap), level);
+    else draw_hline(self, self->width / 2 + hgap - vthick, self->width, self->height / 2 + (top ? -vgap : vgap), level);
+    if (top) draw_vline(self, 0, self->height / 2 - vgap, self->width / 2 + (left ? -hgap : hgap), level);
+    else draw_vline(self, self->height / 2 + vgap, self->height, self->width / 2 + (left ? -hgap : hgap), level);
+}
+
+// }}}
+
+// Supersampled shapes {{{
+
+static Canvas
+supersampled_canvas(const Canvas *self) {
+    Canvas ans = {
+        .width = self->width * SUPERSAMPLE_FACTOR, .height = self->height * SUPERSAMPLE_FACTOR,
+        .supersample_factor = SUPERSAMPLE_FACTOR, .dpi = self->dpi
+    };
+    ans.mask = calloc((size_t)ans.width * ans.height, 1);
+    if (!ans.mask) fatal("Out of memory allocating supersampled canvas");
+    return ans;
+}
+
+static void
+downsample(Canvas *dest, Canvas *src) {
+    const int factor = src->supersample_factor;
+    for (int y = 0; y < dest->height; y++) {
+        uint8_t *d = dest->mask + y * dest->width;
+        for (int x = 0; x < dest->width; x++) {
+            unsigned total = 0;
+            for (int sy = y * factor; sy < (y + 1) * factor; sy++) {
+                const uint8_t *s = src->mask + sy * src->width + x * factor;
+                for (int sx = 0; sx < factor; sx++) total += s[sx];
+            }
+            d[x] = MIN(255u, d[x] + total / (unsigned)(factor * factor));
+        }
+    }
+    free(src->mask); src->mask = NULL;
+}
+
+// Anti-alias the drawing performed by func by using supersampling
+#define supersampled(func, ...) { \
+    Canvas ss_ = supersampled_canvas(self); \
+    func(&ss_, __VA_ARGS__); \
+    downsample(self, &ss_); \
+}
+
+static void
+fill_region(Canvas *self, const Limit *xlimits, int count, bool inverted) {
+    const uint8_t full = inverted ? 0 : 255, empty = inverted ? 255 : 0;
+    count = MIN(count, self->width);
+    for (int y = 0; y < self->height; y++) {
+        uint8_t *row = self->mask + y * self->width;
+        for (int x = 0; x < count; x++) row[x] = (xlimits[x].upper <= y && y <= xlimits[x].lower) ? full : empty;
+    }
+}
+
+typedef struct LineEquation { double m, c; } LineEquation;
+
+static LineEquation
+line_equation(int x1, int y1, int x2, int y2) {
+    LineEquation ans = {.m = (double)(y2 - y1) / (double)(x2 - x1)};
+    ans.c = y1 - ans.m * x1;
+    return ans;
+}
+
+static double
+line_y(LineEquation l, int x) { return l.m * x + l.c; }
+
+static Limit*
+alloc_limits(const Canvas *self) {
+    Limit *ans = malloc(sizeof(ans[0]) * self->width);
+    if (!ans) fatal("Out of memory allocating limits");
+    return ans;
+}
+
+static void
+triangle_(Canvas *self, bool left) {
+    int ay1 = 0, by1 = self->height - 1, y2 = self->height / 2, x1, x2;
+    if (left) { x1 = 0; x2 = self->width - 1; } else { x1 = self->width - 1; x2 = 0; }
+    LineEquation uppery = line_equation(x1, ay1, x2, y2), lowery = line_equation(x1, by1, x2, y2);
+    Limit *xlimits = alloc_limits(self);
+    for (int x = 0; x < self->width; x++) xlimits[x] = (Limit){line_y(uppery, x), line_y(lowery, x)};
+    fill_region(self, xlimits, self->width, false);
+    free(xlimits);
+}
+
+static void
+triangle(Canvas *self, bool left) { supersampled(triangle_, left); }
+
+static void
+corner_triangle_(Canvas *self, Corner corner) {
+    Limit *xlimits = alloc_limits(self);
+    const int w = self->width, h = self->height;
+    LineEquation diagonal = (corner == TOP_RIGHT || corner == BOTTOM_LEFT) ? line_equation(0, 0, w - 1, h - 1) : line_equation(w - 1, 0, 0, h - 1);
+    const bool upper = corner == TOP_RIGHT || corner == TOP_LEFT;
+    for (int x = 0; x < w; x++) xlimits[x] = upper ? (Limit){0, line_y(diagonal, x)} : (Limit){line_y(diagonal, x), h - 1};
+    fill_region(self, xlimits, w, false);
+    free(xlimits);
+}
+
+static void
+corner_triangle(Canvas *self, Corner corner) { supersampled(corner_triangle_, corner); }
+
+static void
+half_triangle_(Canvas *self, Side which, bool inverted) {
+    Limit *xlimits = alloc_limits(self);
+    const int w = self->width, h = self->height, mid_x = w / 2, mid_y = h / 2;
+    LineEquation first, second;
+    switch (which) {
+        case LEFT:
+            first = line_equation(0, 0, mid_x, mid_y); second = line_equation(0, h - 1, mid_x, mid_y);
+            for (int x = 0; x < w; x++) xlimits[x] = (Limit){line_y(first, x), line_y(second, x)};
+            break;
+        case TOP:
+            first = line_equation(0, 0, mid_x, mid_y); second = line_equation(mid_x, mid_y, w - 1, 0);
+            for (int x = 0; x < w; x++) xlimits[x] = (Limit){0, line_y(x < mid_x ? first : second, x)};
+            break;
+        case RIGHT:
+            first = line_equation(mid_x, mid_y, w - 1, 0); second = line_equation(mid_x, mid_y, w - 1, h - 1);
+            for (int x = 0; x < w; x++) xlimits[x] = (Limit){line_y(first, x), line_y(second, x)};
+            break;
+        default:
+            first = line_equation(0, h - 1, mid_x, mid_y); second = line_equation(mid_x, mid_y, w - 1, h - 1);
+            for (int x = 0; x < w; x++) xlimits[x] = (Limit){line_y(x < mid_x ? first : second, x), h - 1};
+            break;
+    }
+    fill_region(self, xlimits, w, inverted);
+    free(xlimits);
+}
+
+static void
+half_triangle(Canvas *self, Side which, bool inverted) { supersampled(half_triangle_, which, inverted); }
+
+static void
+thick_line(Canvas *self, int thickness_in_pixels, Point p1, Point p2) {
+    if (p1.x > p2.x) { Point t = p1; p1 = p2; p2 = t; }
+    LineEquation leq = line_equation(p1.x, p1.y, p2.x, p2.y);
+    const int delta = thickness_in_pixels / 2, extra = thickness_in_pixels % 2;
+    for (int x = MAX(0, p1.x); x < MIN(self->width, p2.x + 1); x++) {
+        int y_p = (int)line_y(leq, x);
+        for (int y = MAX(0, y_p - delta); y < MIN(self->height, y_p + delta + extra); y++) self->mask[x + y * self->width] = 255;
+    }
+}
+
+static void
+cross_line_(Canvas *self, bool left, unsigned level) {
+    const int w = self->width, h = self->height;
+    Point p1 = {0, 0}, p2 = {w - 1, h - 1};
+    if (!left) { p1 = (Point){w - 1, 0}; p2 = (Point){0, h - 1}; }
+    thick_line(self, self->supersample_factor * thickness(self, level), p1, p2);
+}
+
+static void
+cross_line(Canvas *self, bool left, unsigned level) { supersampled(cross_line_, left, level); }
+
+static void
+cross_shade_(Canvas *self, bool rotate, int num_of_lines) {
+    const int w = self->width, h = self->height;
+    const int line_thickness = MAX(self->supersample_factor, w / num_of_lines), delta = 2 * line_thickness;
+    const int y1 = rotate ? h : 0, y2 = rotate ? 0 : h;
+    for (int x = 0; x < w; x += delta) {
+        thick_line(self, line_thickness, (Point){x, y1}, (Point){w + x, y2});
+        thick_line(self, line_thickness, (Point){-x, y1}, (Point){w - x, y2});
+    }
+}
+
+static void
+cross_shade(Canvas *self, bool rotate) { supersampled(cross_shade_, rotate, 7); }
+
+static void
+half_cross_line_(Canvas *self, Corner which, unsigned level) {
+    const int w = self->width, h = self->height, my = (h - 1) / 2;
+    Point p1, p2;
+    switch (which) {
+        case TOP_LEFT: p1 = (Point){0, 0}; p2 = (Point){w - 1, my}; break;
+        case BOTTOM_LEFT: p2 = (Point){0, h - 1}; p1 = (Point){w - 1, my}; break;
+        case TOP_RIGHT: p1 = (Point){w - 1, 0}; p2 = (Point){0, my}; break;
+        default: p2 = (Point){w - 1, h - 1}; p1 = (Point){0, my}; break;
+    }
+    thick_line(self, thickness(self, level) * self->supersample_factor, p1, p2);
+}
+
+static void
+half_cross_line(Canvas *self, Corner which, unsigned level) { supersampled(half_cross_line_, which, level); }
+
+static Point
+mid_point(const Canvas *self, char which) {
+    switch (which) {
+        case 'l': return (Point){0, self->height / 2};
+        case 't': return (Point){self->width / 2, 0};
+        case 'r': return (Point){self->width - 1, self->height / 2};
+        default: return (Point){self->width / 2, self->height - 1};
+    }
+}
+
+static void
+mid_lines_(Canvas *self, unsigned level, const char *pts) {
+    // pts is a space separated list of pairs of l, t, r, b naming the
+    // midpoints of the cell edges to join
+    for (const char *p = pts; p[0] && p[1]; p += p[2] ? 3 : 2) {
+        thick_line(self, self->supersample_factor * thickness(self, level), mid_point(self, p[0]), mid_point(self, p[1]));
+    }
+}
+
+static void
+mid_lines(Canvas *self, unsigned level, const char *pts) { supersampled(mid_lines_, level, pts); }
+
+typedef struct CubicBezier { Point start, c1, c2, end; } CubicBezier;
+
+static double
+bezier_eq(int p0, int p1, int p2, int p3, double t) {
+    const double tm1 = 1 - t, tm1_3 = tm1 * tm1 * tm1, t_3 = t * t * t;
+    return tm1_3 * p0 + 3 * t * tm1 * (tm1 * p1 + t * p2) + t_3 * p3;
+}
+
+static double
+bezier_x(const CubicBezier *b, double t) { return bezier_eq(b->start.x, b->c1.x, b->c2.x, b->end.x, t); }
+
+static double
+bezier_y(const CubicBezier *b, double t) { return bezier_eq(b->start.y, b->c1.y, b->c2.y, b->end.y, t); }
+
+static int
+find_bezier_for_D(int width, int height) {
+    int cx = width - 1, last_cx = cx;
+    while (true) {
+        CubicBezier b = {.start = {0, 0}, .end = {0, height - 1}, .c1 = {cx, 0}, .c2 = {cx, height - 1}};
+        if (bezier_x(&b, 0.5) > width - 1) return last_cx;
+        last_cx = cx++;
+    }
+}
+
+static double
+find_t_for_x(const CubicBezier *b, int x, double start_t) {
+    static const double t_limit = 0.5;
+    if (fabs(bezier_x(b, start_t) - x) < 0.1) return start_t;
+    double increment = t_limit - start_t;
+    if (increment <= 0) return start_t;
+    while (true) {
+        double q = bezier_x(b, start_t + increment);
+        if (fabs(q - x) < 0.1) return start_t + increment;
+        if (q > x) {
+            increment /= 2;
+            if (increment < 1e-6) {
+                log_error("Failed to find cubic bezier t for x=%d", x);
+                return start_t;
+            }
+        } else {
+            start_t += increment;
+            increment = t_limit - start_t;
+            if (increment <= 0) return start_t;
+        }
+    }
+}
+
+static int
+get_bezier_limits(const Canvas *self, const CubicBezier *b, Limit *xlimits) {
+    const int start_x = (int)bezier_x(b, 0), max_x = (int)bezier_x(b, 0.5);
+    double last_t = 0.;
+    int count = 0;
+    for (int x = start_x; x <= max_x && count < self->width; x++) {
+        if (x > start_x) last_t = find_t_for_x(b, x, last_t);
+        double upper = bezier_y(b, last_t), lower = bezier_y(b, 1 - last_t);
+        if (fabs(upper - lower) <= 2) break;  // avoid pip on end of D
+        xlimits[count++] = (Limit){upper, lower};
+    }
+    return count;
+}
+
+static void
+D_(Canvas *self, bool left) {
+    const int c1x = find_bezier_for_D(self->width, self->height);
+    CubicBezier b = {.start = {0, 0}, .end = {0, self->height - 1}, .c1 = {c1x, 0}, .c2 = {c1x, self->height - 1}};
+    Limit *xlimits = alloc_limits(self);
+    int count = get_bezier_limits(self, &b, xlimits);
+    if (left) fill_region(self, xlimits, count, false);
+    else {
+        Canvas m = *self;
+        m.mask = calloc((size_t)self->width * self->height, 1);
+        if (!m.mask) fatal("Out of memory");
+        fill_region(&m, xlimits, count, false);
+        mirror_horizontally(self, &m);
+        free(m.mask);
+    }
+    free(xlimits);
+}
+
+static void
+D(Canvas *self, bool left) { supersampled(D_, left); }
+
+typedef enum CurveType { BEZIER_CURVE, RECTIRCLE_CURVE } CurveType;
+
+typedef struct Rectircle {
+    double a, b, yexp, xexp, cell_width, adjust_x;
+    bool left_quadrants, lower_quadrants;
+} Rectircle;
+
+typedef struct ParametrizedCurve {
+    CurveType type;
+    union { CubicBezier bezier; Rectircle rectircle; };
+} ParametrizedCurve;
+
+static Rectircle
+rectircle_equations(int cell_width, int cell_height, int supersample_factor, Corner which) {
+    /*
+    Define two functions, x(t) and y(t) that map the parameter t which must be
+    in the range [0, 1] to x and y coordinates in the cell. The rectircle equation
+    we use is:
+
+    (|x| / a) ^ (2a / r) + (|y| / a) ^ (2b / r) = 1
+
+    where 2a = width, 2b = height and r is radius
+
+    The entire rectircle fits in four cells, each cell being one quadrant
+    of the full rectircle and the origin being the center of the rectircle.
+    The functions do the mapping for the specified cell.
+    ╭╮
+    ╰╯
+    See https://math.stackexchange.com/questions/1649714
+    */
+    const double radius = cell_width / 2.;
+    const int cell_width_is_odd = (cell_width / supersample_factor) % 2;
+    return (Rectircle){
+        .a = ((cell_width / supersample_factor) / 2) * supersample_factor,
+        .b = ((cell_height / supersample_factor) / 2) * supersample_factor,
+        .yexp = cell_height / radius, .xexp = radius / cell_width,
+        .cell_width = cell_width, .adjust_x = cell_width_is_odd * supersample_factor,
+        .left_quadrants = which == TOP_LEFT || which == BOTTOM_LEFT,
+        .lower_quadrants = which == BOTTOM_LEFT || which == BOTTOM_RIGHT,
+    };
+}
+
+static double
+rectircle_x(const Rectircle *r, double t) {
+    // To get x(t) we first need |y(t)|/b. This is just t since as t goes
+    // from 0 to 1 y goes from either 0 to b or 0 to -b
+    const double xterm = 1 - pow(t, r->yexp);
+    if (r->left_quadrants) return floor(r->cell_width - fabs(r->a * pow(xterm, r->xexp)) - r->adjust_x);
+    return ceil(fabs(r->a * pow(xterm, r->xexp)));
+}
+
+static double
+rectircle_y(const Rectircle *r, double t) {
+    // 0 -> top of cell, 1 -> middle of cell for the lower quadrants
+    // 0 -> bottom of cell, 1 -> middle of cell for the upper quadrants
+    return r->lower_quadrants ? t * r->b : (2 - t) * r->b;
+}
+
+static void
+draw_parametrized_curve(Canvas *self, unsigned level, const ParametrizedCurve *curve) {
+    const int num_samples = self->height * BEZIER_SAMPLES_PER_ROW;
+    const int t = thickness(self, level);
+    const int delta = (t / 2) * self->supersample_factor, extra = (t % 2) * self->supersample_factor;
+    Point prev = {INT_MIN, INT_MIN};
+    for (int i = 0; i <= num_samples; i++) {
+        const double p = (double)i / num_samples;
+        Point pt;
+        if (curve->type == BEZIER_CURVE) pt = (Point){(int)bezier_x(&curve->bezier, p), (int)bezier_y(&curve->bezier, p)};
+        else pt = (Point){(int)rectircle_x(&curve->rectircle, p), (int)rectircle_y(&curve->rectircle, p)};
+        if (pt.x == prev.x && pt.y == prev.y) continue;
+        prev = pt;
+        fill_rect(self, pt.x - delta, pt.x + delta + extra, pt.y - delta, pt.y + delta + extra, 255);
+    }
+}
+
+static void
+rounded_corner_(Canvas *self, unsigned level, Corner which) {
+    ParametrizedCurve c = {.type = RECTIRCLE_CURVE, .rectircle = rectircle_equations(self->width, self->height, self->supersample_factor, which)};
+    draw_parametrized_curve(self, level, &c);
+}
+
+static void
+rounded_corner(Canvas *self, unsigned level, Corner which) { supersampled(rounded_corner_, level, which); }
+
+static void
+rounded_separator_(Canvas *self, unsigned level, bool left) {
+    const int gap = thickness(self, level) * self->supersample_factor;
+    const int c1x = find_bezier_for_D(self->width - gap, self->height);
+    ParametrizedCurve c = {.type = BEZIER_CURVE, .bezier = {.start = {0, 0}, .end = {0, self->height - 1}, .c1 = {c1x, 0}, .c2 = {c1x, self->height - 1}}};
+    if (left) draw_parametrized_curve(self, level, &c);
+    else {
+        Canvas m = *self;
+        m.mask = calloc((size_t)self->width * self->height, 1);
+        if (!m.mask) fatal("Out of memory");
+        draw_parametrized_curve(&m, level, &c);
+        mirror_horizontally(self, &m);
+        free(m.mask);
+    }
+}
+
+static void
+rounded_separator(Canvas *self, unsigned level, bool left) { supersampled(rounded_separator_, level, left); }
+
+static void
+smooth_mosaic_(Canvas *self, bool lower, double ax, double ay, double bx, double by) {
+    const int w = self->width, h = self->height;
+    LineEquation line = line_equation((int)(ax * (w - 1)), (int)(ay * (h - 1)), (int)(bx * (w - 1)), (int)(by * (h - 1)));
+    for (int y = 0; y < h; y++) {
+        uint8_t *row = self->mask + y * w;
+        for (int x = 0; x < w; x++) {
+            const double edge = line_y(line, x);
+            if (lower ? y >= edge : y <= edge) row[x] = 255;
+        }
+    }
+}
+
+static void
+smooth_mosaic(Canvas *self, bool lower, double ax, double ay, double bx, double by) { supersampled(smooth_mosaic_, lower, ax, ay, bx, by); }
+
+// }}}
+
+// Blocks and shades {{{
+
+static void
+shade(Canvas *self, bool light, bool invert, Side which_half, bool fill_blank, int xnum, int ynum) {
+    const int w = self->width, h = self->height;
+    const int square_width = MAX(1, w / xnum);
+    const int square_height = MAX(1, ynum ? h / ynum : square_width);
+    const int number_of_rows = h / square_height, number_of_cols = w / square_width;
+    int row_start = 0, row_end = number_of_rows, col_start = 0, col_end = number_of_cols;
+    switch (which_half) {
+        case TOP: row_end = number_of_rows / 2; break;
+        case BOTTOM: row_start = number_of_rows / 2; break;
+        case LEFT: col_end = number_of_cols / 2; break;
+        case RIGHT: col_start = number_of_cols / 2; break;
+        default: break;
+    }
+    for (int r = row_start; r < row_end; r++) {
+        for (int c = col_start; c < col_end; c++) {
+            if (invert ^ ((r % 2 != c % 2) || (light && r % 2 == 1))) continue;
+            fill_rect(self, c * square_width, (c + 1) * square_width, r * square_height, (r + 1) * square_height, 255);
+        }
+    }
+    if (!fill_blank) return;
+    switch (which_half) {
+        case BOTTOM: fill_rect(self, 0, w, 0, h / 2, 255); break;
+        case TOP: fill_rect(self, 0, w, h / 2 - 1, h, 255); break;
+        case RIGHT: fill_rect(self, 0, w / 2, 0, h, 255); break;
+        case LEFT: fill_rect(self, w / 2 - 1, w, 0, h, 255); break;
+        default: break;
+    }
+}
+
+static void
+plain_shade(Canvas *self) { shade(self, false, false, BOTH_SIDES, false, 12, 0); }
+
+static void
+mask_with_corner_triangle(Canvas *self, Corner corner) {
+    Canvas m = *self;
+    m.mask = calloc((size_t)self->width * self->height, 1);
+    if (!m.mask) fatal("Out of memory");
+    corner_triangle(&m, corner);
+    for (int p = 0; p < self->width * self->height; p++) {
+        self->mask[p] = (uint8_t)(255.0 * (self->mask[p] / 255.0 * m.mask[p] / 255.0));
+    }
+    free(m.mask);
+}
+
+static void
+quad(Canvas *self, int x, int y) {
+    const int num_cols = self->width / 2, num_rows = self->height / 2;
+    fill_rect(self, x * num_cols, x ? self->width : num_cols, y * num_rows, y ? self->height : num_rows, 255);
+}
+
+static void
+sextant(Canvas *self, unsigned which) {
+    const int w = self->width, h = self->height;
+    const int row_limits[4] = {0, h / 3, 2 * h / 3, h}, col_limits[3] = {0, w / 2, w};
+    const unsigned row_bits[3] = {which % 4, which / 4, which / 16};
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 2; c++) {
+            if (row_bits[r] & (1u << c)) fill_rect(self, col_limits[c], col_limits[c + 1], row_limits[r], row_limits[r + 1], 255);
+        }
+    }
+}
+
+static void
+eight_range(int size, unsigned which, int *start, int *end) {
+    const int thickness = MAX(1, size / 8), block = thickness * 8;
+    if (block == size) { *start = thickness * which; *end = *start + thickness; return; }
+    if (block > size) { *start = MIN((int)which * thickness, size - thickness); *end = *start + thickness; return; }
+    int extra = size - block, thicknesses[8];
+    for (int i = 0; i < 8; i++) thicknesses[i] = thickness;
+    // ensures the thickness of first and last are least likely to be changed
+    static const unsigned order[8] = {3, 4, 2, 5, 6, 1, 7, 0};
+    for (int i = 0; i < 8 && extra; i++, extra--) thicknesses[order[i]]++;
+    int pos = 0;
+    for (unsigned i = 0; i < which; i++) pos += thicknesses[i];
+    *start = pos; *end = pos + thicknesses[which];
+}
+
+static void
+eight_bar(Canvas *self, unsigned which, bool horizontal) {
+    int start, end;
+    if (horizontal) {
+        eight_range(self->height, which, &start, &end);
+        fill_rect(self, 0, self->width, start, end, 255);
+    } else {
+        eight_range(self->width, which, &start, &end);
+        fill_rect(self, start, end, 0, self->height, 255);
+    }
+}
+
+static void
+eight_block(Canvas *self, bool horizontal, unsigned first, unsigned last) {
+    for (unsigned which = first; which <= last; which++) eight_bar(self, which, horizontal);
+}
+
+unsigned
+distribute_dots(unsigned available_space, unsigned num_of_dots, unsigned *summed_gaps) {
+    if (!num_of_dots) return 0;
+    const unsigned dot_size = MAX(1u, available_space / (2 * num_of_dots));
+    int extra = (int)available_space - (int)(2 * num_of_dots * dot_size);
+    for (unsigned i = 0; i < num_of_dots; i++) summed_gaps[i] = dot_size;
+    for (unsigned idx = 0; extra > 0; idx = (idx + 1) % num_of_dots, extra--) summed_gaps[idx]++;
+    summed_gaps[0] /= 2;
+    for (unsigned i = 1; i < num_of_dots; i++) summed_gaps[i] += summed_gaps[i - 1];
+    return dot_size;
+}
+
+static void
+braille_dot(Canvas *self, unsigned col, unsigned row) {
+    unsigned x_gaps[2], y_gaps[4];
+    const unsigned dot_width = distribute_dots(self->width, 2, x_gaps), dot_height = distribute_dots(self->height, 4, y_gaps);
+    const int x_start = x_gaps[col] + col * dot_width, y_start = y_gaps[row] + row * dot_height;
+    if (y_start < self->height && x_start < self->width) fill_rect(self, x_start, x_start + dot_width, y_start, y_start + dot_height, 255);
+}
+
+static void
+braille(Canvas *self, unsigned which) {
+    // bit i is dot number i + 1 in the standard braille numbering
+    static const unsigned cols[8] = {0, 0, 0, 1, 1, 1, 0, 1}, rows[8] = {0, 1, 2, 0, 1, 2, 3, 3};
+    for (unsigned i = 0; i < 8; i++) {
+        if (which & (1u << i)) braille_dot(self, cols[i], rows[i]);
+    }
+}
+
+// }}}
+
+enum { THIN = 1, THICK = 3 };  // line levels, see box_drawing_scale
+
+bool
+render_box_char(char_type ch, uint8_t *buf, unsigned width, unsigned height, double dpi) {
+    Canvas canvas = {.mask = buf, .width = width, .height = height, .supersample_factor = 1, .dpi = dpi}, *c = &canvas;
+#define CC(which, ...) case which: { __VA_ARGS__; } break;
+#define SM(which, lower, ax, ay, bx, by) CC(which, smooth_mosaic(c, lower, ax, ay, bx, by))
+    static const unsigned corner_levels[4][2] = {{1, 1}, {3, 1}, {1, 3}, {3, 3}};
+    static const unsigned vert_t_levels[8][3] = {{1, 1, 1}, {1, 3, 1}, {3, 1, 1}, {1, 1, 3}, {3, 1, 3}, {3, 3, 1}, {1, 3, 3}, {3, 3, 3}};
+    static const unsigned horz_t_levels[8][3] = {{1, 1, 1}, {3, 1, 1}, {1, 3, 1}, {3, 3, 1}, {1, 1, 3}, {3, 1, 3}, {1, 3, 3}, {3, 3, 3}};
+    static const unsigned cross_levels[16][4] = {
+        {1, 1, 1, 1}, {3, 1, 1, 1}, {1, 3, 1, 1}, {3, 3, 1, 1}, {1, 1, 3, 1}, {1, 1, 1, 3}, {1, 1, 3, 3},
+        {3, 1, 3, 1}, {1, 3, 3, 1}, {3, 1, 1, 3}, {1, 3, 1, 3}, {3, 3, 3, 1}, {3, 3, 1, 3}, {3, 1, 3, 3},
+        {1, 3, 3, 3}, {3, 3, 3, 3}
+    };
+    static const Corner corners[4] = {TOP_LEFT, TOP_RIGHT, BOTTOM_LEFT, BOTTOM_RIGHT};
+START_ALLOW_CASE_RANGE
+    switch (ch) {
+        CC(0x2500, hline(c, THIN))
+        CC(0x2501, hline(c, THICK))
+        CC(0x2502, vline(c, THIN))
+        CC(0x2503, vline(c, THICK))
+        CC(0x2504, hholes(c, THIN, 2))
+        CC(0x2505, hholes(c, THICK, 2))
+        CC(0x2506, vholes(c, THIN, 2))
+        CC(0x2507, vholes(c, THICK, 2))
+        CC(0x2508, hholes(c, THIN, 3))
+        CC(0x2509, hholes(c, THICK, 3))
+        CC(0x250a, vholes(c, THIN, 3))
+        CC(0x250b, vholes(c, THICK, 3))
+        // ┌ ┐ └ ┘ and their heavy variants
+        CC(0x250c ... 0x251b, corner(c, corner_levels[(ch - 0x250c) % 4][0], corner_levels[(ch - 0x250c) % 4][1], corners[(ch - 0x250c) / 4]))
+        // ├ ┤
+        CC(0x251c ... 0x252b, const unsigned *l = vert_t_levels[(ch - 0x251c) % 8]; vert_t(c, l[0], l[1], l[2], ch < 0x2524 ? RIGHT : LEFT))
+        // ┬ ┴
+        CC(0x252c ... 0x253b, const unsigned *l = horz_t_levels[(ch - 0x252c) % 8]; horz_t(c, l[0], l[1], l[2], ch < 0x2534 ? BOTTOM : TOP))
+        // ┼
+        CC(0x253c ... 0x254b, const unsigned *l = cross_levels[ch - 0x253c]; cross(c, l[0], l[1], l[2], l[3]))
+        CC(0x254c, hholes(c, THIN, 1))
+        CC(0x254d, hholes(c, THICK, 1))
+        CC(0x254e, vholes(c, THIN, 1))
+        CC(0x254f, vholes(c, THICK, 1))
+        CC(0x2550, dhline(c, BOTH_SIDES, 1, NULL))
+        CC(0x2551, dvline(c, BOTH_SIDES, 1, NULL))
+        // ╒ ╕ ╘ ╛
+        CC(0x2552, dvcorner(c, 1, TOP_LEFT))
+        CC(0x2555, dvcorner(c, 1, TOP_RIGHT))
+        CC(0x2558, dvcorner(c, 1, BOTTOM_LEFT))
+        CC(0x255b, dvcorner(c, 1, BOTTOM_RIGHT))
+        // ╓ ╖ ╙ ╜
+        CC(0x2553, dhcorner(c, 1, TOP_LEFT))
+        CC(0x2556, dhcorner(c, 1, TOP_RIGHT))
+        CC(0x2559, dhcorner(c, 1, BOTTOM_LEFT))
+        CC(0x255c, dhcorner(c, 1, BOTTOM_RIGHT))
+        // ╔ ╗ ╚ ╝
+        CC(0x2554, dcorner(c, 1, TOP_LEFT))
+        CC(0x2557, dcorner(c, 1, TOP_RIGHT))
+        CC(0x255a, dcorner(c, 1, BOTTOM_LEFT))
+        CC(0x255d, dcorner(c, 1, BOTTOM_RIGHT))
+        // ╟ ╢ ╤ ╧
+        CC(0x255f, dpip(c, 1, RIGHT))
+        CC(0x2562, dpip(c, 1, LEFT))
+        CC(0x2564, dpip(c, 1, BOTTOM))
+        CC(0x2567, dpip(c, 1, TOP))
+        CC(0x255e, vline(c, THIN); half_dhline(c, 1, RIGHT, BOTH_SIDES, NULL))
+        CC(0x2561, vline(c, THIN); half_dhline(c, 1, LEFT, BOTH_SIDES, NULL))
+        CC(0x2565, hline(c, THIN); half_dvline(c, 1, BOTTOM, BOTH_SIDES, NULL))
+        CC(0x2568, hline(c, THIN); half_dvline(c, 1, TOP, BOTH_SIDES, NULL))
+        CC(0x256a, vline(c, THIN); half_dhline(c, 1, LEFT, BOTH_SIDES, NULL); half_dhline(c, 1, RIGHT, BOTH_SIDES, NULL))
+        CC(0x256b, hline(c, THIN); half_dvline(c, 1, TOP, BOTH_SIDES, NULL); half_dvline(c, 1, BOTTOM, BOTH_SIDES, NULL))
+        CC(0x256c, for (unsigned i = 0; i < 4; i++) inner_corner(c, 1, corners[i]))
+        CC(0x2560, inner_corner(c, 1, TOP_RIGHT); inner_corner(c, 1, BOTTOM_RIGHT); dvline(c, LEFT, 1, NULL))
+        CC(0x2563, inner_corner(c, 1, TOP_LEFT); inner_corner(c, 1, BOTTOM_LEFT); dvline(c, RIGHT, 1, NULL))
+        CC(0x2566, inner_corner(c, 1, BOTTOM_LEFT); inner_corner(c, 1, BOTTOM_RIGHT); dhline(c, TOP, 1, NULL))
+        CC(0x2569, inner_corner(c, 1, TOP_LEFT); inner_corner(c, 1, TOP_RIGHT); dhline(c, BOTTOM, 1, NULL))
+        // ╭ ╮ ╯ ╰
+        CC(0x256d, rounded_corner(c, 1, TOP_LEFT))
+        CC(0x256e, rounded_corner(c, 1, TOP_RIGHT))
+        CC(0x256f, rounded_corner(c, 1, BOTTOM_RIGHT))
+        CC(0x2570, rounded_corner(c, 1, BOTTOM_LEFT))
+        CC(0x2571, cross_line(c, false, 1))
+        CC(0x2572, cross_line(c, true, 1))
+        CC(0x2573, cross_line(c, true, 1); cross_line(c, false, 1))
+        CC(0x2574, half_hline(c, THIN, LEFT, 0))
+        CC(0x2575, half_vline(c, THIN, TOP, 0))
+        CC(0x2576, half_hline(c, THIN, RIGHT, 0))
+        CC(0x2577, half_vline(c, THIN, BOTTOM, 0))
+        CC(0x2578, half_hline(c, THICK, LEFT, 0))
+        CC(0x2579, half_vline(c, THICK, TOP, 0))
+        CC(0x257a, half_hline(c, THICK, RIGHT, 0))
+        CC(0x257b, half_vline(c, THICK, BOTTOM, 0))
+        CC(0x257c, half_hline(c, THIN, LEFT, 0); half_hline(c, THICK, RIGHT, 0))
+        CC(0x257d, half_vline(c, THIN, TOP, 0); half_vline(c, THICK, BOTTOM, 0))
+        CC(0x257e, half_hline(c, THICK, LEFT, 0); half_hline(c, THIN, RIGHT, 0))
+        CC(0x257f, half_vline(c, THICK, TOP, 0); half_vline(c, THIN, BOTTOM, 0))
+        // ▀ ▁ ▂ ▃ ▄ ▅ ▆ ▇ █
+        CC(0x2580, eight_block(c, true, 0, 3))
+        CC(0x2581 ... 0x2588, eight_block(c, true, 0x2588 - ch, 7))
+        // ▉ ▊ ▋ ▌ ▍ ▎ ▏
+        CC(0x2589 ... 0x258f, eight_block(c, false, 0, 0x258f - ch))
+        CC(0x2590, eight_block(c, false, 4, 7))
+        CC(0x2591, shade(c, true, false, BOTH_SIDES, false, 12, 0))
+        CC(0x2592, plain_shade(c))
+        CC(0x2593, shade(c, true, true, BOTH_SIDES, false, 12, 0))
+        CC(0x2594, eight_bar(c, 0, true))
+        CC(0x2595, eight_bar(c, 7, false))
+        CC(0x2596, quad(c, 0, 1))
+        CC(0x2597, quad(c, 1, 1))
+        CC(0x2598, quad(c, 0, 0))
+        CC(0x2599, quad(c, 0, 0); quad(c, 0, 1); quad(c, 1, 1))
+        CC(0x259a, quad(c, 0, 0); quad(c, 1, 1))
+        CC(0x259b, quad(c, 0, 0); quad(c, 1, 0); quad(c, 0, 1))
+        CC(0x259c, quad(c, 0, 0); quad(c, 1, 1); quad(c, 1, 0))
+        CC(0x259d, quad(c, 1, 0))
+        CC(0x259e, quad(c, 1, 0); quad(c, 0, 1))
+        CC(0x259f, quad(c, 1, 0); quad(c, 0, 1); quad(c, 1, 1))
+        // Powerline symbols
+        CC(0xe0b0, triangle(c, true))
+        CC(0xe0b1, half_cross_line(c, TOP_LEFT, 1); half_cross_line(c, BOTTOM_LEFT, 1))
+        CC(0xe0b2, triangle(c, false))
+        CC(0xe0b3, half_cross_line(c, TOP_RIGHT, 1); half_cross_line(c, BOTTOM_RIGHT, 1))
+        CC(0xe0b4, D(c, true))
+        CC(0xe0b5, rounded_separator(c, 1, true))
+        CC(0xe0b6, D(c, false))
+        CC(0xe0b7, rounded_separator(c, 1, false))
+        CC(0xe0b8, corner_triangle(c, BOTTOM_LEFT))
+        CC(0xe0b9, cross_line(c, true, 1))
+        CC(0xe0ba, corner_triangle(c, BOTTOM_RIGHT))
+        CC(0xe0bb, cross_line(c, false, 1))
+        CC(0xe0bc, corner_triangle(c, TOP_LEFT))
+        CC(0xe0bd, cross_line(c, false, 1))
+        CC(0xe0be, corner_triangle(c, TOP_RIGHT))
+        CC(0xe0bf, cross_line(c, true, 1))
+        // Braille
+        CC(0x2800 ... 0x28ff, braille(c, ch - 0x2800))
+        // Sextants, skipping the two that are the left and right half blocks
+        CC(0x1fb00 ... 0x1fb3b, unsigned which = ch - 0x1fb00 + 1; if (which >= 21) which++; if (which >= 42) which++; sextant(c, which))
+        // Smooth mosaics
+        SM(0x1fb3c, true, 0, 0.75, 0.5, 1)
+        SM(0x1fb3d, true, 0, 0.75, 1, 1)
+        SM(0x1fb3e, true, 0, 0.25, 0.5, 1)
+        SM(0x1fb3f, true, 0, 0.25, 1, 1)
+        SM(0x1fb40, true, 0, 0, 0.5, 1)
+        SM(0x1fb41, true, 0, 0.25, 0.5, 0)
+        SM(0x1fb42, true, 0, 0.25, 1, 0)
+        SM(0x1fb43, true, 0, 0.75, 0.5, 0)
+        SM(0x1fb44, true, 0, 0.75, 1, 0)
+        SM(0x1fb45, true, 0, 1, 0.5, 0)
+        SM(0x1fb46, true, 0, 0.75, 1, 0.25)
+        SM(0x1fb47, true, 0.5, 1, 1, 0.75)
+        SM(0x1fb48, true, 0, 1, 1, 0.75)
+        SM(0x1fb49, true, 0.5, 1, 1, 0.25)
+        SM(0x1fb4a, true, 0, 1, 1, 0.25)
+        SM(0x1fb4b, true, 0.5, 1, 1, 0)
+        SM(0x1fb4c, true, 0.5, 0, 1, 0.25)
+        SM(0x1fb4d, true, 0, 0, 1, 0.25)
+        SM(0x1fb4e, true, 0.5, 0, 1, 0.75)
+        SM(0x1fb4f, true, 0, 0, 1, 0.75)
+        SM(0x1fb50, true, 0.5, 0, 1, 1)
+        SM(0x1fb51, true, 0, 0.25, 1, 0.75)
+        SM(0x1fb52, false, 0, 0.75, 0.5, 1)
+        SM(0x1fb53, false, 0, 0.75, 1, 1)
+        SM(0x1fb54, false, 0, 0.25, 0.5, 1)
+        SM(0x1fb55, false, 0, 0.25, 1, 1)
+        SM(0x1fb56, false, 0, 0, 0.5, 1)
+        SM(0x1fb57, false, 0, 0.25, 0.5, 0)
+        SM(0x1fb58, false, 0, 0.25, 1, 0)
+        SM(0x1fb59, false, 0, 0.75, 0.5, 0)
+        SM(0x1fb5a, false, 0, 0.75, 1, 0)
+        SM(0x1fb5b, false, 0, 1, 0.5, 0)
+        SM(0x1fb5c, false, 0, 0.75, 1, 0.25)
+        SM(0x1fb5d, false, 0.5, 1, 1, 0.75)
+        SM(0x1fb5e, false, 0, 1, 1, 0.75)
+        SM(0x1fb5f, false, 0.5, 1, 1, 0.25)
+        SM(0x1fb60, false, 0, 1, 1, 0.25)
+        SM(0x1fb61, false, 0.5, 1, 1, 0)
+        SM(0x1fb62, false, 0.5, 0, 1, 0.25)
+        SM(0x1fb63, false, 0, 0, 1, 0.25)
+        SM(0x1fb64, false, 0.5, 0, 1, 0.75)
+        SM(0x1fb65, false, 0, 0, 1, 0.75)
+        SM(0x1fb66, false, 0.5, 0, 1, 1)
+        SM(0x1fb67, false, 0, 0.25, 1, 0.75)
+        CC(0x1fb68, half_triangle(c, LEFT, true))
+        CC(0x1fb69, half_triangle(c, TOP, true))
+        CC(0x1fb6a, half_triangle(c, RIGHT, true))
+        CC(0x1fb6b, half_triangle(c, BOTTOM, true))
+        CC(0x1fb6c, half_triangle(c, LEFT, false))
+        CC(0x1fb6d, half_triangle(c, TOP, false))
+        CC(0x1fb6e, half_triangle(c, RIGHT, false))
+        CC(0x1fb6f, half_triangle(c, BOTTOM, false))
+        CC(0x1fb70 ... 0x1fb75, eight_bar(c, ch - 0x1fb6f, false))
+        CC(0x1fb76 ... 0x1fb7b, eight_bar(c, ch - 0x1fb75, true))
+        CC(0x1fb7c, eight_bar(c, 0, false); eight_bar(c, 7, true))
+        CC(0x1fb7d, eight_bar(c, 0, false); eight_bar(c, 0, true))
+        CC(0x1fb7e, eight_bar(c, 7, false); eight_bar(c, 0, true))
+        CC(0x1fb7f, eight_bar(c, 7, false); eight_bar(c, 7, true))
+        CC(0x1fb80, eight_bar(c, 0, true); eight_bar(c, 7, true))
+        CC(0x1fb81, eight_bar(c, 0, true); eight_bar(c, 2, true); eight_bar(c, 4, true); eight_bar(c, 7, true))
+        CC(0x1fb82, eight_block(c, true, 0, 1))
+        CC(0x1fb83, eight_block(c, true, 0, 2))
+        CC(0x1fb84 ... 0x1fb86, eight_block(c, true, 0, ch - 0x1fb84 + 4))
+        CC(0x1fb87, eight_block(c, false, 6, 7))
+        CC(0x1fb88, eight_block(c, false, 5, 7))
+        CC(0x1fb89 ... 0x1fb8b, eight_block(c, false, 0x1fb8c - ch, 7))
+        CC(0x1fb8c, shade(c, false, false, LEFT, false, 12, 0))
+        CC(0x1fb8d, shade(c, false, false, RIGHT, false, 12, 0))
+        CC(0x1fb8e, shade(c, false, false, TOP, false, 12, 0))
+        CC(0x1fb8f, shade(c, false, false, BOTTOM, false, 12, 0))
+        CC(0x1fb90, shade(c, false, true, BOTH_SIDES, false, 12, 0))
+        CC(0x1fb91, shade(c, false, true, BOTTOM, true, 12, 0))
+        CC(0x1fb92, shade(c, false, true, TOP, true, 12, 0))
+        CC(0x1fb93, shade(c, false, true, RIGHT, true, 12, 0))
+        CC(0x1fb94, shade(c, false, true, LEFT, true, 12, 0))
+        CC(0x1fb95, shade(c, false, false, BOTH_SIDES, false, 4, 4))
+        CC(0x1fb96, shade(c, false, true, BOTH_SIDES, false, 4, 4))
+        CC(0x1fb97, shade(c, false, true, BOTH_SIDES, false, 1, 4))
+        CC(0x1fb98, cross_shade(c, false))
+        CC(0x1fb99, cross_shade(c, true))
+        CC(0x1fb9a, half_triangle(c, BOTTOM, false); half_triangle(c, TOP, false))
+        CC(0x1fb9b, half_triangle(c, LEFT, false); half_triangle(c, RIGHT, false))
+        CC(0x1fb9c, plain_shade(c); mask_with_corner_triangle(c, TOP_LEFT))
+        CC(0x1fb9d, plain_shade(c); mask_with_corner_triangle(c, TOP_RIGHT))
+        CC(0x1fb9e, plain_shade(c); mask_with_corner_triangle(c, BOTTOM_RIGHT))
+        CC(0x1fb9f, plain_shade(c); mask_with_corner_triangle(c, BOTTOM_LEFT))
+        CC(0x1fba0, mid_lines(c, 1, "lt"))
+        CC(0x1fba1, mid_lines(c, 1, "tr"))
+        CC(0x1fba2, mid_lines(c, 1, "lb"))
+        CC(0x1fba3, mid_lines(c, 1, "br"))
+        CC(0x1fba4, mid_lines(c, 1, "lt lb"))
+        CC(0x1fba5, mid_lines(c, 1, "rt rb"))
+        CC(0x1fba6, mid_lines(c, 1, "rb lb"))
+        CC(0x1fba7, mid_lines(c, 1, "rt lt"))
+        CC(0x1fba8, mid_lines(c, 1, "rb lt"))
+        CC(0x1fba9, mid_lines(c, 1, "lb rt"))
+        CC(0x1fbaa, mid_lines(c, 1, "lb rt rb"))
+        CC(0x1fbab, mid_lines(c, 1, "lb lt rb"))
+        CC(0x1fbac, mid_lines(c, 1, "rt lt rb"))
+        CC(0x1fbad, mid_lines(c, 1, "rt lt lb"))
+        CC(0x1fbae, mid_lines(c, 1, "rt rb lt lb"))
+        default: return false;
+    }
+END_ALLOW_CASE_RANGE
+#undef SM
+#undef CC
+    return true;
+}
+
+void
+render_missing_glyph(uint8_t *buf, unsigned width, unsigned height, double dpi) {
+    Canvas canvas = {.mask = buf, .width = width, .height = height, .supersample_factor = 1, .dpi = dpi}, *c = &canvas;
+    const int hgap = thickness(c, 0) + 1, vgap = hgap, w = width, h = height;
+    draw_hline(c, hgap, w - hgap + 1, vgap, 0);
+    draw_hline(c, hgap, w - hgap + 1, h - vgap, 0);
+    draw_vline(c, vgap, h - vgap + 1, hgap, 0);
+    draw_vline(c, vgap, h - vgap + 1, w - hgap, 0);
+}
@@ -0,0 +1,16 @@
+/*
+ * Copyright (C) 2017 Kovid Goyal <kovid at kovidgoyal.net>
+ *
+ * Distributed under terms of the GPL3 license.
+ */
+
+#pragma once
+
+#include "data-types.h"
+
+// Renders the box drawing/block/braille/powerline character ch into buf,
+// which must be a zeroed alpha mask of width * height bytes. Returns false if
+// ch is not a character we know how to draw.
+bool render_box_char(char_type ch, uint8_t *buf, unsigned width, unsigned height, double dpi);
+void render_missing_glyph(uint8_t *buf, unsigned width, unsigned height, double dpi);
+unsigned distribute_dots(unsigned available_space, unsigned num_of_dots, unsigned *summed_gaps);
@@ -0,0 +1,360 @@
+/*
+ * canvas-kernels.c
+ *
+ * Distributed under terms of the GPL3 license.
+ */
+
+// The SIMD versions produce exactly the same output as the scalar ones, they
+// are compiled with target attributes so that no special compiler flags are
+// needed and selected at startup based on what the CPU supports.
+
+#include "canvas-kernels.h"
+#include "monotonic.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CANVAS_KERNELS_X86
+#include <immintrin.h>
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+#elif defined(__aarch64__) && defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define CANVAS_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+// Scalar {{{
+
+static void
+blend_alpha_mask_row_scalar(pixel *dest, const uint8_t *alpha, size_t count) {
+    for (size_t i = 0; i < count; i++) dest[i] = 0xffffff00 | MAX(alpha[i], (uint8_t)(dest[i] & 0xff));
+}
+
+static void
+copy_bgra_row_scalar(pixel *dest, const uint8_t *bgra, size_t count) {
+    for (size_t i = 0; i < count; i++, bgra += 4) {
+        if (bgra[3]) {
+#define C(idx, shift) ((pixel)(uint8_t)MIN(((float)bgra[idx] / (float)bgra[3]) * 255.f, 255.f) << shift)
+            dest[i] = C(2, 24) | C(1, 16) | C(0, 8) | bgra[3];
+#undef C
+        } else dest[i] = 0;
+    }
+}
+
+static void
+sum_bgra_pixels_scalar(const uint8_t *bgra, size_t count, uint32_t sums[4]) {
+    for (size_t i = 0; i < count; i++, bgra += 4) {
+        sums[0] += bgra[0]; sums[1] += bgra[1]; sums[2] += bgra[2]; sums[3] += bgra[3];
+    }
+}
+// }}}
+
+#ifdef CANVAS_KERNELS_X86
+// SSE2 {{{
+
+static SSE2 void
+blend_alpha_mask_row_sse2(pixel *dest, const uint8_t *alpha, size_t count) {
+    const __m128i zero = _mm_setzero_si128(), low_byte = _mm_set1_epi32(0xff), opaque = _mm_set1_epi32((int)0xffffff00);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        int32_t a; memcpy(&a, alpha + i, sizeof(a));
+        const __m128i s = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(a), zero), zero);
+        const __m128i d = _mm_and_si128(_mm_loadu_si128((const __m128i*)(dest + i)), low_byte);
+        _mm_storeu_si128((__m128i*)(dest + i), _mm_or_si128(_mm_max_epu8(s, d), opaque));
+    }
+    blend_alpha_mask_row_scalar(dest + i, alpha + i, count - i);
+}
+
+static SSE2 void
+copy_bgra_row_sse2(pixel *dest, const uint8_t *bgra, size_t count) {
+    const __m128i zero = _mm_setzero_si128(), low_byte = _mm_set1_epi32(0xff);
+    const __m128 scale = _mm_set1_ps(255.f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4, bgra += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)bgra);
+        const __m128i a = _mm_srli_epi32(v, 24);
+        const __m128 af = _mm_cvtepi32_ps(a);
+        // the division by zero for transparent pixels is masked out below
+#define C(shift) _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(_mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, shift), low_byte)), af), scale), scale))
+        const __m128i b = C(0), g = C(8), r = C(16);
+#undef C
+        const __m128i ans = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 24), _mm_slli_epi32(g, 16)), _mm_or_si128(_mm_slli_epi32(b, 8), a));
+        _mm_storeu_si128((__m128i*)(dest + i), _mm_andnot_si128(_mm_cmpeq_epi32(a, zero), ans));
+    }
+    copy_bgra_row_scalar(dest + i, bgra, count - i);
+}
+
+static SSE2 void
+sum_bgra_pixels_sse2(const uint8_t *bgra, size_t count, uint32_t sums[4]) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4, bgra += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)bgra);
+        // sixteen bit sums of pixels 0 + 2 and 1 + 3 cannot overflow
+        const __m128i pairs = _mm_add_epi16(_mm_unpacklo_epi8(v, zero), _mm_unpackhi_epi8(v, zero));
+        acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_unpacklo_epi16(pairs, zero), _mm_unpackhi_epi16(pairs, zero)));
+    }
+    uint32_t t[4];
+    _mm_storeu_si128((__m128i*)t, acc);
+    for (unsigned k = 0; k < 4; k++) sums[k] += t[k];
+    sum_bgra_pixels_scalar(bgra, count - i, sums);
+}
+// }}}
+
+// AVX2 {{{
+
+// The remainder of each row is handled by the SSE2 version, the upper halves
+// of the AVX registers must be cleared before that or every SSE instruction
+// pays a penalty for the dirty state.
+
+static AVX2 void
+blend_alpha_mask_row_avx2(pixel *dest, const uint8_t *alpha, size_t count) {
+    const __m256i low_byte = _mm256_set1_epi32(0xff), opaque = _mm256_set1_epi32((int)0xffffff00);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i s = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(alpha + i)));
+        const __m256i d = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(dest + i)), low_byte);
+        _mm256_storeu_si256((__m256i*)(dest + i), _mm256_or_si256(_mm256_max_epu8(s, d), opaque));
+    }
+    _mm256_zeroupper();
+    blend_alpha_mask_row_sse2(dest + i, alpha + i, count - i);
+}
+
+static AVX2 void
+copy_bgra_row_avx2(pixel *dest, const uint8_t *bgra, size_t count) {
+    const __m256i zero = _mm256_setzero_si256(), low_byte = _mm256_set1_epi32(0xff);
+    const __m256 scale = _mm256_set1_ps(255.f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8, bgra += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)bgra);
+        const __m256i a = _mm256_srli_epi32(v, 24);
+        const __m256 af = _mm256_cvtepi32_ps(a);
+#define C(shift) _mm256_cvttps_epi32(_mm256_min_ps(_mm256_mul_ps(_mm256_div_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, shift), low_byte)), af), scale), scale))
+        const __m256i b = C(0), g = C(8), r = C(16);
+#undef C
+        const __m256i ans = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(r, 24), _mm256_slli_epi32(g, 16)), _mm256_or_si256(_mm256_slli_epi32(b, 8), a));
+        _mm256_storeu_si256((__m256i*)(dest + i), _mm256_andnot_si256(_mm256_cmpeq_epi32(a, zero), ans));
+    }
+    _mm256_zeroupper();
+    copy_bgra_row_sse2(dest + i, bgra, count - i);
+}
+
+static AVX2 void
+sum_bgra_pixels_avx2(const uint8_t *bgra, size_t count, uint32_t sums[4]) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc = zero;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8, bgra += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)bgra);
+        const __m256i pairs = _mm256_add_epi16(_mm256_unpacklo_epi8(v, zero), _mm256_unpackhi_epi8(v, zero));
+        acc = _mm256_add_epi32(acc, _mm256_add_epi32(_mm256_unpacklo_epi16(pairs, zero), _mm256_unpackhi_epi16(pairs, zero)));
+    }
+    uint32_t t[4];
+    _mm_storeu_si128((__m128i*)t, _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1)));
+    for (unsigned k = 0; k < 4; k++) sums[k] += t[k];
+    _mm256_zeroupper();
+    sum_bgra_pixels_sse2(bgra, count - i, sums);
+}
+// }}}
+#endif
+
+#ifdef CANVAS_KERNELS_NEON
+// NEON {{{
+
+static void
+blend_alpha_mask_row_neon(pixel *dest, const uint8_t *alpha, size_t count) {
+    const uint32x4_t low_byte = vdupq_n_u32(0xff), opaque = vdupq_n_u32(0xffffff00);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const uint16x8_t s = vmovl_u8(vld1_u8(alpha + i));
+        const uint32x4_t lo = vmaxq_u32(vmovl_u16(vget_low_u16(s)), vandq_u32(vld1q_u32(dest + i), low_byte));
+        const uint32x4_t hi = vmaxq_u32(vmovl_u16(vget_high_u16(s)), vandq_u32(vld1q_u32(dest + i + 4), low_byte));
+        vst1q_u32(dest + i, vorrq_u32(lo, opaque));
+        vst1q_u32(dest + i + 4, vorrq_u32(hi, opaque));
+    }
+    blend_alpha_mask_row_scalar(dest + i, alpha + i, count - i);
+}
+
+static void
+copy_bgra_row_neon(pixel *dest, const uint8_t *bgra, size_t count) {
+    const uint32x4_t low_byte = vdupq_n_u32(0xff);
+    const float32x4_t scale = vdupq_n_f32(255.f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4, bgra += 16) {
+        const uint32x4_t v = vreinterpretq_u32_u8(vld1q_u8(bgra));
+        const uint32x4_t a = vshrq_n_u32(v, 24);
+        const float32x4_t af = vcvtq_f32_u32(a);
+#define C(shift) vcvtq_u32_f32(vminq_f32(vmulq_f32(vdivq_f32(vcvtq_f32_u32(vandq_u32(vshrq_n_u32(v, shift), low_byte)), af), scale), scale))
+        const uint32x4_t b = C(0), g = C(8), r = C(16);
+#undef C
+        const uint32x4_t ans = vorrq_u32(vorrq_u32(vshlq_n_u32(r, 24), vshlq_n_u32(g, 16)), vorrq_u32(vshlq_n_u32(b, 8), a));
+        vst1q_u32(dest + i, vbicq_u32(ans, vceqq_u32(a, vdupq_n_u32(0))));
+    }
+    copy_bgra_row_scalar(dest + i, bgra, count - i);
+}
+
+static void
+sum_bgra_pixels_neon(const uint8_t *bgra, size_t count, uint32_t sums[4]) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8, bgra += 32) {
+        const uint8x8x4_t p = vld4_u8(bgra);
+        for (unsigned k = 0; k < 4; k++) sums[k] += vaddlv_u8(p.val[k]);
+    }
+    sum_bgra_pixels_scalar(bgra, count - i, sums);
+}
+// }}}
+#endif
+
+// Dispatch {{{
+
+typedef struct CanvasKernels {
+    const char *name;
+    void (*blend_alpha_mask_row)(pixel*, const uint8_t*, size_t);
+    void (*copy_bgra_row)(pixel*, const uint8_t*, size_t);
+    void (*sum_bgra_pixels)(const uint8_t*, size_t, uint32_t[4]);
+} CanvasKernels;
+
+#define K(name) {#name, blend_alpha_mask_row_##name, copy_bgra_row_##name, sum_bgra_pixels_##name}
+static const CanvasKernels scalar_kernels = K(scalar);
+#ifdef CANVAS_KERNELS_X86
+static const CanvasKernels sse2_kernels = K(sse2), avx2_kernels = K(avx2);
+#endif
+#ifdef CANVAS_KERNELS_NEON
+static const CanvasKernels neon_kernels = K(neon);
+#endif
+#undef K
+
+static const CanvasKernels*
+best_kernels(void) {
+#ifdef CANVAS_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return &avx2_kernels;
+    if (__builtin_cpu_supports("sse2")) return &sse2_kernels;
+#endif
+#ifdef CANVAS_KERNELS_NEON
+    return &neon_kernels;
+#endif
+    return &scalar_kernels;
+}
+
+static const CanvasKernels *current_kernels = NULL;
+
+static void
+select_kernels(void) {
+    if (current_kernels) return;
+    current_kernels = best_kernels();
+    blend_alpha_mask_row = current_kernels->blend_alpha_mask_row;
+    copy_bgra_row = current_kernels->copy_bgra_row;
+    sum_bgra_pixels = current_kernels->sum_bgra_pixels;
+}
+
+// The kernels are normally selected when the module is initialized, these
+// only exist in case they are needed before that
+static void
+blend_alpha_mask_row_resolver(pixel *dest, const uint8_t *alpha, size_t count) { select_kernels(); blend_alpha_mask_row(dest, alpha, count); }
+static void
+copy_bgra_row_resolver(pixel *dest, const uint8_t *bgra, size_t count) { select_kernels(); copy_bgra_row(dest, bgra, count); }
+static void
+sum_bgra_pixels_resolver(const uint8_t *bgra, size_t count, uint32_t sums[4]) { select_kernels(); sum_bgra_pixels(bgra, count, sums); }
+
+void (*blend_alpha_mask_row)(pixel*, const uint8_t*, size_t) = blend_alpha_mask_row_resolver;
+void (*copy_bgra_row)(pixel*, const uint8_t*, size_t) = copy_bgra_row_resolver;
+void (*sum_bgra_pixels)(const uint8_t*, size_t, uint32_t[4]) = sum_bgra_pixels_resolver;
+
+const char*
+canvas_kernels_implementation(void) {
+    select_kernels();
+    return current_kernels->name;
+}
+// }}}
+
+// Benchmark {{{
+
+static double
+time_blend(const CanvasKernels *k, pixel *dest, const uint8_t *alpha, size_t width, size_t height, unsigned iterations) {
+    const monotonic_t start = monotonic();
+    for (unsigned n = 0; n < iterations; n++) {
+        for (size_t r = 0; r < height; r++) k->blend_alpha_mask_row(dest + r * width, alpha + r * width, width);
+    }
+    return monotonic_t_to_s_double(monotonic() - start);
+}
+
+static double
+time_copy(const CanvasKernels *k, pixel *dest, const uint8_t *bgra, size_t width, size_t height, unsigned iterations) {
+    const monotonic_t start = monotonic();
+    for (unsigned n = 0; n < iterations; n++) {
+        for (size_t r = 0; r < height; r++) k->copy_bgra_row(dest + r * width, bgra + 4 * r * width, width);
+    }
+    return monotonic_t_to_s_double(monotonic() - start);
+}
+
+static double
+time_sum(const CanvasKernels *k, uint32_t sums[4], const uint8_t *bgra, size_t width, size_t height, unsigned iterations) {
+    const monotonic_t start = monotonic();
+    for (unsigned n = 0; n < iterations; n++) {
+        zero_at_ptr_count(sums, 4);
+        for (size_t r = 0; r < height; r++) k->sum_bgra_pixels(bgra + 4 * r * width, width, sums);
+    }
+    return monotonic_t_to_s_double(monotonic() - start);
+}
+
+static PyObject*
+test_canvas_kernels(PyObject UNUSED *self, PyObject *args) {
+    // Times the scalar kernels against the selected ones on a canvas of the
+    // specified size, verifying that both produce the same output
+    unsigned int width = 137, height = 128, iterations = 1000;
+    if (!PyArg_ParseTuple(args, "|III", &width, &height, &iterations)) return NULL;
+    if (!width || !height) { PyErr_SetString(PyExc_ValueError, "width and height must be positive"); return NULL; }
+    select_kernels();
+    const size_t num = (size_t)width * height;
+    RAII_ALLOC(uint8_t, alpha, malloc(num));
+    RAII_ALLOC(uint8_t, bgra, malloc(4 * num));
+    RAII_ALLOC(pixel, expected, malloc(sizeof(pixel) * num));
+    RAII_ALLOC(pixel, actual, malloc(sizeof(pixel) * num));
+    if (!alpha || !bgra || !expected || !actual) return PyErr_NoMemory();
+    uint32_t seed = 0x12345678u;
+#define RAND() (seed = seed * 1664525u + 1013904223u, (uint8_t)(seed >> 24))
+    for (size_t i = 0; i < num; i++) {
+        alpha[i] = RAND();
+        // premultiplied colors cannot exceed the alpha value
+        uint8_t *p = bgra + 4 * i;
+        p[3] = i % 7 ? RAND() : 0;
+        for (unsigned k = 0; k < 3; k++) p[k] = p[3] ? RAND() % (p[3] + 1) : 0;
+    }
+    for (size_t i = 0; i < num; i++) expected[i] = actual[i] = RAND();
+#undef RAND
+    const CanvasKernels *simd = current_kernels;
+    double blend[2], copy[2], sum[2];
+    uint32_t sums[2][4];
+
+    blend[0] = time_blend(&scalar_kernels, expected, alpha, width, height, 1);
+    blend[1] = time_blend(simd, actual, alpha, width, height, 1);
+    if (memcmp(expected, actual, sizeof(pixel) * num) != 0) { PyErr_SetString(PyExc_AssertionError, "blend_alpha_mask_row output differs from the scalar version"); return NULL; }
+    blend[0] = time_blend(&scalar_kernels, expected, alpha, width, height, iterations);
+    blend[1] = time_blend(simd, actual, alpha, width, height, iterations);
+
+    copy[0] = time_copy(&scalar_kernels, expected, bgra, width, height, 1);
+    copy[1] = time_copy(simd, actual, bgra, width, height, 1);
+    if (memcmp(expected, actual, sizeof(pixel) * num) != 0) { PyErr_SetString(PyExc_AssertionError, "copy_bgra_row output differs from the scalar version"); return NULL; }
+    copy[0] = time_copy(&scalar_kernels, expected, bgra, width, height, iterations);
+    copy[1] = time_copy(simd, actual, bgra, width, height, iterations);
+
+    sum[0] = time_sum(&scalar_kernels, sums[0], bgra, width, height, iterations);
+    sum[1] = time_sum(simd, sums[1], bgra, width, height, iterations);
+    if (memcmp(sums[0], sums[1], sizeof(sums[0])) != 0) { PyErr_SetString(PyExc_AssertionError, "sum_bgra_pixels output differs from the scalar version"); return NULL; }
+
+    return Py_BuildValue("{ss s(dd) s(dd) s(dd)}", "implementation", simd->name,
+            "blend_alpha_mask_row", blend[0], blend[1], "copy_bgra_row", copy[0], copy[1], "sum_bgra_pixels", sum[0], sum[1]);
+}
+// }}}
+
+static PyMethodDef module_methods[] = {
+    METHODB(test_canvas_kernels, METH_VARARGS),
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+bool
+init_canvas_kernels(PyObject *module) {
+    select_kernels();
+    if (PyModule_AddFunctions(module, module_methods) != 0) return false;
+    return true;
+}
@@ -0,0 +1,19 @@
+/*
+ * Distributed under terms of the GPL3 license.
+ */
+
+#pragma once
+
+#include "data-types.h"
+
+// Per row kernels used to composite glyph bitmaps into cells, the
+// implementation is chosen at runtime based on the capabilities of the CPU.
+
+// dest[i] = 0xffffff00 | max(alpha[i], dest[i] & 0xff)
+extern void (*blend_alpha_mask_row)(pixel *dest, const uint8_t *alpha, size_t count);
+// Converts premultiplied BGRA to straight alpha RGBA pixels
+extern void (*copy_bgra_row)(pixel *dest, const uint8_t *bgra, size_t count);
+// Adds the channels of count BGRA pixels to sums in BGRA order
+extern void (*sum_bgra_pixels)(const uint8_t *bgra, size_t count, uint32_t sums[4]);
+
+const char* canvas_kernels_implementation(void);
@@ -8,6 +8,7 @@ in float bg_alpha;
 
 #ifdef NEEDS_FOREGROUND
 uniform sampler2DArray sprites;
+uniform sampler2DArray color_sprites;
 uniform float text_contrast;
 uniform float text_gamma_adjustment;
 in float effective_text_alpha;
@@ -121,15 +122,16 @@ vec4 foreground_contrast_incorrect(vec4 over, vec3 under) {
 vec4 load_text_foreground_color() {
     // For colored sprites use the color from the sprite rather than the text foreground
     // Return non-premultiplied foreground color
-    vec4 text_fg = texture(sprites, sprite_pos);
-    return vec4(mix(foreground, text_fg.rgb, colored_sprite), text_fg.a);
+    // The sprites atlas has only a single channel holding the glyph coverage
+    vec4 text_fg = vec4(foreground, texture(sprites, sprite_pos).r);
+    return mix(text_fg, texture(color_sprites, sprite_pos), colored_sprite);
 }
 
 vec4 calculate_premul_foreground_from_sprites(vec4 text_fg) {
     // Return premul foreground color from decorations (cursor, underline, strikethrough)
-    float underline_alpha = texture(sprites, underline_pos).a;
-    float strike_alpha = texture(sprites, strike_pos).a;
-    float cursor_alpha = texture(sprites, cursor_pos).a;
+    float underline_alpha = texture(sprites, underline_pos).r;
+    float strike_alpha = texture(sprites, strike_pos).r;
+    float cursor_alpha = texture(sprites, cursor_pos).r;
     // Since strike and text are the same color, we simply add the alpha values
     float combined_alpha = min(text_fg.a + strike_alpha, 1.0f);
     // Underline color might be different, so alpha blend
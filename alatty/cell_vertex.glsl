@@ -4,7 +4,7 @@
 
 // Inputs {{{
 layout(std140) uniform CellRenderData {
-    float xstart, ystart, dx, dy, sprite_dx, sprite_dy, background_opacity, use_cell_bg_for_selection_fg, use_cell_fg_for_selection_fg, use_cell_for_selection_bg;
+    float xstart, ystart, dx, dy, sprite_dx, sprite_dy, color_sprite_dx, color_sprite_dy, background_opacity, use_cell_bg_for_selection_fg, use_cell_fg_for_selection_fg, use_cell_for_selection_bg;
 
     uint default_fg, default_bg, highlight_fg, highlight_bg, cursor_fg, cursor_bg, inverted;
 
@@ -92,12 +92,16 @@ vec3 to_color(uint c, uint defval) {
     return color_to_vec(resolve_color(c, defval));
 }
 
-vec3 to_sprite_pos(uvec2 pos, uint x, uint y, uint z) {
-    vec2 s_xpos = vec2(x, float(x) + 1.0) * sprite_dx;
-    vec2 s_ypos = vec2(y, float(y) + 1.0) * sprite_dy;
+vec3 to_sprite_pos(uvec2 pos, uint x, uint y, uint z, vec2 sprite_size) {
+    vec2 s_xpos = vec2(x, float(x) + 1.0) * sprite_size.x;
+    vec2 s_ypos = vec2(y, float(y) + 1.0) * sprite_size.y;
     return vec3(s_xpos[pos.x], s_ypos[pos.y], z);
 }
 
+vec3 to_sprite_pos(uvec2 pos, uint x, uint y, uint z) {
+    return to_sprite_pos(pos, x, y, z, vec2(sprite_dx, sprite_dy));
+}
+
 vec3 choose_color(float q, vec3 a, vec3 b) {
     return mix(b, a, q);
 }
@@ -137,8 +141,10 @@ CellData set_vertex_position() {
     gl_Position = vec4(xpos[pos.x], ypos[pos.y], 0, 1);
 #ifdef NEEDS_FOREGROUND
     // The character sprite being rendered
-    sprite_pos = to_sprite_pos(pos, sprite_coords.x, sprite_coords.y, sprite_coords.z & Z_MASK);
+    // Colored sprites come from the color atlas, which has its own layout
     colored_sprite = float((sprite_coords.z & COLOR_MASK) >> 14);
+    vec2 sprite_size = mix(vec2(sprite_dx, sprite_dy), vec2(color_sprite_dx, color_sprite_dy), colored_sprite);
+    sprite_pos = to_sprite_pos(pos, sprite_coords.x, sprite_coords.y, sprite_coords.z & Z_MASK, sprite_size);
 #endif
     float is_block_cursor = step(float(cursor_fg_sprite_idx), 0.5);
     float has_cursor = is_cursor(c, r);
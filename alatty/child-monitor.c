@@ -6,12 +6,14 @@
  */
 
 #include "loop-utils.h"
+#include "io-poller.h"
 #include "safe-wrappers.h"
 #include "state.h"
 #include "threading.h"
 #include "screen.h"
 #include "fonts.h"
 #include "monotonic.h"
+#include "alatty-uthash.h"
 #include <termios.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -39,7 +41,7 @@ extern PyTypeObject Screen_Type;
 #endif
 #define USE_RENDER_FRAMES (global_state.has_render_frames && OPT(sync_to_monitor))
 
-static void (*parse_func)(Screen*, PyObject*, monotonic_t);
+static size_t (*parse_func)(Screen*, PyObject*, monotonic_t, size_t, size_t);
 
 typedef struct {
     char *data;
@@ -64,13 +66,14 @@ typedef struct {
 
 typedef struct {
     Screen *screen;
-    bool needs_removal;
+    bool needs_removal, interest_queued;
     int fd;
     unsigned long id;
     pid_t pid;
 } Child;
 
 static const Child EMPTY_CHILD = {0};
+
 #define screen_mutex(op, which) \
     pthread_mutex_##op(&screen->which##_buf_lock);
 #define children_mutex(op) \
@@ -79,12 +82,29 @@ static const Child EMPTY_CHILD = {0};
     pthread_mutex_##op(&talk_lock);
 
 
-static Child children[MAX_CHILDREN] = {{0}};
-static Child scratch[MAX_CHILDREN] = {{0}};
-static Child add_queue[MAX_CHILDREN] = {{0}}, remove_queue[MAX_CHILDREN] = {{0}}, remove_notify[MAX_CHILDREN] = {{0}};
-static size_t add_queue_count = 0, remove_queue_count = 0;
-static struct pollfd children_fds[MAX_CHILDREN + EXTRA_FDS] = {{0}};
+// These arrays grow as needed. children, children_fds and interest_queue are
+// grown only by the I/O thread, which is the only thread that uses them
+// without holding children_lock. interest_queue holds the children whose
+// write buffer was filled by the main thread, so that the I/O thread can
+// update their events without looking at every child.
+static struct {
+    Child *children, *scratch, *add_queue, *remove_queue, *remove_notify;
+    struct pollfd *children_fds;
+    size_t *interest_queue;
+    size_t children_capacity, scratch_capacity, add_queue_capacity, remove_queue_capacity, remove_notify_capacity;
+    size_t children_fds_capacity, interest_queue_capacity;
+} tables = {0};
+static size_t add_queue_count = 0, remove_queue_count = 0, interest_queue_count = 0;
+// Maps child ids to their index in children, protected by children_lock
+typedef struct {
+    unsigned long id;
+    size_t idx;
+    UT_hash_handle hh;
+} ChildIndex;
+static ChildIndex *child_indices = NULL;
+static IOPoller io_poller;
 static pthread_mutex_t children_lock, talk_lock;
+static pthread_cond_t stream_space_cond;
 static bool kill_signal_received = false, reload_config_signal_received = false;
 static ChildMonitor *the_monitor = NULL;
 
@@ -93,6 +113,43 @@ typedef struct {
     int status;
 } ReapedPID;
 
+static void
+ensure_children_capacity(size_t num) {
+    // Called with children_lock held, after the I/O thread has started only
+    // by the I/O thread itself
+    if (num <= tables.children_capacity) return;
+    ensure_space_for(&tables, children, Child, num, children_capacity, 64, true);
+    ensure_space_for(&tables, children_fds, struct pollfd, tables.children_capacity + EXTRA_FDS, children_fds_capacity, 64, true);
+    ensure_space_for(&tables, interest_queue, size_t, tables.children_capacity, interest_queue_capacity, 64, true);
+    if (io_poller.slots && !io_poller_resize(&io_poller, tables.children_fds, tables.children_capacity + EXTRA_FDS)) fatal("Out of memory growing I/O poller");
+}
+
+static ssize_t
+child_index(unsigned long id) {
+    ChildIndex *ci;
+    HASH_FIND(hh, child_indices, &id, sizeof(id), ci);
+    return ci ? (ssize_t)ci->idx : -1;
+}
+
+static void
+set_child_index(unsigned long id, size_t idx) {
+    ChildIndex *ci;
+    HASH_FIND(hh, child_indices, &id, sizeof(id), ci);
+    if (!ci) {
+        if (!(ci = calloc(1, sizeof(ChildIndex)))) fatal("Out of memory");
+        ci->id = id;
+        HASH_ADD(hh, child_indices, id, sizeof(ci->id), ci);
+    }
+    ci->idx = idx;
+}
+
+static void
+remove_child_index(unsigned long id) {
+    ChildIndex *ci;
+    HASH_FIND(hh, child_indices, &id, sizeof(id), ci);
+    if (ci) { HASH_DEL(child_indices, ci); free(ci); }
+}
+
 static pid_t monitored_pids[256] = {0};
 static size_t monitored_pids_count = 0;
 static ReapedPID reaped_pids[arraysz(monitored_pids)] = {{0}};
@@ -169,6 +226,10 @@ new(PyTypeObject *type, PyObject *args, PyObject UNUSED *kwds) {
         PyErr_Format(PyExc_RuntimeError, "Failed to create talk_lock mutex: %s", strerror(ret));
         return NULL;
     }
+    if ((ret = pthread_cond_init(&stream_space_cond, NULL)) != 0) {
+        PyErr_Format(PyExc_RuntimeError, "Failed to create stream_space_cond condition variable: %s", strerror(ret));
+        return NULL;
+    }
     self = (ChildMonitor *)type->tp_alloc(type, 0);
     if (!init_loop_data(&self->io_loop_data, ALATTY_HANDLED_SIGNALS)) return PyErr_SetFromErrno(PyExc_OSError);
     self->talk_fd = talk_fd;
@@ -180,8 +241,9 @@ new(PyTypeObject *type, PyObject *args, PyObject UNUSED *kwds) {
         parse_func = parse_worker_dump;
     } else parse_func = parse_worker;
     self->count = 0;
-    children_fds[0].fd = self->io_loop_data.wakeup_read_fd; children_fds[1].fd = self->io_loop_data.signal_read_fd;
-    children_fds[0].events = POLLIN; children_fds[1].events = POLLIN; children_fds[2].events = POLLIN;
+    ensure_children_capacity(1);
+    tables.children_fds[0].fd = self->io_loop_data.wakeup_read_fd; tables.children_fds[1].fd = self->io_loop_data.signal_read_fd;
+    tables.children_fds[0].events = POLLIN; tables.children_fds[1].events = POLLIN; tables.children_fds[2].events = POLLIN;
     the_monitor = self;
 
     return (PyObject*) self;
@@ -196,16 +258,22 @@ dealloc(ChildMonitor* self) {
     }
     pthread_mutex_destroy(&children_lock);
     pthread_mutex_destroy(&talk_lock);
+    pthread_cond_destroy(&stream_space_cond);
     Py_CLEAR(self->dump_callback);
     Py_CLEAR(self->death_notify);
     while (remove_queue_count) {
         remove_queue_count--;
-        FREE_CHILD(remove_queue[remove_queue_count]);
+        FREE_CHILD(tables.remove_queue[remove_queue_count]);
     }
     while (add_queue_count) {
         add_queue_count--;
-        FREE_CHILD(add_queue[add_queue_count]);
+        FREE_CHILD(tables.add_queue[add_queue_count]);
     }
+    ChildIndex *ci, *tmp;
+    HASH_ITER(hh, child_indices, ci, tmp) { HASH_DEL(child_indices, ci); free(ci); }
+    free(tables.children); free(tables.scratch); free(tables.add_queue); free(tables.remove_queue); free(tables.remove_notify);
+    free(tables.children_fds); free(tables.interest_queue);
+    zero_at_ptr(&tables);
     free_loop_data(&self->io_loop_data);
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
@@ -260,21 +328,37 @@ static PyObject *
 add_child(ChildMonitor *self, PyObject *args) {
 #define add_child_doc "add_child(id, pid, fd, screen) -> Add a child."
     children_mutex(lock);
-    if (self->count + add_queue_count >= MAX_CHILDREN) { PyErr_SetString(PyExc_ValueError, "Too many children"); children_mutex(unlock); return NULL; }
-    add_queue[add_queue_count] = EMPTY_CHILD;
-#define A(attr) &add_queue[add_queue_count].attr
+    ensure_space_for(&tables, add_queue, Child, add_queue_count + 1, add_queue_capacity, 64, true);
+    tables.add_queue[add_queue_count] = EMPTY_CHILD;
+#define A(attr) &tables.add_queue[add_queue_count].attr
     if (!PyArg_ParseTuple(args, "kiiO", A(id), A(pid), A(fd), A(screen))) {
         children_mutex(unlock);
         return NULL;
     }
 #undef A
-    INCREF_CHILD(add_queue[add_queue_count]);
+    INCREF_CHILD(tables.add_queue[add_queue_count]);
     add_queue_count++;
     children_mutex(unlock);
     wakeup_io_loop(self, false);
     Py_RETURN_NONE;
 }
 
+static void
+queue_child_interest(size_t i) {
+    if (!tables.children[i].interest_queued) { tables.children[i].interest_queued = true; tables.interest_queue[interest_queue_count++] = i; }
+}
+
+// Writes, copied or borrowed, beyond this are refused. Only pastes streamed
+// from a file or pipe can be larger, as they are fed in as space frees up.
+#define MAX_QUEUED_WRITE_SZ (100u * 1024u * 1024u)
+
+static bool
+has_space_for_write(const Screen *screen, size_t sz, unsigned long id) {
+    if (screen->write_queue.pending.used + screen->write_queue.held.used + sz <= MAX_QUEUED_WRITE_SZ) return true;
+    log_error("Too much data being sent to child with id: %lu, ignoring it", id);
+    return false;
+}
+
 #define schedule_write_to_child_generic(id, num, va_start, get_next_arg, va_end) \
     ChildMonitor *self = the_monitor; \
     bool found = false; \
@@ -287,38 +371,22 @@ add_child(ChildMonitor *self, PyObject *args) {
     } \
     va_end(ap); \
     children_mutex(lock); \
-    for (size_t i = 0; i < self->count; i++) { \
-        if (children[i].id == id) { \
-            Screen *screen = children[i].screen; \
-            screen_mutex(lock, write); \
-            size_t space_left = screen->write_buf_sz - screen->write_buf_used; \
-            if (space_left < sz) { \
-                if (screen->write_buf_used + sz > 100 * 1024 * 1024) { \
-                    log_error("Too much data being sent to child with id: %lu, ignoring it", id); \
-                    screen_mutex(unlock, write); \
-                    break; \
-                } \
-                screen->write_buf_sz = screen->write_buf_used + sz; \
-                screen->write_buf = PyMem_RawRealloc(screen->write_buf, screen->write_buf_sz); \
-                if (screen->write_buf == NULL) { fatal("Out of memory."); } \
-            } \
+    ssize_t idx = child_index(id); \
+    if (idx > -1) { \
+        Screen *screen = tables.children[idx].screen; \
+        screen_mutex(lock, write); \
+        if (has_space_for_write(screen, sz, id)) { \
             found = true; \
+            queue_child_interest(idx); \
             va_start(ap, num); \
             for (unsigned int i = 0; i < num; i++) { \
                 get_next_arg(ap); \
-                memcpy(screen->write_buf + screen->write_buf_used, data, szval); \
-                screen->write_buf_used += szval; \
+                if (!write_queue_append(&screen->write_queue, data, szval)) { fatal("Out of memory."); } \
             } \
             va_end(ap); \
-            if (screen->write_buf_sz > BUFSIZ && screen->write_buf_used < BUFSIZ) { \
-                screen->write_buf_sz = BUFSIZ; \
-                screen->write_buf = PyMem_RawRealloc(screen->write_buf, screen->write_buf_sz); \
-                if (screen->write_buf == NULL) { fatal("Out of memory."); } \
-            } \
-            if (screen->write_buf_used) wakeup_io_loop(self, false); \
-            screen_mutex(unlock, write); \
-            break; \
+            if (screen->write_queue.pending.used) wakeup_io_loop(self, false); \
         } \
+        screen_mutex(unlock, write); \
     } \
     children_mutex(unlock); \
     return found;
@@ -363,6 +431,222 @@ schedule_write_to_child_python(unsigned long id, const char *prefix, PyObject *a
 #undef get_next_arg
 }
 
+bool
+schedule_borrowed_write_to_child(unsigned long id, PyObject *owner, const char *data, size_t sz) {
+    // The data is written straight from owner, which is kept alive until
+    // then and released by the main thread in release_written_chunks()
+    ChildMonitor *self = the_monitor;
+    bool found = false;
+    children_mutex(lock);
+    ssize_t i = child_index(id);
+    if (i > -1) {
+        Screen *screen = tables.children[i].screen;
+        screen_mutex(lock, write);
+        if (has_space_for_write(screen, sz, id)) {
+            if (!write_queue_append_borrowed(&screen->write_queue, owner, data, sz)) fatal("Out of memory.");
+            found = true;
+            queue_child_interest(i);
+            if (screen->write_queue.pending.used) wakeup_io_loop(self, false);
+        }
+        screen_mutex(unlock, write);
+    }
+    children_mutex(unlock);
+    return found;
+}
+
+// Streaming writes {{{
+// Pastes from a file or pipe are read by a helper thread, a bounded amount
+// at a time, so that neither memory use nor the main thread depend on their
+// size. The I/O thread signals stream_space_cond as the child consumes them.
+
+#define STREAM_HIGH_WATER (4u * 1024u * 1024u)
+#define STREAM_CHUNK_SZ (64u * 1024u)
+
+// Bytes that might still become part of a bracketed paste end marker are
+// kept back, beyond this many the oldest of them are dropped
+#define STREAM_MAX_HELD 4096u
+
+typedef struct StreamData {
+    unsigned long id;
+    int fd;
+    bool bracketed, last_was_cr;
+    char *suffix;
+    uint8_t buf[STREAM_CHUNK_SZ];
+    // filtered data, the first held bytes of which are kept back from the last chunk
+    size_t held;
+    uint8_t out[STREAM_MAX_HELD + STREAM_CHUNK_SZ];
+} StreamData;
+
+static size_t num_streams = 0;
+
+static bool
+ends_paste_end_marker_prefix(const uint8_t *data, size_t end) {
+    // whether any of the bytes before end, together with the byte at end,
+    // form the start of CSI 201 ~
+    static const char seven_bit[] = "\x1b[201~", eight_bit[] = "\x9b" "201~";
+    for (size_t n = 1; n <= end + 1 && n < sizeof(seven_bit) - 1; n++) {
+        const uint8_t *p = data + end + 1 - n;
+        if (memcmp(p, seven_bit, n) == 0 || (n < sizeof(eight_bit) - 1 && memcmp(p, eight_bit, n) == 0)) return true;
+    }
+    return false;
+}
+
+static size_t
+filter_stream_data(StreamData *s, size_t sz) {
+    // The same transformations Window.paste_text() does for in memory pastes,
+    // the filtered data ready to be sent is at the start of s->out. In
+    // bracketed mode every end marker is removed, including ones that only
+    // form once another is removed, like sanitize_for_bracketed_paste().
+    size_t o = s->held;
+    for (size_t i = 0; i < sz; i++) {
+        uint8_t ch = s->buf[i];
+        if (s->bracketed) {
+            s->out[o++] = ch;
+            if (o >= 6 && memcmp(s->out + o - 6, "\x1b[201~", 6) == 0) o -= 6;
+            else if (o >= 5 && memcmp(s->out + o - 5, "\x9b" "201~", 5) == 0) o -= 5;
+            continue;
+        }
+        if (ch == '\n') {
+            if (s->last_was_cr) { s->last_was_cr = false; continue; }
+            ch = '\r';
+        } else s->last_was_cr = ch == '\r';
+        s->out[o++] = ch;
+    }
+    if (!s->bracketed) return o;
+    // a byte that does not end the start of a marker can never become part of
+    // one, so neither can anything before it, since it is never removed
+    size_t ready = o;
+    while (ready && ends_paste_end_marker_prefix(s->out, ready - 1)) ready--;
+    s->held = o - ready;
+    if (s->held > STREAM_MAX_HELD) {
+        // sending these could let an end marker through, so drop them
+        memmove(s->out + ready, s->out + o - STREAM_MAX_HELD, STREAM_MAX_HELD);
+        s->held = STREAM_MAX_HELD;
+    }
+    return ready;
+}
+
+static void
+take_held_stream_data(StreamData *s, size_t sent) {
+    memmove(s->out, s->out + sent, s->held);
+}
+
+static bool
+wait_for_stream_space(unsigned long id) {
+    bool ok = false;
+    children_mutex(lock);
+    while (!the_monitor->shutting_down) {
+        ssize_t i = child_index(id);
+        if (i < 0) break;
+        Screen *screen = tables.children[i].screen;
+        screen_mutex(lock, write);
+        const size_t used = screen->write_queue.pending.used;
+        screen_mutex(unlock, write);
+        if (used < STREAM_HIGH_WATER) { ok = true; break; }
+        pthread_cond_wait(&stream_space_cond, &children_lock);
+    }
+    children_mutex(unlock);
+    return ok;
+}
+
+static bool
+append_stream_data(unsigned long id, const uint8_t *data, size_t sz, bool finished) {
+    bool found = false;
+    children_mutex(lock);
+    ssize_t i = child_index(id);
+    if (i > -1) {
+        found = true;
+        Screen *screen = tables.children[i].screen;
+        screen_mutex(lock, write);
+        if (sz && !write_queue_append_from_stream(&screen->write_queue, data, sz)) fatal("Out of memory.");
+        if (finished) write_queue_end_stream(&screen->write_queue);
+        queue_child_interest(i);
+        if (screen->write_queue.pending.used) wakeup_io_loop(the_monitor, false);
+        screen_mutex(unlock, write);
+    }
+    children_mutex(unlock);
+    return found;
+}
+
+static ssize_t
+read_stream_source(int fd, uint8_t *buf, size_t sz) {
+    // Polls so that a pipe that never gets any data cannot block shutdown
+    struct pollfd pfd = {.fd=fd, .events=POLLIN};
+    while (!the_monitor->shutting_down) {
+        int ret = poll(&pfd, 1, 100);
+        if (ret < 0 && errno != EINTR) return -1;
+        if (ret < 1) continue;
+        ssize_t n = read(fd, buf, sz);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        return n;
+    }
+    return 0;
+}
+
+static void*
+stream_to_child_thread(void *data) {
+    StreamData *s = data;
+    set_thread_name("AlattyPasteFeed");
+    bool alive = true;
+    while (alive && wait_for_stream_space(s->id)) {
+        ssize_t n = read_stream_source(s->fd, s->buf, sizeof(s->buf));
+        if (n < 0) log_error("Failed to read data to paste with error: %s", strerror(errno));
+        if (n <= 0) break;
+        const size_t ready = filter_stream_data(s, n);
+        alive = append_stream_data(s->id, s->out, ready, false);
+        take_held_stream_data(s, ready);
+    }
+    // what is still held is not followed by an end marker now
+    if (alive && s->held) alive = append_stream_data(s->id, s->out, s->held, false);
+    if (alive) append_stream_data(s->id, (uint8_t*)s->suffix, s->suffix ? strlen(s->suffix) : 0, true);
+    safe_close(s->fd, __FILE__, __LINE__);
+    free(s->suffix); free(s);
+    children_mutex(lock);
+    num_streams--;
+    pthread_cond_broadcast(&stream_space_cond);
+    children_mutex(unlock);
+    return NULL;
+}
+
+bool
+stream_to_child(unsigned long id, int fd, const char *prefix, const char *suffix) {
+    // Takes ownership of fd if it returns true. prefix and suffix are only
+    // used for bracketed pastes. Writes scheduled while the stream is active
+    // are sent ahead of the stream data still queued, outside the bracketed
+    // paste, as the suffix and prefix surround them.
+    StreamData *s = calloc(1, sizeof(StreamData));
+    if (!s) return false;
+    s->id = id; s->fd = fd; s->bracketed = prefix != NULL;
+    if (suffix && !(s->suffix = strdup(suffix))) { free(s); return false; }
+    bool started = false;
+    children_mutex(lock);
+    ssize_t i = child_index(id);
+    if (i > -1 && !the_monitor->shutting_down) {
+        Screen *screen = tables.children[i].screen;
+        screen_mutex(lock, write);
+        if (!screen->write_queue.stream_active) {
+            WriteQueue *q = &screen->write_queue;
+            if (prefix && !write_queue_append(q, prefix, strlen(prefix))) fatal("Out of memory.");
+            if (prefix && suffix) {
+                snprintf(q->stream_pause, sizeof(q->stream_pause), "%s", suffix);
+                snprintf(q->stream_resume, sizeof(q->stream_resume), "%s", prefix);
+            }
+            q->stream_active = true;
+            pthread_t thread;
+            int ret = pthread_create(&thread, NULL, stream_to_child_thread, s);
+            if (ret == 0) { pthread_detach(thread); started = true; num_streams++; }
+            else { write_queue_end_stream(q); log_error("Failed to start paste thread with error: %s", strerror(ret)); }
+            queue_child_interest(i);
+            wakeup_io_loop(the_monitor, false);
+        }
+        screen_mutex(unlock, write);
+    }
+    children_mutex(unlock);
+    if (!started) { free(s->suffix); free(s); }
+    return started;
+}
+// }}}
+
 static PyObject *
 needs_write(ChildMonitor UNUSED *self, PyObject *args) {
 #define needs_write_doc "needs_write(id, data) -> Queue data to be written to child."
@@ -379,6 +663,10 @@ shutdown_monitor(ChildMonitor *self, PyObject *a UNUSED) {
     self->shutting_down = true;
     wakeup_talk_loop(false);
     wakeup_io_loop(self, false);
+    children_mutex(lock);
+    pthread_cond_broadcast(&stream_space_cond);
+    while (num_streams) pthread_cond_wait(&stream_space_cond, &children_lock);
+    children_mutex(unlock);
     int ret = pthread_join(self->io_thread, NULL);
     if (ret != 0) return PyErr_Format(PyExc_OSError, "Failed to join() I/O thread with error: %s", strerror(ret));
     if (talk_thread_started) {
@@ -389,27 +677,83 @@ shutdown_monitor(ChildMonitor *self, PyObject *a UNUSED) {
     Py_RETURN_NONE;
 }
 
+// Parse scheduling {{{
+// Input is parsed in slices of this size when a window has a time budget
+#define PARSE_SLICE_SZ (16u * 1024u)
+// Windows that had key input this recently are parsed without a budget
+#define RECENT_KEY_INPUT_TIME s_double_to_monotonic_t(1.0)
+// The input buffers of windows whose child has been quiet this long are shrunk
+#define INPUT_BUF_IDLE_TIME s_double_to_monotonic_t(10.0)
+
+static size_t parse_rotor = 0;
+
+static bool
+is_interactive(const Screen *screen, monotonic_t now) {
+    return screen->has_focus || (screen->last_key_input_at && now - screen->last_key_input_at < RECENT_KEY_INPUT_TIME);
+}
+
 static bool
-do_parse(ChildMonitor *self, Screen *screen, monotonic_t now, bool flush) {
+do_parse(ChildMonitor *self, Screen *screen, monotonic_t now, bool flush, monotonic_t budget) {
+    // A budget <= 0 means everything available is parsed, otherwise parsing
+    // stops once the budget is used up and the rest is carried over to the
+    // next tick. At least one slice is always parsed.
     bool input_read = false;
     screen_mutex(lock, read);
     if (screen->read_buf_sz || screen->pending_mode.used) {
         monotonic_t time_since_new_input = now - screen->new_input_at;
-        if (flush || time_since_new_input >= OPT(input_delay)) {
+        if (flush || screen->echo_received || time_since_new_input >= OPT(input_delay)) {
             bool read_buf_full = screen->read_buf_sz >= READ_BUF_SZ;
             input_read = true;
-            parse_func(screen, self->dump_callback, now);
+            screen->echo_received = false;
+            const monotonic_t start = monotonic();
+            monotonic_t elapsed;
+            size_t parsed = 0;
+            if (budget > 0) {
+                do {
+                    parsed += parse_func(screen, self->dump_callback, now, parsed, PARSE_SLICE_SZ);
+                    elapsed = monotonic() - start;
+                } while (parsed < screen->read_buf_sz && elapsed < budget);
+            } else {
+                parsed = parse_func(screen, self->dump_callback, now, 0, SIZE_MAX);
+                elapsed = monotonic() - start;
+            }
+            // Drop the parsed bytes once per call, not once per slice
+            if (parsed < screen->read_buf_sz) memmove(screen->read_buf, screen->read_buf + parsed, screen->read_buf_sz - parsed);
+            screen->read_buf_sz -= parsed;
+            screen->parse_stats.time += elapsed;
+            screen->parse_stats.max_time = MAX(screen->parse_stats.max_time, elapsed);
+            screen->parse_stats.bytes += parsed;
+            screen->parse_stats.calls++;
             if (read_buf_full) wakeup_io_loop(self, false);  // Ensure the read fd has POLLIN set
-            screen->new_input_at = 0;
+            if (screen->read_buf_sz) {
+                // new_input_at is left as is, so the rest is parsed on the
+                // next tick without waiting for input_delay
+                screen->parse_stats.deferred++;
+                set_maximum_wait(0);
+            } else screen->new_input_at = 0;
             if (screen->pending_mode.activated_at) {
                 monotonic_t time_since_pending = MAX(0, now - screen->pending_mode.activated_at);
                 set_maximum_wait(screen->pending_mode.wait_time - time_since_pending);
             }
         } else set_maximum_wait(OPT(input_delay) - time_since_new_input);
+    } else if (screen->parser_buf && !screen->parser_state && now - screen->last_read_at >= INPUT_BUF_IDLE_TIME) {
+        // No escape code is in progress, the next one allocates it again
+        free(screen->parser_buf); screen->parser_buf = NULL; screen->parser_buf_capacity = 0;
     }
     screen_mutex(unlock, read);
     return input_read;
 }
+// }}}
+
+static bool written_borrowed_chunks = false;
+
+static void
+release_written_chunks(Screen *screen) {
+    screen_mutex(lock, write);
+    WriteQueueChunk *chunks = write_queue_take_consumed(&screen->write_queue);
+    screen_mutex(unlock, write);
+    free_write_queue_chunks(chunks);
+}
 
 static bool
 parse_input(ChildMonitor *self) {
@@ -418,12 +762,13 @@ parse_input(ChildMonitor *self) {
     bool input_read = false, reload_config_called = false;
     monotonic_t now = monotonic();
     children_mutex(lock);
+    ensure_space_for(&tables, remove_notify, Child, remove_queue_count, remove_notify_capacity, 64, true);
     while (remove_queue_count) {
         remove_queue_count--;
-        remove_notify[remove_count] = remove_queue[remove_queue_count];
-        INCREF_CHILD(remove_notify[remove_count]);
+        tables.remove_notify[remove_count] = tables.remove_queue[remove_queue_count];
+        INCREF_CHILD(tables.remove_notify[remove_count]);
         remove_count++;
-        FREE_CHILD(remove_queue[remove_queue_count]);
+        FREE_CHILD(tables.remove_queue[remove_queue_count]);
     }
 
     if (UNLIKELY(kill_signal_received || reload_config_signal_received)) {
@@ -439,9 +784,10 @@ parse_input(ChildMonitor *self) {
         }
     } else {
         count = self->count;
+        ensure_space_for(&tables, scratch, Child, count, scratch_capacity, 64, true);
         for (size_t i = 0; i < count; i++) {
-            scratch[i] = children[i];
-            INCREF_CHILD(scratch[i]);
+            tables.scratch[i] = tables.children[i];
+            INCREF_CHILD(tables.scratch[i]);
         }
     }
     children_mutex(unlock);
@@ -472,18 +818,39 @@ parse_input(ChildMonitor *self) {
         // must be done while no locks are held, since the locks are non-recursive and
         // the python function could call into other functions in this module
         remove_count--;
-        if (remove_notify[remove_count].screen) do_parse(self, remove_notify[remove_count].screen, now, true);
-        PyObject *t = PyObject_CallFunction(self->death_notify, "k", remove_notify[remove_count].id);
+        if (tables.remove_notify[remove_count].screen) do_parse(self, tables.remove_notify[remove_count].screen, now, true, 0);
+        PyObject *t = PyObject_CallFunction(self->death_notify, "k", tables.remove_notify[remove_count].id);
         if (t == NULL) PyErr_Print();
         else Py_DECREF(t);
-        FREE_CHILD(remove_notify[remove_count]);
+        FREE_CHILD(tables.remove_notify[remove_count]);
     }
 
+    // Windows the user is interacting with are parsed completely. The others
+    // share the parse budget, starting from a different window every tick so
+    // that a flood of output in one of them cannot starve the rest.
+    const monotonic_t budget = OPT(input_parse_budget);
+    size_t num_background = 0;
     for (size_t i = 0; i < count; i++) {
-        if (!scratch[i].needs_removal) {
-            if (do_parse(self, scratch[i].screen, now, false)) input_read = true;
+        if (tables.scratch[i].needs_removal) continue;
+        if (budget <= 0 || is_interactive(tables.scratch[i].screen, now)) {
+            if (do_parse(self, tables.scratch[i].screen, now, false, 0)) input_read = true;
+        } else num_background++;
+    }
+    if (num_background) {
+        const monotonic_t deadline = monotonic() + budget;
+        parse_rotor++;
+        for (size_t n = 0; n < count && num_background; n++) {
+            const size_t i = (parse_rotor + n) % count;
+            if (tables.scratch[i].needs_removal || is_interactive(tables.scratch[i].screen, now)) continue;
+            const monotonic_t share = MAX(1, (deadline - monotonic()) / (monotonic_t)num_background--);
+            if (do_parse(self, tables.scratch[i].screen, now, false, share)) input_read = true;
         }
-        DECREF_CHILD(scratch[i]);
+    }
+
+    const bool release_written = __atomic_exchange_n(&written_borrowed_chunks, false, __ATOMIC_ACQ_REL);
+    for (size_t i = 0; i < count; i++) {
+        if (release_written) release_written_chunks(tables.scratch[i].screen);
+        DECREF_CHILD(tables.scratch[i]);
     }
     if (reload_config_called) {
         call_boss(load_config_file, "");
@@ -495,17 +862,15 @@ static bool
 mark_child_for_close(ChildMonitor *self, id_type window_id) {
     bool found = false;
     children_mutex(lock);
-    for (size_t i = 0; i < self->count; i++) {
-        if (children[i].id == window_id) {
-            children[i].needs_removal = true;
-            found = true;
-            break;
-        }
+    ssize_t idx = child_index(window_id);
+    if (idx > -1) {
+        tables.children[idx].needs_removal = true;
+        found = true;
     }
     if (!found) {
         for (size_t i = 0; i < add_queue_count; i++) {
-            if (add_queue[i].id == window_id) {
-                add_queue[i].needs_removal = true;
+            if (tables.add_queue[i].id == window_id) {
+                tables.add_queue[i].needs_removal = true;
                 found = true;
                 break;
             }
@@ -557,8 +922,9 @@ resize_pty(ChildMonitor *self, PyObject *args) {
             break; \
         } \
     }}
-    FIND(children, self->count);
-    if (fd == -1) FIND(add_queue, add_queue_count);
+    ssize_t idx = child_index(window_id);
+    if (idx > -1) fd = tables.children[idx].fd;
+    else FIND(tables.add_queue, add_queue_count);
     if (fd != -1) {
         if (!pty_resize(fd, &dim)) PyErr_SetFromErrno(PyExc_OSError);
     } else log_error("Failed to send resize signal to child with id: %lu (children count: %u) (add queue: %zu)", window_id, self->count, add_queue_count);
@@ -580,18 +946,16 @@ set_iutf8(int UNUSED fd, bool UNUSED on) {
 }
 
 static PyObject*
-pyset_iutf8(ChildMonitor *self, PyObject *args) {
+pyset_iutf8(ChildMonitor UNUSED *self, PyObject *args) {
     id_type window_id;
     int on;
     PyObject *found = Py_False;
     if (!PyArg_ParseTuple(args, "Kp", &window_id, &on)) return NULL;
     children_mutex(lock);
-    for (size_t i = 0; i < self->count; i++) {
-        if (children[i].id == window_id) {
-            found = Py_True;
-            if (!set_iutf8(children_fds[EXTRA_FDS + i].fd, on & 1)) PyErr_SetFromErrno(PyExc_OSError);
-            break;
-        }
+    ssize_t idx = child_index(window_id);
+    if (idx > -1) {
+        found = Py_True;
+        if (!set_iutf8(tables.children[idx].fd, on & 1)) PyErr_SetFromErrno(PyExc_OSError);
     }
     children_mutex(unlock);
     if (PyErr_Occurred()) return NULL;
@@ -667,6 +1031,12 @@ prepare_to_render_os_window(OSWindow *os_window, monotonic_t now, unsigned int *
         Window *w = tab->windows + i;
 #define WD w->render_data
         if (w->visible && WD.screen) {
+            if (WD.vao_idx < 0) {
+                // released while the window was hidden, see release_gpu_resources_of_hidden_windows()
+                create_gpu_resources_for_window(w);
+                WD.screen->reload_all_gpu_data = true;
+            }
+            w->last_rendered_at = now;
             *num_visible_windows += 1;
             color_type window_bg = colorprofile_to_color(WD.screen->color_profile, WD.screen->color_profile->overridden.default_bg, WD.screen->color_profile->configured.default_bg).rgb;
             if (*num_visible_windows == 1) first_window_bg = window_bg;
@@ -726,6 +1096,9 @@ render_prepared_os_window(OSWindow *os_window, unsigned int active_window_id, co
 #undef TD
 }
 
+// How long a frame waits for glyphs being rasterized in the background
+#define GLYPH_RASTERIZATION_DEADLINE ms_to_monotonic_t(4ll)
+
 static bool
 no_render_frame_received_recently(OSWindow *w, monotonic_t now, monotonic_t max_wait) {
     return now - w->last_render_frame_received_at > max_wait;
@@ -759,13 +1132,62 @@ render_os_window(OSWindow *w, monotonic_t now, bool ignore_render_frames) {
     bool all_windows_have_same_bg;
     color_type active_window_bg = 0;
     if (!w->fonts_data) { log_error("No fonts data found for window id: %llu", w->id); return false; }
+    if (compact_sprite_map_if_needed(w->fonts_data, now)) needs_render = true;
+    collect_rasterized_glyphs(w->fonts_data);
     if (prepare_to_render_os_window(w, now, &active_window_id, &active_window_bg, &num_visible_windows, &all_windows_have_same_bg)) needs_render = true;
+    // lines whose glyphs arrive in time are rendered again, the rest are blank for a frame
+    if (wait_for_rasterized_glyphs(w->fonts_data, now, GLYPH_RASTERIZATION_DEADLINE) && prepare_to_render_os_window(w, now, &active_window_id, &active_window_bg, &num_visible_windows, &all_windows_have_same_bg)) needs_render = true;
+    flush_sprite_uploads(w->fonts_data);
+    flush_glyph_disk_caches(w->fonts_data);
     if (w->last_active_window_id != active_window_id || w->last_active_tab != w->active_tab || w->focused_at_last_render != w->is_focused) needs_render = true;
     if (w->render_calls < 3) needs_render = true;
     if (needs_render) render_prepared_os_window(w, active_window_id, active_window_bg, num_visible_windows, all_windows_have_same_bg);
+    // the first frame is always rendered, so it is on screen by now, queue up
+    // the commonly needed glyphs a slice at a time
+    if (prewarm_sprite_atlas(w->fonts_data)) set_maximum_wait(OPT(repaint_delay));
     return needs_render;
 }
 
+// How often windows are checked for having been hidden for longer than hidden_window_release_delay
+#define HIDDEN_WINDOWS_SCAN_INTERVAL ms_to_monotonic_t(1000ll)
+
+static void
+release_gpu_resources_of_hidden_windows(monotonic_t now) {
+    // Windows in background tabs or in minimized OS windows are not drawn, so
+    // their cell buffers on the GPU only hold a copy of the screen. Once they
+    // have not been drawn for long enough the buffers are released, they are
+    // created again and refilled when the window is next drawn.
+    static monotonic_t last_scan_at = 0, next_release_at = 0;
+    const monotonic_t delay = OPT(hidden_window_release_delay);
+    if (delay <= 0) return;
+    if (now - last_scan_at < HIDDEN_WINDOWS_SCAN_INTERVAL) {
+        if (next_release_at) set_maximum_wait(MAX(next_release_at, last_scan_at + HIDDEN_WINDOWS_SCAN_INTERVAL) - now);
+        return;
+    }
+    last_scan_at = now; next_release_at = 0;
+    for (size_t o = 0; o < global_state.num_os_windows; o++) {
+        OSWindow *osw = global_state.os_windows + o;
+        const bool is_shown = should_os_window_be_rendered(osw);
+        bool context_is_current = false;
+        for (unsigned int t = 0; t < osw->num_tabs; t++) {
+            Tab *tab = osw->tabs + t;
+            for (unsigned int i = 0; i < tab->num_windows; i++) {
+                Window *w = tab->windows + i;
+                if (w->render_data.vao_idx < 0) continue;
+                if (is_shown && t == osw->active_tab && w->visible) { w->last_rendered_at = now; continue; }
+                const monotonic_t release_at = w->last_rendered_at + delay;
+                if (release_at > now) {
+                    if (!next_release_at || release_at < next_release_at) next_release_at = release_at;
+                    continue;
+                }
+                if (!context_is_current) { make_os_window_context_current(osw); context_is_current = true; }
+                release_gpu_resources_for_window(w);
+            }
+        }
+    }
+    if (next_release_at) set_maximum_wait(next_release_at - now);
+}
+
 static void
 render(monotonic_t now, bool input_read) {
     EVDBG("input_read: %d, check_for_active_animated_images: %d", input_read, global_state.check_for_active_animated_images);
@@ -790,6 +1212,7 @@ render(monotonic_t now, bool input_read) {
             if (scan_for_animated_images) global_state.check_for_active_animated_images = true;
         }
     }
+    release_gpu_resources_of_hidden_windows(now);
     last_render_at = now;
 #undef TD
 }
@@ -1167,14 +1590,20 @@ main_loop(ChildMonitor *self, PyObject *a UNUSED) {
 
 // I/O thread functions {{{
 
+static void update_child_events(size_t i);
+
 static void
 add_children(ChildMonitor *self) {
-    for (; add_queue_count > 0 && self->count < MAX_CHILDREN;) {
+    ensure_children_capacity(self->count + add_queue_count);
+    for (; add_queue_count > 0;) {
         add_queue_count--;
-        children[self->count] = add_queue[add_queue_count];
-        add_queue[add_queue_count] = EMPTY_CHILD;
-        children_fds[EXTRA_FDS + self->count].fd = children[self->count].fd;
-        children_fds[EXTRA_FDS + self->count].events = POLLIN;
+        tables.children[self->count] = tables.add_queue[add_queue_count];
+        set_child_index(tables.children[self->count].id, self->count);
+        tables.add_queue[add_queue_count] = EMPTY_CHILD;
+        tables.children_fds[EXTRA_FDS + self->count].fd = tables.children[self->count].fd;
+        tables.children_fds[EXTRA_FDS + self->count].events = POLLIN;
+        io_poller_add(&io_poller, EXTRA_FDS + self->count);
+        if (io_poller.kind == IO_POLLER_URING) update_child_events(self->count);
         self->count++;
     }
 }
@@ -1194,34 +1623,155 @@ hangup(pid_t pid) {
 
 static void
 cleanup_child(ssize_t i) {
-    safe_close(children[i].fd, __FILE__, __LINE__);
-    hangup(children[i].pid);
+    safe_close(tables.children[i].fd, __FILE__, __LINE__);
+    hangup(tables.children[i].pid);
 }
 
 
+static size_t num_reads_paused = 0;
+
 static void
 remove_children(ChildMonitor *self) {
-    if (self->count > 0) {
-        size_t count = 0;
-        for (ssize_t i = self->count - 1; i >= 0; i--) {
-            if (children[i].needs_removal) {
-                count++;
-                cleanup_child(i);
-                remove_queue[remove_queue_count] = children[i];
-                remove_queue_count++;
-                children[i] = EMPTY_CHILD;
-                children_fds[EXTRA_FDS + i].fd = -1;
-                size_t num_to_right = self->count - 1 - i;
-                if (num_to_right > 0) {
-                    memmove(children + i, children + i + 1, num_to_right * sizeof(Child));
-                    memmove(children_fds + EXTRA_FDS + i, children_fds + EXTRA_FDS + i + 1, num_to_right * sizeof(struct pollfd));
-                }
-            }
+    size_t count = 0;
+    for (size_t i = 0; i < self->count; i++) {
+        if (tables.children[i].needs_removal) {
+            count++;
+            if (!(tables.children_fds[EXTRA_FDS + i].events & POLLIN)) num_reads_paused--;
+            // also waits for any read into the screen's buffer to finish
+            io_poller_remove(&io_poller, EXTRA_FDS + i);
+            cleanup_child(i);
+            remove_child_index(tables.children[i].id);
+            ensure_space_for(&tables, remove_queue, Child, remove_queue_count + 1, remove_queue_capacity, 64, true);
+            tables.remove_queue[remove_queue_count] = tables.children[i];
+            remove_queue_count++;
+            tables.children[i] = EMPTY_CHILD;
+            tables.children_fds[EXTRA_FDS + i].fd = -1;
+        } else if (count) {
+            tables.children[i - count] = tables.children[i];
+            set_child_index(tables.children[i].id, i - count);
+            tables.children_fds[EXTRA_FDS + i - count] = tables.children_fds[EXTRA_FDS + i];
+            io_poller_slot_moved(&io_poller, EXTRA_FDS + i, EXTRA_FDS + i - count);
+            tables.children[i] = EMPTY_CHILD;
+            tables.children_fds[EXTRA_FDS + i].fd = -1;
         }
-        self->count -= count;
     }
+    self->count -= count;
 }
 
+// Read buffers {{{
+// A screen starts with a small read buffer, which grows while the child
+// writes faster than the main thread parses and is shrunk back once the
+// child has been quiet for INPUT_BUF_IDLE_TIME. Only the I/O thread resizes
+// it, with read_buf_lock held and never while a read targets it.
+
+// Only used by the I/O thread
+static bool grown_read_bufs = false;
+static monotonic_t last_read_buf_sweep_at = 0;
+
+static void
+resize_read_buf(Screen *screen, size_t capacity) {
+    uint8_t *buf = realloc(screen->read_buf, capacity);
+    if (!buf) return;
+    screen->read_buf = buf; screen->read_buf_capacity = capacity;
+    if (capacity > READ_BUF_MIN_SZ) grown_read_bufs = true;
+}
+
+static void
+ensure_read_buf_space(Screen *screen) {
+    // Called with read_buf_lock held. A buffer that is more than half full
+    // means the main thread is not keeping up.
+    if (!screen->read_buf) resize_read_buf(screen, READ_BUF_MIN_SZ);
+    else if (screen->read_buf_sz >= screen->read_buf_capacity / 2 && screen->read_buf_capacity < READ_BUF_SZ) {
+        resize_read_buf(screen, MIN((size_t)READ_BUF_SZ, 2 * screen->read_buf_capacity));
+    }
+}
+
+static void
+shrink_idle_read_bufs(size_t count, monotonic_t now) {
+    grown_read_bufs = false;
+    for (size_t i = 0; i < count; i++) {
+        Screen *screen = tables.children[i].screen;
+        screen_mutex(lock, read);
+        const bool grown = screen->read_buf_capacity > READ_BUF_MIN_SZ;
+        const bool idle = !screen->read_buf_sz && now - screen->last_read_at >= INPUT_BUF_IDLE_TIME;
+        screen_mutex(unlock, read);
+        if (!grown) continue;
+        if (!idle || !io_poller_cancel_read(&io_poller, EXTRA_FDS + i)) { grown_read_bufs = true; continue; }
+        // The main thread only ever consumes from the buffer, so it is still empty
+        screen_mutex(lock, read);
+        resize_read_buf(screen, READ_BUF_MIN_SZ);
+        screen_mutex(unlock, read);
+        update_child_events(i);
+    }
+}
+// }}}
+
+static void
+update_child_events(size_t i) {
+    Screen *screen = tables.children[i].screen;
+    const bool read_outstanding = io_poller_read_pending(&io_poller, EXTRA_FDS + i);
+    screen_mutex(lock, read); screen_mutex(lock, write);
+    // read_bytes() makes space for itself, with io_uring it has to be made
+    // before the read is submitted
+    if (io_poller.kind == IO_POLLER_URING && !read_outstanding) ensure_read_buf_space(screen);
+    const size_t read_buf_sz = screen->read_buf_sz, read_buf_space = screen->read_buf_capacity - read_buf_sz;
+    uint8_t *read_buf = screen->read_buf;
+    const short events = (read_buf_sz < READ_BUF_SZ ? POLLIN : 0) | (screen->write_queue.pending.used ? POLLOUT  : 0);
+    screen_mutex(unlock, read); screen_mutex(unlock, write);
+    if ((tables.children_fds[EXTRA_FDS + i].events ^ events) & POLLIN) {
+        if (events & POLLIN) num_reads_paused--;
+        else num_reads_paused++;
+    }
+    if (io_poller.kind == IO_POLLER_URING && events & POLLIN && !read_outstanding && read_buf_space) {
+        // The same region read_bytes() would read into, see commit_read()
+        io_poller_submit_read(&io_poller, EXTRA_FDS + i, read_buf + read_buf_sz, read_buf_space);
+    }
+    io_poller_set_events(&io_poller, EXTRA_FDS + i, events);
+}
+
+
+// Set by commit_read() when a read is the echo of a key, only used by the
+// I/O thread
+static bool echo_read = false;
+
+static bool
+main_loop_wakeup_due(monotonic_t now, monotonic_t last_wakeup_at) {
+    // we only wakeup the main loop after input_delay as wakeup is an expensive operation
+    // on some platforms, such as cocoa, except to show the echo of a key
+    return echo_read || now - last_wakeup_at > OPT(input_delay);
+}
+
+static void
+commit_read(Screen *screen, size_t orig_sz, size_t len) {
+    // The read was done without holding the lock into the space after
+    // orig_sz, which the parser never touches
+    screen_mutex(lock, read);
+    screen->last_read_at = monotonic();
+    if (screen->new_input_at == 0) screen->new_input_at = screen->last_read_at;
+    if (orig_sz != screen->read_buf_sz) {
+        // The other thread consumed some of the screen read buffer
+        memmove(screen->read_buf + screen->read_buf_sz, screen->read_buf + orig_sz, len);
+    }
+    screen->read_buf_sz += len;
+    // the first read after a key was sent to the child is taken to be its echo
+    if (__atomic_exchange_n(&screen->echo_expected, false, __ATOMIC_ACQ_REL)) screen->echo_received = echo_read = true;
+    screen_mutex(unlock, read);
+}
+
+static bool
+take_completed_read(size_t i) {
+    uint8_t *buf; ssize_t len;
+    if (!io_poller_take_read(&io_poller, EXTRA_FDS + i, &buf, &len)) return true;
+    if (len < 0) {
+        if (len == -EINTR || len == -EAGAIN || len == -ECANCELED) return true;
+        if (len != -EIO) log_error("Read from child fd failed with error: %s", strerror(-len));
+        return false;
+    }
+    if (UNLIKELY(len == 0)) return false;
+    Screen *screen = tables.children[i].screen;
+    commit_read(screen, buf - screen->read_buf, len);
+    return true;
+}
 
 static bool
 read_bytes(int fd, Screen *screen) {
@@ -1229,13 +1779,15 @@ read_bytes(int fd, Screen *screen) {
     size_t available_buffer_space, orig_sz;
 
     screen_mutex(lock, read);
+    ensure_read_buf_space(screen);
     orig_sz = screen->read_buf_sz;
-    if (orig_sz >= READ_BUF_SZ) { screen_mutex(unlock, read); return true; }  // screen read buffer is full
-    available_buffer_space = READ_BUF_SZ - orig_sz;
+    if (orig_sz >= screen->read_buf_capacity) { screen_mutex(unlock, read); return true; }  // screen read buffer is full
+    available_buffer_space = screen->read_buf_capacity - orig_sz;
+    uint8_t *buf = screen->read_buf + orig_sz;
     screen_mutex(unlock, read);
 
     while(true) {
-        len = read(fd, screen->read_buf + orig_sz, available_buffer_space);
+        len = read(fd, buf, available_buffer_space);
         if (len < 0) {
             if (errno == EINTR || errno == EAGAIN) continue;
             if (errno != EIO) perror("Call to read() from child fd failed");
@@ -1244,15 +1796,7 @@ read_bytes(int fd, Screen *screen) {
         break;
     }
     if (UNLIKELY(len == 0)) return false;
-
-    screen_mutex(lock, read);
-    if (screen->new_input_at == 0) screen->new_input_at = monotonic();
-    if (orig_sz != screen->read_buf_sz) {
-        // The other thread consumed some of the screen read buffer
-        memmove(screen->read_buf + screen->read_buf_sz, screen->read_buf + orig_sz, len);
-    }
-    screen->read_buf_sz += len;
-    screen_mutex(unlock, read);
+    commit_read(screen, orig_sz, len);
     return true;
 }
 
@@ -1287,8 +1831,8 @@ static void
 mark_child_for_removal(ChildMonitor *self, pid_t pid) {
     children_mutex(lock);
     for (size_t i = 0; i < self->count; i++) {
-        if (children[i].pid == pid) {
-            children[i].needs_removal = true;
+        if (tables.children[i].pid == pid) {
+            tables.children[i].needs_removal = true;
             break;
         }
     }
@@ -1342,19 +1886,21 @@ print_text(const unsigned char *text, ssize_t sz) {
 
 static void
 write_to_child(int fd, Screen *screen) {
-    size_t written = 0;
+    struct iovec iov[64];
     ssize_t ret = 0;
     screen_mutex(lock, write);
-    while (written < screen->write_buf_used) {
-        ret = write(fd, screen->write_buf + written, screen->write_buf_used - written);
+    WriteQueue *q = &screen->write_queue;
+    while (q->pending.used) {
+        const size_t num = write_queue_iovecs(q, iov, arraysz(iov));
+        ret = writev(fd, iov, num);
 #ifdef ALATTY_PRINT_BYTES_SENT_TO_CHILD
         fprintf(stderr, "Wrote: %zd bytes: ", ret);
 #endif
         if (ret > 0) {
 #ifdef ALATTY_PRINT_BYTES_SENT_TO_CHILD
-            print_text(screen->write_buf + written, ret);
+            for (size_t i = 0, left = ret; i < num && left; left -= MIN(left, iov[i].iov_len), i++) print_text(iov[i].iov_base, MIN(left, iov[i].iov_len));
 #endif
-            written += ret;
+            write_queue_consume(q, ret);
         }
         else if (ret == 0) {
             // could mean anything, ignore
@@ -1363,19 +1909,21 @@ write_to_child(int fd, Screen *screen) {
             if (errno == EINTR) continue;
             if (errno == EWOULDBLOCK || errno == EAGAIN) break;
             perror("Call to write() to child fd failed, discarding data.");
-            written = screen->write_buf_used;
+            write_queue_consume(q, q->pending.used);
         }
 #ifdef ALATTY_PRINT_BYTES_SENT_TO_CHILD
         fprintf(stderr, "\n");
 #endif
     }
-    if (written) {
-        screen->write_buf_used -= written;
-        if (screen->write_buf_used) {
-            memmove(screen->write_buf, screen->write_buf + written, screen->write_buf_used);
-        }
-    }
+    const bool stream_needs_data = q->stream_active && q->pending.used < STREAM_HIGH_WATER / 2;
+    const bool has_consumed = q->consumed != NULL;
     screen_mutex(unlock, write);
+    if (stream_needs_data) {
+        children_mutex(lock);
+        pthread_cond_broadcast(&stream_space_cond);
+        children_mutex(unlock);
+    }
+    if (has_consumed && !__atomic_exchange_n(&written_borrowed_chunks, true, __ATOMIC_ACQ_REL)) wakeup_main_loop();
 }
 
 static void*
@@ -1385,38 +1933,44 @@ io_loop(void *data) {
     int ret;
     bool has_more, data_received, has_pending_wakeups = false;
     monotonic_t last_main_loop_wakeup_at = -1, now = -1;
-    Screen *screen;
     ChildMonitor *self = (ChildMonitor*)data;
     set_thread_name("AlattyChildMon");
+    if (!init_io_poller(&io_poller, tables.children_fds, tables.children_capacity + EXTRA_FDS, OPT(io_backend))) fatal("Out of memory allocating I/O poller");
+    io_poller_add(&io_poller, 0); io_poller_add(&io_poller, 1);
 
     while (LIKELY(!self->shutting_down)) {
         children_mutex(lock);
+        while (interest_queue_count) {
+            i = tables.interest_queue[--interest_queue_count];
+            tables.children[i].interest_queued = false;
+            update_child_events(i);
+        }
         remove_children(self);
         add_children(self);
         children_mutex(unlock);
         data_received = false;
-        for (i = 0; i < self->count + EXTRA_FDS; i++) children_fds[i].revents = 0;
-        for (i = 0; i < self->count; i++) {
-            screen = children[i].screen;
-            /* printf("i:%lu id:%lu fd: %d read_buf_sz: %lu write_buf_used: %lu\n", i, children[i].id, children[i].fd, screen->read_buf_sz, screen->write_buf_used); */
-            screen_mutex(lock, read); screen_mutex(lock, write);
-            children_fds[EXTRA_FDS + i].events = (screen->read_buf_sz < READ_BUF_SZ ? POLLIN : 0) | (screen->write_buf_used ? POLLOUT  : 0);
-            screen_mutex(unlock, read); screen_mutex(unlock, write);
+        // With epoll and io_uring, events change only when buffers fill or
+        // drain, poll() needs them for every child every time
+        if (io_poller.kind == IO_POLLER_POLL) {
+            for (i = 0; i < self->count; i++) update_child_events(i);
+        } else if (num_reads_paused) {
+            // the main thread may have emptied read buffers that were full
+            for (i = 0; i < self->count; i++) if (!(tables.children_fds[EXTRA_FDS + i].events & POLLIN)) update_child_events(i);
         }
         if (has_pending_wakeups) {
             now = monotonic();
             monotonic_t time_delta = OPT(input_delay) - (now - last_main_loop_wakeup_at);
-            if (time_delta >= 0) ret = poll(children_fds, self->count + EXTRA_FDS, monotonic_t_to_ms(time_delta));
+            if (time_delta >= 0) ret = io_poller_wait(&io_poller, self->count + EXTRA_FDS, monotonic_t_to_ms(time_delta));
             else ret = 0;
         } else {
-            ret = poll(children_fds, self->count + EXTRA_FDS, -1);
+            ret = io_poller_wait(&io_poller, self->count + EXTRA_FDS, grown_read_bufs ? monotonic_t_to_ms(INPUT_BUF_IDLE_TIME) : -1);
         }
         if (ret > 0) {
-            if (children_fds[0].revents && POLLIN) drain_fd(children_fds[0].fd); // wakeup
-            if (children_fds[1].revents && POLLIN) {
+            if (tables.children_fds[0].revents && POLLIN) drain_fd(tables.children_fds[0].fd); // wakeup
+            if (tables.children_fds[1].revents && POLLIN) {
                 SignalSet ss = {0};
                 data_received = true;
-                read_signals(children_fds[1].fd, handle_signal, &ss);
+                read_signals(tables.children_fds[1].fd, handle_signal, &ss);
                 if (ss.kill_signal || ss.reload_config) {
                     children_mutex(lock);
                     if (ss.kill_signal) kill_signal_received = true;
@@ -1425,31 +1979,35 @@ io_loop(void *data) {
                 }
                 if (ss.child_died) reap_children(self, OPT(close_on_child_death));
             }
-            for (i = 0; i < self->count; i++) {
-                if (children_fds[EXTRA_FDS + i].revents & (POLLIN | POLLHUP)) {
+            for (size_t r = 0; r < io_poller.num_ready; r++) {
+                if (io_poller.ready[r] < EXTRA_FDS) continue;
+                i = io_poller.ready[r] - EXTRA_FDS;
+                if (tables.children_fds[EXTRA_FDS + i].revents & (POLLIN | POLLHUP)) {
                     data_received = true;
-                    has_more = read_bytes(children_fds[EXTRA_FDS + i].fd, children[i].screen);
+                    if (io_poller.kind == IO_POLLER_URING) has_more = take_completed_read(i);
+                    else has_more = read_bytes(tables.children_fds[EXTRA_FDS + i].fd, tables.children[i].screen);
                     if (!has_more) {
                         // child is dead
                         children_mutex(lock);
-                        children[i].needs_removal = true;
+                        tables.children[i].needs_removal = true;
                         children_mutex(unlock);
                     }
                 }
-                if (children_fds[EXTRA_FDS + i].revents & POLLOUT) {
-                    write_to_child(children[i].fd, children[i].screen);
+                if (tables.children_fds[EXTRA_FDS + i].revents & POLLOUT) {
+                    write_to_child(tables.children[i].fd, tables.children[i].screen);
                 }
-                if (children_fds[EXTRA_FDS + i].revents & POLLNVAL) {
+                if (tables.children_fds[EXTRA_FDS + i].revents & POLLNVAL) {
                     // fd was closed
                     children_mutex(lock);
-                    children[i].needs_removal = true;
+                    tables.children[i].needs_removal = true;
                     children_mutex(unlock);
-                    log_error("The child %lu had its fd unexpectedly closed", children[i].id);
+                    log_error("The child %lu had its fd unexpectedly closed", tables.children[i].id);
                 }
+                if (io_poller.kind != IO_POLLER_POLL) update_child_events(i);
             }
 #ifdef DEBUG_POLL_EVENTS
             for (i = 0; i < self->count + EXTRA_FDS; i++) {
-#define P(w) if (children_fds[i].revents & w) printf("i:%lu %s\n", i, #w);
+#define P(w) if (tables.children_fds[i].revents & w) printf("i:%lu %s\n", i, #w);
                 P(POLLIN); P(POLLPRI); P(POLLOUT); P(POLLERR); P(POLLHUP); P(POLLNVAL);
 #undef P
             }
@@ -1459,21 +2017,25 @@ io_loop(void *data) {
                 perror("Call to poll() failed");
             }
         }
-#define WAKEUP { wakeup_main_loop(); last_main_loop_wakeup_at = now; has_pending_wakeups = false; }
-        // we only wakeup the main loop after input_delay as wakeup is an expensive operation
-        // on some platforms, such as cocoa
+#define WAKEUP { wakeup_main_loop(); last_main_loop_wakeup_at = now; has_pending_wakeups = false; echo_read = false; }
         if (data_received) {
-            if ((now = monotonic()) - last_main_loop_wakeup_at > OPT(input_delay)) WAKEUP
+            if (main_loop_wakeup_due((now = monotonic()), last_main_loop_wakeup_at)) WAKEUP
             else has_pending_wakeups = true;
         } else {
-            if (has_pending_wakeups && (now = monotonic()) - last_main_loop_wakeup_at > OPT(input_delay)) WAKEUP
+            if (has_pending_wakeups && main_loop_wakeup_due((now = monotonic()), last_main_loop_wakeup_at)) WAKEUP
+        }
+        if (grown_read_bufs && (now = monotonic()) - last_read_buf_sweep_at >= INPUT_BUF_IDLE_TIME) {
+            last_read_buf_sweep_at = now;
+            shrink_idle_read_bufs(self->count, now);
         }
     }
 #undef WAKEUP
     children_mutex(lock);
-    for (i = 0; i < self->count; i++) children[i].needs_removal = true;
+    for (i = 0; i < self->count; i++) tables.children[i].needs_removal = true;
     remove_children(self);
+    interest_queue_count = 0;
     children_mutex(unlock);
+    free_io_poller(&io_poller);
     return 0;
 }
 // }}}
@@ -1757,6 +2319,189 @@ send_response_to_peer(id_type peer_id, const char *msg, size_t msg_sz) {
 
 // }}}
 
+// Echo latency benchmark {{{
+// Measures the time from a key being sent to a child to the frame that shows
+// its echo, without a window system. The child is the line discipline of a
+// pty, which echoes input at once. The I/O side does what io_loop() does for
+// a single child, using read_bytes(), write_to_child() and
+// main_loop_wakeup_due(). The main loop is a pipe the I/O side writes to, with
+// the timeouts set through set_maximum_wait(), as with the state check timer.
+// A frame is the render() after the parse that contains the echo, with no OS
+// windows it draws nothing.
+
+typedef struct {
+    Screen *screen;
+    int master, slave, io_wakeup[2], main_wakeup[2];
+    bool stop;
+} EchoBench;
+
+static void*
+echo_bench_io_loop(void *data) {
+    EchoBench *b = data;
+    Screen *screen = b->screen;
+    monotonic_t last_wakeup_at = -1;
+    bool has_pending_wakeups = false;
+    char discard[256];
+    while (!__atomic_load_n(&b->stop, __ATOMIC_ACQUIRE)) {
+        screen_mutex(lock, write);
+        const bool has_pending_writes = screen->write_queue.pending.used > 0;
+        screen_mutex(unlock, write);
+        struct pollfd fds[3] = {
+            {.fd = b->io_wakeup[0], .events = POLLIN},
+            {.fd = b->master, .events = POLLIN | (has_pending_writes ? POLLOUT : 0)},
+            {.fd = b->slave, .events = POLLIN},
+        };
+        int timeout = -1;
+        if (has_pending_wakeups) timeout = MAX(0, monotonic_t_to_ms(OPT(input_delay) - (monotonic() - last_wakeup_at)));
+        if (poll(fds, arraysz(fds), timeout) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        bool data_received = false;
+        if (fds[0].revents & POLLIN) drain_fd(fds[0].fd);
+        // nothing reads the input of the child, drop it so that it keeps echoing
+        if (fds[2].revents & POLLIN) while (read(b->slave, discard, sizeof(discard)) > 0);
+        if (fds[1].revents & POLLOUT) write_to_child(b->master, screen);
+        if (fds[1].revents & POLLIN) { data_received = true; read_bytes(b->master, screen); }
+        const monotonic_t now = monotonic();
+        if ((data_received || has_pending_wakeups) && main_loop_wakeup_due(now, last_wakeup_at)) {
+            last_wakeup_at = now; has_pending_wakeups = false; echo_read = false;
+            while (write(b->main_wakeup[1], "w", 1) < 0 && errno == EINTR);
+        } else if (data_received) has_pending_wakeups = true;
+    }
+    return NULL;
+}
+
+static bool
+open_echoing_pty(EchoBench *b) {
+    if ((b->master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC)) < 0) return false;
+    if (grantpt(b->master) != 0 || unlockpt(b->master) != 0) return false;
+    const char *name = ptsname(b->master);
+    if (!name || (b->slave = open(name, O_RDWR | O_NOCTTY | O_CLOEXEC | O_NONBLOCK)) < 0) return false;
+    struct termios t;
+    if (tcgetattr(b->slave, &t) != 0) return false;
+    // echo every key as it arrives, not a line at a time
+    t.c_lflag &= ~ICANON; t.c_lflag |= ECHO;
+    t.c_cc[VMIN] = 1; t.c_cc[VTIME] = 0;
+    if (tcsetattr(b->slave, TCSANOW, &t) != 0) return false;
+    return fcntl(b->master, F_SETFL, fcntl(b->master, F_GETFL) | O_NONBLOCK) == 0;
+}
+
+static int
+compare_latencies(const void *a, const void *b) {
+    const monotonic_t x = *(const monotonic_t*)a, y = *(const monotonic_t*)b;
+    return (x > y) - (x < y);
+}
+
+static PyObject*
+test_echo_latency(PyObject UNUSED *self, PyObject *args) {
+    unsigned int samples = 1000;
+    int low_latency = 1;
+    double input_delay_ms = 3, key_interval_ms = 20;
+    if (!PyArg_ParseTuple(args, "|Ipdd", &samples, &low_latency, &input_delay_ms, &key_interval_ms)) return NULL;
+    if (!samples) { PyErr_SetString(PyExc_ValueError, "samples must be positive"); return NULL; }
+    // the I/O side uses the same state as the real I/O thread
+    if (the_monitor) { PyErr_SetString(PyExc_RuntimeError, "Cannot run while a ChildMonitor exists"); return NULL; }
+    RAII_ALLOC(monotonic_t, latencies, calloc(samples, sizeof(monotonic_t)));
+    if (!latencies) return PyErr_NoMemory();
+    RAII_PyObject(screen_, PyObject_CallFunction((PyObject*)&Screen_Type, NULL));
+    if (!screen_) return NULL;
+    Screen *screen = (Screen*)screen_;
+    EchoBench b = {.screen = screen, .master = -1, .slave = -1, .io_wakeup = {-1, -1}, .main_wakeup = {-1, -1}};
+    ChildMonitor monitor = {.dump_callback = NULL};
+    const monotonic_t saved_input_delay = OPT(input_delay);
+    const bool saved_low_latency_echo = OPT(low_latency_echo);
+    size_t (*saved_parse_func)(Screen*, PyObject*, monotonic_t, size_t, size_t) = parse_func;
+    PyObject *ans = NULL, *hist = NULL;
+    pthread_t io_thread;
+    bool thread_started = false;
+
+    if (!open_echoing_pty(&b) || !self_pipe(b.io_wakeup, true) || !self_pipe(b.main_wakeup, true)) { PyErr_SetFromErrno(PyExc_OSError); goto end; }
+    // do_parse() wakes the I/O side through this when the read buffer was full
+#ifdef HAS_EVENT_FD
+    monitor.io_loop_data.wakeup_read_fd = b.io_wakeup[1];
+#else
+    monitor.io_loop_data.wakeup_fds[1] = b.io_wakeup[1];
+#endif
+    OPT(input_delay) = ms_double_to_monotonic_t(input_delay_ms);
+    OPT(low_latency_echo) = low_latency;
+    parse_func = parse_worker;
+    int ret = pthread_create(&io_thread, NULL, echo_bench_io_loop, &b);
+    if (ret != 0) { PyErr_Format(PyExc_OSError, "Failed to start I/O thread with error: %s", strerror(ret)); goto end; }
+    thread_started = true;
+
+    for (unsigned s = 0; s < samples; s++) {
+        const char key = 'a' + s % 26;
+        const unsigned long long expected = screen->parse_stats.bytes + 1;
+        const monotonic_t start = monotonic();
+        // what send_key_to_child() does
+        screen->last_key_input_at = start;
+        if (OPT(low_latency_echo)) __atomic_store_n(&screen->echo_expected, true, __ATOMIC_RELEASE);
+        screen_mutex(lock, write);
+        if (!write_queue_append(&screen->write_queue, &key, 1)) fatal("Out of memory.");
+        screen_mutex(unlock, write);
+        while (write(b.io_wakeup[1], "w", 1) < 0 && errno == EINTR);
+        // the main loop, until the frame with the echo
+        monotonic_t timeout = -1;
+        while (screen->parse_stats.bytes < expected) {
+            struct pollfd pfd = {.fd = b.main_wakeup[0], .events = POLLIN};
+            if (poll(&pfd, 1, timeout < 0 ? 1000 : monotonic_t_to_ms(timeout)) == 0 && timeout < 0) {
+                PyErr_SetString(PyExc_TimeoutError, "The pty did not echo a key within a second"); goto end;
+            }
+            if (pfd.revents & POLLIN) drain_fd(pfd.fd);
+            maximum_wait = -1;
+            const monotonic_t now = monotonic();
+            render(now, do_parse(&monitor, screen, now, false, 0));
+            timeout = maximum_wait;
+        }
+        const monotonic_t frame_at = monotonic();
+        latencies[s] = frame_at - start;
+        const monotonic_t next_key_at = start + ms_double_to_monotonic_t(key_interval_ms);
+        if (next_key_at > frame_at) {
+            struct timespec ts = {.tv_sec = (next_key_at - frame_at) / 1000000000ll, .tv_nsec = (next_key_at - frame_at) % 1000000000ll};
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    qsort(latencies, samples, sizeof(latencies[0]), compare_latencies);
+    // power of two buckets, the first one holds everything below 16us
+    unsigned long long histogram[24] = {0};
+    monotonic_t total = 0;
+    for (unsigned s = 0; s < samples; s++) {
+        total += latencies[s];
+        unsigned bucket = 0;
+        for (monotonic_t us = latencies[s] / 1000; us >= 16 && bucket < arraysz(histogram) - 1; us >>= 1) bucket++;
+        histogram[bucket]++;
+    }
+    if (!(hist = PyList_New(0))) goto end;
+    for (unsigned i = 0; i < arraysz(histogram); i++) {
+        if (!histogram[i]) continue;
+        RAII_PyObject(entry, Py_BuildValue("KK", i ? 8ull << i : 0ull, histogram[i]));
+        if (!entry || PyList_Append(hist, entry) != 0) goto end;
+    }
+#define US(x) ((double)(x) / 1000.)
+    ans = Py_BuildValue("{sI sO sd sd sd sd sd sO}", "samples", samples, "low_latency", low_latency ? Py_True : Py_False,
+            "mean_us", US(total / samples), "p50_us", US(latencies[samples / 2]),
+            "p90_us", US(latencies[samples * 9 / 10]), "p99_us", US(latencies[samples * 99 / 100]),
+            "max_us", US(latencies[samples - 1]), "histogram", hist);
+#undef US
+end:
+    if (thread_started) {
+        __atomic_store_n(&b.stop, true, __ATOMIC_RELEASE);
+        while (write(b.io_wakeup[1], "w", 1) < 0 && errno == EINTR);
+        pthread_join(io_thread, NULL);
+    }
+    echo_read = false;
+    OPT(input_delay) = saved_input_delay;
+    OPT(low_latency_echo) = saved_low_latency_echo;
+    parse_func = saved_parse_func;
+    int fds[] = {b.master, b.slave, b.io_wakeup[0], b.io_wakeup[1], b.main_wakeup[0], b.main_wakeup[1]};
+    for (unsigned i = 0; i < arraysz(fds); i++) if (fds[i] > -1) safe_close(fds[i], __FILE__, __LINE__);
+    Py_XDECREF(hist);
+    return ans;
+}
+// }}}
+
 // Boilerplate {{{
 static PyMethodDef methods[] = {
     METHOD(add_child, METH_VARARGS)
@@ -1812,6 +2557,7 @@ static PyMethodDef module_methods[] = {
     METHODB(send_data_to_peer, METH_VARARGS),
     METHODB(mask_alatty_signals_process_wide, METH_NOARGS),
     {"sigqueue", (PyCFunction)sig_queue, METH_VARARGS, ""},
+    METHODB(test_echo_latency, METH_VARARGS),
     {NULL}  /* Sentinel */
 };
 
@@ -15,6 +15,8 @@
 #include <signal.h>
 #include <sys/ioctl.h>
 #include <termios.h>
+#include <spawn.h>
+#include <sys/syscall.h>
 
 static char**
 serialize_string_tuple(PyObject *src) {
@@ -65,7 +67,9 @@ write_to_stderr(const char *text) {
     }
 }
 
-#define exit_on_err(m) { write_to_stderr(m); write_to_stderr(": "); write_to_stderr(strerror(errno)); exit(EXIT_FAILURE); }
+// Only async-signal-safe functions may be used in the child (man 7
+// signal-safety)
+#define exit_on_err(m) { write_to_stderr(m); write_to_stderr(": "); write_to_stderr(strerror(errno)); _exit(EXIT_FAILURE); }
 
 static void
 wait_for_terminal_ready(int fd) {
@@ -77,119 +81,480 @@ wait_for_terminal_ready(int fd) {
     }
 }
 
+static void
+close_fds_from(int first) {
+#ifdef SYS_close_range
+    if (syscall(SYS_close_range, (unsigned)first, ~0u, 0u) == 0) return;
+#endif
+    for (int c = first; c < 201; c++) safe_close(c, __FILE__, __LINE__);
+}
+
+typedef struct {
+    const char *exe, *cwd, *tty_name, *kitten_exe;
+    char **argv, **env;
+    int master, slave, stdin_read_fd, stdin_write_fd, ready_read_fd, ready_write_fd, forward_stdio;
+    const int *handled_signals;
+    int num_handled_signals;
+} ChildSpec;
+
+__attribute__((noreturn)) static void
+run_child(const ChildSpec *s) {
+    const struct sigaction act = {.sa_handler=SIG_DFL};
+#define SA(which)  if (sigaction(which, &act, NULL) != 0) exit_on_err("sigaction() in child process failed");
+    for (int si = 0; si < s->num_handled_signals; si++) { SA(s->handled_signals[si]); }
+    // See _Py_RestoreSignals in signalmodule.c for a list of signals python nukes
+#ifdef SIGPIPE
+    SA(SIGPIPE)
+#endif
+#ifdef SIGXFSZ
+    SA(SIGXFSZ);
+#endif
+#ifdef SIGXFZ
+    SA(SIGXFZ);
+#endif
+#undef SA
+    sigset_t signals; sigemptyset(&signals);
+    if (sigprocmask(SIG_SETMASK, &signals, NULL) != 0) exit_on_err("sigprocmask() in child process failed");
+    if (chdir(s->cwd) != 0) { if (chdir("/") != 0) {} };  // ignore failure to chdir to /
+    if (setsid() == -1) exit_on_err("setsid() in child process failed");
+
+    // Establish the controlling terminal (see man 7 credentials)
+    int tfd = safe_open(s->tty_name, O_RDWR | O_CLOEXEC, 0);
+    if (tfd == -1) exit_on_err("Failed to open controlling terminal");
+    // On BSD open() does not establish the controlling terminal
+    if (ioctl(tfd, TIOCSCTTY, 0) == -1) exit_on_err("Failed to set controlling terminal with TIOCSCTTY");
+    safe_close(tfd, __FILE__, __LINE__);
+
+    int min_closed_fd = 3;
+    if (s->forward_stdio) {
+        if (safe_dup2(STDOUT_FILENO, min_closed_fd++) == -1) exit_on_err("dup2() failed for forwarded fd 1");
+        if (safe_dup2(STDERR_FILENO, min_closed_fd++) == -1) exit_on_err("dup2() failed for forwarded fd 2");
+    }
+    // Redirect stdin/stdout/stderr to the pty
+    if (safe_dup2(s->slave, STDOUT_FILENO) == -1) exit_on_err("dup2() failed for fd number 1");
+    if (safe_dup2(s->slave, STDERR_FILENO) == -1) exit_on_err("dup2() failed for fd number 2");
+    if (s->stdin_read_fd > -1) {
+        if (safe_dup2(s->stdin_read_fd, STDIN_FILENO) == -1) exit_on_err("dup2() failed for fd number 0");
+        safe_close(s->stdin_read_fd, __FILE__, __LINE__);
+        safe_close(s->stdin_write_fd, __FILE__, __LINE__);
+    } else {
+        if (safe_dup2(s->slave, STDIN_FILENO) == -1) exit_on_err("dup2() failed for fd number 0");
+    }
+    safe_close(s->slave, __FILE__, __LINE__);
+    safe_close(s->master, __FILE__, __LINE__);
+    safe_close(s->ready_write_fd, __FILE__, __LINE__);
+
+    // Wait for READY_SIGNAL which indicates alatty has setup the screen object
+    wait_for_terminal_ready(s->ready_read_fd);
+    safe_close(s->ready_read_fd, __FILE__, __LINE__);
+
+    // Close any extra fds inherited from parent
+    close_fds_from(min_closed_fd);
+
+    environ = s->env;
+    execvp(s->exe, s->argv);
+    // Report the failure and exec kitten instead, so that we are not left
+    // with a forked but not exec'ed process
+    write_to_stderr("Failed to launch child: ");
+    write_to_stderr(s->exe);
+    write_to_stderr("\nWith error: ");
+    write_to_stderr(strerror(errno));
+    write_to_stderr("\n");
+    execlp(s->kitten_exe, "kitten", "__hold_till_enter__", NULL);
+    _exit(EXIT_FAILURE);
+}
+#undef exit_on_err
+
+// posix_spawn() {{{
+// posix_spawn() does not copy the page tables of this, potentially very
+// large, process. It cannot run any code of ours between setsid() and exec,
+// so the child is kitten __wait_for_ready__, which makes the pty the
+// controlling terminal, changes to cwd, waits for the terminal to be ready
+// and then execs the actual child.
+#ifdef POSIX_SPAWN_SETSID
+#define HAS_POSIX_SPAWN_SETSID
+
+static char**
+trampoline_argv(const ChildSpec *s, int ready_fd) {
+    size_t argc = 0;
+    while (s->argv[argc]) argc++;
+    char **ans = calloc(argc + 6, sizeof(char*));
+    if (!ans) fatal("Out of memory");
+    char fd[16];
+    snprintf(fd, sizeof(fd), "%d", ready_fd);
+    ans[0] = strdup(s->kitten_exe); ans[1] = strdup("__wait_for_ready__"); ans[2] = strdup(fd); ans[3] = strdup(s->cwd); ans[4] = strdup(s->exe);
+    for (size_t i = 0; i < argc; i++) ans[i + 5] = strdup(s->argv[i]);
+    for (size_t i = 0; i < argc + 5; i++) if (!ans[i]) fatal("Out of memory");
+    return ans;
+}
+
+static int
+set_spawn_signals(const ChildSpec *s, posix_spawnattr_t *attr) {
+    // The same signals as in run_child(), exec takes care of the handlers
+    sigset_t defaults, mask;
+    sigemptyset(&defaults); sigemptyset(&mask);
+    for (int si = 0; si < s->num_handled_signals; si++) sigaddset(&defaults, s->handled_signals[si]);
+#ifdef SIGPIPE
+    sigaddset(&defaults, SIGPIPE);
+#endif
+#ifdef SIGXFSZ
+    sigaddset(&defaults, SIGXFSZ);
+#endif
+#ifdef SIGXFZ
+    sigaddset(&defaults, SIGXFZ);
+#endif
+    int ret = posix_spawnattr_setflags(attr, POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+    if (ret == 0) ret = posix_spawnattr_setsigdefault(attr, &defaults);
+    if (ret == 0) ret = posix_spawnattr_setsigmask(attr, &mask);
+    return ret;
+}
+
+static int
+set_spawn_fds(const ChildSpec *s, posix_spawn_file_actions_t *fa, int *ready_fd) {
+    // Gives the child the same fds as run_child(), except for the ready fd,
+    // which kitten closes before exec. The master, stdin_write_fd and
+    // ready_write_fd are close on exec.
+    int ret, min_closed_fd = 3;
+#define A(x) if ((ret = x) != 0) return ret;
+    if (s->forward_stdio) {
+        A(posix_spawn_file_actions_adddup2(fa, STDOUT_FILENO, min_closed_fd)); min_closed_fd++;
+        A(posix_spawn_file_actions_adddup2(fa, STDERR_FILENO, min_closed_fd)); min_closed_fd++;
+    }
+    // Redirect stdin/stdout/stderr to the pty
+    A(posix_spawn_file_actions_adddup2(fa, s->slave, STDOUT_FILENO));
+    A(posix_spawn_file_actions_adddup2(fa, s->slave, STDERR_FILENO));
+    A(posix_spawn_file_actions_adddup2(fa, s->stdin_read_fd > -1 ? s->stdin_read_fd : s->slave, STDIN_FILENO));
+    A(posix_spawn_file_actions_adddup2(fa, s->ready_read_fd, min_closed_fd));
+    *ready_fd = min_closed_fd;
+    const int inherited[] = {s->slave, s->stdin_read_fd, s->ready_read_fd};
+    for (size_t i = 0; i < arraysz(inherited); i++) {
+        if (inherited[i] > min_closed_fd) A(posix_spawn_file_actions_addclose(fa, inherited[i]));
+    }
+#if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#if __GLIBC_PREREQ(2, 34)
+    // Any other fds that were left inheritable
+    A(posix_spawn_file_actions_addclosefrom_np(fa, min_closed_fd + 1));
+#endif
+#endif
+#undef A
+    return 0;
+}
+
+static pid_t
+spawn_via_posix_spawn(const ChildSpec *s) {
+    posix_spawnattr_t attr; posix_spawn_file_actions_t fa;
+    pid_t pid = -1;
+    int ret = posix_spawnattr_init(&attr);
+    if (ret != 0) { errno = ret; return -1; }
+    if ((ret = posix_spawn_file_actions_init(&fa)) != 0) { posix_spawnattr_destroy(&attr); errno = ret; return -1; }
+    int ready_fd;
+    if ((ret = set_spawn_signals(s, &attr)) == 0 && (ret = set_spawn_fds(s, &fa, &ready_fd)) == 0) {
+        char **argv = trampoline_argv(s, ready_fd);
+        ret = posix_spawn(&pid, s->kitten_exe, &fa, &attr, argv, s->env);
+        free_string_tuple(argv);
+    }
+    posix_spawn_file_actions_destroy(&fa);
+    posix_spawnattr_destroy(&attr);
+    if (ret != 0) { errno = ret; return -1; }
+    return pid;
+}
+#endif
+// }}}
+
 static PyObject*
 spawn(PyObject *self UNUSED, PyObject *args) {
     PyObject *argv_p, *env_p, *handled_signals_p;
-    int master, slave, stdin_read_fd, stdin_write_fd, ready_read_fd, ready_write_fd, forward_stdio;
+    int master, slave, stdin_read_fd, stdin_write_fd, ready_read_fd, ready_write_fd, forward_stdio, use_posix_spawn = 0;
     const char *kitten_exe;
     char *cwd, *exe;
-    if (!PyArg_ParseTuple(args, "ssO!O!iiiiiiO!sp", &exe, &cwd, &PyTuple_Type, &argv_p, &PyTuple_Type, &env_p, &master, &slave, &stdin_read_fd, &stdin_write_fd, &ready_read_fd, &ready_write_fd, &PyTuple_Type, &handled_signals_p, &kitten_exe, &forward_stdio)) return NULL;
+    if (!PyArg_ParseTuple(args, "ssO!O!iiiiiiO!sp|p", &exe, &cwd, &PyTuple_Type, &argv_p, &PyTuple_Type, &env_p, &master, &slave, &stdin_read_fd, &stdin_write_fd, &ready_read_fd, &ready_write_fd, &PyTuple_Type, &handled_signals_p, &kitten_exe, &forward_stdio, &use_posix_spawn)) return NULL;
     char name[2048] = {0};
     if (ttyname_r(slave, name, sizeof(name) - 1) != 0) { PyErr_SetFromErrno(PyExc_OSError); return NULL; }
-    char **argv = serialize_string_tuple(argv_p);
-    char **env = serialize_string_tuple(env_p);
     int handled_signals[16] = {0}, num_handled_signals = MIN((int)arraysz(handled_signals), PyTuple_GET_SIZE(handled_signals_p));
     for (Py_ssize_t i = 0; i < num_handled_signals; i++) handled_signals[i] = PyLong_AsLong(PyTuple_GET_ITEM(handled_signals_p, i));
-
-#if PY_VERSION_HEX >= 0x03070000
-    PyOS_BeforeFork();
+    ChildSpec spec = {
+        .exe = exe, .cwd = cwd, .tty_name = name, .kitten_exe = kitten_exe,
+        .argv = serialize_string_tuple(argv_p), .env = serialize_string_tuple(env_p),
+        .master = master, .slave = slave, .stdin_read_fd = stdin_read_fd, .stdin_write_fd = stdin_write_fd,
+        .ready_read_fd = ready_read_fd, .ready_write_fd = ready_write_fd, .forward_stdio = forward_stdio,
+        .handled_signals = handled_signals, .num_handled_signals = num_handled_signals,
+    };
+    pid_t pid;
+#ifdef HAS_POSIX_SPAWN_SETSID
+    if (use_posix_spawn) {
+        if ((pid = spawn_via_posix_spawn(&spec)) == -1) PyErr_SetFromErrno(PyExc_OSError);
+    } else
 #endif
-    pid_t pid = fork();
-    switch(pid) {
-        case 0: {
-            // child
+    {
 #if PY_VERSION_HEX >= 0x03070000
-            PyOS_AfterFork_Child();
+        PyOS_BeforeFork();
 #endif
-            const struct sigaction act = {.sa_handler=SIG_DFL};
-
-#define SA(which)  if (sigaction(which, &act, NULL) != 0) exit_on_err("sigaction() in child process failed");
-            for (int si = 0; si < num_handled_signals; si++) { SA(handled_signals[si]); }
-            // See _Py_RestoreSignals in signalmodule.c for a list of signals python nukes
-#ifdef SIGPIPE
-            SA(SIGPIPE)
-#endif
-#ifdef SIGXFSZ
-            SA(SIGXFSZ);
-#endif
-#ifdef SIGXFZ
-            SA(SIGXFZ);
-#endif
-#undef SA
-            sigset_t signals; sigemptyset(&signals);
-            if (sigprocmask(SIG_SETMASK, &signals, NULL) != 0) exit_on_err("sigprocmask() in child process failed");
-            // Use only signal-safe functions (man 7 signal-safety)
-            if (chdir(cwd) != 0) { if (chdir("/") != 0) {} };  // ignore failure to chdir to /
-            if (setsid() == -1) exit_on_err("setsid() in child process failed");
-
-            // Establish the controlling terminal (see man 7 credentials)
-            int tfd = safe_open(name, O_RDWR | O_CLOEXEC, 0);
-            if (tfd == -1) exit_on_err("Failed to open controlling terminal");
-            // On BSD open() does not establish the controlling terminal
-            if (ioctl(tfd, TIOCSCTTY, 0) == -1) exit_on_err("Failed to set controlling terminal with TIOCSCTTY");
-            safe_close(tfd, __FILE__, __LINE__);
-
-            int min_closed_fd = 3;
-            if (forward_stdio) {
-                if (safe_dup2(STDOUT_FILENO, min_closed_fd++) == -1) exit_on_err("dup2() failed for forwarded fd 1");
-                if (safe_dup2(STDERR_FILENO, min_closed_fd++) == -1) exit_on_err("dup2() failed for forwarded fd 2");
-            }
-            // Redirect stdin/stdout/stderr to the pty
-            if (safe_dup2(slave, STDOUT_FILENO) == -1) exit_on_err("dup2() failed for fd number 1");
-            if (safe_dup2(slave, STDERR_FILENO) == -1) exit_on_err("dup2() failed for fd number 2");
-            if (stdin_read_fd > -1) {
-                if (safe_dup2(stdin_read_fd, STDIN_FILENO) == -1) exit_on_err("dup2() failed for fd number 0");
-                safe_close(stdin_read_fd, __FILE__, __LINE__);
-                safe_close(stdin_write_fd, __FILE__, __LINE__);
-            } else {
-                if (safe_dup2(slave, STDIN_FILENO) == -1) exit_on_err("dup2() failed for fd number 0");
-            }
-            safe_close(slave, __FILE__, __LINE__);
-            safe_close(master, __FILE__, __LINE__);
-
-            // Wait for READY_SIGNAL which indicates alatty has setup the screen object
-            safe_close(ready_write_fd, __FILE__, __LINE__);
-            wait_for_terminal_ready(ready_read_fd);
-            safe_close(ready_read_fd, __FILE__, __LINE__);
-
-            // Close any extra fds inherited from parent
-            for (int c = min_closed_fd; c < 201; c++) safe_close(c, __FILE__, __LINE__);
-
-            environ = env;
-            execvp(exe, argv);
-            // Report the failure and exec kitten instead, so that we are not left
-            // with a forked but not exec'ed process
-            write_to_stderr("Failed to launch child: ");
-            write_to_stderr(exe);
-            write_to_stderr("\nWith error: ");
-            write_to_stderr(strerror(errno));
-            write_to_stderr("\n");
-            execlp(kitten_exe, "kitten", "__hold_till_enter__", NULL);
-            exit(EXIT_FAILURE);
-            break;
-        }
-        case -1: {
+        pid = fork();
+        if (pid == 0) {
 #if PY_VERSION_HEX >= 0x03070000
-            int saved_errno = errno;
-            PyOS_AfterFork_Parent();
-            errno = saved_errno;
+            PyOS_AfterFork_Child();
 #endif
-            PyErr_SetFromErrno(PyExc_OSError);
-            break;
+            run_child(&spec);
         }
-        default:
 #if PY_VERSION_HEX >= 0x03070000
-            PyOS_AfterFork_Parent();
+        int saved_errno = errno;
+        PyOS_AfterFork_Parent();
+        errno = saved_errno;
 #endif
-            break;
+        if (pid == -1) PyErr_SetFromErrno(PyExc_OSError);
     }
-#undef exit_on_err
-    free_string_tuple(argv);
-    free_string_tuple(env);
+    free_string_tuple(spec.argv);
+    free_string_tuple(spec.env);
     if (PyErr_Occurred()) return NULL;
     return PyLong_FromLong(pid);
 }
 
+// Zygote {{{
+// A small helper process forked at startup, before this process has grown,
+// that creates children on its behalf, so that the cost of starting a shell
+// does not depend on the size of this process. Requests arrive over a
+// socket with the pty and pipe fds attached. Children are created with
+// CLONE_PARENT, making them children of this process, so they are reaped
+// and signalled exactly like the ones created by spawn().
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/prctl.h>
+#include <linux/sched.h>
+#define HAS_ZYGOTE
+
+#define ZYGOTE_MAX_MSG_SZ (64u * 1024u)
+#define ZYGOTE_MAX_FDS 3
+
+typedef struct {
+    uint32_t argc, envc, forward_stdio, num_fds;
+} ZygoteRequest;
+
+typedef struct {
+    int32_t pid, err;
+} ZygoteResponse;
+
+static struct {
+    int fd, handled_signals[16], num_handled_signals;
+    char *kitten_exe;
+} zygote = {.fd=-1};
+
+static char**
+unpack_strings(char **p, const char *end, size_t count) {
+    char **ans = calloc(count + 1, sizeof(char*));
+    if (!ans) return NULL;
+    for (size_t i = 0; i < count; i++) {
+        const char *nul = *p < end ? memchr(*p, 0, end - *p) : NULL;
+        if (!nul) { free(ans); return NULL; }
+        ans[i] = *p; *p = (char*)nul + 1;
+    }
+    return ans;
+}
+
+static int
+zygote_spawn_child(char *buf, size_t sz, const int *fds, size_t num_fds, pid_t *pid) {
+    ZygoteRequest rq;
+    if (sz < sizeof(rq)) return EINVAL;
+    memcpy(&rq, buf, sizeof(rq));
+    if (rq.num_fds != num_fds || num_fds < 2) return EINVAL;
+    char *p = buf + sizeof(rq), *end = buf + sz;
+    char **strings = unpack_strings(&p, end, 2 + rq.argc + rq.envc);
+    if (!strings) return EINVAL;
+    // exe, cwd, then argv and env which must each be NULL terminated
+    char **argv = calloc(rq.argc + 1, sizeof(char*)), **env = calloc(rq.envc + 1, sizeof(char*));
+    if (!argv || !env) { free(strings); free(argv); free(env); return ENOMEM; }
+    memcpy(argv, strings + 2, rq.argc * sizeof(char*));
+    memcpy(env, strings + 2 + rq.argc, rq.envc * sizeof(char*));
+    char name[2048] = {0};
+    int ret = 0;
+    if (ttyname_r(fds[0], name, sizeof(name) - 1) != 0) { ret = errno; goto end; }
+    ChildSpec spec = {
+        .exe = strings[0], .cwd = strings[1], .tty_name = name, .kitten_exe = zygote.kitten_exe,
+        .argv = argv, .env = env, .master = -1, .slave = fds[0], .ready_read_fd = fds[1], .ready_write_fd = -1,
+        .stdin_read_fd = num_fds > 2 ? fds[2] : -1, .stdin_write_fd = -1, .forward_stdio = rq.forward_stdio,
+        .handled_signals = zygote.handled_signals, .num_handled_signals = zygote.num_handled_signals,
+    };
+    // With CLONE_PARENT the exit signal is inherited from the zygote, which
+    // is SIGCHLD as it was created with fork()
+    struct clone_args ca = {.flags = CLONE_PARENT};
+    *pid = syscall(SYS_clone3, &ca, sizeof(ca));
+    if (*pid == 0) run_child(&spec);
+    if (*pid == -1) ret = errno;
+end:
+    free(strings); free(argv); free(env);
+    return ret;
+}
+
+__attribute__((noreturn)) static void
+zygote_main(int sock) {
+    prctl(PR_SET_NAME, "alatty-zygote", 0, 0, 0);
+    // Do not receive the signals meant for the terminal alatty was started from
+    setsid();
+    const struct sigaction act = {.sa_handler=SIG_DFL};
+    for (int si = 1; si < NSIG; si++) sigaction(si, &act, NULL);
+    sigset_t signals; sigemptyset(&signals);
+    sigprocmask(SIG_SETMASK, &signals, NULL);
+    // Keep fds 3 and 4 occupied, so that received fds are never clobbered
+    // by run_child() forwarding stdio to them
+    int high = fcntl(sock, F_DUPFD_CLOEXEC, 16);
+    if (high == -1 || (sock = safe_dup2(high, 5)) == -1) _exit(EXIT_FAILURE);
+    int null_fd = safe_open("/dev/null", O_RDONLY | O_CLOEXEC, 0);
+    if (null_fd == -1) _exit(EXIT_FAILURE);
+    for (int fd = 3; fd < 5; fd++) {
+        if (fd != null_fd && safe_dup2(null_fd, fd) == -1) _exit(EXIT_FAILURE);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    fcntl(sock, F_SETFD, FD_CLOEXEC);
+    close_fds_from(6);
+    char *buf = malloc(ZYGOTE_MAX_MSG_SZ);
+    if (!buf) _exit(EXIT_FAILURE);
+    union { char buf[CMSG_SPACE(sizeof(int) * ZYGOTE_MAX_FDS)]; struct cmsghdr align; } control;
+    while (true) {
+        struct iovec iov = {.iov_base = buf, .iov_len = ZYGOTE_MAX_MSG_SZ};
+        struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buf, .msg_controllen = sizeof(control.buf)};
+        ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR) continue;
+        // alatty has quit
+        if (n <= 0) _exit(EXIT_SUCCESS);
+        int fds[ZYGOTE_MAX_FDS]; size_t num_fds = 0;
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+            const int *src = (const int*)CMSG_DATA(c);
+            for (size_t i = 0; i < (c->cmsg_len - CMSG_LEN(0)) / sizeof(int); i++) {
+                if (num_fds < arraysz(fds)) fds[num_fds++] = src[i];
+                else safe_close(src[i], __FILE__, __LINE__);
+            }
+        }
+        ZygoteResponse r = {.pid = -1};
+        if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) r.err = E2BIG;
+        else {
+            pid_t pid = -1;
+            r.err = zygote_spawn_child(buf, n, fds, num_fds, &pid);
+            r.pid = pid;
+        }
+        for (size_t i = 0; i < num_fds; i++) safe_close(fds[i], __FILE__, __LINE__);
+        while (send(sock, &r, sizeof(r), MSG_NOSIGNAL) < 0) { if (errno != EINTR) _exit(EXIT_FAILURE); }
+    }
+}
+
+static void
+stop_zygote_(void) {
+    if (zygote.fd > -1) { safe_close(zygote.fd, __FILE__, __LINE__); zygote.fd = -1; }
+}
+
+static PyObject*
+start_zygote(PyObject *self UNUSED, PyObject *args) {
+    PyObject *handled_signals_p; const char *kitten_exe;
+    if (!PyArg_ParseTuple(args, "O!s", &PyTuple_Type, &handled_signals_p, &kitten_exe)) return NULL;
+    if (zygote.fd > -1) Py_RETURN_NONE;
+    zygote.num_handled_signals = MIN((int)arraysz(zygote.handled_signals), PyTuple_GET_SIZE(handled_signals_p));
+    for (int i = 0; i < zygote.num_handled_signals; i++) zygote.handled_signals[i] = PyLong_AsLong(PyTuple_GET_ITEM(handled_signals_p, i));
+    free(zygote.kitten_exe); zygote.kitten_exe = strdup(kitten_exe);
+    if (!zygote.kitten_exe) return PyErr_NoMemory();
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) != 0) return PyErr_SetFromErrno(PyExc_OSError);
+    PyOS_BeforeFork();
+    pid_t pid = fork();
+    if (pid == 0) {
+        safe_close(fds[0], __FILE__, __LINE__);
+        zygote_main(fds[1]);
+    }
+    int saved_errno = errno;
+    PyOS_AfterFork_Parent();
+    safe_close(fds[1], __FILE__, __LINE__);
+    if (pid == -1) {
+        safe_close(fds[0], __FILE__, __LINE__);
+        errno = saved_errno;
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    zygote.fd = fds[0];
+    Py_RETURN_NONE;
+}
+
+static bool
+send_to_zygote(const ZygoteRequest *rq, const char *strings, size_t sz, const int *fds) {
+    struct iovec iov[2] = {{.iov_base = (void*)rq, .iov_len = sizeof(*rq)}, {.iov_base = (void*)strings, .iov_len = sz}};
+    union { char buf[CMSG_SPACE(sizeof(int) * ZYGOTE_MAX_FDS)]; struct cmsghdr align; } control;
+    zero_at_ptr(&control);
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = 2, .msg_control = control.buf, .msg_controllen = CMSG_SPACE(sizeof(int) * rq->num_fds)};
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET; c->cmsg_type = SCM_RIGHTS; c->cmsg_len = CMSG_LEN(sizeof(int) * rq->num_fds);
+    memcpy(CMSG_DATA(c), fds, sizeof(int) * rq->num_fds);
+    ssize_t n;
+    while ((n = sendmsg(zygote.fd, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR);
+    return n == (ssize_t)(sizeof(*rq) + sz);
+}
+
+static bool
+append_strings(char *buf, size_t *sz, char **strings, uint32_t *count) {
+    for (char **s = strings; *s; s++) {
+        const size_t len = strlen(*s) + 1;
+        if (*sz + len > ZYGOTE_MAX_MSG_SZ - sizeof(ZygoteRequest)) { errno = E2BIG; return false; }
+        memcpy(buf + *sz, *s, len); *sz += len;
+        if (count) (*count)++;
+    }
+    return true;
+}
+
+static PyObject*
+zygote_spawn(PyObject *self UNUSED, PyObject *args) {
+    PyObject *argv_p, *env_p;
+    int slave, stdin_read_fd, ready_read_fd, forward_stdio;
+    const char *exe, *cwd;
+    if (!PyArg_ParseTuple(args, "ssO!O!iiip", &exe, &cwd, &PyTuple_Type, &argv_p, &PyTuple_Type, &env_p, &slave, &stdin_read_fd, &ready_read_fd, &forward_stdio)) return NULL;
+    if (zygote.fd < 0) { errno = ENOTCONN; return PyErr_SetFromErrno(PyExc_OSError); }
+    ZygoteRequest rq = {.forward_stdio = forward_stdio, .num_fds = stdin_read_fd > -1 ? 3 : 2};
+    const int fds[ZYGOTE_MAX_FDS] = {slave, ready_read_fd, stdin_read_fd};
+    char *header[] = {(char*)exe, (char*)cwd, NULL};
+    char **argv = serialize_string_tuple(argv_p), **env = serialize_string_tuple(env_p);
+    RAII_ALLOC(char, buf, malloc(ZYGOTE_MAX_MSG_SZ));
+    if (!buf) { free_string_tuple(argv); free_string_tuple(env); return PyErr_NoMemory(); }
+    size_t sz = 0;
+    bool ok = append_strings(buf, &sz, header, NULL) && append_strings(buf, &sz, argv, &rq.argc) && append_strings(buf, &sz, env, &rq.envc);
+    free_string_tuple(argv); free_string_tuple(env);
+    // Too large a request is only a problem for this child, not the zygote
+    if (!ok) return PyErr_SetFromErrno(PyExc_OSError);
+    ZygoteResponse r = {0};
+    ssize_t n = -1;
+    Py_BEGIN_ALLOW_THREADS
+    if (send_to_zygote(&rq, buf, sz, fds)) {
+        while ((n = recv(zygote.fd, &r, sizeof(r), 0)) < 0 && errno == EINTR);
+    }
+    Py_END_ALLOW_THREADS
+    if (n != sizeof(r)) {
+        if (n >= 0) errno = EPIPE;
+        PyErr_SetFromErrno(PyExc_OSError);
+        stop_zygote_();
+        return NULL;
+    }
+    if (r.err) {
+        // Most likely clone3() is unavailable, no point in trying again
+        errno = r.err;
+        PyErr_SetFromErrno(PyExc_OSError);
+        stop_zygote_();
+        return NULL;
+    }
+    return PyLong_FromLong(r.pid);
+}
+#endif
+
+static PyObject*
+stop_zygote(PyObject *self UNUSED, PyObject *args UNUSED) {
+    // The zygote exits when it reads EOF and is reaped with the other children
+#ifdef HAS_ZYGOTE
+    stop_zygote_();
+#endif
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+zygote_running(PyObject *self UNUSED, PyObject *args UNUSED) {
+#ifdef HAS_ZYGOTE
+    if (zygote.fd > -1) Py_RETURN_TRUE;
+#endif
+    Py_RETURN_FALSE;
+}
+// }}}
+
 #ifdef __APPLE__
 #include <crt_externs.h>
 #else
@@ -209,6 +574,12 @@ clearenv_py(PyObject *self UNUSED, PyObject *args UNUSED) {
 
 static PyMethodDef module_methods[] = {
     METHODB(spawn, METH_VARARGS),
+#ifdef HAS_ZYGOTE
+    METHODB(start_zygote, METH_VARARGS),
+    METHODB(zygote_spawn, METH_VARARGS),
+#endif
+    METHODB(stop_zygote, METH_NOARGS),
+    METHODB(zygote_running, METH_NOARGS),
     {"clearenv", clearenv_py, METH_NOARGS, ""},
     {NULL, NULL, 0, NULL}        /* Sentinel */
 };
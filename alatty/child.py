@@ -166,14 +166,81 @@ def set_LANG_in_default_env(val: str) -> None:
     default_env().setdefault('LANG', val)
 
 
-def openpty() -> Tuple[int, int]:
+def create_pty() -> Tuple[int, int]:
     master, slave = os.openpty()  # Note that master and slave are in blocking mode
-    os.set_inheritable(slave, True)
     os.set_inheritable(master, False)
     fast_data_types.set_iutf8_fd(master, True)
     return master, slave
 
 
+class PtyPool:
+    '''
+    Keeps pty_pool_size ptys open, so that windows opened in quick
+    succession, for example from a session file, do not each have to wait
+    for one. The pool is filled at startup, before the first windows are
+    created, and refilled from the main loop after a window has taken a pty
+    from it.
+    '''
+
+    def __init__(self) -> None:
+        self.ptys: List[Tuple[int, int]] = []
+        self.refill_scheduled = False
+
+    def get(self) -> Tuple[int, int]:
+        ans = self.ptys.pop() if self.ptys else create_pty()
+        if not self.refill_scheduled and len(self.ptys) < fast_data_types.get_options().pty_pool_size:
+            self.refill_scheduled = True
+            fast_data_types.add_timer(self.refill, 0, False)
+        return ans
+
+    def refill(self, timer_id: Optional[int] = None) -> None:
+        self.refill_scheduled = False
+        size = fast_data_types.get_options().pty_pool_size
+        while len(self.ptys) < size:
+            self.ptys.append(create_pty())
+        while len(self.ptys) > size:
+            for fd in self.ptys.pop():
+                os.close(fd)
+
+
+pty_pool = PtyPool()
+
+
+def openpty() -> Tuple[int, int]:
+    master, slave = pty_pool.get()
+    os.set_inheritable(slave, True)
+    return master, slave
+
+
+@run_once
+def spawn_with_posix_spawn() -> bool:
+    # The child execs kitten to wait for the terminal to be ready, see spawn() in child.c
+    return os.access(kitten_exe(), os.X_OK)
+
+
+def start_zygote() -> None:
+    if is_macos or is_freebsd:
+        return
+    try:
+        fast_data_types.start_zygote(tuple(handled_signals), kitten_exe())
+    except OSError as err:
+        log_error(f'Failed to start the zygote process with error: {err}')
+
+
+def spawn_via_zygote(
+    exe: str, cwd: str, argv: Sequence[str], env: Tuple[str, ...], slave: int, stdin_read_fd: int, ready_read_fd: int, forward_stdio: bool
+) -> Optional[int]:
+    if not fast_data_types.zygote_running():
+        return None
+    try:
+        return fast_data_types.zygote_spawn(exe, cwd, tuple(argv), env, slave, stdin_read_fd, ready_read_fd, forward_stdio)
+    except OSError as err:
+        # The zygote is still running if only this request was too large for it
+        if not fast_data_types.zygote_running():
+            log_error(f'The zygote process failed to create a child, no longer using it. Error: {err}')
+    return None
+
+
 @run_once
 def getpid() -> str:
     return str(os.getpid())
@@ -303,9 +370,11 @@ def fork(self) -> Optional[int]:
             argv = cmdline_for_hold(argv)
             final_exe = argv[0]
         env = tuple(f'{k}={v}' for k, v in self.final_env.items())
-        pid = fast_data_types.spawn(
-            final_exe, cwd, tuple(argv), env, master, slave, stdin_read_fd, stdin_write_fd,
-            ready_read_fd, ready_write_fd, tuple(handled_signals), kitten_exe(), opts.forward_stdio)
+        pid = spawn_via_zygote(final_exe, cwd, argv, env, slave, stdin_read_fd, ready_read_fd, opts.forward_stdio)
+        if pid is None:
+            pid = fast_data_types.spawn(
+                final_exe, cwd, tuple(argv), env, master, slave, stdin_read_fd, stdin_write_fd,
+                ready_read_fd, ready_write_fd, tuple(handled_signals), kitten_exe(), opts.forward_stdio, spawn_with_posix_spawn())
         os.close(slave)
         self.pid = pid
         self.child_fd = master
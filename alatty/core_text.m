@@ -8,6 +8,7 @@
 #include "state.h"
 #include "cleanup.h"
 #include "fonts.h"
+#include "glyph-rasterizer.h"
 #include "unicode-data.h"
 #include <structmember.h>
 #include <stdint.h>
@@ -661,6 +662,19 @@
     return do_render(self->ct_font, self->units_per_em, info, hb_positions, num_glyphs, canvas, cell_width, cell_height, num_cells, baseline, was_colored, true, fg, center_glyph);
 }
 
+// Rendering uses shared buffers so glyphs are always rasterized on the main thread
+bool
+rasterizer_face_for(PyObject *s UNUSED, RasterizerFace *ans UNUSED) { return false; }
+
+void*
+create_rasterizer_thread_data(void) { return NULL; }
+
+void
+free_rasterizer_thread_data(void *data UNUSED) {}
+
+bool
+rasterize_glyph_job(void *data UNUSED, GlyphRasterJob *job UNUSED) { return false; }
+
 
 
 // Boilerplate {{{
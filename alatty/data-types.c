@@ -334,6 +334,9 @@ extern bool init_shaders(PyObject *module);
 extern bool init_mouse(PyObject *module);
 extern bool init_logging(PyObject *module);
 extern bool init_loop_utils(PyObject *module);
+extern bool init_canvas_kernels(PyObject *module);
+extern bool init_glyph_cache(PyObject *module);
+extern bool init_io_poller_module(PyObject *module);
 #ifdef __APPLE__
 extern int init_CoreText(PyObject *);
 extern bool init_cocoa(PyObject *module);
@@ -398,6 +401,9 @@ PyInit_fast_data_types(void) {
 #endif
     if (!init_fonts(m)) return NULL;
     if (!init_loop_utils(m)) return NULL;
+    if (!init_canvas_kernels(m)) return NULL;
+    if (!init_glyph_cache(m)) return NULL;
+    if (!init_io_poller_module(m)) return NULL;
 
     CellAttrs a;
 #define s(name, attr) { a.val = 0; a.attr = 1; PyModule_AddIntConstant(m, #name, shift_to_first_set_bit(a)); }
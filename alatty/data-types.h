@@ -336,7 +336,12 @@ typedef struct {FONTS_DATA_HEAD} *FONTS_DATA_HANDLE;
 
 #define PARSER_BUF_SZ (8 * 1024)
 #define READ_BUF_SZ (1024*1024)
+// The per screen buffers start at these sizes and grow on demand
+#define PARSER_BUF_MIN_SZ 64
+#define READ_BUF_MIN_SZ (16 * 1024)
 
+// Set in sprite_z for sprites stored in the RGBA (color) sprite atlas
+#define COLORED_SPRITE_MASK 0x4000u
 #define clear_sprite_position(cell) (cell).sprite_x = 0; (cell).sprite_y = 0; (cell).sprite_z = 0;
 
 #define ensure_space_for(base, array, type, num, capacity, initial_cap, zero_mem) \
@@ -391,6 +396,8 @@ const char* cursor_as_sgr(const Cursor *);
 PyObject* cm_thread_write(PyObject *self, PyObject *args);
 bool schedule_write_to_child(unsigned long id, unsigned int num, ...);
 bool schedule_write_to_child_python(unsigned long id, const char *prefix, PyObject* tuple_of_str_or_bytes, const char *suffix);
+bool schedule_borrowed_write_to_child(unsigned long id, PyObject *owner, const char *data, size_t sz);
+bool stream_to_child(unsigned long id, int fd, const char *prefix, const char *suffix);
 bool set_iutf8(int, bool);
 
 DynamicColor colorprofile_to_color(ColorProfile *self, DynamicColor entry, DynamicColor defval);
@@ -408,3 +415,4 @@ void scroll_event(double, double, int, int);
 void on_key_input(GLFWkeyevent *ev);
 SPRITE_MAP_HANDLE alloc_sprite_map(unsigned int, unsigned int);
 SPRITE_MAP_HANDLE free_sprite_map(SPRITE_MAP_HANDLE);
+void sprite_map_upload_stats(SPRITE_MAP_HANDLE, unsigned int *uploads, unsigned int *sprites);
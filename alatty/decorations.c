@@ -0,0 +1,160 @@
+/*
+ * decorations.c
+ * Copyright (C) 2016 Kovid Goyal <kovid at kovidgoyal.net>
+ *
+ * Distributed under terms of the GPL3 license.
+ */
+
+#include "decorations.h"
+#include "box-drawing.h"
+#include <math.h>
+
+// Underlines and strikethrough {{{
+
+static void
+add_line(uint8_t *buf, unsigned cell_width, int position, int thickness, unsigned cell_height) {
+    int y = position - thickness / 2;
+    while (thickness > 0 && -1 < y && y < (int)cell_height) {
+        thickness--;
+        memset(buf + cell_width * y, 255, cell_width);
+        y++;
+    }
+}
+
+static void
+add_dline(uint8_t *buf, unsigned cell_width, int position, int thickness, unsigned cell_height) {
+    const int max_y = (int)cell_height - 1;
+    int a = MIN(position - thickness, max_y), b = MIN(position, max_y);
+    int top = MIN(a, b), bottom = MAX(a, b);
+    int deficit = 2 - (bottom - top);
+    if (deficit > 0) {
+        if (bottom + deficit < (int)cell_height) bottom += deficit;
+        else if (bottom < max_y) {
+            bottom += 1;
+            if (deficit > 1) top -= deficit - 1;
+        } else top -= deficit;
+    }
+    top = MAX(0, MIN(top, max_y));
+    bottom = MAX(0, MIN(bottom, max_y));
+    memset(buf + cell_width * top, 255, cell_width);
+    memset(buf + cell_width * bottom, 255, cell_width);
+}
+
+static void
+add_intensity(uint8_t *buf, unsigned cell_width, int x, int y, unsigned val, int position, int max_y) {
+    y = MAX(0, MIN(y + position, max_y));
+    uint8_t *p = buf + cell_width * y + x;
+    *p = MIN(255u, *p + val);
+}
+
+static void
+add_curl(uint8_t *buf, unsigned cell_width, int position, int thickness, unsigned cell_height) {
+    const int max_x = (int)cell_width - 1, max_y = (int)cell_height - 1;
+    if (max_x < 1) return;
+    // undercurl_style is always thin-sparse, dense would be 4 * pi
+    const double xfactor = 2.0 * M_PI / max_x;
+
+    const int max_height = (int)cell_height - (position - thickness / 2);  // descender from the font
+    const int half_height = MAX(1, max_height / 4);
+    thickness = MAX(1, thickness) - (thickness < 3 ? 1 : 2);
+
+    // Ensure curve doesn't exceed cell boundary at the bottom
+    position += half_height * 2;
+    if (position + half_height > max_y) position = max_y - half_height;
+
+    // Use the Wu antialias algorithm to draw the curve
+    // cosine waves always have slope <= 1 so are never steep
+    for (int x = 0; x < (int)cell_width; x++) {
+        const double y = half_height * cos(x * xfactor);
+        const int y1 = (int)floor(y - thickness), y2 = (int)ceil(y);
+        const unsigned i1 = (unsigned)(255 * fabs(y - floor(y)));
+        add_intensity(buf, cell_width, x, y1, 255 - i1, position, max_y);  // upper bound
+        add_intensity(buf, cell_width, x, y2, i1, position, max_y);  // lower bound
+        // fill between upper and lower bound
+        for (int t = 1; t <= thickness; t++) add_intensity(buf, cell_width, x, y1 + t, 255, position, max_y);
+    }
+}
+
+static void
+add_dots(uint8_t *buf, unsigned cell_width, int position, int thickness, unsigned cell_height) {
+    if (thickness < 1) return;
+    const unsigned num_of_dots = cell_width / (2 * thickness);
+    if (!num_of_dots) return;
+    RAII_ALLOC(unsigned, spacing, malloc(sizeof(unsigned) * num_of_dots));
+    if (!spacing) return;
+    const unsigned size = distribute_dots(cell_width, num_of_dots, spacing);
+    const size_t limit = (size_t)cell_width * cell_height;
+    const int y = 1 + position - thickness / 2;
+    for (int i = MAX(0, y); i < MIN(y + thickness, (int)cell_height); i++) {
+        for (unsigned j = 0; j < num_of_dots; j++) {
+            const size_t start = (size_t)cell_width * i + j * size + spacing[j];
+            if (start < limit) memset(buf + start, 255, MIN((size_t)size, limit - start));
+        }
+    }
+}
+
+static void
+add_dashes(uint8_t *buf, unsigned cell_width, int position, int thickness, unsigned cell_height) {
+    const unsigned halfspace_width = cell_width / 4, dash_width = cell_width - 3 * halfspace_width;
+    const int y = 1 + position - thickness / 2;
+    for (int i = MAX(0, y); i < MIN(y + thickness, (int)cell_height); i++) {
+        uint8_t *row = buf + cell_width * i;
+        memset(row, 255, dash_width);
+        memset(row + 3 * halfspace_width, 255, dash_width);
+    }
+}
+
+void
+add_underline(uint8_t *buf, unsigned style, const DecorationMetrics *m) {
+    int t = m->underline_thickness;
+    const int position = MIN((int)m->underline_position, (int)m->cell_height - (t / 2 + t % 2));
+    if (style > 1) t = MAX(1, MIN((int)m->cell_height - position - 1, t));
+    switch (style) {
+        case 1: add_line(buf, m->cell_width, position, t, m->cell_height); break;
+        case 2: add_dline(buf, m->cell_width, position, t, m->cell_height); break;
+        case 3: add_curl(buf, m->cell_width, position, t, m->cell_height); break;
+        case 4: add_dots(buf, m->cell_width, position, t, m->cell_height); break;
+        case 5: add_dashes(buf, m->cell_width, position, t, m->cell_height); break;
+    }
+}
+
+void
+add_strikethrough(uint8_t *buf, const DecorationMetrics *m) {
+    add_line(buf, m->cell_width, m->strikethrough_position, m->strikethrough_thickness, m->cell_height);
+}
+
+// }}}
+
+// Cursors {{{
+
+static void
+vert(uint8_t *buf, bool left_edge, double width_pt, const DecorationMetrics *m) {
+    const unsigned width = MAX(1, MIN((int)nearbyint(width_pt * m->dpi_x / 72.0), (int)m->cell_width));
+    const unsigned left = left_edge ? 0 : m->cell_width - width;
+    for (unsigned y = 0; y < m->cell_height; y++) memset(buf + y * m->cell_width + left, 255, width);
+}
+
+static void
+horz(uint8_t *buf, bool top_edge, double height_pt, const DecorationMetrics *m) {
+    const unsigned height = MAX(1, MIN((int)nearbyint(height_pt * m->dpi_y / 72.0), (int)m->cell_height));
+    const unsigned top = top_edge ? 0 : m->cell_height - height;
+    memset(buf + top * m->cell_width, 255, (size_t)height * m->cell_width);
+}
+
+void
+add_beam_cursor(uint8_t *buf, float thickness_in_pts, const DecorationMetrics *m) {
+    vert(buf, true, thickness_in_pts, m);
+}
+
+void
+add_underline_cursor(uint8_t *buf, float thickness_in_pts, const DecorationMetrics *m) {
+    horz(buf, false, thickness_in_pts, m);
+}
+
+void
+add_hollow_cursor(uint8_t *buf, const DecorationMetrics *m) {
+    vert(buf, true, 1, m); vert(buf, false, 1, m);
+    horz(buf, true, 1, m); horz(buf, false, 1, m);
+}
+
+// }}}
@@ -0,0 +1,22 @@
+/*
+ * Copyright (C) 2016 Kovid Goyal <kovid at kovidgoyal.net>
+ *
+ * Distributed under terms of the GPL3 license.
+ */
+
+#pragma once
+
+#include "data-types.h"
+
+typedef struct DecorationMetrics {
+    unsigned cell_width, cell_height;
+    unsigned underline_position, underline_thickness, strikethrough_position, strikethrough_thickness;
+    double dpi_x, dpi_y;
+} DecorationMetrics;
+
+// All of these draw into buf, an alpha mask of cell_width * cell_height bytes
+void add_underline(uint8_t *buf, unsigned style, const DecorationMetrics *m);
+void add_strikethrough(uint8_t *buf, const DecorationMetrics *m);
+void add_beam_cursor(uint8_t *buf, float thickness_in_pts, const DecorationMetrics *m);
+void add_underline_cursor(uint8_t *buf, float thickness_in_pts, const DecorationMetrics *m);
+void add_hollow_cursor(uint8_t *buf, const DecorationMetrics *m);
@@ -1,5 +1,4 @@
 import termios
-from ctypes import Array, c_ubyte
 from typing import (
     Any,
     Callable,
@@ -428,7 +427,8 @@ def add_window(os_window_id: int, tab_id: int, title: str) -> int:
 
 
 def compile_program(
-    which: int, vertex_shaders: Tuple[str, ...], fragment_shaders: Tuple[str, ...], allow_recompile: bool = False
+    which: int, vertex_shaders: Tuple[str, ...], fragment_shaders: Tuple[str, ...], allow_recompile: bool = False,
+    cache_dir: Optional[str] = None
 ) -> int:
     pass
 
@@ -881,6 +881,55 @@ def sprite_map_set_limits(w: int, h: int) -> None:
     pass
 
 
+class SpriteAtlasStats(TypedDict):
+    used_slots: int
+    slot_limit: int
+    live_sprites: int
+    columns: int
+    rows: int
+    layers: int
+    texture_bytes: int
+
+
+class SpriteMapStats(TypedDict):
+    id: int
+    font_size: float
+    cell_width: int
+    cell_height: int
+    alpha: SpriteAtlasStats
+    color: SpriteAtlasStats
+    compactions: int
+    evicted: int
+    uploads_last_frame: int
+    sprites_uploaded_last_frame: int
+    prewarm_time: float
+    prewarmed_cells: int
+
+
+def sprite_map_stats() -> List[SpriteMapStats]:
+    pass
+
+
+def test_canvas_kernels(
+    width: int = 137, height: int = 128, iterations: int = 1000
+) -> Dict[str, Union[str, Tuple[float, float]]]:
+    pass
+
+
+def test_sprite_position_table(num_lookups: int = 1000000, iterations: int = 5) -> Dict[str, Union[int, float]]:
+    pass
+
+
+def test_io_pollers(num_idle: int = 500, iterations: int = 20000) -> Dict[str, Union[int, float]]:
+    pass
+
+
+def test_echo_latency(
+    samples: int = 1000, low_latency: bool = True, input_delay_ms: float = 3, key_interval_ms: float = 20
+) -> Dict[str, Union[int, bool, float, List[Tuple[int, int]]]]:
+    pass
+
+
 def set_send_sprite_to_gpu(
     func: Optional[Callable[[int, int, int, bytes], None]]
 ) -> None:
@@ -888,14 +937,10 @@ def set_send_sprite_to_gpu(
 
 
 def set_font_data(
-    box_drawing_func: Callable[[int, int, int, float],
-                               Tuple[int, Union[bytearray, bytes, Array[c_ubyte]]]],
-    prerender_func: Callable[
-        [int, int, int, int, int, int, int, float, float, float, float],
-        Tuple[Tuple[int, ...], Tuple[Array[c_ubyte], ...]]],
     descriptor_for_idx: Callable[[int], Tuple[FontObject, bool, bool]],
     num_symbol_fonts: int,
     font_sz_in_pts: float,
+    glyph_cache_dir: Optional[str] = None,
 ) -> None:
     pass
 
@@ -959,6 +1004,9 @@ class Screen:
     def cursor_at_prompt(self) -> bool:
         pass
 
+    def parse_stats(self) -> Dict[str, Union[int, float]]:
+        pass
+
     def set_window_char(self, ch: str = "") -> None:
         pass
 
@@ -1032,6 +1080,9 @@ class Screen:
         pass
     paste = paste_bytes
 
+    def paste_from_fd(self, fd: int) -> bool:
+        pass
+
     def as_text(self, callback: Callable[[str], None], as_ansi: bool, insert_wrap_markers: bool) -> None:
         pass
     as_text_non_visual = as_text
@@ -1191,10 +1242,36 @@ def spawn(
     handled_signals: Tuple[int, ...],
     kitten_exe: str,
     forward_stdio: bool,
+    use_posix_spawn: bool = False,
 ) -> int:
     pass
 
 
+def start_zygote(handled_signals: Tuple[int, ...], kitten_exe: str) -> None:
+    pass
+
+
+def zygote_spawn(
+    exe: str,
+    cwd: str,
+    argv: Tuple[str, ...],
+    env: Tuple[str, ...],
+    slave: int,
+    stdin_read_fd: int,
+    ready_read_fd: int,
+    forward_stdio: bool,
+) -> int:
+    pass
+
+
+def stop_zygote() -> None:
+    pass
+
+
+def zygote_running() -> bool:
+    pass
+
+
 def set_window_padding(os_window_id: int, tab_id: int, window_id: int, left: int, top: int, right: int, bottom: int) -> None:
     pass
 
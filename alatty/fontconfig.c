@@ -13,6 +13,12 @@
 #include <dlfcn.h>
 #include "emoji.h"
 #include "freetype_render_ui_text.h"
+#include "glyph-disk-cache.h"
+#include "alatty-uthash.h"
+#include "safe-wrappers.h"
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <libgen.h>
 #ifndef FC_COLOR
 #define FC_COLOR "color"
 #endif
@@ -43,6 +49,13 @@ static void* libfontconfig_handle = NULL;
 #define FcPatternCreate dynamically_loaded_fc_symbol.PatternCreate
 #define FcPatternGetBool dynamically_loaded_fc_symbol.PatternGetBool
 #define FcPatternAddCharSet dynamically_loaded_fc_symbol.PatternAddCharSet
+#define FcPatternGetCharSet dynamically_loaded_fc_symbol.PatternGetCharSet
+#define FcCharSetHasChar dynamically_loaded_fc_symbol.CharSetHasChar
+#define FcConfigGetCacheDirs dynamically_loaded_fc_symbol.ConfigGetCacheDirs
+#define FcConfigGetFontDirs dynamically_loaded_fc_symbol.ConfigGetFontDirs
+#define FcConfigGetConfigFiles dynamically_loaded_fc_symbol.ConfigGetConfigFiles
+#define FcStrListNext dynamically_loaded_fc_symbol.StrListNext
+#define FcStrListDone dynamically_loaded_fc_symbol.StrListDone
 
 static struct {
     FcBool(*Init)(void);
@@ -67,6 +80,13 @@ static struct {
     FcPattern * (*PatternCreate) (void);
     FcResult (*PatternGetBool) (const FcPattern *p, const char *object, int n, FcBool *b);
     FcBool (*PatternAddCharSet) (FcPattern *p, const char *object, const FcCharSet *c);
+    FcResult (*PatternGetCharSet) (const FcPattern *p, const char *object, int n, FcCharSet **c);
+    FcBool (*CharSetHasChar) (const FcCharSet *fcs, FcChar32 ucs4);
+    FcStrList* (*ConfigGetCacheDirs) (FcConfig *config);
+    FcStrList* (*ConfigGetFontDirs) (FcConfig *config);
+    FcStrList* (*ConfigGetConfigFiles) (FcConfig *config);
+    FcChar8* (*StrListNext) (FcStrList *list);
+    void (*StrListDone) (FcStrList *list);
 } dynamically_loaded_fc_symbol = {0};
 #define LOAD_FUNC(name) {\
     *(void **) (&dynamically_loaded_fc_symbol.name) = dlsym(libfontconfig_handle, "Fc" #name); \
@@ -117,6 +137,13 @@ load_fontconfig_lib(void) {
         LOAD_FUNC(PatternCreate);
         LOAD_FUNC(PatternGetBool);
         LOAD_FUNC(PatternAddCharSet);
+        LOAD_FUNC(PatternGetCharSet);
+        LOAD_FUNC(CharSetHasChar);
+        LOAD_FUNC(ConfigGetCacheDirs);
+        LOAD_FUNC(ConfigGetFontDirs);
+        LOAD_FUNC(ConfigGetConfigFiles);
+        LOAD_FUNC(StrListNext);
+        LOAD_FUNC(StrListDone);
 }
 #undef LOAD_FUNC
 
@@ -129,8 +156,11 @@ ensure_initialized(void) {
     }
 }
 
+static void free_fallback_cache(void);
+
 static void
 finalize(void) {
+    free_fallback_cache();
     if (initialized) {
         FcFini();
         dlclose(libfontconfig_handle);
@@ -430,17 +460,290 @@ end:
     return ok;
 }
 
+
+// Persistent fallback cache {{{
+
+// Maps the text of a cell and its presentation to the font fontconfig chose
+// for it, or to nothing if no font has a glyph for the cell. Entries are kept
+// in an append only file in the glyph cache directory so that they survive
+// restarts. The file is discarded when the timestamps of the fontconfig
+// cache or font directories change, that is whenever fonts are installed or
+// removed, or when the fontconfig configuration is edited. Like the glyph
+// cache files it is only validated and truncated under an exclusive flock()
+// and appended to under a shared one.
+
+#define FALLBACK_CACHE_MAGIC "ALFBCK01"
+#define FALLBACK_RECORD_MAGIC 0x46424b00u
+#define FALLBACK_EMOJI 1u
+#define FALLBACK_MISSING 2u
+#define FALLBACK_HINTING 4u
+#define MAX_FALLBACK_CACHE_FILE_SIZE (4u * 1024u * 1024u)
+
+typedef struct FallbackCacheHeader {
+    char magic[8];
+    uint64_t stamp;
+} FallbackCacheHeader;
+
+typedef struct FallbackRecordHeader {
+    uint32_t magic;
+    uint8_t num_chars, flags;
+    uint16_t path_len;
+    int32_t index, hint_style;
+} FallbackRecordHeader;
+
+typedef struct FallbackCacheEntry {
+    UT_hash_handle hh;
+    char *path;
+    int index, hint_style;
+    bool hinting, missing;
+    unsigned key_sz;
+    // the presentation followed by the codepoints of the cell
+    uint32_t key[];
+} FallbackCacheEntry;
+
+static struct {
+    FallbackCacheEntry *entries;
+    char *dir;
+    int fd;
+    size_t file_sz;
+    bool loaded;
+} fallback_cache = {.fd = -1};
+
+static uint64_t
+mix_stamp(uint64_t h, const void *data, size_t sz) {
+    const uint8_t *p = data;
+    for (; sz; sz--, p++) h = (h ^ *p) * 0x100000001b3ull;
+    return h;
+}
+
+static uint64_t
+hash_timestamp(uint64_t h, const char *path) {
+    struct stat st;
+    h = mix_stamp(h, path, strlen(path) + 1);
+    if (stat(path, &st) == 0) {
+        const int64_t t[2] = {st.st_mtim.tv_sec, st.st_mtim.tv_nsec};
+        h = mix_stamp(h, t, sizeof(t));
+    }
+    return h;
+}
+
+static uint64_t
+hash_timestamps(uint64_t h, FcStrList *paths, bool with_parent_dirs) {
+    if (!paths) return h;
+    FcChar8 *path;
+    while ((path = FcStrListNext(paths))) {
+        h = hash_timestamp(h, (const char*)path);
+        if (with_parent_dirs) {
+            // so that files added to a directory such as conf.d are noticed
+            char buf[4096];
+            snprintf(buf, sizeof(buf), "%s", (const char*)path);
+            h = hash_timestamp(h, dirname(buf));
+        }
+    }
+    FcStrListDone(paths);
+    return h;
+}
+
+static uint64_t
+fontconfig_stamp(void) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    h = hash_timestamps(h, FcConfigGetCacheDirs(NULL), false);
+    h = hash_timestamps(h, FcConfigGetFontDirs(NULL), false);
+    h = hash_timestamps(h, FcConfigGetConfigFiles(NULL), true);
+    return h;
+}
+
+static bool
+lock_fallback_cache_file(int fd, int operation) {
+    while (flock(fd, operation) != 0) {
+        if (errno != EINTR) return false;
+    }
+    return true;
+}
+
+static FallbackCacheEntry*
+find_in_fallback_cache(const uint32_t *key, unsigned key_sz) {
+    FallbackCacheEntry *e = NULL;
+    HASH_FIND(hh, fallback_cache.entries, key, sizeof(key[0]) * key_sz, e);
+    return e;
+}
+
+static FallbackCacheEntry*
+add_to_fallback_cache(const uint32_t *key, unsigned key_sz, const char *path, int index, int hint_style, bool hinting, bool missing) {
+    FallbackCacheEntry *e = find_in_fallback_cache(key, key_sz);
+    if (e) return e;
+    e = calloc(1, sizeof(FallbackCacheEntry) + sizeof(key[0]) * key_sz);
+    if (!e) return NULL;
+    if (path && !(e->path = strdup(path))) { free(e); return NULL; }
+    e->index = index; e->hint_style = hint_style; e->hinting = hinting; e->missing = missing;
+    e->key_sz = key_sz;
+    memcpy(e->key, key, sizeof(key[0]) * key_sz);
+    HASH_ADD(hh, fallback_cache.entries, key, sizeof(key[0]) * key_sz, e);
+    return e;
+}
+
+static size_t
+fallback_record_size(size_t num_chars, size_t path_len) {
+    return (sizeof(FallbackRecordHeader) + sizeof(uint32_t) * num_chars + path_len + 3) & ~(size_t)3;
+}
+
+static void
+index_fallback_records(const uint8_t *data, size_t sz) {
+    size_t pos = sizeof(FallbackCacheHeader);
+    uint32_t key[32];
+    while (pos + sizeof(FallbackRecordHeader) <= sz) {
+        FallbackRecordHeader h;
+        memcpy(&h, data + pos, sizeof(h));
+        const size_t rsz = fallback_record_size(h.num_chars, h.path_len);
+        // a partially written record from a crashed instance ends the file
+        if (h.magic != FALLBACK_RECORD_MAGIC || !h.num_chars || h.num_chars >= arraysz(key) || pos + rsz > sz) break;
+        const uint8_t *p = data + pos + sizeof(h);
+        key[0] = h.flags & FALLBACK_EMOJI;
+        memcpy(key + 1, p, sizeof(uint32_t) * h.num_chars);
+        p += sizeof(uint32_t) * h.num_chars;
+        char path[4096];
+        const bool missing = h.flags & FALLBACK_MISSING;
+        if (!missing) {
+            if (!h.path_len || h.path_len >= sizeof(path)) break;
+            memcpy(path, p, h.path_len); path[h.path_len] = 0;
+        }
+        if (!add_to_fallback_cache(key, h.num_chars + 1, missing ? NULL : path, h.index, h.hint_style, h.flags & FALLBACK_HINTING, missing)) break;
+        pos += rsz;
+    }
+}
+
+static void
+close_fallback_cache_file(void) {
+    if (fallback_cache.fd > -1) safe_close(fallback_cache.fd, __FILE__, __LINE__);
+    fallback_cache.fd = -1;
+    free(fallback_cache.dir); fallback_cache.dir = NULL;
+}
+
+static void
+load_fallback_cache(void) {
+    // The cache directory is only known once the font data has been set
+    const char *dir = glyph_disk_cache_dir();
+    if (fallback_cache.loaded && (dir == NULL || (fallback_cache.dir && strcmp(dir, fallback_cache.dir) == 0))) return;
+    fallback_cache.loaded = true;
+    close_fallback_cache_file();
+    if (!dir) return;
+    fallback_cache.dir = strdup(dir);
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/fallback-fonts", dir);
+    int fd = safe_open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd < 0) return;
+    FallbackCacheHeader expected = {.magic = FALLBACK_CACHE_MAGIC, .stamp = fontconfig_stamp()};
+    // no other instance can be appending while the file is read and possibly truncated
+    if (!lock_fallback_cache_file(fd, LOCK_EX)) { safe_close(fd, __FILE__, __LINE__); return; }
+    struct stat st;
+    if (fstat(fd, &st) != 0) { flock(fd, LOCK_UN); safe_close(fd, __FILE__, __LINE__); return; }
+    size_t sz = MIN((size_t)st.st_size, MAX_FALLBACK_CACHE_FILE_SIZE);
+    uint8_t *data = sz >= sizeof(expected) ? malloc(sz) : NULL;
+    if (data && pread(fd, data, sz, 0) == (ssize_t)sz && memcmp(data, &expected, sizeof(expected)) == 0) {
+        index_fallback_records(data, sz);
+    } else {
+        // fonts or the configuration have changed since the cache was written
+        if (ftruncate(fd, 0) != 0 || write(fd, &expected, sizeof(expected)) != (ssize_t)sizeof(expected)) {
+            free(data); flock(fd, LOCK_UN); safe_close(fd, __FILE__, __LINE__); return;
+        }
+        sz = sizeof(expected);
+    }
+    flock(fd, LOCK_UN);
+    free(data);
+    fallback_cache.fd = fd;
+    fallback_cache.file_sz = sz;
+}
+
+static void
+write_fallback_record(const FallbackCacheEntry *e) {
+    if (fallback_cache.fd < 0) return;
+    const size_t num_chars = e->key_sz - 1, path_len = e->path ? strlen(e->path) : 0;
+    if (num_chars > 255 || path_len >= 4096) return;
+    const size_t sz = fallback_record_size(num_chars, path_len);
+    if (fallback_cache.file_sz + sz > MAX_FALLBACK_CACHE_FILE_SIZE) return;
+    RAII_ALLOC(uint8_t, buf, calloc(1, sz));
+    if (!buf) return;
+    FallbackRecordHeader h = {
+        .magic = FALLBACK_RECORD_MAGIC, .num_chars = num_chars, .path_len = path_len, .index = e->index, .hint_style = e->hint_style,
+        .flags = (e->key[0] ? FALLBACK_EMOJI : 0) | (e->missing ? FALLBACK_MISSING : 0) | (e->hinting ? FALLBACK_HINTING : 0),
+    };
+    memcpy(buf, &h, sizeof(h));
+    memcpy(buf + sizeof(h), e->key + 1, sizeof(uint32_t) * num_chars);
+    if (path_len) memcpy(buf + sizeof(h) + sizeof(uint32_t) * num_chars, e->path, path_len);
+    // O_APPEND makes whole record writes safe even if another instance is
+    // appending as well, the record is dropped if one is validating the file
+    if (!lock_fallback_cache_file(fallback_cache.fd, LOCK_SH | LOCK_NB)) return;
+    if (write(fallback_cache.fd, buf, sz) == (ssize_t)sz) fallback_cache.file_sz += sz;
+    flock(fallback_cache.fd, LOCK_UN);
+}
+
+static void
+free_fallback_cache(void) {
+    FallbackCacheEntry *e, *tmp;
+    HASH_ITER(hh, fallback_cache.entries, e, tmp) {
+        HASH_DEL(fallback_cache.entries, e);
+        free(e->path); free(e);
+    }
+    close_fallback_cache_file();
+    fallback_cache.loaded = false;
+}
+
+static PyObject*
+fallback_cache_entry_as_descriptor(const FallbackCacheEntry *e) {
+    return Py_BuildValue("{ss si sO si}", "path", e->path, "index", e->index, "hinting", e->hinting ? Py_True : Py_False, "hint_style", e->hint_style);
+}
+
+static FallbackCacheEntry*
+fallback_fc_match(FcPattern *pat, const uint32_t *key, unsigned key_sz) {
+    FcPattern *match = NULL;
+    FallbackCacheEntry *ans = NULL;
+    FcResult result;
+    FcConfigSubstitute(NULL, pat, FcMatchPattern);
+    FcDefaultSubstitute(pat);
+    match = FcFontMatch(NULL, pat, &result);
+    if (match == NULL) { PyErr_SetString(PyExc_KeyError, "FcFontMatch() failed"); goto end; }
+    FcChar8 *path = NULL;
+    FcCharSet *charset = NULL;
+    int index = 0, hint_style = 0;
+    FcBool hinting = FcFalse;
+    if (FcPatternGetString(match, FC_FILE, 0, &path) != FcResultMatch) { PyErr_SetString(PyExc_ValueError, "No " FC_FILE " found in fontconfig match result"); goto end; }
+    FcPatternGetInteger(match, FC_INDEX, 0, &index);
+    FcPatternGetInteger(match, FC_HINT_STYLE, 0, &hint_style);
+    FcPatternGetBool(match, FC_HINTING, 0, &hinting);
+    // fontconfig returns its best match even if no font has the character,
+    // remember such characters so they are never looked up again
+    const bool missing = FcPatternGetCharSet(match, FC_CHARSET, 0, &charset) == FcResultMatch && !FcCharSetHasChar(charset, key[1]);
+    ans = add_to_fallback_cache(key, key_sz, missing ? NULL : (const char*)path, index, hint_style, hinting, missing);
+    if (!ans) { PyErr_NoMemory(); goto end; }
+    write_fallback_record(ans);
+end:
+    if (match != NULL) FcPatternDestroy(match);
+    return ans;
+}
+// }}}
+
 PyObject*
 create_fallback_face(PyObject UNUSED *base_face, CPUCell* cell, bool emoji_presentation, FONTS_DATA_HANDLE fg) {
     ensure_initialized();
+    load_fallback_cache();
     PyObject *ans = NULL;
-    FcPattern *pat = FcPatternCreate();
-    if (pat == NULL) return PyErr_NoMemory();
-    AP(FcPatternAddString, FC_FAMILY, (const FcChar8*)(emoji_presentation ? "emoji" : "monospace"), "family");
-    if (emoji_presentation) { AP(FcPatternAddBool, FC_COLOR, true, "color"); }
-    size_t num = cell_as_unicode_for_fallback(cell, char_buf);
-    add_charset(pat, num);
-    PyObject *d = _fc_match(pat);
+    FcPattern *pat = NULL;
+    const size_t num = cell_as_unicode_for_fallback(cell, char_buf);
+    uint32_t key[1 + arraysz(cell->cc_idx) + 1] = {emoji_presentation ? 1 : 0};
+    for (size_t i = 0; i < num && i + 1 < arraysz(key); i++) key[i + 1] = char_buf[i];
+    const unsigned key_sz = 1 + MIN(num, arraysz(key) - 1);
+    FallbackCacheEntry *e = find_in_fallback_cache(key, key_sz);
+    if (!e) {
+        pat = FcPatternCreate();
+        if (pat == NULL) return PyErr_NoMemory();
+        AP(FcPatternAddString, FC_FAMILY, (const FcChar8*)(emoji_presentation ? "emoji" : "monospace"), "family");
+        if (emoji_presentation) { AP(FcPatternAddBool, FC_COLOR, true, "color"); }
+        add_charset(pat, num);
+        if (PyErr_Occurred()) goto end;
+        if (!(e = fallback_fc_match(pat, key, key_sz))) goto end;
+    }
+    if (e->missing) { ans = Py_None; Py_INCREF(ans); goto end; }
+    PyObject *d = fallback_cache_entry_as_descriptor(e);
     if (d) {
         ssize_t idx = -1;
         PyObject *q;
@@ -12,6 +12,12 @@
 #include "unicode-data.h"
 #include "alatty-uthash.h"
 #include "glyph-cache.h"
+#include "glyph-rasterizer.h"
+#include "glyph-disk-cache.h"
+#include "box-drawing.h"
+#include "decorations.h"
+#include "canvas-kernels.h"
+#include "wcwidth-std.h"
 
 #define MISSING_GLYPH (NUM_UNDERLINE_STYLES + 2)
 #define MAX_NUM_EXTRA_GLYPHS_PUA 4u
@@ -54,10 +60,13 @@ typedef enum { SPACER_STRATEGY_UNKNOWN, SPACERS_BEFORE, SPACERS_AFTER, SPACERS_I
 typedef struct {
     PyObject *face;
     // Map glyphs to sprite map co-ords
-    SpritePosition *sprite_position_hash_table;
-    GlyphProperties *glyph_properties_hash_table;
+    SpritePositionTable *sprite_position_hash_table;
+    GlyphPropertiesTable *glyph_properties_hash_table;
     bool emoji_presentation;
     SpacerStrategy spacer_strategy;
+    // opened lazily, NULL if the face has no persistent cache
+    GlyphDiskCache *disk_cache;
+    bool disk_cache_opened;
 } Font;
 
 typedef struct Canvas {
@@ -65,22 +74,73 @@ typedef struct Canvas {
     unsigned current_cells, alloced_cells;
 } Canvas;
 
+// Printable ASCII is rendered without shaping when the main font allows it
+#define ASCII_FAST_PATH_FIRST 0x20
+#define ASCII_FAST_PATH_LAST 0x7e
+#define NUM_ASCII_FAST_PATH_CHARS (ASCII_FAST_PATH_LAST - ASCII_FAST_PATH_FIRST + 1)
+typedef enum { ASCII_FAST_PATH_UNKNOWN, ASCII_FAST_PATH_ENABLED, ASCII_FAST_PATH_DISABLED } AsciiFastPathState;
+
 typedef struct fallback_font_map {
     const char *cell_text;
     size_t font_idx;
     UT_hash_handle hh;
 } fallback_font_map_t;
 
+// Caches the result of font_for_cell() for cells without combining marks.
+// The BMP is direct mapped in lazily allocated pages of 256 codepoints, the
+// astral planes use a hash map. Values are zero when unknown, otherwise the
+// font index offset by one past NO_FONT shifted left once, with the low bit
+// set if the index is that of the main font.
+#define FONT_INDEX_PAGE_SHIFT 8u
+#define FONT_INDEX_PAGE_SIZE (1u << FONT_INDEX_PAGE_SHIFT)
+typedef uint16_t FontIndexPage[FONT_INDEX_PAGE_SIZE][2];
+
+typedef struct AstralFontIndex {
+    char_type key;
+    uint16_t val;
+    UT_hash_handle hh;
+} AstralFontIndex;
+
+typedef struct FontIndexCache {
+    FontIndexPage *bmp[0x10000u >> FONT_INDEX_PAGE_SHIFT];
+    AstralFontIndex *astral;
+} FontIndexCache;
+
 typedef struct {
     FONTS_DATA_HEAD
     id_type id;
+    // used to pick which unused groups to discard, see trim_unused_font_groups()
+    monotonic_t last_requested_at;
     unsigned int baseline, underline_position, underline_thickness, strikethrough_position, strikethrough_thickness;
     size_t fonts_capacity, fonts_count, fallback_fonts_count;
     ssize_t medium_font_idx, first_symbol_font_idx, first_fallback_font_idx;
     Font *fonts;
     Canvas canvas;
-    GPUSpriteTracker sprite_tracker;
+    // index 0 is the alpha atlas and index 1 the color atlas
+    GPUSpriteTracker sprite_trackers[2];
     fallback_font_map_t *fallback_font_map;
+    FontIndexCache font_index_cache;
+    AsciiFastPathState ascii_fast_path;
+    glyph_index ascii_glyphs[NUM_ASCII_FAST_PATH_CHARS];
+    SpritePosition *ascii_sprites[NUM_ASCII_FAST_PATH_CHARS];
+    struct {
+        // incremented once per rendered frame, sprites are stamped with it when used
+        uint32_t generation;
+        // OS windows sharing this group render in the same pass, the atlas
+        // housekeeping is done only by the first of them
+        monotonic_t last_frame_at, glyph_wait_frame_at, glyph_wait_deadline;
+        // lines prepared for the OS window being rendered that are waiting for glyphs
+        unsigned lines_with_pending_glyphs;
+        size_t num_compactions, num_evicted, used_slots_after_compaction[2];
+        GPUSpriteTracker after_prerendered;
+    } sprite_atlas;
+    struct {
+        bool done;
+        size_t range;
+        char_type next_char;
+        monotonic_t time;
+        size_t num_cells;
+    } prewarm;
 } FontGroup;
 
 static FontGroup* font_groups = NULL;
@@ -145,10 +205,24 @@ static void
 del_font(Font *f) {
     Py_CLEAR(f->face);
     free_maps(f);
+    close_glyph_disk_cache(f->disk_cache);
+    f->disk_cache = NULL; f->disk_cache_opened = false;
+}
+
+static void
+clear_font_index_cache(FontIndexCache *c) {
+    for (size_t i = 0; i < arraysz(c->bmp); i++) { free(c->bmp[i]); c->bmp[i] = NULL; }
+    AstralFontIndex *current, *tmp;
+    HASH_ITER(hh, c->astral, current, tmp) {
+        HASH_DEL(c->astral, current);
+        free(current);
+    }
+    c->astral = NULL;
 }
 
 static void
 del_font_group(FontGroup *fg) {
+    cancel_glyph_raster_jobs(fg->id);
     free(fg->canvas.buf); fg->canvas.buf = NULL; fg->canvas = (Canvas){0};
     fg->sprite_map = free_sprite_map(fg->sprite_map);
     if (fg->fallback_font_map) {
@@ -160,21 +234,41 @@ del_font_group(FontGroup *fg) {
         }
         fg->fallback_font_map = NULL;
     }
+    clear_font_index_cache(&fg->font_index_cache);
     for (size_t i = 0; i < fg->fonts_count; i++) del_font(fg->fonts + i);
     free(fg->fonts); fg->fonts = NULL;
 }
 
+static size_t
+sprite_atlas_texture_bytes(const FontGroup *fg, bool colored) {
+    if (!fg->sprite_map) return 0;
+    const GPUSpriteTracker *t = fg->sprite_trackers + colored;
+    return (size_t)t->xnum * fg->cell_width * t->ynum * fg->cell_height * (t->z + 1) * (colored ? sizeof(pixel) : 1);
+}
+
+// Groups no longer used by any OS window are kept, along with their sprite
+// atlases, so that going back to a previous font size or DPI, for example
+// when toggling zoom, needs no glyphs to be rendered again. The least
+// recently requested ones are discarded once they exceed these limits.
+#define MAX_RETAINED_FONT_GROUPS 8u
+#define RETAINED_FONT_GROUPS_BUDGET (96u * 1024u * 1024u)
+
 static void
 trim_unused_font_groups(void) {
     save_window_font_groups();
-    size_t i = 0;
-    while (i < num_font_groups) {
-        if (font_group_is_unused(font_groups + i)) {
-            del_font_group(font_groups + i);
-            size_t num_to_right = (--num_font_groups) - i;
-            if (!num_to_right) break;
-            memmove(font_groups + i, font_groups + 1 + i, num_to_right * sizeof(FontGroup));
-        } else i++;
+    while (true) {
+        size_t num_unused = 0, unused_bytes = 0, oldest = num_font_groups;
+        for (size_t i = 0; i < num_font_groups; i++) {
+            FontGroup *fg = font_groups + i;
+            if (!font_group_is_unused(fg)) continue;
+            num_unused++;
+            unused_bytes += sprite_atlas_texture_bytes(fg, false) + sprite_atlas_texture_bytes(fg, true);
+            if (oldest == num_font_groups || fg->last_requested_at < font_groups[oldest].last_requested_at) oldest = i;
+        }
+        if (!num_unused || (num_unused <= MAX_RETAINED_FONT_GROUPS && unused_bytes <= RETAINED_FONT_GROUPS_BUDGET)) break;
+        del_font_group(font_groups + oldest);
+        size_t num_to_right = (--num_font_groups) - oldest;
+        if (num_to_right) memmove(font_groups + oldest, font_groups + 1 + oldest, num_to_right * sizeof(FontGroup));
     }
     restore_window_font_groups();
 }
@@ -196,7 +290,10 @@ static FontGroup*
 font_group_for(double font_sz_in_pts, double logical_dpi_x, double logical_dpi_y) {
     for (size_t i = 0; i < num_font_groups; i++) {
         FontGroup *fg = font_groups + i;
-        if (fg->font_sz_in_pts == font_sz_in_pts && fg->logical_dpi_x == logical_dpi_x && fg->logical_dpi_y == logical_dpi_y) return fg;
+        if (fg->font_sz_in_pts == font_sz_in_pts && fg->logical_dpi_x == logical_dpi_x && fg->logical_dpi_y == logical_dpi_y) {
+            fg->last_requested_at = monotonic();
+            return fg;
+        }
     }
     add_font_group();
     FontGroup *fg = font_groups + num_font_groups - 1;
@@ -205,6 +302,7 @@ font_group_for(double font_sz_in_pts, double logical_dpi_x, double logical_dpi_y
     fg->logical_dpi_x = logical_dpi_x;
     fg->logical_dpi_y = logical_dpi_y;
     fg->id = ++font_group_id_counter;
+    fg->last_requested_at = monotonic();
     initialize_font_group(fg);
     return fg;
 }
@@ -232,35 +330,48 @@ sprite_tracker_set_limits(size_t max_texture_size_, size_t max_array_len_) {
 }
 
 static void
-do_increment(FontGroup *fg, int *error) {
-    fg->sprite_tracker.x++;
-    if (fg->sprite_tracker.x >= fg->sprite_tracker.xnum) {
-        fg->sprite_tracker.x = 0; fg->sprite_tracker.y++;
-        fg->sprite_tracker.ynum = MIN(MAX(fg->sprite_tracker.ynum, fg->sprite_tracker.y + 1), fg->sprite_tracker.max_y);
-        if (fg->sprite_tracker.y >= fg->sprite_tracker.max_y) {
-            fg->sprite_tracker.y = 0; fg->sprite_tracker.z++;
-            if (fg->sprite_tracker.z >= MIN((size_t)UINT16_MAX, max_array_len)) *error = 2;
+do_increment(GPUSpriteTracker *t) {
+    t->x++;
+    if (t->x >= t->xnum) {
+        t->x = 0; t->y++;
+        t->ynum = MIN(MAX(t->ynum, t->y + 1), t->max_y);
+        if (t->y >= t->max_y) {
+            t->y = 0; t->z++;
         }
     }
 }
 
+static bool
+allocate_sprite(FontGroup *fg, SpritePosition *s, bool colored, int *error) {
+    // Sprites are placed only once rendered, as only then is it known which
+    // atlas they belong in
+    GPUSpriteTracker *t = fg->sprite_trackers + colored;
+    if (t->z >= MIN((size_t)UINT16_MAX, max_array_len)) { *error = 2; return false; }
+    s->x = t->x; s->y = t->y; s->z = t->z;
+    s->colored = colored; s->rendered = true;
+    do_increment(t);
+    return true;
+}
+
+static unsigned int
+sprite_z(const SpritePosition *s) {
+    return s->colored ? s->z | COLORED_SPRITE_MASK : s->z;
+}
+
 
 static SpritePosition*
 sprite_position_for(FontGroup *fg, Font *font, glyph_index *glyphs, unsigned glyph_count, uint8_t ligature_index, unsigned cell_count, int *error) {
     bool created;
     SpritePosition *s = find_or_create_sprite_position(&font->sprite_position_hash_table, glyphs, glyph_count, ligature_index, cell_count, &created);
     if (!s) { *error = 1; return NULL; }
-    if (created) {
-        s->x = fg->sprite_tracker.x; s->y = fg->sprite_tracker.y; s->z = fg->sprite_tracker.z;
-        do_increment(fg, error);
-    }
+    s->last_used = fg->sprite_atlas.generation;
     return s;
 }
 
 void
-sprite_tracker_current_layout(FONTS_DATA_HANDLE data, unsigned int *x, unsigned int *y, unsigned int *z) {
-    FontGroup *fg = (FontGroup*)data;
-    *x = fg->sprite_tracker.xnum; *y = fg->sprite_tracker.ynum; *z = fg->sprite_tracker.z;
+sprite_tracker_current_layout(FONTS_DATA_HANDLE data, bool colored, unsigned int *x, unsigned int *y, unsigned int *z) {
+    const GPUSpriteTracker *t = ((FontGroup*)data)->sprite_trackers + colored;
+    *x = t->xnum; *y = t->ynum; *z = t->z;
 }
 
 
@@ -291,12 +402,12 @@ init_font(Font *f, PyObject *face, bool emoji_presentation) {
 
 static void
 free_font_groups(void) {
+    shutdown_glyph_rasterizer();
     if (font_groups) {
         for (size_t i = 0; i < num_font_groups; i++) del_font_group(font_groups + i);
         free(font_groups); font_groups = NULL;
         font_groups_capacity = 0; num_font_groups = 0;
     }
-    free_glyph_cache_global_resources();
 }
 
 static void
@@ -377,7 +488,8 @@ calc_cell_metrics(FontGroup *fg) {
         baseline += MIN(cell_height - 1, (unsigned)line_height_adjustment / 2);
         underline_position += MIN(cell_height - 1, (unsigned)line_height_adjustment / 2);
     }
-    sprite_tracker_set_layout(&fg->sprite_tracker, cell_width, cell_height);
+    sprite_tracker_set_layout(fg->sprite_trackers, cell_width, cell_height);
+    sprite_tracker_set_layout(fg->sprite_trackers + 1, cell_width, cell_height);
     fg->cell_width = cell_width; fg->cell_height = cell_height;
     fg->baseline = baseline; fg->underline_position = underline_position; fg->underline_thickness = underline_thickness, fg->strikethrough_position = strikethrough_position, fg->strikethrough_thickness = strikethrough_thickness;
     ensure_canvas_can_fit(fg, 8);
@@ -500,6 +612,35 @@ fallback_font(FontGroup *fg, CPUCell *cpu_cell, GPUCell *gpu_cell) {
     return idx;
 }
 
+static uint16_t
+cached_font_index(FontGroup *fg, char_type ch, bool emoji_presentation) {
+    FontIndexCache *c = &fg->font_index_cache;
+    if (ch < 0x10000) {
+        FontIndexPage *page = c->bmp[ch >> FONT_INDEX_PAGE_SHIFT];
+        return page ? (*page)[ch & (FONT_INDEX_PAGE_SIZE - 1)][emoji_presentation] : 0;
+    }
+    const char_type key = (ch << 1) | emoji_presentation;
+    AstralFontIndex *s = NULL;
+    HASH_FIND(hh, c->astral, &key, sizeof(key), s);
+    return s ? s->val : 0;
+}
+
+static void
+cache_font_index(FontGroup *fg, char_type ch, bool emoji_presentation, ssize_t idx, bool is_main_font) {
+    FontIndexCache *c = &fg->font_index_cache;
+    const uint16_t val = (uint16_t)(((idx - NO_FONT + 1) << 1) | is_main_font);
+    if (ch < 0x10000) {
+        FontIndexPage **page = c->bmp + (ch >> FONT_INDEX_PAGE_SHIFT);
+        if (!*page && !(*page = calloc(1, sizeof(FontIndexPage)))) return;
+        (**page)[ch & (FONT_INDEX_PAGE_SIZE - 1)][emoji_presentation] = val;
+        return;
+    }
+    AstralFontIndex *s = calloc(1, sizeof(AstralFontIndex));
+    if (!s) return;
+    s->key = (ch << 1) | emoji_presentation; s->val = val;
+    HASH_ADD(hh, c->astral, key, sizeof(s->key), s);
+}
+
 // Decides which 'font' to use for a given cell.
 //
 // Possible results:
@@ -527,11 +668,20 @@ START_ALLOW_CASE_RANGE
         case 0xe0b0 ... 0xe0bf:    // powerline box drawing
         case 0x1fb00 ... 0x1fbae:  // symbols for legacy computing
             return BOX_FONT;
-        default:
+        default: {
             *is_emoji_presentation = has_emoji_presentation(cpu_cell, gpu_cell);
+            // the font used for a cell with combining marks depends on the marks as well
+            const bool cacheable = !cpu_cell->cc_idx[0];
+            if (cacheable) {
+                const uint16_t val = cached_font_index(fg, cpu_cell->ch, *is_emoji_presentation);
+                if (val) { *is_main_font = val & 1; return (ssize_t)(val >> 1) - 1 + NO_FONT; }
+            }
             ans = fg->medium_font_idx;
-            if (!*is_emoji_presentation && has_cell_text(fg->fonts + ans, cpu_cell)) { *is_main_font = true; return ans; }
-            return fallback_font(fg, cpu_cell, gpu_cell);
+            if (!*is_emoji_presentation && has_cell_text(fg->fonts + ans, cpu_cell)) *is_main_font = true;
+            else ans = fallback_font(fg, cpu_cell, gpu_cell);
+            if (cacheable) cache_font_index(fg, cpu_cell->ch, *is_emoji_presentation, ans, *is_main_font);
+            return ans;
+        }
     }
 END_ALLOW_CASE_RANGE
 }
@@ -560,43 +710,49 @@ START_ALLOW_CASE_RANGE
 END_ALLOW_CASE_RANGE
 }
 
-static PyObject* box_drawing_function = NULL, *prerender_function = NULL, *descriptor_for_idx = NULL;
+static PyObject *descriptor_for_idx = NULL;
 
 void
 render_alpha_mask(const uint8_t *alpha_mask, pixel* dest, Region *src_rect, Region *dest_rect, size_t src_stride, size_t dest_stride) {
+    if (src_rect->left >= src_rect->right || dest_rect->left >= dest_rect->right) return;
+    const size_t count = MIN(src_rect->right - src_rect->left, dest_rect->right - dest_rect->left);
     for (size_t sr = src_rect->top, dr = dest_rect->top; sr < src_rect->bottom && dr < dest_rect->bottom; sr++, dr++) {
-        pixel *d = dest + dest_stride * dr;
-        const uint8_t *s = alpha_mask + src_stride * sr;
-        for(size_t sc = src_rect->left, dc = dest_rect->left; sc < src_rect->right && dc < dest_rect->right; sc++, dc++) {
-            uint8_t src_alpha = d[dc] & 0xff;
-            uint8_t alpha = s[sc];
-            d[dc] = 0xffffff00 | MAX(alpha, src_alpha);
-        }
+        blend_alpha_mask_row(dest + dest_stride * dr + dest_rect->left, alpha_mask + src_stride * sr + src_rect->left, count);
     }
 }
 
+static uint8_t*
+cleared_alpha_mask(FontGroup *fg) {
+    // The canvas has room for three cells, the mask lives after the first one
+    ensure_canvas_can_fit(fg, 1);
+    return (uint8_t*)(fg->canvas.buf + fg->cell_width * fg->cell_height);
+}
+
+static void
+send_alpha_mask_to_gpu(FontGroup *fg, const uint8_t *alpha_mask, sprite_index x, sprite_index y, sprite_index z) {
+    Region r = { .right = fg->cell_width, .bottom = fg->cell_height };
+    render_alpha_mask(alpha_mask, fg->canvas.buf, &r, &r, fg->cell_width, fg->cell_width);
+    current_send_sprite_to_gpu((FONTS_DATA_HANDLE)fg, x, y, z, fg->canvas.buf);
+}
+
 static void
 render_box_cell(FontGroup *fg, CPUCell *cpu_cell, GPUCell *gpu_cell) {
     int error = 0;
     glyph_index glyph = box_glyph_id(cpu_cell->ch);
     SpritePosition *sp = sprite_position_for(fg, &fg->fonts[BOX_FONT], &glyph, 1, 0, 1, &error);
+    if (sp != NULL && !sp->rendered) {
+        if (allocate_sprite(fg, sp, false, &error)) {
+            uint8_t *alpha_mask = cleared_alpha_mask(fg);
+            render_box_char(cpu_cell->ch, alpha_mask, fg->cell_width, fg->cell_height, (fg->logical_dpi_x + fg->logical_dpi_y) / 2.0);
+            send_alpha_mask_to_gpu(fg, alpha_mask, sp->x, sp->y, sp->z);
+        } else sp = NULL;
+    }
     if (sp == NULL) {
         sprite_map_set_error(error); PyErr_Print();
         set_sprite(gpu_cell, 0, 0, 0);
         return;
     }
     set_sprite(gpu_cell, sp->x, sp->y, sp->z);
-    if (sp->rendered) return;
-    sp->rendered = true;
-    sp->colored = false;
-    PyObject *ret = PyObject_CallFunction(box_drawing_function, "IIId", cpu_cell->ch, fg->cell_width, fg->cell_height, (fg->logical_dpi_x + fg->logical_dpi_y) / 2.0);
-    if (ret == NULL) { PyErr_Print(); return; }
-    uint8_t *alpha_mask = PyLong_AsVoidPtr(PyTuple_GET_ITEM(ret, 0));
-    ensure_canvas_can_fit(fg, 1);
-    Region r = { .right = fg->cell_width, .bottom = fg->cell_height };
-    render_alpha_mask(alpha_mask, fg->canvas.buf, &r, &r, fg->cell_width, fg->cell_width);
-    current_send_sprite_to_gpu((FONTS_DATA_HANDLE)fg, sp->x, sp->y, sp->z, fg->canvas.buf);
-    Py_DECREF(ret);
 }
 
 static void
@@ -623,7 +779,7 @@ load_hb_buffer(CPUCell *first_cpu_cell, GPUCell *first_gpu_cell, index_type num_
 static void
 set_cell_sprite(GPUCell *cell, const SpritePosition *sp) {
     cell->sprite_x = sp->x; cell->sprite_y = sp->y; cell->sprite_z = sp->z;
-    if (sp->colored) cell->sprite_z |= 0x4000;
+    if (sp->colored) cell->sprite_z |= COLORED_SPRITE_MASK;
 }
 
 static pixel*
@@ -636,22 +792,122 @@ extract_cell_from_canvas(FontGroup *fg, unsigned int i, unsigned int num_cells)
 
 typedef struct GlyphRenderScratch {
     SpritePosition* *sprite_positions;
-    glyph_index *glyphs;
+    glyph_index *glyphs, *ligature_indices;
     size_t sz;
 } GlyphRenderScratch;
 static GlyphRenderScratch global_glyph_render_scratch = {0};
 
+static void
+ensure_glyph_render_scratch_space(size_t sz) {
+    sz += 16;
+    if (global_glyph_render_scratch.sz < sz) {
+#define a(what) free(global_glyph_render_scratch.what); global_glyph_render_scratch.what = malloc(sz * sizeof(global_glyph_render_scratch.what[0])); if (!global_glyph_render_scratch.what) fatal("Out of memory");
+        a(glyphs); a(sprite_positions); a(ligature_indices);
+#undef a
+        global_glyph_render_scratch.sz = sz;
+    }
+}
+
+static GlyphDiskCache*
+disk_cache_for(FontGroup *fg, Font *font) {
+    // sprites sent to python, as the tests do, are always rendered afresh
+    if (current_send_sprite_to_gpu != send_sprite_to_gpu) return NULL;
+    if (!font->disk_cache_opened) {
+        font->disk_cache_opened = true;
+        RasterizerFace face;
+        if (rasterizer_face_for(font->face, &face)) font->disk_cache = open_glyph_disk_cache(&face, fg->cell_width, fg->cell_height, fg->baseline);
+    }
+    return font->disk_cache;
+}
+
+static void
+send_rendered_sprites_to_gpu(FontGroup *fg, Font *font, SpritePosition **sp, unsigned int num_cells, bool colored, const glyph_index *glyphs, unsigned glyph_count, const glyph_index *ligature_indices, bool cacheable) {
+    // the cells of the group have been rendered into the canvas
+    int error = 0;
+    GlyphDiskCache *cache = cacheable ? disk_cache_for(fg, font) : NULL;
+    for (unsigned i = 0; i < num_cells; i++) {
+        if (sp[i]->rendered) continue;
+        sp[i]->rasterizing = false; sp[i]->prewarming = false;
+        if (!allocate_sprite(fg, sp[i], colored, &error)) { sprite_map_set_error(error); PyErr_Print(); continue; }
+        pixel *buf = num_cells == 1 ? fg->canvas.buf : extract_cell_from_canvas(fg, i, num_cells);
+        current_send_sprite_to_gpu((FONTS_DATA_HANDLE)fg, sp[i]->x, sp[i]->y, sprite_z(sp[i]), buf);
+        if (cache) glyph_disk_cache_put(cache, glyphs, glyph_count, ligature_indices[i], num_cells, colored, buf);
+    }
+}
+
+static bool
+load_group_from_disk_cache(FontGroup *fg, Font *font, unsigned int num_cells, const glyph_index *glyphs, unsigned glyph_count) {
+#define sp global_glyph_render_scratch.sprite_positions
+    // returns true if all cells of the group are now rendered
+    GlyphDiskCache *cache = disk_cache_for(fg, font);
+    if (!cache) return false;
+    int error = 0;
+    bool all_rendered = true;
+    const size_t num_pixels = (size_t)fg->cell_width * fg->cell_height;
+    ensure_canvas_can_fit(fg, 1);
+    for (unsigned i = 0; i < num_cells; i++) {
+        if (sp[i]->rendered) continue;
+        bool colored;
+        const uint8_t *pixels = glyph_disk_cache_get(cache, glyphs, glyph_count, global_glyph_render_scratch.ligature_indices[i], num_cells, &colored);
+        if (!pixels) { all_rendered = false; continue; }
+        if (!allocate_sprite(fg, sp[i], colored, &error)) { sprite_map_set_error(error); PyErr_Print(); return false; }
+        pixel *buf = fg->canvas.buf;
+        if (colored) memcpy(buf, pixels, num_pixels * sizeof(pixel));
+        else for (size_t p = 0; p < num_pixels; p++) buf[p] = pixels[p] ? 0xffffff00 | pixels[p] : 0;
+        current_send_sprite_to_gpu((FONTS_DATA_HANDLE)fg, sp[i]->x, sp[i]->y, sprite_z(sp[i]), buf);
+    }
+    return all_rendered;
+#undef sp
+}
+
+// Set when a glyph in the line being rendered is still being rasterized in the background
+static bool line_has_pending_glyphs = false;
+// Set while the line being rendered is one shaped by prewarm_sprite_atlas()
+static bool rendering_prewarm_line = false;
+
+static bool
+rasterize_group_in_background(FontGroup *fg, unsigned int num_cells, unsigned int num_glyphs, hb_glyph_info_t *info, hb_glyph_position_t *positions, Font *font, glyph_index *glyphs, unsigned glyph_count, bool center_glyph, bool was_colored) {
+#define sp global_glyph_render_scratch.sprite_positions
+    // sprites sent to python, as the tests do, must be rendered synchronously
+    if (current_send_sprite_to_gpu != send_sprite_to_gpu || !fg->sprite_map) return false;
+    bool needs_job = false;
+    for (unsigned i = 0; i < num_cells; i++) {
+        // glyphs on screen that are only queued by a prewarm job get a job of their own
+        if (!sp[i]->rendered && (!sp[i]->rasterizing || (sp[i]->prewarming && !rendering_prewarm_line))) needs_job = true;
+    }
+    if (!needs_job) return true;
+    RasterizerFace face;
+    if (!rasterizer_face_for(font->face, &face)) return false;
+    GlyphRasterJob *job = alloc_glyph_raster_job(&face, num_cells, num_glyphs, glyph_count, fg->cell_width, fg->cell_height);
+    if (!job) return false;
+    job->font_group_id = fg->id; job->font_idx = font - fg->fonts;
+    job->baseline = fg->baseline; job->center_glyph = center_glyph; job->was_colored = was_colored;
+    job->prewarm = rendering_prewarm_line;
+    memcpy(job->info, info, sizeof(info[0]) * num_glyphs);
+    memcpy(job->positions, positions, sizeof(positions[0]) * num_glyphs);
+    memcpy(job->glyphs, glyphs, sizeof(glyphs[0]) * glyph_count);
+    memcpy(job->ligature_indices, global_glyph_render_scratch.ligature_indices, sizeof(job->ligature_indices[0]) * num_cells);
+    if (!submit_glyph_raster_job(job)) { free_glyph_raster_jobs(job); return false; }
+    for (unsigned i = 0; i < num_cells; i++) {
+        if (!sp[i]->rendered) { sp[i]->rasterizing = true; sp[i]->prewarming = rendering_prewarm_line; }
+    }
+    return true;
+#undef sp
+}
+
 static void
 render_group(FontGroup *fg, unsigned int num_cells, unsigned int num_glyphs, CPUCell *cpu_cells, GPUCell *gpu_cells, hb_glyph_info_t *info, hb_glyph_position_t *positions, Font *font, glyph_index *glyphs, unsigned glyph_count, bool center_glyph) {
 #define sp global_glyph_render_scratch.sprite_positions
+#define ligature_indices global_glyph_render_scratch.ligature_indices
     int error = 0;
     bool all_rendered = true;
     bool is_infinite_ligature = num_cells > 9 && num_glyphs == num_cells;
     for (unsigned i = 0, ligature_index = 0; i < num_cells; i++) {
         bool is_repeat_glyph = is_infinite_ligature && i > 1 && i + 1 < num_cells && glyphs[i] == glyphs[i-1] && glyphs[i] == glyphs[i-2] && glyphs[i] == glyphs[i+1];
         if (is_repeat_glyph) {
-            sp[i] = sp[i-1];
+            sp[i] = sp[i-1]; ligature_indices[i] = ligature_indices[i-1];
         } else {
+            ligature_indices[i] = ligature_index;
             sp[i] = sprite_position_for(fg, font, glyphs, glyph_count, ligature_index++, num_cells, &error);
         }
         if (error != 0) { sprite_map_set_error(error); PyErr_Print(); return; }
@@ -662,23 +918,92 @@ render_group(FontGroup *fg, unsigned int num_cells, unsigned int num_glyphs, CPU
         return;
     }
 
-    ensure_canvas_can_fit(fg, num_cells + 1);
+    if (load_group_from_disk_cache(fg, font, num_cells, glyphs, glyph_count)) {
+        for (unsigned i = 0; i < num_cells; i++) set_cell_sprite(gpu_cells + i, sp[i]);
+        return;
+    }
     bool was_colored = gpu_cells->attrs.width == 2 && is_emoji(cpu_cells->ch);
-    render_glyphs_in_cells(font->face, info, positions, num_glyphs, fg->canvas.buf, fg->cell_width, fg->cell_height, num_cells, fg->baseline, &was_colored, (FONTS_DATA_HANDLE)fg, center_glyph);
+    if (rasterize_group_in_background(fg, num_cells, num_glyphs, info, positions, font, glyphs, glyph_count, center_glyph, was_colored)) {
+        // cells stay blank until the glyphs arrive, which is at most a frame later
+        for (unsigned i = 0; i < num_cells; i++) {
+            if (sp[i]->rendered) set_cell_sprite(gpu_cells + i, sp[i]);
+            else set_sprite(gpu_cells + i, 0, 0, 0);
+        }
+        line_has_pending_glyphs = true;
+        return;
+    }
+    ensure_canvas_can_fit(fg, num_cells + 1);
+    const bool ok = render_glyphs_in_cells(font->face, info, positions, num_glyphs, fg->canvas.buf, fg->cell_width, fg->cell_height, num_cells, fg->baseline, &was_colored, (FONTS_DATA_HANDLE)fg, center_glyph);
     if (PyErr_Occurred()) PyErr_Print();
+    send_rendered_sprites_to_gpu(fg, font, sp, num_cells, was_colored, glyphs, glyph_count, ligature_indices, ok);
 
     for (unsigned i = 0; i < num_cells; i++) {
-        if (!sp[i]->rendered) {
-            sp[i]->rendered = true;
-            sp[i]->colored = was_colored;
-            pixel *buf = num_cells == 1 ? fg->canvas.buf : extract_cell_from_canvas(fg, i, num_cells);
-            current_send_sprite_to_gpu((FONTS_DATA_HANDLE)fg, sp[i]->x, sp[i]->y, sp[i]->z, buf);
+        if (sp[i]->rendered) set_cell_sprite(gpu_cells + i, sp[i]);
+        else set_sprite(gpu_cells + i, 0, 0, 0);
+    }
+#undef ligature_indices
+#undef sp
+}
+
+static void
+collect_rasterized_glyphs_for(FontGroup *fg) {
+#define sp global_glyph_render_scratch.sprite_positions
+    GlyphRasterJob *jobs = finished_glyph_raster_jobs(fg->id);
+    for (GlyphRasterJob *job = jobs; job; job = job->next) {
+        if (job->error[0]) log_error("%s", job->error);
+        if (job->font_idx >= fg->fonts_count || job->cell_width != fg->cell_width || job->cell_height != fg->cell_height) continue;
+        Font *font = fg->fonts + job->font_idx;
+        // look the sprites up again as they may have been evicted meanwhile
+        int error = 0;
+        bool all_rendered = true;
+        ensure_glyph_render_scratch_space(job->num_cells);
+        for (unsigned i = 0; i < job->num_cells && !error; i++) {
+            sp[i] = sprite_position_for(fg, font, job->glyphs, job->glyph_count, job->ligature_indices[i], job->num_cells, &error);
+            if (sp[i] && !sp[i]->rendered) all_rendered = false;
         }
-        set_cell_sprite(gpu_cells + i, sp[i]);
+        if (error) { sprite_map_set_error(error); PyErr_Print(); continue; }
+        if (all_rendered) continue;
+        ensure_canvas_can_fit(fg, job->num_cells + 1);
+        memcpy(fg->canvas.buf, job->canvas, sizeof(pixel) * job->num_cells * fg->cell_width * fg->cell_height);
+        send_rendered_sprites_to_gpu(fg, font, sp, job->num_cells, job->was_colored, job->glyphs, job->glyph_count, job->ligature_indices, job->succeeded);
     }
+    free_glyph_raster_jobs(jobs);
 #undef sp
 }
 
+void
+collect_rasterized_glyphs(FONTS_DATA_HANDLE fg_) {
+    // Called before the cell data of an OS window is prepared
+    FontGroup *fg = (FontGroup*)fg_;
+    fg->sprite_atlas.lines_with_pending_glyphs = 0;
+    collect_rasterized_glyphs_for(fg);
+}
+
+bool
+wait_for_rasterized_glyphs(FONTS_DATA_HANDLE fg_, monotonic_t frame_started_at, monotonic_t timeout) {
+    // All OS windows using this font group share one deadline per frame, so
+    // they do not each wait for the same glyphs
+    FontGroup *fg = (FontGroup*)fg_;
+    // only wait if the window being rendered has lines left blank
+    if (!fg->sprite_atlas.lines_with_pending_glyphs) return false;
+    fg->sprite_atlas.lines_with_pending_glyphs = 0;
+    const monotonic_t now = monotonic();
+    if (fg->sprite_atlas.glyph_wait_frame_at != frame_started_at) {
+        fg->sprite_atlas.glyph_wait_frame_at = frame_started_at;
+        fg->sprite_atlas.glyph_wait_deadline = now + timeout;
+    }
+    if (!wait_for_glyph_raster_jobs(fg->id, MAX(0, fg->sprite_atlas.glyph_wait_deadline - now))) return false;
+    collect_rasterized_glyphs_for(fg);
+    return true;
+}
+
+void
+flush_glyph_disk_caches(FONTS_DATA_HANDLE fg_) {
+    // the sprites rendered during a frame are written to the disk caches in one go
+    FontGroup *fg = (FontGroup*)fg_;
+    for (size_t i = 0; i < fg->fonts_count; i++) flush_glyph_disk_cache(fg->fonts[i].disk_cache);
+}
+
 typedef struct {
     CPUCell *cpu_cell;
     GPUCell *gpu_cell;
@@ -1137,13 +1462,7 @@ render_groups(FontGroup *fg, Font *font, bool center_glyph) {
         /* printf("Group: idx: %u num_cells: %u num_glyphs: %u first_glyph_idx: %u first_cell_idx: %u total_num_glyphs: %zu\n", */
         /*         idx, group->num_cells, group->num_glyphs, group->first_glyph_idx, group->first_cell_idx, group_state.num_glyphs); */
         if (group->num_glyphs) {
-            size_t sz = MAX(group->num_glyphs, group->num_cells) + 16;
-            if (global_glyph_render_scratch.sz < sz) {
-#define a(what) free(global_glyph_render_scratch.what); global_glyph_render_scratch.what = malloc(sz * sizeof(global_glyph_render_scratch.what[0])); if (!global_glyph_render_scratch.what) fatal("Out of memory");
-                a(glyphs); a(sprite_positions);
-#undef a
-                global_glyph_render_scratch.sz = sz;
-            }
+            ensure_glyph_render_scratch_space(MAX(group->num_glyphs, group->num_cells));
             for (unsigned i = 0; i < group->num_glyphs; i++) global_glyph_render_scratch.glyphs[i] = G(info)[group->first_glyph_idx + i].codepoint;
             render_group(fg, group->num_cells, group->num_glyphs, G(first_cpu_cell) + group->first_cell_idx, G(first_gpu_cell) + group->first_cell_idx, G(info) + group->first_glyph_idx, G(positions) + group->first_glyph_idx, font, global_glyph_render_scratch.glyphs, group->num_glyphs, center_glyph);
         }
@@ -1190,6 +1509,77 @@ render_run(FontGroup *fg, CPUCell *first_cpu_cell, GPUCell *first_gpu_cell, inde
     }
 }
 
+// ASCII fast path {{{
+
+static void
+detect_ascii_fast_path(FontGroup *fg) {
+    // Bypassing the shaper is only correct if the main font renders every
+    // pair of printable ASCII characters as exactly the glyphs from its cmap,
+    // with no substitutions (ligatures) and no positioning offsets.
+    Font *font = fg->fonts + fg->medium_font_idx;
+    fg->ascii_fast_path = ASCII_FAST_PATH_DISABLED;
+    char_type chars[NUM_ASCII_FAST_PATH_CHARS];
+    unsigned num_chars = 0;
+    for (char_type ch = ASCII_FAST_PATH_FIRST + 1; ch <= ASCII_FAST_PATH_LAST; ch++) {
+        glyph_index g = glyph_id_for_codepoint(font->face, ch);
+        fg->ascii_glyphs[ch - ASCII_FAST_PATH_FIRST] = g;
+        if (g) chars[num_chars++] = ch;
+    }
+    if (!num_chars) return;
+    const unsigned text_len = 2 * num_chars * num_chars;
+    RAII_ALLOC(char_type, text, malloc(text_len * sizeof(char_type)));
+    if (!text) return;
+    for (unsigned a = 0, n = 0; a < num_chars; a++) {
+        for (unsigned b = 0; b < num_chars; b++) { text[n++] = chars[a]; text[n++] = chars[b]; }
+    }
+    hb_buffer_clear_contents(harfbuzz_buffer);
+    hb_buffer_add_utf32(harfbuzz_buffer, text, text_len, 0, text_len);
+    hb_buffer_guess_segment_properties(harfbuzz_buffer);
+    hb_shape(harfbuzz_font_for_face(font->face), harfbuzz_buffer, hb_features, 1);
+    unsigned int info_length, positions_length;
+    hb_glyph_info_t *info = hb_buffer_get_glyph_infos(harfbuzz_buffer, &info_length);
+    hb_glyph_position_t *positions = hb_buffer_get_glyph_positions(harfbuzz_buffer, &positions_length);
+    if (!info || !positions || info_length != text_len || positions_length != text_len) return;
+    for (unsigned i = 0; i < text_len; i++) {
+        if (
+            info[i].cluster != i || info[i].codepoint != fg->ascii_glyphs[text[i] - ASCII_FAST_PATH_FIRST] ||
+            positions[i].x_offset || positions[i].y_offset
+        ) return;
+    }
+    fg->ascii_fast_path = ASCII_FAST_PATH_ENABLED;
+}
+
+static bool
+is_ascii_fast_path_cell(const FontGroup *fg, const CPUCell *cpu_cell) {
+    const char_type ch = cpu_cell->ch;
+    return ASCII_FAST_PATH_FIRST <= ch && ch <= ASCII_FAST_PATH_LAST && !cpu_cell->cc_idx[0] && (ch == ' ' || fg->ascii_glyphs[ch - ASCII_FAST_PATH_FIRST]);
+}
+
+static SpritePosition*
+render_ascii_glyph(FontGroup *fg, CPUCell *cpu_cell, GPUCell *gpu_cell) {
+    Font *font = fg->fonts + fg->medium_font_idx;
+    glyph_index glyph = fg->ascii_glyphs[cpu_cell->ch - ASCII_FAST_PATH_FIRST];
+    hb_glyph_info_t info = {.codepoint = glyph};
+    hb_glyph_position_t position = {0};
+    ensure_glyph_render_scratch_space(1);
+    global_glyph_render_scratch.sprite_positions[0] = NULL;
+    render_group(fg, 1, 1, cpu_cell, gpu_cell, &info, &position, font, &glyph, 1, false);
+    SpritePosition *s = global_glyph_render_scratch.sprite_positions[0];
+    return s && s->rendered ? s : NULL;
+}
+
+static void
+render_ascii_run(FontGroup *fg, CPUCell *cpu_cells, GPUCell *gpu_cells, index_type num_cells) {
+    for (index_type i = 0; i < num_cells; i++) {
+        const char_type ch = cpu_cells[i].ch;
+        if (ch == ' ') { set_sprite(gpu_cells + i, 0, 0, 0); continue; }
+        SpritePosition **s = fg->ascii_sprites + (ch - ASCII_FAST_PATH_FIRST);
+        if (LIKELY(*s)) { set_cell_sprite(gpu_cells + i, *s); (*s)->last_used = fg->sprite_atlas.generation; }
+        else *s = render_ascii_glyph(fg, cpu_cells + i, gpu_cells + i);
+    }
+}
+// }}}
+
 static bool
 is_non_emoji_dingbat(char_type ch) {
     switch(ch) {
@@ -1202,7 +1592,7 @@ is_non_emoji_dingbat(char_type ch) {
     return false;
 }
 
-void
+bool
 render_line(FONTS_DATA_HANDLE fg_, Line *line, Cursor *cursor) {
 #define RENDER if (run_font_idx != NO_FONT && i > first_cell_in_run) { \
     int cursor_offset = -1; \
@@ -1214,10 +1604,25 @@ render_line(FONTS_DATA_HANDLE fg_, Line *line, Cursor *cursor) {
     bool center_glyph = false;
     index_type first_cell_in_run, i;
     uint16_t prev_width = 0;
+    line_has_pending_glyphs = false;
+    if (UNLIKELY(fg->ascii_fast_path == ASCII_FAST_PATH_UNKNOWN)) detect_ascii_fast_path(fg);
+    const bool use_ascii_fast_path = fg->ascii_fast_path == ASCII_FAST_PATH_ENABLED;
     for (i=0, first_cell_in_run=0; i < line->xnum; i++) {
         if (prev_width == 2) { prev_width = 0; continue; }
         CPUCell *cpu_cell = line->cpu_cells + i;
         GPUCell *gpu_cell = line->gpu_cells + i;
+        if (use_ascii_fast_path && is_ascii_fast_path_cell(fg, cpu_cell)) {
+            // Runs of plain ASCII in the main font need no shaping
+            index_type limit = i + 1;
+            while (limit < line->xnum && is_ascii_fast_path_cell(fg, line->cpu_cells + limit)) limit++;
+            RENDER
+            render_ascii_run(fg, cpu_cell, gpu_cell, limit - i);
+            run_font_idx = NO_FONT;
+            first_cell_in_run = limit;
+            prev_width = 1;
+            i = limit - 1;
+            continue;
+        }
         bool is_main_font, is_emoji_presentation;
         ssize_t cell_font_idx = font_for_cell(fg, cpu_cell, gpu_cell, &is_main_font, &is_emoji_presentation);
 
@@ -1272,6 +1677,8 @@ render_line(FONTS_DATA_HANDLE fg_, Line *line, Cursor *cursor) {
     }
     RENDER
 #undef RENDER
+    if (line_has_pending_glyphs && !rendering_prewarm_line) fg->sprite_atlas.lines_with_pending_glyphs++;
+    return !line_has_pending_glyphs;
 }
 
 StringCanvas
@@ -1290,40 +1697,50 @@ DescriptorIndices descriptor_indices = {0};
 
 static PyObject*
 set_font_data(PyObject UNUSED *m, PyObject *args) {
-    Py_CLEAR(box_drawing_function); Py_CLEAR(prerender_function); Py_CLEAR(descriptor_for_idx);
-    if (!PyArg_ParseTuple(args, "OOOId",
-                &box_drawing_function, &prerender_function, &descriptor_for_idx,
-                &descriptor_indices.num_symbol_fonts,
-                &OPT(font_size))) return NULL;
-    Py_INCREF(box_drawing_function); Py_INCREF(prerender_function); Py_INCREF(descriptor_for_idx);
+    Py_CLEAR(descriptor_for_idx);
+    const char *glyph_cache_dir = NULL;
+    if (!PyArg_ParseTuple(args, "OId|z",
+                &descriptor_for_idx, &descriptor_indices.num_symbol_fonts,
+                &OPT(font_size), &glyph_cache_dir)) return NULL;
+    Py_INCREF(descriptor_for_idx);
     free_font_groups();
+    set_glyph_disk_cache_dir(glyph_cache_dir);
     Py_RETURN_NONE;
 }
 
 static void
 send_prerendered_sprites(FontGroup *fg) {
-    int error = 0;
+    GPUSpriteTracker *t = fg->sprite_trackers;
     sprite_index x = 0, y = 0, z = 0;
     // blank cell
     ensure_canvas_can_fit(fg, 1);
     current_send_sprite_to_gpu((FONTS_DATA_HANDLE)fg, x, y, z, fg->canvas.buf);
-    do_increment(fg, &error);
-    if (error != 0) { sprite_map_set_error(error); PyErr_Print(); fatal("Failed"); }
-    PyObject *args = PyObject_CallFunction(prerender_function, "IIIIIIIffdd", fg->cell_width, fg->cell_height, fg->baseline, fg->underline_position, fg->underline_thickness, fg->strikethrough_position, fg->strikethrough_thickness, OPT(cursor_beam_thickness), OPT(cursor_underline_thickness), fg->logical_dpi_x, fg->logical_dpi_y);
-    if (args == NULL) { PyErr_Print(); fatal("Failed to pre-render cells"); }
-    PyObject *cell_addresses = PyTuple_GET_ITEM(args, 0);
-    for (ssize_t i = 0; i < PyTuple_GET_SIZE(cell_addresses); i++) {
-        x = fg->sprite_tracker.x; y = fg->sprite_tracker.y; z = fg->sprite_tracker.z;
+    do_increment(t);
+    const DecorationMetrics dm = {
+        .cell_width = fg->cell_width, .cell_height = fg->cell_height,
+        .underline_position = fg->underline_position, .underline_thickness = fg->underline_thickness,
+        .strikethrough_position = fg->strikethrough_position, .strikethrough_thickness = fg->strikethrough_thickness,
+        .dpi_x = fg->logical_dpi_x, .dpi_y = fg->logical_dpi_y,
+    };
+    // If you change the mapping of these cells you will need to change
+    // NUM_UNDERLINE_STYLES and BEAM_IDX in shaders.c and STRIKE_SPRITE_INDEX in
+    // shaders.py and MISSING_GLYPH above
+    for (unsigned i = 0; i < NUM_UNDERLINE_STYLES + 5; i++) {
+        x = t->x; y = t->y; z = t->z;
         if (y > 0) { fatal("Too many pre-rendered sprites for your GPU or the font size is too large"); }
-        do_increment(fg, &error);
-        if (error != 0) { sprite_map_set_error(error); PyErr_Print(); fatal("Failed"); }
-        uint8_t *alpha_mask = PyLong_AsVoidPtr(PyTuple_GET_ITEM(cell_addresses, i));
-        ensure_canvas_can_fit(fg, 1);  // clear canvas
-        Region r = { .right = fg->cell_width, .bottom = fg->cell_height };
-        render_alpha_mask(alpha_mask, fg->canvas.buf, &r, &r, fg->cell_width, fg->cell_width);
-        current_send_sprite_to_gpu((FONTS_DATA_HANDLE)fg, x, y, z, fg->canvas.buf);
+        do_increment(t);
+        uint8_t *alpha_mask = cleared_alpha_mask(fg);
+        if (i < NUM_UNDERLINE_STYLES) add_underline(alpha_mask, i + 1, &dm);
+        else switch (i - NUM_UNDERLINE_STYLES) {
+            case 0: add_strikethrough(alpha_mask, &dm); break;
+            case 1: render_missing_glyph(alpha_mask, fg->cell_width, fg->cell_height, (fg->logical_dpi_x + fg->logical_dpi_y) / 2.0); break;
+            case 2: add_beam_cursor(alpha_mask, OPT(cursor_beam_thickness), &dm); break;
+            case 3: add_underline_cursor(alpha_mask, OPT(cursor_underline_thickness), &dm); break;
+            case 4: add_hollow_cursor(alpha_mask, &dm); break;
+        }
+        send_alpha_mask_to_gpu(fg, alpha_mask, x, y, z);
     }
-    Py_CLEAR(args);
+    fg->sprite_atlas.after_prerendered = *t;
 }
 
 static size_t
@@ -1371,6 +1788,265 @@ send_prerendered_sprites_for_window(OSWindow *w) {
     }
 }
 
+// Sprite atlas prewarming {{{
+// Once the first frame is on screen, the glyphs from the prewarm_glyphs option
+// are shaped and queued for rasterization, so that they are usually already in
+// the atlas by the time they are first displayed. Shaping happens on the main
+// thread, so it is done one line of cells per frame.
+
+#define PREWARM_LINE_SZ 256u
+
+static void
+prewarm_cells(FontGroup *fg, CPUCell *cpu_cells, GPUCell *gpu_cells, index_type num) {
+    if (!num) return;
+    Line line = {.cpu_cells=cpu_cells, .gpu_cells=gpu_cells, .xnum=num, .ynum=1};
+    Cursor cursor = {.x=UINT_MAX};
+    // the line is never displayed, so its glyphs are rasterized after those
+    // on screen and frames do not wait for them
+    rendering_prewarm_line = true;
+    render_line((FONTS_DATA_HANDLE)fg, &line, &cursor);
+    rendering_prewarm_line = false;
+    fg->prewarm.num_cells += num;
+}
+
+bool
+prewarm_sprite_atlas(FONTS_DATA_HANDLE fg_) {
+    // Returns true while there is more to prewarm
+    FontGroup *fg = (FontGroup*)fg_;
+    if (fg->prewarm.done || !fg->sprite_map) return false;
+    const monotonic_t start = monotonic();
+    CPUCell cpu_cells[PREWARM_LINE_SZ]; GPUCell gpu_cells[PREWARM_LINE_SZ];
+    index_type num = 0;
+    while (fg->prewarm.range < OPT(prewarm_glyphs).count) {
+        const char_type first = OPT(prewarm_glyphs).ranges[2*fg->prewarm.range], last = OPT(prewarm_glyphs).ranges[2*fg->prewarm.range + 1];
+        const char_type ch = MAX(first, fg->prewarm.next_char);
+        if (ch > last) { fg->prewarm.range++; fg->prewarm.next_char = 0; continue; }
+        const int width = wcwidth_std(ch);
+        if (width > 0) {
+            if (num + width + 1 > PREWARM_LINE_SZ) break;
+            zero_at_ptr_count(cpu_cells + num, width + 1); zero_at_ptr_count(gpu_cells + num, width + 1);
+            cpu_cells[num].ch = ch; gpu_cells[num].attrs.width = width;
+            num += width;
+            // separate the glyphs with spaces so they are not shaped into ligatures
+            cpu_cells[num].ch = ' '; gpu_cells[num].attrs.width = 1;
+            num++;
+        }
+        fg->prewarm.next_char = ch + 1;
+    }
+    prewarm_cells(fg, cpu_cells, gpu_cells, num);
+    fg->prewarm.time += monotonic() - start;
+    if (fg->prewarm.range >= OPT(prewarm_glyphs).count) fg->prewarm.done = true;
+    return !fg->prewarm.done;
+}
+#undef PREWARM_LINE_SZ
+// }}}
+
+// Sprite atlas eviction and compaction {{{
+// Sprites are never freed as they are rendered, instead, once an atlas nears
+// its limit, the least recently used sprites that are not referenced by any
+// on screen cell are evicted and the rest are packed into a fresh texture.
+// All screens using the font group are then marked dirty so that their cells
+// pick up the new sprite positions when next rendered.
+
+#define SPRITE_MAP_MEMORY_BUDGET (256u * 1024u * 1024u)
+
+static size_t
+sprite_slot(const GPUSpriteTracker *t, size_t x, size_t y, size_t z) {
+    return (z * t->max_y + y) * t->xnum + x;
+}
+
+static size_t
+sprite_slots_used(const GPUSpriteTracker *t) {
+    return sprite_slot(t, t->x, t->y, t->z);
+}
+
+static size_t
+num_prerendered_sprites(const FontGroup *fg) {
+    return sprite_slots_used(&fg->sprite_atlas.after_prerendered);
+}
+
+static size_t
+sprite_slot_limit(const FontGroup *fg, bool colored) {
+    const GPUSpriteTracker *t = fg->sprite_trackers + colored;
+    const size_t capacity = t->xnum * t->max_y * MIN((size_t)UINT16_MAX, max_array_len);
+    const size_t sprite_size = (size_t)fg->cell_width * fg->cell_height * (colored ? sizeof(pixel) : 1);
+    const size_t min_slots = 2 * (colored ? 0 : num_prerendered_sprites(fg)) + 64;
+    return MIN(capacity, MAX(SPRITE_MAP_MEMORY_BUDGET / sprite_size, min_slots));
+}
+
+typedef struct SpriteAtlasCompaction {
+    uint8_t *pinned;
+    size_t num_slots, num_pinned;
+    uint32_t *stamps;
+    size_t num_stamps;
+    bool has_cutoff;
+    uint32_t cutoff;
+    SpriteMove *moves;
+    size_t num_moves;
+} SpriteAtlasCompaction;
+
+typedef struct SpriteCompaction {
+    FontGroup *fg;
+    SpriteAtlasCompaction atlases[2];
+    size_t num_evicted;
+} SpriteCompaction;
+
+static bool
+is_sprite_pinned(const SpriteCompaction *c, const SpritePosition *s) {
+    const SpriteAtlasCompaction *a = c->atlases + s->colored;
+    const size_t slot = sprite_slot(c->fg->sprite_trackers + s->colored, s->x, s->y, s->z);
+    return slot < a->num_slots && (a->pinned[slot / 8] & (1u << (slot % 8)));
+}
+
+static void
+pin_sprites_in_linebuf(SpriteCompaction *c, const LineBuf *lb) {
+    const GPUCell *cell = lb->gpu_cell_buf, *limit = lb->gpu_cell_buf + (size_t)lb->xnum * lb->ynum;
+    for (; cell < limit; cell++) {
+        const bool colored = (cell->sprite_z & COLORED_SPRITE_MASK) != 0;
+        SpriteAtlasCompaction *a = c->atlases + colored;
+        const size_t slot = sprite_slot(c->fg->sprite_trackers + colored, cell->sprite_x, cell->sprite_y, cell->sprite_z & 0xfff);
+        if (slot < a->num_slots) a->pinned[slot / 8] |= 1u << (slot % 8);
+    }
+}
+
+static void
+pin_sprites_in_screen(SpriteCompaction *c, Screen *screen) {
+    if (!screen) return;
+    pin_sprites_in_linebuf(c, screen->main_linebuf);
+    pin_sprites_in_linebuf(c, screen->alt_linebuf);
+}
+
+static void
+dirty_screens_using_font_group(FontGroup *fg) {
+    for (size_t o = 0; o < global_state.num_os_windows; o++) {
+        OSWindow *w = global_state.os_windows + o;
+        if (w->fonts_data != (FONTS_DATA_HANDLE)fg) continue;
+        if (w->tab_bar_render_data.screen) screen_dirty_sprite_positions(w->tab_bar_render_data.screen);
+        for (size_t t = 0; t < w->num_tabs; t++) {
+            Tab *tab = w->tabs + t;
+            for (size_t i = 0; i < tab->num_windows; i++) {
+                if (tab->windows[i].render_data.screen) screen_dirty_sprite_positions(tab->windows[i].render_data.screen);
+            }
+        }
+    }
+}
+
+static bool
+collect_sprite_stamps(SpritePosition *s, void *data) {
+    SpriteCompaction *c = data;
+    if (!s->rendered) return true;
+    SpriteAtlasCompaction *a = c->atlases + s->colored;
+    if (is_sprite_pinned(c, s)) a->num_pinned++;
+    else a->stamps[a->num_stamps++] = s->last_used;
+    return true;
+}
+
+static bool
+relocate_sprite(SpritePosition *s, void *data) {
+    SpriteCompaction *c = data;
+    if (!s->rendered) return false;
+    SpriteAtlasCompaction *a = c->atlases + s->colored;
+    if (a->has_cutoff && s->last_used <= a->cutoff && !is_sprite_pinned(c, s)) return false;
+    GPUSpriteTracker *t = c->fg->sprite_trackers + s->colored;
+    a->moves[a->num_moves++] = (SpriteMove){
+        .src_x = s->x, .src_y = s->y, .src_z = s->z, .dest_x = t->x, .dest_y = t->y, .dest_z = t->z};
+    s->x = t->x; s->y = t->y; s->z = t->z;
+    do_increment(t);
+    return true;
+}
+
+static int
+compare_stamps(const void *a_, const void *b_) {
+    const uint32_t a = *(const uint32_t*)a_, b = *(const uint32_t*)b_;
+    return (a > b) - (a < b);
+}
+
+static void
+free_sprite_compaction(SpriteCompaction *c) {
+    for (unsigned i = 0; i < arraysz(c->atlases); i++) {
+        free(c->atlases[i].pinned); free(c->atlases[i].stamps); free(c->atlases[i].moves);
+    }
+    zero_at_ptr(c);
+}
+
+static void
+compact_sprite_map(FontGroup *fg) {
+    SpriteCompaction c = {.fg=fg};
+    const size_t num_prerendered = num_prerendered_sprites(fg);
+    for (unsigned i = 0; i < arraysz(c.atlases); i++) {
+        SpriteAtlasCompaction *a = c.atlases + i;
+        a->num_slots = sprite_slots_used(fg->sprite_trackers + i);
+        a->pinned = calloc(a->num_slots / 8 + 1, 1);
+        a->stamps = malloc(sizeof(a->stamps[0]) * (a->num_slots + 1));
+        a->moves = malloc(sizeof(a->moves[0]) * (a->num_slots + 1));
+        if (!a->pinned || !a->stamps || !a->moves) {
+            free_sprite_compaction(&c);
+            log_error("Out of memory compacting the sprite map");
+            return;
+        }
+    }
+    for (size_t o = 0; o < global_state.num_os_windows; o++) {
+        OSWindow *w = global_state.os_windows + o;
+        if (w->fonts_data != (FONTS_DATA_HANDLE)fg) continue;
+        pin_sprites_in_screen(&c, w->tab_bar_render_data.screen);
+        for (size_t t = 0; t < w->num_tabs; t++) {
+            Tab *tab = w->tabs + t;
+            for (size_t i = 0; i < tab->num_windows; i++) pin_sprites_in_screen(&c, tab->windows[i].render_data.screen);
+        }
+    }
+    for (size_t i = 0; i < fg->fonts_count; i++) filter_sprite_position_hash_table(&fg->fonts[i].sprite_position_hash_table, collect_sprite_stamps, &c);
+    const bool update_textures = fg->sprite_map && current_send_sprite_to_gpu == send_sprite_to_gpu;
+    // sprites waiting to be uploaded must reach the texture at their old positions
+    if (update_textures) flush_sprite_uploads((FONTS_DATA_HANDLE)fg);
+    for (unsigned i = 0; i < arraysz(c.atlases); i++) {
+        // keep at most half the limit, so that compaction is not needed again soon
+        SpriteAtlasCompaction *a = c.atlases + i;
+        const size_t reserved = a->num_pinned + (i ? 0 : num_prerendered), target = sprite_slot_limit(fg, i) / 2;
+        const size_t budget = target > reserved ? target - reserved : 0;
+        if (a->num_stamps > budget) {
+            qsort(a->stamps, a->num_stamps, sizeof(a->stamps[0]), compare_stamps);
+            a->has_cutoff = true; a->cutoff = a->stamps[a->num_stamps - budget - 1];
+        }
+    }
+    // prerendered sprites stay where they are
+    GPUSpriteTracker *t = fg->sprite_trackers;
+    *t = fg->sprite_atlas.after_prerendered;
+    for (size_t i = 0; i < num_prerendered; i++) {
+        const sprite_index x = i % t->xnum, y = (i / t->xnum) % t->max_y, z = i / (t->xnum * t->max_y);
+        c.atlases[0].moves[c.atlases[0].num_moves++] = (SpriteMove){.src_x=x, .src_y=y, .src_z=z, .dest_x=x, .dest_y=y, .dest_z=z};
+    }
+    t = fg->sprite_trackers + 1;
+    t->x = 0; t->y = 0; t->z = 0; t->ynum = 1;
+    for (size_t i = 0; i < fg->fonts_count; i++) c.num_evicted += filter_sprite_position_hash_table(&fg->fonts[i].sprite_position_hash_table, relocate_sprite, &c);
+    zero_at_ptr_count(fg->ascii_sprites, NUM_ASCII_FAST_PATH_CHARS);
+    for (unsigned i = 0; i < arraysz(c.atlases); i++) {
+        if (update_textures) move_sprites_to_new_texture((FONTS_DATA_HANDLE)fg, i, c.atlases[i].moves, c.atlases[i].num_moves);
+        fg->sprite_atlas.used_slots_after_compaction[i] = sprite_slots_used(fg->sprite_trackers + i);
+    }
+    fg->sprite_atlas.num_compactions++;
+    fg->sprite_atlas.num_evicted += c.num_evicted;
+    free_sprite_compaction(&c);
+    dirty_screens_using_font_group(fg);
+}
+
+bool
+compact_sprite_map_if_needed(FONTS_DATA_HANDLE fg_, monotonic_t frame_started_at) {
+    // Must be called between frames with the GL context of a window using this font group current
+    FontGroup *fg = (FontGroup*)fg_;
+    if (fg->sprite_atlas.last_frame_at == frame_started_at) return false;
+    fg->sprite_atlas.last_frame_at = frame_started_at;
+    fg->sprite_atlas.generation++;
+    if (!fg->sprite_map) return false;
+    bool needed = false;
+    for (unsigned i = 0; i < arraysz(fg->sprite_trackers); i++) {
+        const size_t used = sprite_slots_used(fg->sprite_trackers + i), limit = sprite_slot_limit(fg, i);
+        if (used >= limit - limit / 8 && used >= fg->sprite_atlas.used_slots_after_compaction[i] + limit / 8) needed = true;
+    }
+    if (needed) compact_sprite_map(fg);
+    return needed;
+}
+// }}}
+
 FONTS_DATA_HANDLE
 load_fonts_data(double font_sz_in_pts, double dpi_x, double dpi_y) {
     FontGroup *fg = font_group_for(font_sz_in_pts, dpi_x, dpi_y);
@@ -1384,15 +2060,15 @@ load_fonts_data(double font_sz_in_pts, double dpi_x, double dpi_y) {
 static void
 finalize(void) {
     Py_CLEAR(python_send_to_gpu_impl);
-    Py_CLEAR(box_drawing_function);
-    Py_CLEAR(prerender_function);
     Py_CLEAR(descriptor_for_idx);
     free_font_groups();
+    free_glyph_disk_cache_global_resources();
     free(ligature_types);
     if (harfbuzz_buffer) { hb_buffer_destroy(harfbuzz_buffer); harfbuzz_buffer = NULL; }
     free(group_state.groups); group_state.groups = NULL; group_state.groups_capacity = 0;
     free(global_glyph_render_scratch.glyphs);
     free(global_glyph_render_scratch.sprite_positions);
+    free(global_glyph_render_scratch.ligature_indices);
     global_glyph_render_scratch = (GlyphRenderScratch){0};
 }
 
@@ -1401,13 +2077,14 @@ sprite_map_set_layout(PyObject UNUSED *self, PyObject *args) {
     unsigned int w, h;
     if(!PyArg_ParseTuple(args, "II", &w, &h)) return NULL;
     if (!num_font_groups) { PyErr_SetString(PyExc_RuntimeError, "must create font group first"); return NULL; }
-    sprite_tracker_set_layout(&font_groups->sprite_tracker, w, h);
+    sprite_tracker_set_layout(font_groups->sprite_trackers, w, h);
+    sprite_tracker_set_layout(font_groups->sprite_trackers + 1, w, h);
     Py_RETURN_NONE;
 }
 
 static PyObject*
 test_sprite_position_for(PyObject UNUSED *self, PyObject *args) {
-    int error;
+    int error = 0;
     RAII_ALLOC(glyph_index, glyphs, calloc(PyTuple_GET_SIZE(args), sizeof(glyph_index)));
     for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(args); i++) {
         if (!PyLong_Check(PyTuple_GET_ITEM(args, i))) {
@@ -1420,10 +2097,55 @@ test_sprite_position_for(PyObject UNUSED *self, PyObject *args) {
     FontGroup *fg = font_groups;
     if (!num_font_groups) { PyErr_SetString(PyExc_RuntimeError, "must create font group first"); return NULL; }
     SpritePosition *pos = sprite_position_for(fg, &fg->fonts[fg->medium_font_idx], glyphs, PyTuple_GET_SIZE(args), 0, 1, &error);
-    if (pos == NULL) { sprite_map_set_error(error); return NULL; }
+    if (pos == NULL || (!pos->rendered && !allocate_sprite(fg, pos, false, &error))) { sprite_map_set_error(error); return NULL; }
     return Py_BuildValue("HHH", pos->x, pos->y, pos->z);
 }
 
+static bool
+count_sprite(SpritePosition *s, void *data) {
+    if (s->rendered) ((size_t*)data)[s->colored]++;
+    return true;
+}
+
+static PyObject*
+sprite_atlas_stats(const FontGroup *fg, bool colored, size_t num_sprites) {
+    const GPUSpriteTracker *t = fg->sprite_trackers + colored;
+    const unsigned long long texture_bytes = sprite_atlas_texture_bytes(fg, colored);
+    return Py_BuildValue("{sn sn sn sI sI sI sK}",
+        "used_slots", (Py_ssize_t)sprite_slots_used(t), "slot_limit", (Py_ssize_t)sprite_slot_limit(fg, colored),
+        "live_sprites", (Py_ssize_t)num_sprites,
+        "columns", t->xnum, "rows", t->ynum, "layers", t->z + 1,
+        "texture_bytes", texture_bytes
+    );
+}
+
+static PyObject*
+sprite_map_stats(PyObject UNUSED *self, PyObject *args UNUSED) {
+    RAII_PyObject(ans, PyList_New(0));
+    if (!ans) return NULL;
+    for (size_t g = 0; g < num_font_groups; g++) {
+        FontGroup *fg = font_groups + g;
+        size_t num_sprites[2] = {0};
+        for (size_t i = 0; i < fg->fonts_count; i++) filter_sprite_position_hash_table(&fg->fonts[i].sprite_position_hash_table, count_sprite, num_sprites);
+        unsigned int uploads, sprites_uploaded;
+        sprite_map_upload_stats(fg->sprite_map, &uploads, &sprites_uploaded);
+        RAII_PyObject(alpha, sprite_atlas_stats(fg, false, num_sprites[0]));
+        RAII_PyObject(color, sprite_atlas_stats(fg, true, num_sprites[1]));
+        if (!alpha || !color) return NULL;
+        RAII_PyObject(stats, Py_BuildValue("{sK sd sI sI sO sO sn sn sI sI sd sn}",
+            "id", (unsigned long long)fg->id, "font_size", fg->font_sz_in_pts,
+            "cell_width", fg->cell_width, "cell_height", fg->cell_height,
+            "alpha", alpha, "color", color,
+            "compactions", (Py_ssize_t)fg->sprite_atlas.num_compactions, "evicted", (Py_ssize_t)fg->sprite_atlas.num_evicted,
+            "uploads_last_frame", uploads, "sprites_uploaded_last_frame", sprites_uploaded,
+            "prewarm_time", monotonic_t_to_s_double(fg->prewarm.time), "prewarmed_cells", (Py_ssize_t)fg->prewarm.num_cells
+        ));
+        if (!stats || PyList_Append(ans, stats) != 0) return NULL;
+    }
+    Py_INCREF(ans);
+    return ans;
+}
+
 static PyObject*
 set_send_sprite_to_gpu(PyObject UNUSED *self, PyObject *func) {
     Py_CLEAR(python_send_to_gpu_impl);
@@ -1523,6 +2245,7 @@ static PyMethodDef module_methods[] = {
     METHODB(free_font_data, METH_NOARGS),
     METHODB(sprite_map_set_layout, METH_VARARGS),
     METHODB(test_sprite_position_for, METH_VARARGS),
+    METHODB(sprite_map_stats, METH_NOARGS),
     METHODB(concat_cells, METH_VARARGS),
     METHODB(set_send_sprite_to_gpu, METH_O),
     METHODB(current_fonts, METH_NOARGS),
@@ -34,9 +34,11 @@ PyObject* iter_fallback_faces(FONTS_DATA_HANDLE fgh, ssize_t *idx);
 bool face_equals_descriptor(PyObject *face_, PyObject *descriptor);
 const char* postscript_name_for_face(const PyObject*);
 
-void sprite_tracker_current_layout(FONTS_DATA_HANDLE data, unsigned int *x, unsigned int *y, unsigned int *z);
+void sprite_tracker_current_layout(FONTS_DATA_HANDLE data, bool colored, unsigned int *x, unsigned int *y, unsigned int *z);
 void render_alpha_mask(const uint8_t *alpha_mask, pixel* dest, Region *src_rect, Region *dest_rect, size_t src_stride, size_t dest_stride);
-void render_line(FONTS_DATA_HANDLE, Line *line, Cursor *cursor);
+// Returns false if some glyphs of the line are still being rasterized in the
+// background, their cells are blank until the line is rendered again
+bool render_line(FONTS_DATA_HANDLE, Line *line, Cursor *cursor);
 void sprite_tracker_set_limits(size_t max_texture_size, size_t max_array_len);
 typedef void (*free_extra_data_func)(void*);
 StringCanvas render_simple_text_impl(PyObject *s, const char *text, unsigned int baseline);
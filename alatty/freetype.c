@@ -8,6 +8,8 @@
 #include "fonts.h"
 #include "cleanup.h"
 #include "state.h"
+#include "glyph-rasterizer.h"
+#include "canvas-kernels.h"
 #include <math.h>
 #include <structmember.h>
 #include <ft2build.h>
@@ -40,6 +42,9 @@ typedef struct {
 PyTypeObject Face_Type;
 
 static PyObject* FreeType_Exception = NULL;
+// Set while a worker thread rasterizes a job, errors are reported in the job
+// as the thread cannot use the Python API
+static _Thread_local GlyphRasterJob *current_raster_job = NULL;
 
 void
 set_freetype_error(const char* prefix, int err_code) {
@@ -63,12 +68,14 @@ set_freetype_error(const char* prefix, int err_code) {
 
     while(ft_errors[i].err_msg != NULL) {
         if (ft_errors[i].err_code == err_code) {
-            PyErr_Format(FreeType_Exception, "%s %s", prefix, ft_errors[i].err_msg);
+            if (current_raster_job) snprintf(current_raster_job->error, sizeof(current_raster_job->error), "%s %s", prefix, ft_errors[i].err_msg);
+            else PyErr_Format(FreeType_Exception, "%s %s", prefix, ft_errors[i].err_msg);
             return;
         }
         i++;
     }
-    PyErr_Format(FreeType_Exception, "%s (error code: %d)", prefix, err_code);
+    if (current_raster_job) snprintf(current_raster_job->error, sizeof(current_raster_job->error), "%s (error code: %d)", prefix, err_code);
+    else PyErr_Format(FreeType_Exception, "%s (error code: %d)", prefix, err_code);
 }
 
 static FT_Library  library;
@@ -420,11 +427,11 @@ populate_processed_bitmap(FT_GlyphSlotRec *slot, FT_Bitmap *bitmap, ProcessedBit
     ans->bitmap_top = slot->bitmap_top; ans->bitmap_left = slot->bitmap_left;
 }
 
-bool
-freetype_convert_mono_bitmap(FT_Bitmap *src, FT_Bitmap *dest) {
+static bool
+convert_mono_bitmap(FT_Library lib, FT_Bitmap *src, FT_Bitmap *dest) {
     FT_Bitmap_Init(dest);
     // This also sets pixel_mode to FT_PIXEL_MODE_GRAY so we don't have to
-    int error = FT_Bitmap_Convert(library, src, dest, 1);
+    int error = FT_Bitmap_Convert(lib, src, dest, 1);
     if (error) { set_freetype_error("Failed to convert bitmap, with error:", error); return false; }
     // Normalize gray levels to the range [0..255]
     dest->num_grays = 256;
@@ -436,6 +443,11 @@ freetype_convert_mono_bitmap(FT_Bitmap *src, FT_Bitmap *dest) {
     return true;
 }
 
+bool
+freetype_convert_mono_bitmap(FT_Bitmap *src, FT_Bitmap *dest) {
+    return convert_mono_bitmap(library, src, dest);
+}
+
 static bool
 render_bitmap(Face *self, int glyph_id, ProcessedBitmap *ans, unsigned int cell_width, unsigned int cell_height, unsigned int num_cells, bool rescale, FONTS_DATA_HANDLE fg) {
     if (!load_glyph(self, glyph_id, FT_LOAD_RENDER)) return false;
@@ -443,10 +455,11 @@ render_bitmap(Face *self, int glyph_id, ProcessedBitmap *ans, unsigned int cell_
 
     // Embedded bitmap glyph?
     if (self->face->glyph->bitmap.pixel_mode == FT_PIXEL_MODE_MONO) {
+        // use the library the face belongs to, which is per thread
         FT_Bitmap bitmap;
-        freetype_convert_mono_bitmap(&self->face->glyph->bitmap, &bitmap);
+        convert_mono_bitmap(self->face->glyph->library, &self->face->glyph->bitmap, &bitmap);
         populate_processed_bitmap(self->face->glyph, &bitmap, ans, true);
-        FT_Bitmap_Done(library, &bitmap);
+        FT_Bitmap_Done(self->face->glyph->library, &bitmap);
     } else {
         populate_processed_bitmap(self->face->glyph, &self->face->glyph->bitmap, ans, false);
     }
@@ -483,15 +496,16 @@ downsample_32bit_image(uint8_t *src, unsigned src_width, unsigned src_height, un
     for (unsigned int i = 0, sr = 0; i < dest_height; i++, sr += factor) {
         for (unsigned int j = 0, sc = 0; j < dest_width; j++, sc += factor, d += 4) {
             // calculate area average
-            unsigned int r=0, g=0, b=0, a=0, count=0;
-            for (unsigned int y=sr; y < MIN(sr + factor, src_height); y++) {
-                uint8_t *p = src + (y * src_stride) + sc * 4;
-                for (unsigned int x=sc; x < MIN(sc + factor, src_width); x++, count++) {
-                    b += *(p++); g += *(p++); r += *(p++); a += *(p++);
+            uint32_t sums[4] = {0};
+            unsigned int count = 0;
+            const unsigned int x_limit = MIN(sc + factor, src_width);
+            if (sc < x_limit) {
+                for (unsigned int y=sr; y < MIN(sr + factor, src_height); y++, count += x_limit - sc) {
+                    sum_bgra_pixels(src + (y * src_stride) + sc * 4, x_limit - sc, sums);
                 }
             }
             if (count) {
-                d[0] = b / count; d[1] = g / count; d[2] = r / count; d[3] = a / count;
+                d[0] = sums[0] / count; d[1] = sums[1] / count; d[2] = sums[2] / count; d[3] = sums[3] / count;
             }
         }
     }
@@ -551,17 +565,10 @@ render_color_bitmap(Face *self, int glyph_id, ProcessedBitmap *ans, unsigned int
 
 static void
 copy_color_bitmap(uint8_t *src, pixel* dest, Region *src_rect, Region *dest_rect, size_t src_stride, size_t dest_stride) {
+    if (src_rect->left >= src_rect->right || dest_rect->left >= dest_rect->right) return;
+    const size_t count = MIN(src_rect->right - src_rect->left, dest_rect->right - dest_rect->left);
     for (size_t sr = src_rect->top, dr = dest_rect->top; sr < src_rect->bottom && dr < dest_rect->bottom; sr++, dr++) {
-        pixel *d = dest + dest_stride * dr;
-        uint8_t *s = src + src_stride * sr;
-        for(size_t sc = src_rect->left, dc = dest_rect->left; sc < src_rect->right && dc < dest_rect->right; sc++, dc++) {
-            uint8_t *bgra = s + 4 * sc;
-            if (bgra[3]) {
-#define C(idx, shift) ( (uint8_t)(((float)bgra[idx] / (float)bgra[3]) * 255) << shift)
-                d[dc] = C(2, 24) | C(1, 16) | C(0, 8) | bgra[3];
-#undef C
-        } else d[dc] = 0;
-        }
+        copy_bgra_row(dest + dest_stride * dr + dest_rect->left, src + src_stride * sr + 4 * src_rect->left, count);
     }
 }
 
@@ -615,7 +622,7 @@ render_glyphs_in_cells(PyObject *f, hb_glyph_info_t *info, hb_glyph_position_t *
         if (info[i].codepoint != self->space_glyph_id) {
             if (*was_colored) {
                 if (!render_color_bitmap(self, info[i].codepoint, &bm, cell_width, cell_height, num_cells, baseline)) {
-                    if (PyErr_Occurred()) PyErr_Print();
+                    if (!current_raster_job && PyErr_Occurred()) PyErr_Print();
                     if (!render_bitmap(self, info[i].codepoint, &bm, cell_width, cell_height, num_cells, true, fg)) {
                         free_processed_bitmap(&bm);
                         return false;
@@ -708,6 +715,122 @@ render_simple_text_impl(PyObject *s, const char *text, unsigned int baseline) {
     return ans;
 }
 
+// Rasterization in worker threads {{{
+
+#define RASTERIZER_FACE_CACHE_SIZE 8
+
+typedef struct RasterizerFaceCacheEntry {
+    Face face;
+    RasterizerFace spec;
+    unsigned long long last_used;
+} RasterizerFaceCacheEntry;
+
+typedef struct RasterizerThreadData {
+    FT_Library library;
+    RasterizerFaceCacheEntry faces[RASTERIZER_FACE_CACHE_SIZE];
+    size_t num_faces;
+    unsigned long long counter;
+} RasterizerThreadData;
+
+bool
+rasterizer_face_for(PyObject *s, RasterizerFace *ans) {
+    Face *self = (Face*)s;
+    // faces created from a bare path have no path to re-open them with
+    if (!self->path || !PyUnicode_Check(self->path)) return false;
+    const char *path = PyUnicode_AsUTF8(self->path);
+    if (!path) { PyErr_Clear(); return false; }
+    *ans = (RasterizerFace){
+        .path = path, .index = (int)self->face->face_index, .hinting = self->hinting, .hintstyle = self->hintstyle,
+        .char_width = self->char_width, .char_height = self->char_height, .xdpi = self->xdpi, .ydpi = self->ydpi,
+        // bitmap fonts are identified by the strike currently selected
+        .y_ppem = self->is_scalable || !self->face->size ? 0 : self->face->size->metrics.y_ppem,
+    };
+    return true;
+}
+
+static bool
+same_rasterizer_face(const RasterizerFace *a, const RasterizerFace *b) {
+    return a->index == b->index && a->hinting == b->hinting && a->hintstyle == b->hintstyle && a->char_width == b->char_width && a->char_height == b->char_height && a->xdpi == b->xdpi && a->ydpi == b->ydpi && a->y_ppem == b->y_ppem && strcmp(a->path, b->path) == 0;
+}
+
+static void
+free_rasterizer_face(RasterizerFaceCacheEntry *e) {
+    if (e->face.face) FT_Done_Face(e->face.face);
+    free((void*)e->spec.path);
+    zero_at_ptr(e);
+}
+
+static Face*
+rasterizer_face(RasterizerThreadData *td, const RasterizerFace *spec, unsigned int cell_height) {
+    RasterizerFaceCacheEntry *e = NULL;
+    for (size_t i = 0; i < td->num_faces; i++) {
+        e = td->faces + i;
+        if (e->spec.path && same_rasterizer_face(&e->spec, spec)) { e->last_used = ++td->counter; return &e->face; }
+    }
+    if (td->num_faces < arraysz(td->faces)) e = td->faces + td->num_faces++;
+    else {
+        e = td->faces;
+        for (size_t i = 1; i < td->num_faces; i++) if (td->faces[i].last_used < e->last_used) e = td->faces + i;
+        free_rasterizer_face(e);
+    }
+    FT_Face face;
+    int error = FT_New_Face(td->library, spec->path, spec->index, &face);
+    if (error) { set_load_error(spec->path, error); return NULL; }
+    Face *self = &e->face;
+    self->face = face;
+    self->hinting = spec->hinting; self->hintstyle = spec->hintstyle; self->index = spec->index & 0xFFFF;
+    self->is_scalable = FT_IS_SCALABLE(face);
+    self->has_color = FT_HAS_COLOR(face);
+    bool ok = false;
+    if (spec->y_ppem) {
+        for (FT_Int i = 0; i < face->num_fixed_sizes && !ok; i++) {
+            if ((unsigned)((face->available_sizes[i].y_ppem + 32) >> 6) == spec->y_ppem) ok = FT_Select_Size(face, i) == 0;
+        }
+    }
+    if (!ok) ok = set_font_size(self, spec->char_width, spec->char_height, spec->xdpi, spec->ydpi, 0, cell_height);
+    if (!ok) { FT_Done_Face(face); zero_at_ptr(e); return NULL; }
+    self->char_width = spec->char_width; self->char_height = spec->char_height; self->xdpi = spec->xdpi; self->ydpi = spec->ydpi;
+    self->space_glyph_id = FT_Get_Char_Index(face, ' ');
+    e->spec = *spec;
+    e->spec.path = strdup(spec->path);
+    if (!e->spec.path) fatal("Out of memory");
+    e->last_used = ++td->counter;
+    return self;
+}
+
+void*
+create_rasterizer_thread_data(void) {
+    RasterizerThreadData *ans = calloc(1, sizeof(RasterizerThreadData));
+    if (!ans) return NULL;
+    // FreeType libraries must not be shared between threads
+    if (FT_Init_FreeType(&ans->library) != 0) { free(ans); return NULL; }
+    return ans;
+}
+
+void
+free_rasterizer_thread_data(void *data) {
+    RasterizerThreadData *td = data;
+    for (size_t i = 0; i < td->num_faces; i++) free_rasterizer_face(td->faces + i);
+    FT_Done_FreeType(td->library);
+    free(td);
+}
+
+bool
+rasterize_glyph_job(void *data, GlyphRasterJob *job) {
+    RasterizerThreadData *td = data;
+    bool ok = false;
+    current_raster_job = job;
+    Face *face = rasterizer_face(td, &job->face, job->cell_height);
+    if (face) {
+        struct { FONTS_DATA_HEAD } metrics = {.cell_width = job->cell_width, .cell_height = job->cell_height};
+        ok = render_glyphs_in_cells((PyObject*)face, job->info, job->positions, job->num_glyphs, job->canvas, job->cell_width, job->cell_height, job->num_cells, job->baseline, &job->was_colored, (FONTS_DATA_HANDLE)&metrics, job->center_glyph);
+    }
+    current_raster_job = NULL;
+    return ok;
+}
+
+// }}}
+
 // Boilerplate {{{
 
 static PyMemberDef members[] = {
@@ -42,6 +42,85 @@ static bool is_nvidia = false;
 
 bool is_nvidia_gpu_driver(void) { return is_nvidia; }
 
+// Program binaries need GL 4.1 or ARB_get_program_binary which are not part
+// of the generated loader, so the functions are resolved here. They bypass
+// the debug callback, any errors they cause are cleared after each call.
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+typedef void (*GetProgramBinaryFunc)(GLuint, GLsizei, GLsizei*, GLenum*, void*);
+typedef void (*ProgramBinaryFunc)(GLuint, GLenum, const void*, GLsizei);
+typedef void (*ProgramParameteriFunc)(GLuint, GLenum, GLint);
+static struct {
+    bool supported;
+    GetProgramBinaryFunc get_program_binary;
+    ProgramBinaryFunc program_binary;
+    ProgramParameteriFunc program_parameteri;
+} program_binaries = {0};
+
+static void
+clear_gl_errors(void) {
+    while (glad_glGetError() != GL_NO_ERROR);
+}
+
+static void
+init_program_binaries(int gl_major, int gl_minor) {
+    bool available = gl_major > 4 || (gl_major == 4 && gl_minor >= 1);
+    if (!available) {
+        GLint num_extensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+        for (GLint i = 0; i < num_extensions && !available; i++) {
+            const char *ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (ext && strcmp(ext, "GL_ARB_get_program_binary") == 0) available = true;
+        }
+    }
+    if (!available) return;
+    program_binaries.get_program_binary = (GetProgramBinaryFunc)glfwGetProcAddress("glGetProgramBinary");
+    program_binaries.program_binary = (ProgramBinaryFunc)glfwGetProcAddress("glProgramBinary");
+    program_binaries.program_parameteri = (ProgramParameteriFunc)glfwGetProcAddress("glProgramParameteri");
+    if (!program_binaries.get_program_binary || !program_binaries.program_binary || !program_binaries.program_parameteri) return;
+    GLint num_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    program_binaries.supported = num_formats > 0;
+}
+
+bool
+gl_program_binaries_supported(void) { return program_binaries.supported; }
+
+void
+mark_program_binary_retrievable(GLuint program) {
+    if (!program_binaries.supported) return;
+    program_binaries.program_parameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    clear_gl_errors();
+}
+
+bool
+load_program_binary(GLuint program, GLenum format, const void *data, GLsizei sz) {
+    if (!program_binaries.supported) return false;
+    program_binaries.program_binary(program, format, data, sz);
+    clear_gl_errors();
+    GLint ret = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &ret);
+    return ret == GL_TRUE;
+}
+
+void*
+get_program_binary(GLuint program, GLenum *format, GLsizei *sz) {
+    if (!program_binaries.supported) return NULL;
+    GLint len = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &len);
+    if (len < 1) return NULL;
+    void *ans = malloc(len);
+    if (!ans) return NULL;
+    *sz = 0;
+    program_binaries.get_program_binary(program, len, sz, format, ans);
+    clear_gl_errors();
+    if (*sz < 1) { free(ans); return NULL; }
+    return ans;
+}
+
 void
 gl_init(void) {
     static bool glad_loaded = false;
@@ -65,6 +144,7 @@ gl_init(void) {
         if (gl_major < OPENGL_REQUIRED_VERSION_MAJOR || (gl_major == OPENGL_REQUIRED_VERSION_MAJOR && gl_minor < OPENGL_REQUIRED_VERSION_MINOR)) {
             fatal("OpenGL version is %d.%d, version >= 3.3 required for alatty", gl_major, gl_minor);
         }
+        init_program_binaries(gl_major, gl_minor);
     }
 }
 
@@ -204,46 +284,43 @@ typedef struct {
 } Buffer;
 
 
-static Buffer buffers[MAX_CHILDREN * 6 + 4] = {{0}};
+// Indices into the buffer and VAO tables are handed out, so they only ever grow
+static struct { Buffer *items; size_t capacity; } buffers = {0};
 
 static ssize_t
 create_buffer(GLenum usage) {
     GLuint buffer_id;
     glGenBuffers(1, &buffer_id);
-    for (size_t i = 0; i < sizeof(buffers)/sizeof(buffers[0]); i++) {
-        if (buffers[i].id == 0) {
-            buffers[i].id = buffer_id;
-            buffers[i].size = 0;
-            buffers[i].usage = usage;
-            return i;
-        }
-    }
-    glDeleteBuffers(1, &buffer_id);
-    fatal("Too many buffers");
-    return -1;
+    size_t i = 0;
+    while (i < buffers.capacity && buffers.items[i].id) i++;
+    ensure_space_for(&buffers, items, Buffer, i + 1, capacity, 64, true);
+    buffers.items[i].id = buffer_id;
+    buffers.items[i].size = 0;
+    buffers.items[i].usage = usage;
+    return i;
 }
 
 static void
 delete_buffer(ssize_t buf_idx) {
-    glDeleteBuffers(1, &(buffers[buf_idx].id));
-    buffers[buf_idx].id = 0;
-    buffers[buf_idx].size = 0;
+    glDeleteBuffers(1, &(buffers.items[buf_idx].id));
+    buffers.items[buf_idx].id = 0;
+    buffers.items[buf_idx].size = 0;
 }
 
 static GLuint
 bind_buffer(ssize_t buf_idx) {
-    glBindBuffer(buffers[buf_idx].usage, buffers[buf_idx].id);
-    return buffers[buf_idx].id;
+    glBindBuffer(buffers.items[buf_idx].usage, buffers.items[buf_idx].id);
+    return buffers.items[buf_idx].id;
 }
 
 static void
 unbind_buffer(ssize_t buf_idx) {
-    glBindBuffer(buffers[buf_idx].usage, 0);
+    glBindBuffer(buffers.items[buf_idx].usage, 0);
 }
 
 static void
 alloc_buffer(ssize_t idx, GLsizeiptr size, GLenum usage) {
-    Buffer *b = buffers + idx;
+    Buffer *b = buffers.items + idx;
     if (b->size == size) return;
     b->size = size;
     glBufferData(b->usage, size, NULL, usage);
@@ -251,13 +328,13 @@ alloc_buffer(ssize_t idx, GLsizeiptr size, GLenum usage) {
 
 static void*
 map_buffer(ssize_t idx, GLenum access) {
-    void *ans = glMapBuffer(buffers[idx].usage, access);
+    void *ans = glMapBuffer(buffers.items[idx].usage, access);
     return ans;
 }
 
 static void
 unmap_buffer(ssize_t idx) {
-    glUnmapBuffer(buffers[idx].usage);
+    glUnmapBuffer(buffers.items[idx].usage);
 }
 
 // }}}
@@ -270,28 +347,24 @@ typedef struct {
     ssize_t buffers[10];
 } VAO;
 
-static VAO vaos[4*MAX_CHILDREN + 10] = {{0}};
+static struct { VAO *items; size_t capacity; } vaos = {0};
 
 ssize_t
 create_vao(void) {
     GLuint vao_id;
     glGenVertexArrays(1, &vao_id);
-    for (size_t i = 0; i < sizeof(vaos)/sizeof(vaos[0]); i++) {
-        if (!vaos[i].id) {
-            vaos[i].id = vao_id;
-            vaos[i].num_buffers = 0;
-            glBindVertexArray(vao_id);
-            return i;
-        }
-    }
-    glDeleteVertexArrays(1, &vao_id);
-    fatal("Too many VAOs");
-    return -1;
+    size_t i = 0;
+    while (i < vaos.capacity && vaos.items[i].id) i++;
+    ensure_space_for(&vaos, items, VAO, i + 1, capacity, 64, true);
+    vaos.items[i].id = vao_id;
+    vaos.items[i].num_buffers = 0;
+    glBindVertexArray(vao_id);
+    return i;
 }
 
 size_t
 add_buffer_to_vao(ssize_t vao_idx, GLenum usage) {
-    VAO* vao = vaos + vao_idx;
+    VAO* vao = vaos.items + vao_idx;
     if (vao->num_buffers >= sizeof(vao->buffers) / sizeof(vao->buffers[0])) {
         fatal("Too many buffers in a single VAO");
     }
@@ -302,7 +375,7 @@ add_buffer_to_vao(ssize_t vao_idx, GLenum usage) {
 
 static void
 add_located_attribute_to_vao(ssize_t vao_idx, GLint aloc, GLint size, GLenum data_type, GLsizei stride, void *offset, GLuint divisor) {
-    VAO *vao = vaos + vao_idx;
+    VAO *vao = vaos.items + vao_idx;
     if (!vao->num_buffers) fatal("You must create a buffer for this attribute first");
     ssize_t buf = vao->buffers[vao->num_buffers - 1];
     bind_buffer(buf);
@@ -336,18 +409,18 @@ add_attribute_to_vao(int p, ssize_t vao_idx, const char *name, GLint size, GLenu
 
 void
 remove_vao(ssize_t vao_idx) {
-    VAO *vao = vaos + vao_idx;
+    VAO *vao = vaos.items + vao_idx;
     while (vao->num_buffers) {
         vao->num_buffers--;
         delete_buffer(vao->buffers[vao->num_buffers]);
     }
     glDeleteVertexArrays(1, &(vao->id));
-    vaos[vao_idx].id = 0;
+    vaos.items[vao_idx].id = 0;
 }
 
 void
 bind_vertex_array(ssize_t vao_idx) {
-    glBindVertexArray(vaos[vao_idx].id);
+    glBindVertexArray(vaos.items[vao_idx].id);
 }
 
 void
@@ -357,7 +430,7 @@ unbind_vertex_array(void) {
 
 ssize_t
 alloc_vao_buffer(ssize_t vao_idx, GLsizeiptr size, size_t bufnum, GLenum usage) {
-    ssize_t buf_idx = vaos[vao_idx].buffers[bufnum];
+    ssize_t buf_idx = vaos.items[vao_idx].buffers[bufnum];
     bind_buffer(buf_idx);
     alloc_buffer(buf_idx, size, usage);
     return buf_idx;
@@ -365,7 +438,7 @@ alloc_vao_buffer(ssize_t vao_idx, GLsizeiptr size, size_t bufnum, GLenum usage)
 
 void*
 map_vao_buffer(ssize_t vao_idx, size_t bufnum, GLenum access) {
-    ssize_t buf_idx = vaos[vao_idx].buffers[bufnum];
+    ssize_t buf_idx = vaos.items[vao_idx].buffers[bufnum];
     bind_buffer(buf_idx);
     return map_buffer(buf_idx, access);
 }
@@ -378,13 +451,13 @@ alloc_and_map_vao_buffer(ssize_t vao_idx, GLsizeiptr size, size_t bufnum, GLenum
 
 void
 bind_vao_uniform_buffer(ssize_t vao_idx, size_t bufnum, GLuint block_index) {
-    ssize_t buf_idx = vaos[vao_idx].buffers[bufnum];
-    glBindBufferBase(GL_UNIFORM_BUFFER, block_index, buffers[buf_idx].id);
+    ssize_t buf_idx = vaos.items[vao_idx].buffers[bufnum];
+    glBindBufferBase(GL_UNIFORM_BUFFER, block_index, buffers.items[buf_idx].id);
 }
 
 void
 unmap_vao_buffer(ssize_t vao_idx, size_t bufnum) {
-    ssize_t buf_idx = vaos[vao_idx].buffers[bufnum];
+    ssize_t buf_idx = vaos.items[vao_idx].buffers[bufnum];
     unmap_buffer(buf_idx);
     unbind_buffer(buf_idx);
 }
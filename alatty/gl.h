@@ -57,3 +57,7 @@ void unbind_vertex_array(void);
 void unbind_program(void);
 GLuint compile_shaders(GLenum shader_type, GLsizei count, const GLchar * const * string);
 bool is_nvidia_gpu_driver(void);
+bool gl_program_binaries_supported(void);
+void mark_program_binary_retrievable(GLuint program);
+bool load_program_binary(GLuint program, GLenum format, const void *data, GLsizei sz);
+void* get_program_binary(GLuint program, GLenum *format, GLsizei *sz);
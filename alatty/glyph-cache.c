@@ -6,86 +6,344 @@
  */
 
 #include "glyph-cache.h"
-#include "alatty-uthash.h"
+#include "monotonic.h"
 
+// Open addressing hash tables with linear probing. Sprite positions are
+// allocated from an arena so that pointers to them remain valid until they
+// are removed from the table, the slots of the table store the hash of the
+// key so that probing rarely needs to touch the entries themselves. Keys of
+// up to INLINE_GLYPHS glyphs are stored in the entry.
+
+#define INLINE_GLYPHS 4u
+#define MIN_TABLE_CAPACITY 64u
+#define ITEMS_PER_ARENA_CHUNK 256u
+
+// Arena {{{
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t used;
+    _Alignas(void*) uint8_t data[];
+} ArenaChunk;
+
+typedef struct Arena {
+    ArenaChunk *chunks;
+    void *free_list;
+    size_t item_size;
+} Arena;
+
+static void*
+arena_alloc(Arena *a) {
+    void *ans;
+    if (a->free_list) {
+        ans = a->free_list;
+        memcpy(&a->free_list, ans, sizeof(void*));
+    } else {
+        if (!a->chunks || a->chunks->used >= ITEMS_PER_ARENA_CHUNK) {
+            ArenaChunk *c = malloc(sizeof(ArenaChunk) + a->item_size * ITEMS_PER_ARENA_CHUNK);
+            if (!c) return NULL;
+            c->used = 0; c->next = a->chunks; a->chunks = c;
+        }
+        ans = a->chunks->data + a->item_size * a->chunks->used++;
+    }
+    memset(ans, 0, a->item_size);
+    return ans;
+}
+
+static void
+arena_free(Arena *a, void *item) {
+    memcpy(item, &a->free_list, sizeof(void*));
+    a->free_list = item;
+}
+
+static void
+arena_destroy(Arena *a) {
+    while (a->chunks) {
+        ArenaChunk *next = a->chunks->next;
+        free(a->chunks);
+        a->chunks = next;
+    }
+    a->free_list = NULL;
+}
+// }}}
+
+// Sprite positions {{{
 
 typedef struct SpritePosItem {
     SpritePositionHead
-    UT_hash_handle hh;
-    glyph_index key[];
+    glyph_index count, ligature_index, cell_count;
+    union {
+        glyph_index inline_glyphs[INLINE_GLYPHS];
+        glyph_index *glyphs;
+    } key;
 } SpritePosItem;
 
-static glyph_index *scratch = NULL;
-static unsigned scratch_sz = 0;
+typedef struct SpritePosSlot {
+    uint32_t hash;
+    SpritePosItem *item;
+} SpritePosSlot;
 
+struct SpritePositionTable {
+    SpritePosSlot *slots;
+    // count includes removed entries that could not be cleared from the slots
+    size_t capacity, count;
+    Arena arena;
+};
 
-void
-free_glyph_cache_global_resources(void) {
-    free(scratch);
-    scratch = NULL; scratch_sz = 0;
+static SpritePosItem removed_item = {0};
+#define REMOVED (&removed_item)
+
+static uint32_t
+hash_sprite_key(const glyph_index *glyphs, unsigned count, unsigned ligature_index, unsigned cell_count) {
+    // multiplicative hashing, the upper half of the product is well mixed
+    const uint64_t m = 0x9e3779b97f4a7c15ull;
+    uint64_t h = ((uint64_t)count | (uint64_t)ligature_index << 16 | (uint64_t)cell_count << 32) * m;
+    for (unsigned i = 0; i < count; i++) h = (h ^ glyphs[i]) * m;
+    return (uint32_t)(h >> 32);
 }
 
+static const glyph_index*
+sprite_key_glyphs(const SpritePosItem *s) {
+    return s->count > INLINE_GLYPHS ? s->key.glyphs : s->key.inline_glyphs;
+}
 
-static unsigned
-key_size_for_glyph_count(unsigned count) { return count + 3; }
+static void
+insert_slot(SpritePosSlot *slots, size_t capacity, uint32_t hash, SpritePosItem *item) {
+    const size_t mask = capacity - 1;
+    size_t i = hash & mask;
+    while (slots[i].item) i = (i + 1) & mask;
+    slots[i].hash = hash; slots[i].item = item;
+}
 
+static bool
+resize_sprite_position_table(SpritePositionTable *t, size_t capacity) {
+    SpritePosSlot *slots = calloc(capacity, sizeof(SpritePosSlot));
+    if (!slots) return false;
+    for (size_t i = 0; i < t->capacity; i++) {
+        if (t->slots[i].item && t->slots[i].item != REMOVED) insert_slot(slots, capacity, t->slots[i].hash, t->slots[i].item);
+    }
+    free(t->slots);
+    t->slots = slots; t->capacity = capacity;
+    return true;
+}
 
 SpritePosition*
-find_or_create_sprite_position(SpritePosition **head_, glyph_index *glyphs, glyph_index count, glyph_index ligature_index, glyph_index cell_count, bool *created) {
-    SpritePosItem **head = (SpritePosItem**)head_, *p;
-    const unsigned key_sz = key_size_for_glyph_count(count);
-    if (key_sz > scratch_sz) {
-        scratch = realloc(scratch, sizeof(glyph_index) * (key_sz + 16));
-        if (!scratch) return NULL;
-        scratch_sz = key_sz + 16;
-    }
-    const unsigned key_sz_bytes = key_sz * sizeof(glyph_index);
-    scratch[0] = count; scratch[1] = ligature_index; scratch[2] = cell_count;
-    memcpy(scratch + 3, glyphs, count * sizeof(glyph_index));
-    HASH_FIND(hh, *head, scratch, key_sz_bytes, p);
-    if (p) { *created = false; return (SpritePosition*)p; }
-
-    p = calloc(1, sizeof(SpritePosItem) + key_sz_bytes);
-    if (!p) return NULL;
-    memcpy(p->key, scratch, key_sz_bytes);
-    HASH_ADD(hh, *head, key, key_sz_bytes, p);
+find_or_create_sprite_position(SpritePositionTable **table, glyph_index *glyphs, glyph_index count, glyph_index ligature_index, glyph_index cell_count, bool *created) {
+    SpritePositionTable *t = *table;
+    if (!t) {
+        t = calloc(1, sizeof(SpritePositionTable));
+        if (!t) return NULL;
+        t->arena.item_size = sizeof(SpritePosItem);
+        if (!resize_sprite_position_table(t, MIN_TABLE_CAPACITY)) { free(t); return NULL; }
+        *table = t;
+    }
+    const uint32_t hash = hash_sprite_key(glyphs, count, ligature_index, cell_count);
+    const size_t mask = t->capacity - 1;
+    size_t i = hash & mask;
+    for (; t->slots[i].item; i = (i + 1) & mask) {
+        SpritePosItem *s = t->slots[i].item;
+        if (t->slots[i].hash == hash && s != REMOVED && s->count == count && s->ligature_index == ligature_index && s->cell_count == cell_count && memcmp(sprite_key_glyphs(s), glyphs, sizeof(glyph_index) * count) == 0) {
+            *created = false;
+            return (SpritePosition*)s;
+        }
+    }
+    // keep the load factor at or below a half
+    if (2 * (t->count + 1) > t->capacity) {
+        if (!resize_sprite_position_table(t, 2 * t->capacity)) return NULL;
+        for (i = hash & (t->capacity - 1); t->slots[i].item; i = (i + 1) & (t->capacity - 1));
+    }
+    SpritePosItem *s = arena_alloc(&t->arena);
+    if (!s) return NULL;
+    if (count > INLINE_GLYPHS) {
+        if (!(s->key.glyphs = malloc(sizeof(glyph_index) * count))) { arena_free(&t->arena, s); return NULL; }
+    }
+    memcpy(count > INLINE_GLYPHS ? s->key.glyphs : s->key.inline_glyphs, glyphs, sizeof(glyph_index) * count);
+    s->count = count; s->ligature_index = ligature_index; s->cell_count = cell_count;
+    t->slots[i].hash = hash; t->slots[i].item = s;
+    t->count++;
     *created = true;
-    return (SpritePosition*)p;
+    return (SpritePosition*)s;
+}
+
+static void
+free_sprite_position(SpritePositionTable *t, SpritePosItem *s) {
+    if (s->count > INLINE_GLYPHS) free(s->key.glyphs);
+    arena_free(&t->arena, s);
 }
 
 void
-free_sprite_position_hash_table(SpritePosition **head_) {
-    SpritePosItem **head = (SpritePosItem**)head_, *s, *tmp;
-    HASH_ITER(hh, *head, s, tmp) {
-        HASH_DEL(*head, s);
-        free(s);
+free_sprite_position_hash_table(SpritePositionTable **table) {
+    SpritePositionTable *t = *table;
+    if (!t) return;
+    for (size_t i = 0; i < t->capacity; i++) {
+        SpritePosItem *s = t->slots[i].item;
+        if (s && s != REMOVED && s->count > INLINE_GLYPHS) free(s->key.glyphs);
+    }
+    arena_destroy(&t->arena);
+    free(t->slots);
+    free(t);
+    *table = NULL;
+}
+
+size_t
+filter_sprite_position_hash_table(SpritePositionTable **table, sprite_position_filter keep, void *data) {
+    SpritePositionTable *t = *table;
+    if (!t) return 0;
+    size_t num_removed = 0;
+    for (size_t i = 0; i < t->capacity; i++) {
+        SpritePosItem *s = t->slots[i].item;
+        if (s && s != REMOVED && !keep((SpritePosition*)s, data)) {
+            free_sprite_position(t, s);
+            t->slots[i].item = REMOVED;
+            num_removed++;
+        }
+    }
+    if (num_removed) {
+        // emptying the slots would break probe sequences, so re-insert the
+        // survivors into a new set of slots
+        size_t live = 0;
+        for (size_t i = 0; i < t->capacity; i++) if (t->slots[i].item && t->slots[i].item != REMOVED) live++;
+        size_t capacity = MIN_TABLE_CAPACITY;
+        while (2 * live > capacity) capacity *= 2;
+        if (resize_sprite_position_table(t, MAX(capacity, t->capacity / 2))) t->count = live;
     }
+    return num_removed;
 }
+// }}}
+
+// Glyph properties {{{
+
+// The entries are stored in the slots, so pointers to them are only valid
+// until the next call to find_or_create_glyph_properties()
 
 typedef struct GlyphPropertiesItem {
     GlyphPropertiesHead
-    UT_hash_handle hh;
+    bool occupied;
     unsigned key;
 } GlyphPropertiesItem;
 
+struct GlyphPropertiesTable {
+    GlyphPropertiesItem *slots;
+    size_t capacity, count;
+    unsigned shift;
+};
+
+static size_t
+glyph_slot(const GlyphPropertiesTable *t, unsigned glyph) {
+    // Fibonacci hashing
+    return (size_t)((glyph * 2654435769u) >> t->shift);
+}
+
+static bool
+resize_glyph_properties_table(GlyphPropertiesTable *t, unsigned bits) {
+    const size_t capacity = (size_t)1 << bits;
+    GlyphPropertiesItem *slots = calloc(capacity, sizeof(GlyphPropertiesItem));
+    if (!slots) return false;
+    GlyphPropertiesItem *old = t->slots;
+    const size_t old_capacity = t->capacity;
+    t->slots = slots; t->capacity = capacity; t->shift = 32 - bits;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (!old[i].occupied) continue;
+        size_t s = glyph_slot(t, old[i].key);
+        while (slots[s].occupied) s = (s + 1) & (capacity - 1);
+        slots[s] = old[i];
+    }
+    free(old);
+    return true;
+}
 
 GlyphProperties*
-find_or_create_glyph_properties(GlyphProperties **head_, unsigned glyph) {
-    GlyphPropertiesItem **head = (GlyphPropertiesItem**)head_, *p;
-    HASH_FIND_INT(*head, &glyph, p);
-    if (p) return (GlyphProperties*)p;
-    p = calloc(1, sizeof(GlyphPropertiesItem));
-    if (!p) return NULL;
-    p->key = glyph;
-    HASH_ADD_INT(*head, key, p);
+find_or_create_glyph_properties(GlyphPropertiesTable **table, unsigned glyph) {
+    GlyphPropertiesTable *t = *table;
+    if (!t) {
+        t = calloc(1, sizeof(GlyphPropertiesTable));
+        if (!t) return NULL;
+        if (!resize_glyph_properties_table(t, 8)) { free(t); return NULL; }
+        *table = t;
+    }
+    const size_t mask = t->capacity - 1;
+    size_t i = glyph_slot(t, glyph);
+    for (; t->slots[i].occupied; i = (i + 1) & mask) {
+        if (t->slots[i].key == glyph) return (GlyphProperties*)(t->slots + i);
+    }
+    if (2 * (t->count + 1) > t->capacity) {
+        if (!resize_glyph_properties_table(t, 33 - t->shift)) return NULL;
+        for (i = glyph_slot(t, glyph); t->slots[i].occupied; i = (i + 1) & (t->capacity - 1));
+    }
+    GlyphPropertiesItem *p = t->slots + i;
+    p->occupied = true; p->key = glyph; p->data = 0;
+    t->count++;
     return (GlyphProperties*)p;
 }
 
 void
-free_glyph_properties_hash_table(GlyphProperties **head_) {
-    GlyphPropertiesItem **head = (GlyphPropertiesItem**)head_, *s, *tmp;
-    HASH_ITER(hh, *head, s, tmp) {
-        HASH_DEL(*head, s);
-        free(s);
+free_glyph_properties_hash_table(GlyphPropertiesTable **table) {
+    GlyphPropertiesTable *t = *table;
+    if (!t) return;
+    free(t->slots);
+    free(t);
+    *table = NULL;
+}
+// }}}
+
+// Benchmark {{{
+
+static PyObject*
+test_sprite_position_table(PyObject UNUSED *self, PyObject *args) {
+    // Replays a synthetic trace of the lookups made while rendering text:
+    // mostly single glyphs with a skewed distribution, a long tail of rarer
+    // glyphs and some multi-cell ligatures
+    unsigned int num_lookups = 1000000, iterations = 5;
+    if (!PyArg_ParseTuple(args, "|II", &num_lookups, &iterations)) return NULL;
+    if (!num_lookups) { PyErr_SetString(PyExc_ValueError, "num_lookups must be positive"); return NULL; }
+    RAII_ALLOC(glyph_index, trace, malloc(sizeof(glyph_index) * 8 * (size_t)num_lookups));
+    if (!trace) return PyErr_NoMemory();
+    uint32_t seed = 0x9e3779b9u;
+#define RAND() (seed = seed * 1664525u + 1013904223u, seed >> 8)
+    glyph_index *p = trace;
+    for (unsigned i = 0; i < num_lookups; i++) {
+        const unsigned kind = RAND() % 100;
+        if (kind < 80) {
+            // product of two uniform numbers is skewed towards small values
+            *p++ = 1; *p++ = 0; *p++ = 1; *p++ = (glyph_index)(1 + (RAND() % 96) * (RAND() % 96) / 96);
+        } else if (kind < 95) {
+            *p++ = 1; *p++ = 0; *p++ = 2; *p++ = (glyph_index)(1000 + RAND() % 5000);
+        } else {
+            const glyph_index count = (glyph_index)(2 + RAND() % 5), base = (glyph_index)(100 + RAND() % 20);
+            *p++ = count; *p++ = (glyph_index)(RAND() % count); *p++ = count;
+            for (glyph_index g = 0; g < count; g++) *p++ = base + g;
+        }
+    }
+#undef RAND
+    const glyph_index *end = p;
+    SpritePositionTable *table = NULL;
+    size_t created_count = 0;
+    bool created;
+    monotonic_t first_pass = 0, steady_state = 0;
+    for (unsigned n = 0; n <= iterations; n++) {
+        const monotonic_t start = monotonic();
+        for (p = trace; p < end; p += 3 + p[0]) {
+            SpritePosition *s = find_or_create_sprite_position(&table, (glyph_index*)p + 3, p[0], p[1], p[2], &created);
+            if (!s) { free_sprite_position_hash_table(&table); return PyErr_NoMemory(); }
+            s->last_used = n;
+            if (created) created_count++;
+        }
+        if (n) steady_state += monotonic() - start; else first_pass = monotonic() - start;
     }
+    free_sprite_position_hash_table(&table);
+    return Py_BuildValue("{sI sn sd sd}", "lookups", num_lookups, "entries", (Py_ssize_t)created_count,
+            "first_pass_ns_per_lookup", (double)first_pass / num_lookups,
+            "steady_state_ns_per_lookup", iterations ? (double)steady_state / ((double)num_lookups * iterations) : 0.);
+}
+// }}}
+
+static PyMethodDef module_methods[] = {
+    METHODB(test_sprite_position_table, METH_VARARGS),
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+bool
+init_glyph_cache(PyObject *module) {
+    if (PyModule_AddFunctions(module, module_methods) != 0) return false;
+    return true;
 }
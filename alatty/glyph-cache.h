@@ -8,20 +8,26 @@
 
 #include "data-types.h"
 
-void free_glyph_cache_global_resources(void);
-
 #define SpritePositionHead \
-    bool rendered, colored; \
+    bool rendered, colored, rasterizing, prewarming; \
     sprite_index x, y, z; \
+    uint32_t last_used; \
 
 typedef struct SpritePosition {
     SpritePositionHead
 } SpritePosition;
 
+typedef struct SpritePositionTable SpritePositionTable;
+
+// Return false to remove the sprite position from the table
+typedef bool (*sprite_position_filter)(SpritePosition *s, void *data);
 
-void free_sprite_position_hash_table(SpritePosition **head);
+// Tables are created on first use, pointers to sprite positions remain valid
+// until they are removed from the table
+void free_sprite_position_hash_table(SpritePositionTable **table);
+size_t filter_sprite_position_hash_table(SpritePositionTable **table, sprite_position_filter keep, void *data);
 SpritePosition*
-find_or_create_sprite_position(SpritePosition **head, glyph_index *glyphs, glyph_index count, glyph_index ligature_index, glyph_index cell_count, bool *created);
+find_or_create_sprite_position(SpritePositionTable **table, glyph_index *glyphs, glyph_index count, glyph_index ligature_index, glyph_index cell_count, bool *created);
 
 #define GlyphPropertiesHead \
     uint8_t data;
@@ -30,6 +36,9 @@ typedef struct GlyphProperties {
     GlyphPropertiesHead
 } GlyphProperties;
 
-void free_glyph_properties_hash_table(GlyphProperties **head);
+typedef struct GlyphPropertiesTable GlyphPropertiesTable;
+
+void free_glyph_properties_hash_table(GlyphPropertiesTable **table);
+// The returned pointer is only valid until the next call
 GlyphProperties*
-find_or_create_glyph_properties(GlyphProperties **head, unsigned glyph);
+find_or_create_glyph_properties(GlyphPropertiesTable **table, unsigned glyph);
@@ -0,0 +1,495 @@
+/*
+ * glyph-disk-cache.c
+ *
+ * Distributed under terms of the GPL3 license.
+ */
+
+// A persistent cache of rendered cells. Each cache file starts with a header
+// followed by an append only sequence of records, every record being the key
+// of the cell in the sprite position cache followed by its pixels. Files are
+// memory mapped when opened and an index of the records is built in memory,
+// records added later are read back with pread(). Several instances can share
+// a file: records are appended under a shared flock() and the file is only
+// ever truncated under an exclusive one.
+//
+// The render path never touches the file: hashing the font, opening, validating
+// and indexing the file happen in a background thread, until that is done the
+// cache is empty. New records are kept in memory and appended once per frame
+// by flush_glyph_disk_cache().
+
+#include "glyph-disk-cache.h"
+#include "alatty-uthash.h"
+#include "safe-wrappers.h"
+#include "threading.h"
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <dirent.h>
+
+#define CACHE_FILE_MAGIC "ALGLYPH1"
+#define RECORD_MAGIC 0x474c5900u
+#define RECORD_COLORED 1u
+#define MAX_CACHE_FILE_SIZE (64u * 1024u * 1024u)
+#define MAX_GLYPHS_IN_RECORD 1024u
+// Records not yet flushed are written out early beyond this size
+#define MAX_PENDING_SIZE (4u * 1024u * 1024u)
+// Limits for all the cache files together, files unused for longer than
+// MAX_CACHE_FILE_AGE are deleted, then the least recently used ones until
+// the rest fit in MAX_CACHE_DIR_SIZE
+#define MAX_CACHE_DIR_SIZE (256u * 1024u * 1024u)
+#define MAX_CACHE_FILE_AGE (30 * 24 * 60 * 60)
+
+typedef struct CacheFileHeader {
+    char magic[8];
+    uint64_t config_hash;
+    uint32_t byte_order, cell_width, cell_height, baseline;
+} CacheFileHeader;
+
+typedef struct RecordHeader {
+    uint32_t magic, glyph_count, ligature_index, cell_count;
+} RecordHeader;
+
+typedef struct IndexEntry {
+    UT_hash_handle hh;
+    // records that are not flushed yet have the offset -(1 + offset in pending)
+    off_t offset;
+    glyph_index key[];
+} IndexEntry;
+
+typedef enum { CACHE_OPENING, CACHE_OPEN, CACHE_FAILED } CacheState;
+
+struct GlyphDiskCache {
+    int fd;
+    uint8_t *map;
+    // map_sz is the part of the mapping holding valid records
+    size_t map_len, map_sz, file_sz;
+    unsigned cell_width, cell_height, baseline;
+    IndexEntry *index;
+    uint8_t *scratch;
+    size_t scratch_sz;
+    glyph_index *key;
+    size_t key_capacity;
+    uint8_t *pending;
+    size_t pending_sz, pending_capacity;
+    // everything above is owned by the opener thread until state is no longer CACHE_OPENING
+    CacheState state;
+    pthread_t opener;
+    bool opener_started;
+    RasterizerFace face;
+    char *dir;
+};
+
+static char *cache_dir = NULL;
+
+// Pruning {{{
+
+typedef struct CacheFileInfo {
+    char name[64];
+    off_t size;
+    time_t mtime;
+} CacheFileInfo;
+
+static int
+cmp_by_mtime(const void *a_, const void *b_) {
+    const CacheFileInfo *a = a_, *b = b_;
+    return (a->mtime > b->mtime) - (a->mtime < b->mtime);
+}
+
+static void
+prune_cache_dir(const char *dir) {
+    // opening a cache file touches it, so mtime is the time it was last used
+    DIR *d = opendir(dir);
+    if (!d) return;
+    CacheFileInfo *files = NULL;
+    size_t count = 0, capacity = 0;
+    off_t total = 0;
+    const time_t now = time(NULL);
+    struct dirent *ent;
+    while ((ent = readdir(d))) {
+        const size_t len = strlen(ent->d_name);
+        if (len < 8 || len >= sizeof(files->name) || strcmp(ent->d_name + len - 7, ".glyphs") != 0) continue;
+        struct stat st;
+        if (fstatat(dirfd(d), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode)) continue;
+        if (now - st.st_mtime > MAX_CACHE_FILE_AGE) { unlinkat(dirfd(d), ent->d_name, 0); continue; }
+        if (count >= capacity) {
+            capacity = MAX(16u, capacity * 2);
+            CacheFileInfo *n = realloc(files, capacity * sizeof(files[0]));
+            if (!n) break;
+            files = n;
+        }
+        memcpy(files[count].name, ent->d_name, len + 1);
+        files[count].size = st.st_size; files[count].mtime = st.st_mtime;
+        total += st.st_size; count++;
+    }
+    if (total > (off_t)MAX_CACHE_DIR_SIZE) {
+        qsort(files, count, sizeof(files[0]), cmp_by_mtime);
+        // instances that still have a deleted file open keep using it, unlinked
+        for (size_t i = 0; i < count && total > (off_t)MAX_CACHE_DIR_SIZE; i++) {
+            if (unlinkat(dirfd(d), files[i].name, 0) == 0) total -= files[i].size;
+        }
+    }
+    free(files);
+    closedir(d);
+}
+// }}}
+
+void
+set_glyph_disk_cache_dir(const char *path) {
+    free(cache_dir); cache_dir = NULL;
+    if (path && path[0]) {
+        cache_dir = strdup(path);
+        if (cache_dir) prune_cache_dir(cache_dir);
+    }
+}
+
+const char*
+glyph_disk_cache_dir(void) { return cache_dir; }
+
+// Hashing {{{
+
+static uint64_t
+hash_bytes(uint64_t h, const uint8_t *data, size_t sz) {
+    // FNV-1a over eight bytes at a time, good enough for cache keys
+    const uint64_t prime = 0x100000001b3ull;
+    for (; sz >= 8; sz -= 8, data += 8) {
+        uint64_t w; memcpy(&w, data, 8);
+        h = (h ^ w) * prime;
+    }
+    for (; sz; sz--, data++) h = (h ^ *data) * prime;
+    h ^= h >> 33; h *= 0xff51afd7ed558ccdull; h ^= h >> 33;
+    return h;
+}
+
+typedef struct ContentHash {
+    char *path;
+    off_t size;
+    time_t mtime;
+    uint64_t hash;
+} ContentHash;
+static ContentHash content_hashes[16] = {{0}};
+static size_t num_content_hashes = 0;
+static pthread_mutex_t content_hashes_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool
+cached_content_hash(const char *path, const struct stat *st, uint64_t *ans) {
+    bool found = false;
+    pthread_mutex_lock(&content_hashes_lock);
+    for (size_t i = 0; i < num_content_hashes && !found; i++) {
+        ContentHash *c = content_hashes + i;
+        if (c->path && c->size == st->st_size && c->mtime == st->st_mtime && strcmp(c->path, path) == 0) { *ans = c->hash; found = true; }
+    }
+    pthread_mutex_unlock(&content_hashes_lock);
+    return found;
+}
+
+static bool
+font_file_content_hash(const char *path, uint64_t *ans) {
+    // fonts are hashed once per process, as long as they are not modified.
+    // Called from the opener threads.
+    struct stat st;
+    if (stat(path, &st) != 0 || st.st_size < 1) return false;
+    if (cached_content_hash(path, &st, ans)) return true;
+    int fd = safe_open(path, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) return false;
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    safe_close(fd, __FILE__, __LINE__);
+    if (data == MAP_FAILED) return false;
+    *ans = hash_bytes(0xcbf29ce484222325ull, data, st.st_size);
+    munmap(data, st.st_size);
+    pthread_mutex_lock(&content_hashes_lock);
+    ContentHash *c = content_hashes + (num_content_hashes < arraysz(content_hashes) ? num_content_hashes++ : (size_t)(*ans % arraysz(content_hashes)));
+    free(c->path);
+    *c = (ContentHash){.path=strdup(path), .size=st.st_size, .mtime=st.st_mtime, .hash=*ans};
+    pthread_mutex_unlock(&content_hashes_lock);
+    return true;
+}
+// }}}
+
+// Records {{{
+
+static size_t
+pixel_bytes(const GlyphDiskCache *self, bool colored) {
+    return (size_t)self->cell_width * self->cell_height * (colored ? 4 : 1);
+}
+
+static size_t
+record_size(const GlyphDiskCache *self, unsigned glyph_count, bool colored) {
+    const size_t sz = sizeof(RecordHeader) + sizeof(glyph_index) * glyph_count + pixel_bytes(self, colored);
+    return (sz + 3) & ~(size_t)3;
+}
+
+static bool
+lock_cache_file(int fd, int operation) {
+    while (flock(fd, operation) != 0) {
+        if (errno != EINTR) return false;
+    }
+    return true;
+}
+
+static void
+unlock_cache_file(int fd) { flock(fd, LOCK_UN); }
+
+static bool
+ensure_scratch(GlyphDiskCache *self, size_t sz) {
+    if (self->scratch_sz >= sz) return true;
+    free(self->scratch);
+    self->scratch = malloc(sz);
+    self->scratch_sz = self->scratch ? sz : 0;
+    return self->scratch != NULL;
+}
+
+static size_t
+make_key(GlyphDiskCache *self, const glyph_index *glyphs, unsigned glyph_count, unsigned ligature_index, unsigned cell_count) {
+    const size_t key_sz = glyph_count + 3;
+    if (self->key_capacity < key_sz) {
+        free(self->key);
+        self->key_capacity = key_sz + 16;
+        self->key = malloc(self->key_capacity * sizeof(glyph_index));
+        if (!self->key) fatal("Out of memory");
+    }
+    self->key[0] = glyph_count; self->key[1] = ligature_index; self->key[2] = cell_count;
+    memcpy(self->key + 3, glyphs, glyph_count * sizeof(glyph_index));
+    return key_sz * sizeof(glyph_index);
+}
+
+static void
+add_to_index(GlyphDiskCache *self, const RecordHeader *h, const glyph_index *glyphs, off_t offset) {
+    const size_t key_sz = make_key(self, glyphs, h->glyph_count, h->ligature_index, h->cell_count);
+    IndexEntry *e;
+    HASH_FIND(hh, self->index, self->key, key_sz, e);
+    if (e) { e->offset = offset; return; }
+    e = malloc(sizeof(IndexEntry) + key_sz);
+    if (!e) return;
+    e->offset = offset;
+    memcpy(e->key, self->key, key_sz);
+    HASH_ADD(hh, self->index, key, key_sz, e);
+}
+
+static bool
+is_valid_record(const GlyphDiskCache *self, const RecordHeader *h, size_t available) {
+    if ((h->magic & ~RECORD_COLORED) != RECORD_MAGIC || !h->glyph_count || h->glyph_count > MAX_GLYPHS_IN_RECORD) return false;
+    return record_size(self, h->glyph_count, h->magic & RECORD_COLORED) <= available;
+}
+
+static void
+index_records(GlyphDiskCache *self) {
+    // Must be called with an exclusive lock on the file, so that no other
+    // instance is in the middle of appending a record
+    size_t pos = sizeof(CacheFileHeader);
+    while (pos + sizeof(RecordHeader) <= self->map_sz) {
+        RecordHeader h; memcpy(&h, self->map + pos, sizeof(h));
+        if (!is_valid_record(self, &h, self->map_sz - pos)) break;
+        // records are four byte aligned
+        add_to_index(self, &h, (const glyph_index*)(self->map + pos + sizeof(h)), pos);
+        pos += record_size(self, h.glyph_count, h.magic & RECORD_COLORED);
+    }
+    if (pos < self->map_sz) {
+        // a truncated or corrupted record, drop it and everything after it,
+        // pos is within the size seen under the lock so this only ever shrinks
+        if (ftruncate(self->fd, pos) == 0) self->file_sz = pos;
+        self->map_sz = pos;
+    }
+}
+// }}}
+
+// Opening {{{
+
+static bool
+open_cache_file(GlyphDiskCache *self) {
+    const RasterizerFace *face = &self->face;
+    uint64_t content_hash;
+    if (!font_file_content_hash(face->path, &content_hash)) return false;
+    struct {
+        uint64_t content_hash;
+        int64_t char_width, char_height;
+        // ten 32 bit fields so that the struct has no padding
+        uint32_t version, index, hinting, hintstyle, xdpi, ydpi, y_ppem, cell_width, cell_height, baseline;
+    } config = {
+        .version = 1, .content_hash = content_hash, .char_width = face->char_width, .char_height = face->char_height,
+        .index = face->index, .hinting = face->hinting, .hintstyle = face->hintstyle, .xdpi = face->xdpi, .ydpi = face->ydpi,
+        .y_ppem = face->y_ppem, .cell_width = self->cell_width, .cell_height = self->cell_height, .baseline = self->baseline,
+    };
+    const uint64_t config_hash = hash_bytes(0xcbf29ce484222325ull, (const uint8_t*)&config, sizeof(config));
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%016llx.glyphs", self->dir, (unsigned long long)config_hash);
+
+    self->fd = safe_open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (self->fd < 0) return false;
+    const CacheFileHeader expected = {
+        .magic = CACHE_FILE_MAGIC, .config_hash = config_hash, .byte_order = 0x01020304,
+        .cell_width = self->cell_width, .cell_height = self->cell_height, .baseline = self->baseline};
+    // the file is only validated, truncated and indexed while no other
+    // instance can be appending to it
+    if (!lock_cache_file(self->fd, LOCK_EX)) return false;
+    struct stat st;
+    if (fstat(self->fd, &st) != 0) goto fail;
+    self->file_sz = st.st_size;
+    futimens(self->fd, NULL);  // mark as recently used for prune_cache_dir()
+    CacheFileHeader header = {0};
+    if (self->file_sz < sizeof(header) || pread(self->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || memcmp(&header, &expected, sizeof(header)) != 0) {
+        if (ftruncate(self->fd, 0) != 0 || write(self->fd, &expected, sizeof(expected)) != (ssize_t)sizeof(expected)) goto fail;
+        self->file_sz = sizeof(expected);
+    } else if (self->file_sz > sizeof(header)) {
+        self->map = mmap(NULL, self->file_sz, PROT_READ, MAP_SHARED, self->fd, 0);
+        if (self->map == MAP_FAILED) { self->map = NULL; goto fail; }
+        self->map_len = self->map_sz = self->file_sz;
+        index_records(self);
+    }
+    unlock_cache_file(self->fd);
+    return true;
+fail:
+    unlock_cache_file(self->fd);
+    return false;
+}
+
+static void*
+opener_main(void *x) {
+    GlyphDiskCache *self = x;
+    set_thread_name("AlattyGlyphIO");
+    const CacheState state = open_cache_file(self) ? CACHE_OPEN : CACHE_FAILED;
+    __atomic_store_n(&self->state, state, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static bool
+is_open(const GlyphDiskCache *self) {
+    return __atomic_load_n(&self->state, __ATOMIC_ACQUIRE) == CACHE_OPEN;
+}
+
+GlyphDiskCache*
+open_glyph_disk_cache(const RasterizerFace *face, unsigned int cell_width, unsigned int cell_height, unsigned int baseline) {
+    if (!cache_dir) return NULL;
+    GlyphDiskCache *self = calloc(1, sizeof(GlyphDiskCache));
+    if (!self) return NULL;
+    self->fd = -1;
+    self->cell_width = cell_width; self->cell_height = cell_height; self->baseline = baseline;
+    self->face = *face;
+    self->face.path = strdup(face->path);
+    self->dir = strdup(cache_dir);
+    if (!self->face.path || !self->dir) { close_glyph_disk_cache(self); return NULL; }
+    const int ret = pthread_create(&self->opener, NULL, opener_main, self);
+    if (ret != 0) {
+        log_error("Failed to start glyph disk cache thread: %s", strerror(ret));
+        close_glyph_disk_cache(self); return NULL;
+    }
+    self->opener_started = true;
+    return self;
+}
+// }}}
+
+// Pending records {{{
+
+static void
+drop_pending(GlyphDiskCache *self) {
+    // forget the records that could not be written
+    for (size_t pos = 0; pos < self->pending_sz; ) {
+        RecordHeader h; memcpy(&h, self->pending + pos, sizeof(h));
+        const size_t key_sz = make_key(self, (const glyph_index*)(self->pending + pos + sizeof(h)), h.glyph_count, h.ligature_index, h.cell_count);
+        IndexEntry *e;
+        HASH_FIND(hh, self->index, self->key, key_sz, e);
+        if (e && e->offset < 0) { HASH_DEL(self->index, e); free(e); }
+        pos += record_size(self, h.glyph_count, h.magic & RECORD_COLORED);
+    }
+    self->pending_sz = 0;
+}
+
+void
+flush_glyph_disk_cache(GlyphDiskCache *self) {
+    if (!self || !self->pending_sz || !is_open(self)) return;
+    // with O_APPEND the records are written at the end of the file even if
+    // another instance is appending to it as well. The cache is best effort,
+    // so the records are dropped rather than waiting for an instance that is
+    // validating the file.
+    if (!lock_cache_file(self->fd, LOCK_SH | LOCK_NB)) { drop_pending(self); return; }
+    const bool written = write(self->fd, self->pending, self->pending_sz) == (ssize_t)self->pending_sz;
+    const off_t end = lseek(self->fd, 0, SEEK_CUR);
+    unlock_cache_file(self->fd);
+    if (!written || end < (off_t)self->pending_sz) { drop_pending(self); return; }
+    self->file_sz = end;
+    const off_t start = end - self->pending_sz;
+    for (size_t pos = 0; pos < self->pending_sz; ) {
+        RecordHeader h; memcpy(&h, self->pending + pos, sizeof(h));
+        add_to_index(self, &h, (const glyph_index*)(self->pending + pos + sizeof(h)), start + pos);
+        pos += record_size(self, h.glyph_count, h.magic & RECORD_COLORED);
+    }
+    self->pending_sz = 0;
+}
+// }}}
+
+void
+close_glyph_disk_cache(GlyphDiskCache *self) {
+    if (!self) return;
+    if (self->opener_started) pthread_join(self->opener, NULL);
+    flush_glyph_disk_cache(self);
+    IndexEntry *e, *tmp;
+    HASH_ITER(hh, self->index, e, tmp) {
+        HASH_DEL(self->index, e);
+        free(e);
+    }
+    if (self->map) munmap(self->map, self->map_len);
+    if (self->fd > -1) safe_close(self->fd, __FILE__, __LINE__);
+    free(self->scratch); free(self->key); free(self->pending);
+    free((char*)self->face.path); free(self->dir);
+    free(self);
+}
+
+const uint8_t*
+glyph_disk_cache_get(GlyphDiskCache *self, const glyph_index *glyphs, unsigned int glyph_count, unsigned int ligature_index, unsigned int cell_count, bool *colored) {
+    if (!is_open(self)) return NULL;
+    const size_t key_sz = make_key(self, glyphs, glyph_count, ligature_index, cell_count);
+    IndexEntry *e;
+    HASH_FIND(hh, self->index, self->key, key_sz, e);
+    if (!e) return NULL;
+    const uint8_t *record;
+    RecordHeader h;
+    if (e->offset < 0) {
+        const size_t pos = -(e->offset + 1);
+        record = self->pending + pos;
+        memcpy(&h, record, sizeof(h));
+    } else if ((size_t)e->offset + sizeof(h) <= self->map_sz) {
+        record = self->map + e->offset;
+        memcpy(&h, record, sizeof(h));
+        if (!is_valid_record(self, &h, self->map_sz - e->offset)) return NULL;
+    } else {
+        // written after the file was mapped, possibly by another instance, so verify the key
+        if (pread(self->fd, &h, sizeof(h), e->offset) != (ssize_t)sizeof(h) || !is_valid_record(self, &h, SIZE_MAX)) return NULL;
+        const size_t sz = record_size(self, h.glyph_count, h.magic & RECORD_COLORED);
+        if (!ensure_scratch(self, sz) || pread(self->fd, self->scratch, sz, e->offset) != (ssize_t)sz) return NULL;
+        record = self->scratch;
+    }
+    if (h.glyph_count != glyph_count || h.ligature_index != ligature_index || h.cell_count != cell_count || memcmp(record + sizeof(h), glyphs, sizeof(glyph_index) * glyph_count) != 0) return NULL;
+    *colored = h.magic & RECORD_COLORED;
+    return record + sizeof(h) + sizeof(glyph_index) * glyph_count;
+}
+
+void
+glyph_disk_cache_put(GlyphDiskCache *self, const glyph_index *glyphs, unsigned int glyph_count, unsigned int ligature_index, unsigned int cell_count, bool colored, const pixel *cell) {
+    if (!glyph_count || glyph_count > MAX_GLYPHS_IN_RECORD || !is_open(self)) return;
+    const size_t sz = record_size(self, glyph_count, colored);
+    if (self->pending_sz + sz > MAX_PENDING_SIZE) flush_glyph_disk_cache(self);
+    if (self->file_sz + self->pending_sz + sz > MAX_CACHE_FILE_SIZE) return;
+    if (self->pending_sz + sz > self->pending_capacity) {
+        const size_t capacity = MAX(self->pending_capacity * 2, self->pending_sz + sz);
+        uint8_t *n = realloc(self->pending, capacity);
+        if (!n) return;
+        self->pending = n; self->pending_capacity = capacity;
+    }
+    uint8_t *record = self->pending + self->pending_sz;
+    memset(record, 0, sz);
+    const RecordHeader h = {.magic = RECORD_MAGIC | (colored ? RECORD_COLORED : 0), .glyph_count = glyph_count, .ligature_index = ligature_index, .cell_count = cell_count};
+    memcpy(record, &h, sizeof(h));
+    memcpy(record + sizeof(h), glyphs, sizeof(glyph_index) * glyph_count);
+    uint8_t *pixels = record + sizeof(h) + sizeof(glyph_index) * glyph_count;
+    const size_t num_pixels = (size_t)self->cell_width * self->cell_height;
+    if (colored) memcpy(pixels, cell, num_pixels * sizeof(pixel));
+    else for (size_t i = 0; i < num_pixels; i++) pixels[i] = cell[i] & 0xff;
+    add_to_index(self, &h, glyphs, -(off_t)(self->pending_sz + 1));
+    self->pending_sz += sz;
+}
+
+void
+free_glyph_disk_cache_global_resources(void) {
+    free(cache_dir); cache_dir = NULL;
+    for (size_t i = 0; i < num_content_hashes; i++) free(content_hashes[i].path);
+    zero_at_ptr_count(content_hashes, arraysz(content_hashes));
+    num_content_hashes = 0;
+}
@@ -0,0 +1,26 @@
+/*
+ * Distributed under terms of the GPL3 license.
+ */
+
+#pragma once
+
+#include "glyph-rasterizer.h"
+
+typedef struct GlyphDiskCache GlyphDiskCache;
+
+// An empty or NULL path disables the cache
+void set_glyph_disk_cache_dir(const char *path);
+// NULL if the cache is disabled
+const char* glyph_disk_cache_dir(void);
+// Returns NULL if the cache is disabled. There is one cache file per face,
+// size, DPI, hinting and cell metrics combination. The file is opened in a
+// background thread, the cache is empty until that is done or if it fails.
+GlyphDiskCache* open_glyph_disk_cache(const RasterizerFace *face, unsigned int cell_width, unsigned int cell_height, unsigned int baseline);
+void close_glyph_disk_cache(GlyphDiskCache *cache);
+// Returns the pixels of the cell, one byte of alpha per pixel, or four bytes
+// of RGBA for colored sprites. Valid until the next call on the cache.
+const uint8_t* glyph_disk_cache_get(GlyphDiskCache *cache, const glyph_index *glyphs, unsigned int glyph_count, unsigned int ligature_index, unsigned int cell_count, bool *colored);
+// Records are written to the file by the next flush_glyph_disk_cache()
+void glyph_disk_cache_put(GlyphDiskCache *cache, const glyph_index *glyphs, unsigned int glyph_count, unsigned int ligature_index, unsigned int cell_count, bool colored, const pixel *cell);
+void flush_glyph_disk_cache(GlyphDiskCache *cache);
+void free_glyph_disk_cache_global_resources(void);
@@ -0,0 +1,264 @@
+/*
+ * glyph-rasterizer.c
+ *
+ * Distributed under terms of the GPL3 license.
+ */
+
+#include "glyph-rasterizer.h"
+#include "state.h"
+#include "threading.h"
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_RASTERIZER_THREADS 4u
+
+typedef struct JobQueue {
+    GlyphRasterJob *head, *tail;
+} JobQueue;
+
+typedef struct RasterizerThread {
+    pthread_t thread;
+    GlyphRasterJob *current;
+} RasterizerThread;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work_available, work_done;
+    RasterizerThread threads[MAX_RASTERIZER_THREADS];
+    size_t num_threads;
+    // jobs for glyphs on screen are taken before prewarm jobs
+    JobQueue queue, prewarm_queue;
+    GlyphRasterJob *finished;
+    unsigned num_waiters;
+    bool initialized, failed, shutting_down;
+} pool = {0};
+
+// Jobs {{{
+
+GlyphRasterJob*
+alloc_glyph_raster_job(const RasterizerFace *face, unsigned int num_cells, unsigned int num_glyphs, unsigned int glyph_count, unsigned int cell_width, unsigned int cell_height) {
+    // The job and all its arrays live in a single allocation, everything
+    // after the job struct has four byte alignment
+    const size_t path_len = strlen(face->path) + 1;
+    const size_t canvas_sz = sizeof(pixel) * num_cells * cell_width * cell_height;
+    const size_t info_sz = sizeof(hb_glyph_info_t) * num_glyphs, positions_sz = sizeof(hb_glyph_position_t) * num_glyphs;
+    const size_t glyphs_sz = sizeof(glyph_index) * glyph_count, ligatures_sz = sizeof(glyph_index) * num_cells;
+    uint8_t *p = calloc(1, sizeof(GlyphRasterJob) + canvas_sz + info_sz + positions_sz + glyphs_sz + ligatures_sz + path_len);
+    if (!p) return NULL;
+    GlyphRasterJob *job = (GlyphRasterJob*)p; p += sizeof(GlyphRasterJob);
+    job->canvas = (pixel*)p; p += canvas_sz;
+    job->info = (hb_glyph_info_t*)p; p += info_sz;
+    job->positions = (hb_glyph_position_t*)p; p += positions_sz;
+    job->glyphs = (glyph_index*)p; p += glyphs_sz;
+    job->ligature_indices = (glyph_index*)p; p += ligatures_sz;
+    memcpy(p, face->path, path_len);
+    job->face = *face; job->face.path = (const char*)p;
+    job->num_cells = num_cells; job->num_glyphs = num_glyphs; job->glyph_count = glyph_count;
+    job->cell_width = cell_width; job->cell_height = cell_height;
+    return job;
+}
+
+void
+free_glyph_raster_jobs(GlyphRasterJob *job) {
+    while (job) {
+        GlyphRasterJob *next = job->next;
+        free(job);
+        job = next;
+    }
+}
+
+static void
+push_job(JobQueue *q, GlyphRasterJob *job) {
+    job->next = NULL;
+    if (q->tail) q->tail->next = job;
+    else q->head = job;
+    q->tail = job;
+}
+
+static GlyphRasterJob*
+pop_job(JobQueue *q) {
+    GlyphRasterJob *job = q->head;
+    if (!job) return NULL;
+    q->head = job->next;
+    if (!q->head) q->tail = NULL;
+    job->next = NULL;
+    return job;
+}
+
+static GlyphRasterJob*
+remove_jobs_for_font_group(GlyphRasterJob **head, id_type font_group_id) {
+    GlyphRasterJob *ans = NULL, **prev = head;
+    for (GlyphRasterJob *job = *head; job; ) {
+        GlyphRasterJob *next = job->next;
+        if (job->font_group_id == font_group_id) {
+            *prev = next;
+            job->next = ans; ans = job;
+        } else prev = &job->next;
+        job = next;
+    }
+    return ans;
+}
+
+static bool
+has_jobs_for_font_group(const GlyphRasterJob *job, id_type font_group_id) {
+    for (; job; job = job->next) if (job->font_group_id == font_group_id) return true;
+    return false;
+}
+
+static GlyphRasterJob*
+remove_queued_jobs_for_font_group(JobQueue *q, id_type font_group_id) {
+    GlyphRasterJob *ans = remove_jobs_for_font_group(&q->head, font_group_id);
+    q->tail = q->head;
+    while (q->tail && q->tail->next) q->tail = q->tail->next;
+    return ans;
+}
+
+static bool
+has_pending_jobs(id_type font_group_id) {
+    // prewarm jobs are for glyphs nobody is looking at yet
+    if (has_jobs_for_font_group(pool.queue.head, font_group_id)) return true;
+    for (size_t i = 0; i < pool.num_threads; i++) {
+        const GlyphRasterJob *job = pool.threads[i].current;
+        if (job && !job->cancelled && !job->prewarm && job->font_group_id == font_group_id) return true;
+    }
+    return false;
+}
+// }}}
+
+// Worker threads {{{
+
+static void*
+rasterizer_thread_main(void *x) {
+    RasterizerThread *self = x;
+    set_thread_name("AlattyGlyphs");
+    // each thread has its own font library and faces, so no locking is
+    // needed while rasterizing
+    void *thread_data = create_rasterizer_thread_data();
+    pthread_mutex_lock(&pool.lock);
+    while (true) {
+        while (!pool.shutting_down && !pool.queue.head && !pool.prewarm_queue.head) pthread_cond_wait(&pool.work_available, &pool.lock);
+        if (pool.shutting_down) break;
+        GlyphRasterJob *job = pool.queue.head ? pop_job(&pool.queue) : pop_job(&pool.prewarm_queue);
+        self->current = job;
+        pthread_mutex_unlock(&pool.lock);
+
+        if (thread_data) job->succeeded = rasterize_glyph_job(thread_data, job);
+        else snprintf(job->error, sizeof(job->error), "Failed to initialize the font library for glyph rasterization");
+
+        pthread_mutex_lock(&pool.lock);
+        self->current = NULL;
+        pthread_cond_broadcast(&pool.work_done);
+        if (job->cancelled) { free(job); continue; }
+        job->next = pool.finished; pool.finished = job;
+        // if no frame is waiting for the results, render them as soon as possible
+        if (!pool.num_waiters && !pool.shutting_down) wakeup_main_loop();
+    }
+    pthread_mutex_unlock(&pool.lock);
+    if (thread_data) free_rasterizer_thread_data(thread_data);
+    return NULL;
+}
+
+static bool
+ensure_rasterizer_threads(void) {
+    if (pool.num_threads) return true;
+    if (pool.failed) return false;
+    int ret;
+    if (!pool.initialized) {
+        if ((ret = pthread_mutex_init(&pool.lock, NULL)) != 0) {
+            log_error("Failed to create glyph rasterizer mutex: %s", strerror(ret)); pool.failed = true; return false;
+        }
+        if ((ret = pthread_cond_init(&pool.work_available, NULL)) != 0 || (ret = pthread_cond_init(&pool.work_done, NULL)) != 0) {
+            log_error("Failed to create glyph rasterizer condition variable: %s", strerror(ret)); pool.failed = true; return false;
+        }
+        pool.initialized = true;
+    }
+    // leave a core for the main thread
+    const long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    const size_t num_threads = num_cpus > 2 ? MIN((size_t)num_cpus - 1, MAX_RASTERIZER_THREADS) : 1;
+    for (size_t i = 0; i < num_threads; i++) {
+        RasterizerThread *t = pool.threads + pool.num_threads;
+        t->current = NULL;
+        if ((ret = pthread_create(&t->thread, NULL, rasterizer_thread_main, t)) != 0) {
+            log_error("Failed to start glyph rasterizer thread: %s", strerror(ret));
+            break;
+        }
+        pool.num_threads++;
+    }
+    if (!pool.num_threads) pool.failed = true;
+    return pool.num_threads > 0;
+}
+
+bool
+submit_glyph_raster_job(GlyphRasterJob *job) {
+    if (!ensure_rasterizer_threads()) return false;
+    pthread_mutex_lock(&pool.lock);
+    push_job(job->prewarm ? &pool.prewarm_queue : &pool.queue, job);
+    pthread_cond_signal(&pool.work_available);
+    pthread_mutex_unlock(&pool.lock);
+    return true;
+}
+
+GlyphRasterJob*
+finished_glyph_raster_jobs(id_type font_group_id) {
+    if (!pool.num_threads) return NULL;
+    pthread_mutex_lock(&pool.lock);
+    GlyphRasterJob *ans = remove_jobs_for_font_group(&pool.finished, font_group_id);
+    pthread_mutex_unlock(&pool.lock);
+    return ans;
+}
+
+bool
+wait_for_glyph_raster_jobs(id_type font_group_id, monotonic_t timeout) {
+    if (!pool.num_threads) return false;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    const monotonic_t nsec = deadline.tv_nsec + timeout % MONOTONIC_T_1e9;
+    deadline.tv_sec += (time_t)(timeout / MONOTONIC_T_1e9 + nsec / MONOTONIC_T_1e9);
+    deadline.tv_nsec = (long)(nsec % MONOTONIC_T_1e9);
+    pthread_mutex_lock(&pool.lock);
+    pool.num_waiters++;
+    while (has_pending_jobs(font_group_id)) {
+        if (pthread_cond_timedwait(&pool.work_done, &pool.lock, &deadline) == ETIMEDOUT) break;
+    }
+    pool.num_waiters--;
+    const bool ans = has_jobs_for_font_group(pool.finished, font_group_id);
+    pthread_mutex_unlock(&pool.lock);
+    return ans;
+}
+
+void
+cancel_glyph_raster_jobs(id_type font_group_id) {
+    if (!pool.num_threads) return;
+    pthread_mutex_lock(&pool.lock);
+    GlyphRasterJob *queued = remove_queued_jobs_for_font_group(&pool.queue, font_group_id);
+    GlyphRasterJob *queued_prewarm = remove_queued_jobs_for_font_group(&pool.prewarm_queue, font_group_id);
+    GlyphRasterJob *finished = remove_jobs_for_font_group(&pool.finished, font_group_id);
+    // jobs being rasterized are freed by their thread once done
+    for (size_t i = 0; i < pool.num_threads; i++) {
+        GlyphRasterJob *job = pool.threads[i].current;
+        if (job && job->font_group_id == font_group_id) job->cancelled = true;
+    }
+    pthread_mutex_unlock(&pool.lock);
+    free_glyph_raster_jobs(queued);
+    free_glyph_raster_jobs(queued_prewarm);
+    free_glyph_raster_jobs(finished);
+}
+
+void
+shutdown_glyph_rasterizer(void) {
+    if (!pool.initialized) return;
+    pthread_mutex_lock(&pool.lock);
+    pool.shutting_down = true;
+    pthread_cond_broadcast(&pool.work_available);
+    pthread_mutex_unlock(&pool.lock);
+    for (size_t i = 0; i < pool.num_threads; i++) pthread_join(pool.threads[i].thread, NULL);
+    free_glyph_raster_jobs(pool.queue.head);
+    free_glyph_raster_jobs(pool.prewarm_queue.head);
+    free_glyph_raster_jobs(pool.finished);
+    pthread_cond_destroy(&pool.work_available);
+    pthread_cond_destroy(&pool.work_done);
+    pthread_mutex_destroy(&pool.lock);
+    zero_at_ptr(&pool);
+}
+// }}}
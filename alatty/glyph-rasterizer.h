@@ -0,0 +1,57 @@
+/*
+ * Distributed under terms of the GPL3 license.
+ */
+
+#pragma once
+
+#include "data-types.h"
+#include "monotonic.h"
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#include <hb.h>
+#pragma GCC diagnostic pop
+
+// Everything a worker thread needs to open its own copy of a face
+typedef struct RasterizerFace {
+    const char *path;
+    int index, hinting, hintstyle;
+    long char_width, char_height;
+    unsigned int xdpi, ydpi, y_ppem;
+} RasterizerFace;
+
+typedef struct GlyphRasterJob {
+    id_type font_group_id;
+    size_t font_idx;
+    RasterizerFace face;
+    unsigned int num_cells, num_glyphs, glyph_count, cell_width, cell_height, baseline;
+    bool center_glyph, was_colored, cancelled, succeeded;
+    // prewarm jobs are rasterized after all others and are never waited for
+    bool prewarm;
+    hb_glyph_info_t *info;
+    hb_glyph_position_t *positions;
+    // the key of the group in the sprite position cache, repeated glyphs
+    // of infinite ligatures share a ligature index
+    glyph_index *glyphs;
+    glyph_index *ligature_indices;
+    pixel *canvas;
+    char error[512];
+    struct GlyphRasterJob *next;
+} GlyphRasterJob;
+
+GlyphRasterJob* alloc_glyph_raster_job(const RasterizerFace *face, unsigned int num_cells, unsigned int num_glyphs, unsigned int glyph_count, unsigned int cell_width, unsigned int cell_height);
+void free_glyph_raster_jobs(GlyphRasterJob *job);
+// Takes ownership of job on success, returns false if no worker is available
+bool submit_glyph_raster_job(GlyphRasterJob *job);
+// Detaches the list of finished jobs for the specified font group
+GlyphRasterJob* finished_glyph_raster_jobs(id_type font_group_id);
+// Waits until all jobs for the font group except prewarm jobs are finished or
+// timeout expires, returns true if any finished jobs are waiting to be collected
+bool wait_for_glyph_raster_jobs(id_type font_group_id, monotonic_t timeout);
+void cancel_glyph_raster_jobs(id_type font_group_id);
+void shutdown_glyph_rasterizer(void);
+
+// API that font backends need to implement to rasterize in worker threads
+bool rasterizer_face_for(PyObject *face, RasterizerFace *ans);
+void* create_rasterizer_thread_data(void);
+void free_rasterizer_thread_data(void *data);
+bool rasterize_glyph_job(void *thread_data, GlyphRasterJob *job);
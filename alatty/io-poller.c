@@ -0,0 +1,663 @@
+/*
+ * io-poller.c
+ *
+ * Distributed under terms of the GPL3 license.
+ */
+
+#include "io-poller.h"
+#include "loop-utils.h"
+#include "monotonic.h"
+#include "safe-wrappers.h"
+#include <errno.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#define HAS_EPOLL
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#ifdef IORING_FEAT_EXT_ARG
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <endian.h>
+#define HAS_IO_URING
+#endif
+#endif
+#endif
+
+// Poller {{{
+
+#ifdef HAS_EPOLL
+static uint32_t
+to_epoll_events(short events) {
+    return (events & POLLIN ? EPOLLIN : 0) | (events & POLLOUT ? EPOLLOUT : 0);
+}
+
+static short
+from_epoll_events(uint32_t events) {
+    return (events & EPOLLIN ? POLLIN : 0) | (events & EPOLLOUT ? POLLOUT : 0) | (events & EPOLLHUP ? POLLHUP : 0) | (events & EPOLLERR ? POLLERR : 0);
+}
+
+static bool
+epoll_ctl_slot(IOPoller *self, int op, size_t slot) {
+    struct epoll_event ev = {.events=to_epoll_events(self->slots[slot].events), .data.u64=slot};
+    if (epoll_ctl(self->epoll_fd, op, self->slots[slot].fd, &ev) == 0) return true;
+    log_error("Failed to update epoll registration of fd %d with error: %s", self->slots[slot].fd, strerror(errno));
+    return false;
+}
+#endif
+
+#ifdef HAS_IO_URING
+// io_uring {{{
+// There is no liburing dependency, the rings are set up with the raw
+// syscalls. Polls are oneshot and re-armed after they are delivered, which
+// gives the same level triggered semantics as the other backends. Slots
+// that have had a read submitted get their data from a poll linked to a read
+// instead, so the bytes land directly in the caller's buffer with no extra
+// syscall. Completions refer to a heap allocated token per slot, since slots
+// move around when children are removed.
+
+enum { OP_POLL_IN, OP_POLL_OUT, OP_LINKED_POLL, OP_READ, OP_CANCEL, OP_MASK = 7 };
+
+typedef struct UringSlot {
+    size_t slot;
+    unsigned in_flight;
+    short polls_armed, revents;
+    bool reader, read_pending, read_done, completed, queued_for_rearm;
+    int read_result;
+    uint8_t *read_buf;
+} UringSlot;
+
+typedef struct IOUring {
+    int fd;
+    unsigned sq_entries, sq_tail_local, *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_sz, cq_ring_sz, sqes_sz;
+    UringSlot **tokens, **completed, **rearm;
+    size_t num_completed, num_rearm;
+} IOUring;
+
+static void
+free_uring(IOUring *r, size_t capacity) {
+    if (r->sqes) munmap(r->sqes, r->sqes_sz);
+    if (r->cq_ring && r->cq_ring != r->sq_ring) munmap(r->cq_ring, r->cq_ring_sz);
+    if (r->sq_ring) munmap(r->sq_ring, r->sq_ring_sz);
+    if (r->fd > -1) safe_close(r->fd, __FILE__, __LINE__);
+    if (r->tokens) for (size_t i = 0; i < capacity; i++) free(r->tokens[i]);
+    free(r->tokens); free(r->completed); free(r->rearm);
+    free(r);
+}
+
+static IOUring*
+create_uring(size_t capacity) {
+    IOUring *r = calloc(1, sizeof(IOUring));
+    if (!r) return NULL;
+    r->fd = -1;
+    r->tokens = calloc(capacity, sizeof(r->tokens[0]));
+    r->completed = calloc(capacity, sizeof(r->completed[0]));
+    r->rearm = calloc(capacity, sizeof(r->rearm[0]));
+    if (!r->tokens || !r->completed || !r->rearm) goto fail;
+    // every slot can have at most a poll for writing, a poll for reading or
+    // a linked poll and read and a cancellation of each in flight
+    unsigned entries = 8;
+    while (entries < 4 * capacity && entries < 4096) entries *= 2;
+    struct io_uring_params params = {0};
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (r->fd < 0) { r->fd = -1; goto fail; }
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) { errno = ENOSYS; goto fail; }
+    r->sq_entries = params.sq_entries;
+    r->sq_ring_sz = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    r->cq_ring_sz = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) r->sq_ring_sz = r->cq_ring_sz = MAX(r->sq_ring_sz, r->cq_ring_sz);
+    r->sq_ring = mmap(NULL, r->sq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ring == MAP_FAILED) { r->sq_ring = NULL; goto fail; }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) r->cq_ring = r->sq_ring;
+    else {
+        r->cq_ring = mmap(NULL, r->cq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ring == MAP_FAILED) { r->cq_ring = NULL; goto fail; }
+    }
+    r->sqes_sz = params.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) { r->sqes = NULL; goto fail; }
+#define R(ring, field) (unsigned*)((char*)r->ring##_ring + params.ring##_off.field)
+    r->sq_head = R(sq, head); r->sq_tail = R(sq, tail); r->sq_mask = R(sq, ring_mask); r->sq_array = R(sq, array);
+    r->cq_head = R(cq, head); r->cq_tail = R(cq, tail); r->cq_mask = R(cq, ring_mask);
+#undef R
+    r->cqes = (struct io_uring_cqe*)((char*)r->cq_ring + params.cq_off.cqes);
+    r->sq_tail_local = *r->sq_tail;
+    return r;
+fail:
+    free_uring(r, capacity);
+    return NULL;
+}
+
+static bool
+resize_uring(IOUring *r, size_t old_capacity, size_t capacity) {
+#define G(arr) { \
+    UringSlot **a = realloc(r->arr, capacity * sizeof(a[0])); \
+    if (!a) return false; \
+    memset(a + old_capacity, 0, (capacity - old_capacity) * sizeof(a[0])); \
+    r->arr = a; \
+}
+    G(tokens); G(completed); G(rearm);
+#undef G
+    return true;
+}
+
+static int
+uring_enter(IOUring *r, unsigned min_complete, int timeout_ms) {
+    __atomic_store_n(r->sq_tail, r->sq_tail_local, __ATOMIC_RELEASE);
+    const unsigned to_submit = r->sq_tail_local - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    struct __kernel_timespec ts = {0};
+    struct io_uring_getevents_arg arg = {0};
+    const void *argp = NULL; size_t argsz = 0;
+    if (min_complete && timeout_ms > -1) {
+        ts.tv_sec = timeout_ms / 1000; ts.tv_nsec = (timeout_ms % 1000) * 1000000ll;
+        arg.ts = (uint64_t)(uintptr_t)&ts; argp = &arg; argsz = sizeof(arg);
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+    if (!to_submit && !min_complete) return 0;
+    int ret = (int)syscall(__NR_io_uring_enter, r->fd, to_submit, min_complete, flags, argp, argsz);
+    if (ret < 0 && errno == ETIME) ret = 0;
+    return ret;
+}
+
+static void
+mark_completed(IOUring *r, UringSlot *t) {
+    if (!t->completed) { t->completed = true; r->completed[r->num_completed++] = t; }
+}
+
+static void
+uring_reap(IOUring *r) {
+    unsigned head = *r->cq_head;
+    const unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        const struct io_uring_cqe *cqe = r->cqes + (head & *r->cq_mask);
+        UringSlot *t = (UringSlot*)(uintptr_t)(cqe->user_data & ~(uint64_t)OP_MASK);
+        t->in_flight--;
+        switch (cqe->user_data & OP_MASK) {
+            case OP_POLL_IN: case OP_POLL_OUT: {
+                const short which = (cqe->user_data & OP_MASK) == OP_POLL_IN ? POLLIN : POLLOUT;
+                t->polls_armed &= ~which;
+                if (cqe->res > 0) { t->revents |= cqe->res & (which | POLLHUP | POLLERR); mark_completed(r, t); }
+            } break;
+            case OP_READ:
+                t->read_pending = false; t->read_done = true; t->read_result = cqe->res; t->revents |= POLLIN;
+                mark_completed(r, t);
+                break;
+            default:  // the poll a read is linked to and cancellations
+                break;
+        }
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static struct io_uring_sqe*
+uring_get_sqes(IOUring *r, UringSlot *t, unsigned count) {
+    // returns count consecutive zeroed submission entries
+    while (r->sq_tail_local + count - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) > r->sq_entries) {
+        if (uring_enter(r, 0, 0) < 0) {
+            if (errno == EBUSY) { uring_reap(r); continue; }  // too many unreaped completions
+            if (errno != EINTR) { log_error("Failed to submit to io_uring with error: %s", strerror(errno)); return NULL; }
+        }
+    }
+    struct io_uring_sqe *first = NULL;
+    for (unsigned i = 0; i < count; i++) {
+        const unsigned idx = r->sq_tail_local++ & *r->sq_mask;
+        struct io_uring_sqe *sqe = r->sqes + idx;
+        zero_at_ptr(sqe);
+        r->sq_array[idx] = idx;
+        if (!i) first = sqe;
+    }
+    t->in_flight += count;
+    return first;
+}
+
+static struct io_uring_sqe*
+next_sqe(IOUring *r, struct io_uring_sqe *sqe) {
+    return r->sqes + (((sqe - r->sqes) + 1) & *r->sq_mask);
+}
+
+static void
+prep_poll(struct io_uring_sqe *sqe, int fd, short events, UringSlot *t, unsigned op) {
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    uint32_t mask = events;
+#if __BYTE_ORDER == __BIG_ENDIAN
+    mask = (mask << 16) | (mask >> 16);
+#endif
+    sqe->poll32_events = mask;
+    sqe->user_data = (uint64_t)(uintptr_t)t | op;
+}
+
+static void
+uring_arm(IOPoller *self, UringSlot *t) {
+    const struct pollfd *s = self->slots + t->slot;
+    const short wanted = s->events & (t->reader ? POLLOUT : (POLLIN | POLLOUT)) & ~t->polls_armed;
+    for (short which = POLLIN; which <= POLLOUT; which <<= 1) {
+        if (!(wanted & which)) continue;
+        struct io_uring_sqe *sqe = uring_get_sqes(self->uring, t, 1);
+        if (!sqe) return;
+        prep_poll(sqe, s->fd, which, t, which == POLLIN ? OP_POLL_IN : OP_POLL_OUT);
+        t->polls_armed |= which;
+    }
+}
+
+static void
+uring_forget(IOUring *r, UringSlot *t) {
+#define drop(arr, num) for (size_t i = 0; i < r->num; i++) if (r->arr[i] == t) { r->arr[i] = r->arr[--r->num]; break; }
+    if (t->completed) drop(completed, num_completed);
+    if (t->queued_for_rearm) drop(rearm, num_rearm);
+#undef drop
+}
+
+static bool
+uring_remove(IOUring *r, UringSlot *t) {
+    // Waits for everything in flight to finish, the buffer a read targets
+    // and the token must not be freed while the kernel can still use them
+    unsigned ops[4], n = 0;
+    if (t->polls_armed & POLLIN) ops[n++] = OP_POLL_IN;
+    if (t->polls_armed & POLLOUT) ops[n++] = OP_POLL_OUT;
+    if (t->read_pending) { ops[n++] = OP_LINKED_POLL; ops[n++] = OP_READ; }
+    for (unsigned i = 0; i < n; i++) {
+        struct io_uring_sqe *sqe = uring_get_sqes(r, t, 1);
+        if (!sqe) return false;
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = (uint64_t)(uintptr_t)t | ops[i];
+        sqe->user_data = (uint64_t)(uintptr_t)t | OP_CANCEL;
+    }
+    while (t->in_flight) {
+        if (uring_enter(r, 1, -1) < 0 && errno != EINTR) {
+            log_error("Failed to wait for io_uring cancellation with error: %s", strerror(errno));
+            return false;
+        }
+        uring_reap(r);
+    }
+    uring_forget(r, t);
+    return true;
+}
+
+static int
+uring_wait(IOPoller *self, int timeout_ms) {
+    IOUring *r = self->uring;
+    for (size_t i = 0; i < r->num_rearm; i++) {
+        r->rearm[i]->queued_for_rearm = false;
+        uring_arm(self, r->rearm[i]);
+    }
+    r->num_rearm = 0;
+    // completions can already be waiting if they were reaped while removing a slot
+    int ret = uring_enter(r, r->num_completed ? 0 : 1, timeout_ms);
+    if (ret < 0) return ret;
+    uring_reap(r);
+    for (size_t i = 0; i < r->num_completed; i++) {
+        UringSlot *t = r->completed[i];
+        t->completed = false;
+        self->slots[t->slot].revents = t->revents; t->revents = 0;
+        self->ready[self->num_ready++] = t->slot;
+        t->queued_for_rearm = true; r->rearm[r->num_rearm++] = t;
+    }
+    r->num_completed = 0;
+    return (int)self->num_ready;
+}
+
+bool
+io_poller_submit_read(IOPoller *self, size_t slot, uint8_t *buf, size_t sz) {
+    if (self->kind != IO_POLLER_URING) return false;
+    UringSlot *t = self->uring->tokens[slot];
+    if (!t || t->read_pending || t->read_done) return false;
+    // A poll linked to the read, since the fd is non-blocking and a read
+    // by itself would just fail with EAGAIN when there is nothing to read
+    struct io_uring_sqe *sqe;
+    if (t->polls_armed & POLLIN && !t->reader) {
+        // from before the slot became a reader, a late completion is harmless
+        if (!(sqe = uring_get_sqes(self->uring, t, 1))) return false;
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = (uint64_t)(uintptr_t)t | OP_POLL_IN;
+        sqe->user_data = (uint64_t)(uintptr_t)t | OP_CANCEL;
+    }
+    if (!(sqe = uring_get_sqes(self->uring, t, 2))) return false;
+    prep_poll(sqe, self->slots[slot].fd, POLLIN, t, OP_LINKED_POLL);
+    sqe->flags |= IOSQE_IO_LINK;
+    sqe = next_sqe(self->uring, sqe);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = self->slots[slot].fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (uint32_t)MIN(sz, (size_t)UINT32_MAX);
+    sqe->off = (uint64_t)-1;
+    sqe->user_data = (uint64_t)(uintptr_t)t | OP_READ;
+    t->reader = true; t->read_pending = true; t->read_buf = buf;
+    return true;
+}
+
+bool
+io_poller_read_pending(const IOPoller *self, size_t slot) {
+    if (self->kind != IO_POLLER_URING) return false;
+    const UringSlot *t = self->uring->tokens[slot];
+    return t && (t->read_pending || t->read_done);
+}
+
+bool
+io_poller_cancel_read(IOPoller *self, size_t slot) {
+    if (self->kind != IO_POLLER_URING) return true;
+    UringSlot *t = self->uring->tokens[slot];
+    if (!t) return true;
+    IOUring *r = self->uring;
+    if (t->read_pending) {
+        const unsigned ops[2] = {OP_LINKED_POLL, OP_READ};
+        for (unsigned i = 0; i < arraysz(ops); i++) {
+            struct io_uring_sqe *sqe = uring_get_sqes(r, t, 1);
+            if (!sqe) return false;
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = (uint64_t)(uintptr_t)t | ops[i];
+            sqe->user_data = (uint64_t)(uintptr_t)t | OP_CANCEL;
+        }
+        while (t->read_pending) {
+            if (uring_enter(r, 1, -1) < 0 && errno != EINTR) {
+                log_error("Failed to wait for io_uring cancellation with error: %s", strerror(errno));
+                return false;
+            }
+            uring_reap(r);
+        }
+    }
+    if (t->read_done && t->read_result != -ECANCELED) return false;
+    // the slot is still reported as ready, with no read to take
+    t->read_done = false;
+    return true;
+}
+
+bool
+io_poller_take_read(IOPoller *self, size_t slot, uint8_t **buf, ssize_t *result) {
+    if (self->kind != IO_POLLER_URING) return false;
+    UringSlot *t = self->uring->tokens[slot];
+    if (!t || !t->read_done) return false;
+    t->read_done = false;
+    *buf = t->read_buf; *result = t->read_result;
+    return true;
+}
+// }}}
+#else
+bool io_poller_submit_read(IOPoller *self UNUSED, size_t slot UNUSED, uint8_t *buf UNUSED, size_t sz UNUSED) { return false; }
+bool io_poller_read_pending(const IOPoller *self UNUSED, size_t slot UNUSED) { return false; }
+bool io_poller_cancel_read(IOPoller *self UNUSED, size_t slot UNUSED) { return true; }
+bool io_poller_take_read(IOPoller *self UNUSED, size_t slot UNUSED, uint8_t **buf UNUSED, ssize_t *result UNUSED) { return false; }
+#endif
+
+bool
+init_io_poller(IOPoller *self, struct pollfd *slots, size_t capacity, IOPollerKind preferred) {
+    // Falls back to the next simplest backend if preferred is not available
+    zero_at_ptr(self);
+    self->slots = slots; self->capacity = capacity; self->epoll_fd = -1;
+    self->ready = calloc(capacity, sizeof(self->ready[0]));
+    if (!self->ready) return false;
+#ifdef HAS_IO_URING
+    if (preferred == IO_POLLER_URING) {
+        self->uring = create_uring(capacity);
+        if (self->uring) { self->kind = IO_POLLER_URING; return true; }
+        log_error("Failed to create io_uring instance, falling back to epoll with error: %s", strerror(errno));
+    }
+#endif
+#ifdef HAS_EPOLL
+    if (preferred >= IO_POLLER_EPOLL) {
+        self->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (self->epoll_fd > -1) {
+            self->events = calloc(capacity, sizeof(struct epoll_event));
+            if (!self->events) { free_io_poller(self); return false; }
+            self->kind = IO_POLLER_EPOLL;
+        } else log_error("Failed to create epoll instance, falling back to poll() with error: %s", strerror(errno));
+    }
+#else
+    (void)preferred;
+#endif
+    return true;
+}
+
+void
+free_io_poller(IOPoller *self) {
+    if (self->epoll_fd > -1) safe_close(self->epoll_fd, __FILE__, __LINE__);
+#ifdef HAS_IO_URING
+    if (self->uring) free_uring(self->uring, self->capacity);
+#endif
+    free(self->ready); free(self->events);
+    zero_at_ptr(self);
+    self->epoll_fd = -1;
+}
+
+bool
+io_poller_resize(IOPoller *self, struct pollfd *slots, size_t capacity) {
+    self->slots = slots;
+    if (capacity <= self->capacity) return true;
+    size_t *ready = realloc(self->ready, capacity * sizeof(ready[0]));
+    if (!ready) return false;
+    self->ready = ready;
+#ifdef HAS_EPOLL
+    if (self->kind == IO_POLLER_EPOLL) {
+        void *events = realloc(self->events, capacity * sizeof(struct epoll_event));
+        if (!events) return false;
+        self->events = events;
+    }
+#endif
+#ifdef HAS_IO_URING
+    if (self->kind == IO_POLLER_URING && !resize_uring(self->uring, self->capacity, capacity)) return false;
+#endif
+    self->capacity = capacity;
+    return true;
+}
+
+const char*
+io_poller_name(const IOPoller *self) {
+    switch (self->kind) {
+        case IO_POLLER_POLL: return "poll";
+        case IO_POLLER_EPOLL: return "epoll";
+        case IO_POLLER_URING: return "io_uring";
+    }
+    return "unknown";
+}
+
+bool
+io_poller_add(IOPoller *self, size_t slot) {
+    self->slots[slot].revents = 0;
+#ifdef HAS_IO_URING
+    if (self->kind == IO_POLLER_URING) {
+        UringSlot *t = calloc(1, sizeof(UringSlot));
+        if (!t) return false;
+        t->slot = slot; self->uring->tokens[slot] = t;
+        uring_arm(self, t);
+        return true;
+    }
+#endif
+#ifdef HAS_EPOLL
+    if (self->kind == IO_POLLER_EPOLL) return epoll_ctl_slot(self, EPOLL_CTL_ADD, slot);
+#endif
+    return true;
+}
+
+void
+io_poller_set_events(IOPoller *self, size_t slot, short events) {
+    if (self->slots[slot].events == events) return;
+    self->slots[slot].events = events;
+#ifdef HAS_IO_URING
+    if (self->kind == IO_POLLER_URING && self->uring->tokens[slot]) uring_arm(self, self->uring->tokens[slot]);
+#endif
+#ifdef HAS_EPOLL
+    if (self->kind == IO_POLLER_EPOLL) epoll_ctl_slot(self, EPOLL_CTL_MOD, slot);
+#endif
+}
+
+void
+io_poller_remove(IOPoller *self, size_t slot) {
+    self->slots[slot].revents = 0;
+#ifdef HAS_IO_URING
+    if (self->kind == IO_POLLER_URING) {
+        UringSlot *t = self->uring->tokens[slot];
+        self->uring->tokens[slot] = NULL;
+        // if the kernel could not be made to let go of it, leak it
+        if (t && uring_remove(self->uring, t)) free(t);
+        return;
+    }
+#endif
+#ifdef HAS_EPOLL
+    if (self->kind == IO_POLLER_EPOLL && self->slots[slot].fd > -1) epoll_ctl(self->epoll_fd, EPOLL_CTL_DEL, self->slots[slot].fd, NULL);
+#else
+    (void)self; (void)slot;
+#endif
+}
+
+void
+io_poller_slot_moved(IOPoller *self, size_t from, size_t to) {
+#ifdef HAS_IO_URING
+    if (self->kind == IO_POLLER_URING) {
+        UringSlot *t = self->uring->tokens[from];
+        self->uring->tokens[from] = NULL; self->uring->tokens[to] = t;
+        if (t) t->slot = to;
+        return;
+    }
+#endif
+#ifdef HAS_EPOLL
+    if (self->kind == IO_POLLER_EPOLL) epoll_ctl_slot(self, EPOLL_CTL_MOD, to);
+#else
+    (void)self; (void)from; (void)to;
+#endif
+}
+
+int
+io_poller_wait(IOPoller *self, size_t num_slots, int timeout_ms) {
+    int ret;
+    switch (self->kind) {
+        case IO_POLLER_POLL:
+            self->num_ready = 0;
+            ret = poll(self->slots, num_slots, timeout_ms);
+            if (ret > 0) {
+                for (size_t i = 0; i < num_slots; i++) if (self->slots[i].revents) self->ready[self->num_ready++] = i;
+            }
+            return ret;
+        case IO_POLLER_EPOLL:
+#ifdef HAS_EPOLL
+            for (size_t i = 0; i < self->num_ready; i++) self->slots[self->ready[i]].revents = 0;
+            self->num_ready = 0;
+            struct epoll_event *events = self->events;
+            ret = epoll_wait(self->epoll_fd, events, MIN(num_slots, self->capacity), timeout_ms);
+            for (int i = 0; i < ret; i++) {
+                const size_t slot = events[i].data.u64;
+                if (slot >= num_slots) continue;
+                self->slots[slot].revents = from_epoll_events(events[i].events);
+                self->ready[self->num_ready++] = slot;
+            }
+            return ret;
+#endif
+            break;
+        case IO_POLLER_URING:
+#ifdef HAS_IO_URING
+            for (size_t i = 0; i < self->num_ready; i++) self->slots[self->ready[i]].revents = 0;
+            self->num_ready = 0;
+            return uring_wait(self, timeout_ms);
+#endif
+            break;
+    }
+    errno = EINVAL;
+    return -1;
+}
+// }}}
+
+// Benchmark {{{
+
+#define BENCH_CHUNK 256
+
+static bool
+time_poller(IOPoller *p, size_t num_slots, unsigned iterations, int busy_write_fd, pthread_mutex_t *locks, uint8_t *bufs, double *ans) {
+    // Emulates the work done by the I/O thread for every wakeup: the poll()
+    // backend has to recompute the interest of every child, taking its
+    // buffer locks, the other backends only look at the ready children, and
+    // with io_uring the data has already been read when they are woken.
+    static const char data[BENCH_CHUNK] = {0};
+    char buf[sizeof(data)];
+    if (p->kind == IO_POLLER_URING) {
+        for (size_t i = 0; i < num_slots; i++) if (!io_poller_submit_read(p, i, bufs + i * BENCH_CHUNK, BENCH_CHUNK)) return false;
+    }
+    const monotonic_t start = monotonic();
+    for (unsigned n = 0; n < iterations; n++) {
+        if (write(busy_write_fd, data, sizeof(data)) < 0 && errno != EAGAIN) return false;
+        if (p->kind == IO_POLLER_POLL) {
+            for (size_t i = 0; i < num_slots; i++) {
+                pthread_mutex_lock(locks + i); pthread_mutex_unlock(locks + i);
+                io_poller_set_events(p, i, POLLIN);
+            }
+        }
+        if (io_poller_wait(p, num_slots, -1) < 0 && errno != EINTR) return false;
+        for (size_t r = 0; r < p->num_ready; r++) {
+            const size_t i = p->ready[r];
+            if (p->kind == IO_POLLER_URING) {
+                uint8_t *b; ssize_t result;
+                // the read is still in flight, nothing to resubmit
+                if (!io_poller_take_read(p, i, &b, &result)) continue;
+                if (result < 0 && result != -EAGAIN) { errno = -result; return false; }
+                pthread_mutex_lock(locks + i); pthread_mutex_unlock(locks + i);
+                if (!io_poller_submit_read(p, i, bufs + i * BENCH_CHUNK, BENCH_CHUNK)) return false;
+                continue;
+            }
+            while (read(p->slots[i].fd, buf, sizeof(buf)) > 0);
+            pthread_mutex_lock(locks + i); pthread_mutex_unlock(locks + i);
+        }
+    }
+    *ans = (double)(monotonic() - start) / (1000. * iterations);
+    return true;
+}
+
+static PyObject*
+test_io_pollers(PyObject UNUSED *self, PyObject *args) {
+    unsigned int num_idle = 500, iterations = 20000;
+    if (!PyArg_ParseTuple(args, "|II", &num_idle, &iterations)) return NULL;
+    if (!iterations) { PyErr_SetString(PyExc_ValueError, "iterations must be positive"); return NULL; }
+    // the busy child is the last slot, like a newly opened window
+    const size_t num_slots = (size_t)num_idle + 1;
+    RAII_ALLOC(struct pollfd, slots, calloc(num_slots, sizeof(struct pollfd)));
+    RAII_ALLOC(int, write_fds, malloc(num_slots * sizeof(int)));
+    RAII_ALLOC(pthread_mutex_t, locks, malloc(num_slots * sizeof(pthread_mutex_t)));
+    RAII_ALLOC(uint8_t, bufs, malloc(num_slots * BENCH_CHUNK));
+    if (!slots || !write_fds || !locks || !bufs) return PyErr_NoMemory();
+    size_t num_open = 0;
+    for (; num_open < num_slots; num_open++) {
+        int fds[2];
+        if (!self_pipe(fds, true)) break;
+        slots[num_open].fd = fds[0]; slots[num_open].events = POLLIN; write_fds[num_open] = fds[1];
+        pthread_mutex_init(locks + num_open, NULL);
+    }
+    PyObject *ans = NULL;
+    if (num_open < num_slots) { PyErr_SetFromErrno(PyExc_OSError); goto end; }
+    double timings[IO_POLLER_URING + 1] = {-1, -1, -1};
+    for (IOPollerKind kind = IO_POLLER_POLL; kind <= IO_POLLER_URING; kind++) {
+        IOPoller p;
+        if (!init_io_poller(&p, slots, num_slots, kind)) { PyErr_NoMemory(); goto end; }
+        if (p.kind != kind) { free_io_poller(&p); continue; }
+        bool ok = true;
+        for (size_t i = 0; i < num_slots && ok; i++) ok = io_poller_add(&p, i);
+        if (ok) ok = time_poller(&p, num_slots, iterations, write_fds[num_slots - 1], locks, bufs, timings + kind);
+        for (size_t i = 0; i < num_slots; i++) io_poller_remove(&p, i);
+        free_io_poller(&p);
+        if (!ok) { PyErr_SetFromErrno(PyExc_OSError); goto end; }
+    }
+    ans = Py_BuildValue("{sI sd sd sd}", "children", (unsigned)num_slots,
+            "poll_us_per_wakeup", timings[IO_POLLER_POLL], "epoll_us_per_wakeup", timings[IO_POLLER_EPOLL],
+            "io_uring_us_per_wakeup", timings[IO_POLLER_URING]);
+end:
+    for (size_t i = 0; i < num_open; i++) {
+        safe_close(slots[i].fd, __FILE__, __LINE__); safe_close(write_fds[i], __FILE__, __LINE__);
+        pthread_mutex_destroy(locks + i);
+    }
+    return ans;
+}
+#undef BENCH_CHUNK
+
+static PyMethodDef module_methods[] = {
+    METHODB(test_io_pollers, METH_VARARGS),
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+bool
+init_io_poller_module(PyObject *module) {
+    if (PyModule_AddFunctions(module, module_methods) != 0) return false;
+    return true;
+}
+// }}}
@@ -0,0 +1,52 @@
+/*
+ * Distributed under terms of the GPL3 license.
+ */
+
+#pragma once
+
+#include "data-types.h"
+#include <poll.h>
+
+// In order of preference, later kinds fall back to earlier ones
+typedef enum { IO_POLLER_POLL, IO_POLLER_EPOLL, IO_POLLER_URING } IOPollerKind;
+
+// Waits for events on a table of slots owned by the caller, who sets fd and
+// events for each slot. After a wait, revents is set for the ready slots and
+// their indices are in ready. With poll() every wait scans the whole table,
+// with epoll slots are registered once and only the ready ones are visited.
+// io_uring additionally supports reads submitted straight into a buffer, the
+// slot is then reported with POLLIN once the read has completed.
+typedef struct IOPoller {
+    IOPollerKind kind;
+    int epoll_fd;
+    struct pollfd *slots;
+    size_t capacity, num_ready, *ready;
+    void *events;
+    struct IOUring *uring;
+} IOPoller;
+
+bool init_io_poller(IOPoller *self, struct pollfd *slots, size_t capacity, IOPollerKind preferred);
+void free_io_poller(IOPoller *self);
+// For when the slots table has been reallocated, possibly with a larger capacity
+bool io_poller_resize(IOPoller *self, struct pollfd *slots, size_t capacity);
+const char* io_poller_name(const IOPoller *self);
+// Start watching a slot whose fd and events have been set
+bool io_poller_add(IOPoller *self, size_t slot);
+// Change the events of a slot, a no-op if they are unchanged
+void io_poller_set_events(IOPoller *self, size_t slot, short events);
+// Must be called before the fd of a slot is closed
+void io_poller_remove(IOPoller *self, size_t slot);
+// Must be called when the contents of a slot are moved to a different index
+void io_poller_slot_moved(IOPoller *self, size_t from, size_t to);
+int io_poller_wait(IOPoller *self, size_t num_slots, int timeout_ms);
+// io_uring only: once a read has been submitted for a slot, POLLIN in its
+// events means nothing, data arrives only through reads. The buffer must
+// stay valid until the read is taken or the slot is removed.
+bool io_poller_submit_read(IOPoller *self, size_t slot, uint8_t *buf, size_t sz);
+// True from when a read is submitted until it has been taken
+bool io_poller_read_pending(const IOPoller *self, size_t slot);
+// Waits for the read of a slot to be cancelled. Returns false if it completed
+// with data or an error first, which is then taken as usual.
+bool io_poller_cancel_read(IOPoller *self, size_t slot);
+// Returns true if a read completed, result is the byte count or -errno
+bool io_poller_take_read(IOPoller *self, size_t slot, uint8_t **buf, ssize_t *result);
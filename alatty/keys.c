@@ -145,6 +145,14 @@ format_mods(unsigned mods) {
     return buf;
 }
 
+static void
+send_key_to_child(id_type window_id, Screen *screen, const char *data, size_t sz) {
+    screen->last_key_input_at = monotonic();
+    // must be set before the write is queued, see commit_read()
+    if (OPT(low_latency_echo)) __atomic_store_n(&screen->echo_expected, true, __ATOMIC_RELEASE);
+    schedule_write_to_child(window_id, 1, data, sz);
+}
+
 void
 on_key_input(GLFWkeyevent *ev) {
     Window *w = active_window();
@@ -169,7 +177,7 @@ on_key_input(GLFWkeyevent *ev) {
             return;
         case GLFW_IME_COMMIT_TEXT:
             if (*text) {
-                schedule_write_to_child(w->id, 1, text, strlen(text));
+                send_key_to_child(w->id, screen, text, strlen(text));
             }
             screen_update_overlay_text(screen, NULL);
             return;
@@ -213,12 +221,12 @@ on_key_input(GLFWkeyevent *ev) {
     char encoded_key[KEY_BUFFER_SIZE] = {0};
     int size = encode_glfw_key_event(ev, screen->modes.mDECCKM, screen_current_key_encoding_flags(screen), encoded_key);
     if (size == SEND_TEXT_TO_CHILD) {
-        schedule_write_to_child(w->id, 1, text, strlen(text));
+        send_key_to_child(w->id, screen, text, strlen(text));
     } else if (size > 0) {
         if (size == 1 && screen->modes.mHANDLE_TERMIOS_SIGNALS) {
             if (screen_send_signal_for_key(screen, *encoded_key)) return;
         }
-        schedule_write_to_child(w->id, 1, encoded_key, size);
+        send_key_to_child(w->id, screen, encoded_key, size);
     }
 }
 
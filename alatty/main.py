@@ -10,7 +10,7 @@
 
 from .borders import load_borders_program
 from .boss import Boss
-from .child import set_default_env, set_LANG_in_default_env
+from .child import pty_pool, set_default_env, set_LANG_in_default_env, start_zygote
 from .cli import create_opts, parse_args
 from .cli_stub import CLIOptions
 from .conf.utils import BadLine
@@ -37,7 +37,6 @@
     set_default_window_icon,
     set_options,
 )
-from .fonts.box_drawing import set_scale
 from .fonts.render import set_font_family
 from .options.types import Options
 from .options.utils import DELETE_ENV_VAR
@@ -212,8 +211,10 @@ def __init__(self) -> None:
         self.initial_window_size_func = initial_window_size_func
 
     def __call__(self, opts: Options, args: CLIOptions, bad_lines: Sequence[BadLine] = ()) -> None:
-        set_scale(opts.box_drawing_scale)
         set_options(opts, is_wayland(), args.debug_font_fallback)
+        if opts.pty_pool_size > 0:
+            # fill the pool before the startup windows, such as those of a session file, are created
+            pty_pool.refill()
         try:
             set_font_family(opts)
             _run_app(opts, args, bad_lines)
@@ -355,6 +356,9 @@ def _main() -> None:
     cli_opts.args = rest
     bad_lines: List[BadLine] = []
     opts = create_opts(cli_opts, accumulate_bad_lines=bad_lines)
+    if opts.use_zygote:
+        # fork the zygote while this process is still small and has no threads
+        start_zygote()
     setup_environment(opts, cli_opts)
 
     # set_locale on macOS uses cocoa APIs when LANG is not set, so we have to
@@ -13,7 +13,7 @@
     deprecated_hide_window_decorations_aliases,
     deprecated_send_text, edge_width, env, hide_window_decorations,
     macos_option_as_alt, macos_titlebar_color, menu_map, modify_font,
-    notify_on_cmd_finish, optional_edge_width, parse_map, parse_mouse_map, paste_actions,
+    notify_on_cmd_finish, optional_edge_width, parse_map, parse_mouse_map, paste_actions, prewarm_glyphs,
     resize_debounce_time, scrollback_lines, scrollback_pager_history_size,
     store_multiple, tab_activity_symbol, tab_bar_edge,
     tab_bar_margin_height, tab_bar_min_tabs, tab_fade, tab_separator,
@@ -183,6 +183,9 @@ def foreground(self, val: str, ans: typing.Dict[str, typing.Any]) -> None:
     def forward_stdio(self, val: str, ans: typing.Dict[str, typing.Any]) -> None:
         ans['forward_stdio'] = to_bool(val)
 
+    def hidden_window_release_delay(self, val: str, ans: typing.Dict[str, typing.Any]) -> None:
+        ans['hidden_window_release_delay'] = positive_float(val)
+
     def hide_window_decorations(self, val: str, ans: typing.Dict[str, typing.Any]) -> None:
         ans['hide_window_decorations'] = hide_window_decorations(val)
 
@@ -207,6 +210,17 @@ def initial_window_width(self, val: str, ans: typing.Dict[str, typing.Any]) -> N
     def input_delay(self, val: str, ans: typing.Dict[str, typing.Any]) -> None:
         ans['input_delay'] = positive_int(val)
 
+    def input_parse_budget(self, val: str, ans: typing.Dict[str, typing.Any]) -> None:
+        ans['input_parse_budget'] = positive_int(val)
+
+    def io_backend(self, val: str, ans: typing.Dict[str, typing.Any]) -> None:
+        val = val.lower()
+        if val not in self.choices_for_io_backend:
+            raise ValueError(f"The value {val} is not a valid choice for io_backend")
+        ans["io_backend"] = val
+
+    choices_for_io_backend = frozenset(('epoll', 'io_uring', 'poll'))
+
     def kitten_alias(self, val: str, ans: typing.Dict[str, typing.Any]) -> None:
         for k, v in action_alias(val):
             ans["kitten_alias"][k] = v
@@ -222,6 +236,9 @@ def linux_display_server(self, val: str, ans: typing.Dict[str, typing.Any]) -> N
 
     choices_for_linux_display_server = frozenset(('auto', 'wayland', 'x11'))
 
+    def low_latency_echo(self, val: str, ans: typing.Dict[str, typing.Any]) -> None:
+        ans['low_latency_echo'] = to_bool(val)
+
     def macos_colorspace(self, val: str, ans: typing.Dict[str, typing.Any]) -> None:
         val = val.lower()
         if val not in self.choices_for_macos_colorspace:
@@ -268,6 +285,12 @@ def notify_on_cmd_finish(self, val: str, ans: typing.Dict[str, typing.Any]) -> N
     def paste_actions(self, val: str, ans: typing.Dict[str, typing.Any]) -> None:
         ans['paste_actions'] = paste_actions(val)
 
+    def prewarm_glyphs(self, val: str, ans: typing.Dict[str, typing.Any]) -> None:
+        ans['prewarm_glyphs'] = prewarm_glyphs(val)
+
+    def pty_pool_size(self, val: str, ans: typing.Dict[str, typing.Any]) -> None:
+        ans['pty_pool_size'] = positive_int(val)
+
     def remember_window_size(self, val: str, ans: typing.Dict[str, typing.Any]) -> None:
         ans['remember_window_size'] = to_bool(val)
 
@@ -380,6 +403,9 @@ def text_fg_override_threshold(self, val: str, ans: typing.Dict[str, typing.Any]
     def touch_scroll_multiplier(self, val: str, ans: typing.Dict[str, typing.Any]) -> None:
         ans['touch_scroll_multiplier'] = float(val)
 
+    def use_zygote(self, val: str, ans: typing.Dict[str, typing.Any]) -> None:
+        ans['use_zygote'] = to_bool(val)
+
     def visual_window_select_characters(self, val: str, ans: typing.Dict[str, typing.Any]) -> None:
         ans['visual_window_select_characters'] = visual_window_select_characters(val)
 
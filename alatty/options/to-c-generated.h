@@ -44,6 +44,32 @@ convert_from_opts_modify_font(PyObject *py_opts, Options *opts) {
     Py_DECREF(ret);
 }
 
+static void
+convert_from_python_box_drawing_scale(PyObject *val, Options *opts) {
+    box_drawing_scale(val, opts);
+}
+
+static void
+convert_from_opts_box_drawing_scale(PyObject *py_opts, Options *opts) {
+    PyObject *ret = PyObject_GetAttrString(py_opts, "box_drawing_scale");
+    if (ret == NULL) return;
+    convert_from_python_box_drawing_scale(ret, opts);
+    Py_DECREF(ret);
+}
+
+static void
+convert_from_python_prewarm_glyphs(PyObject *val, Options *opts) {
+    prewarm_glyphs(val, opts);
+}
+
+static void
+convert_from_opts_prewarm_glyphs(PyObject *py_opts, Options *opts) {
+    PyObject *ret = PyObject_GetAttrString(py_opts, "prewarm_glyphs");
+    if (ret == NULL) return;
+    convert_from_python_prewarm_glyphs(ret, opts);
+    Py_DECREF(ret);
+}
+
 static void
 convert_from_python_text_composition_strategy(PyObject *val, Options *opts) {
     text_composition_strategy(val, opts);
@@ -265,6 +291,58 @@ convert_from_opts_input_delay(PyObject *py_opts, Options *opts) {
     Py_DECREF(ret);
 }
 
+static void
+convert_from_python_input_parse_budget(PyObject *val, Options *opts) {
+    opts->input_parse_budget = parse_ms_long_to_monotonic_t(val);
+}
+
+static void
+convert_from_opts_input_parse_budget(PyObject *py_opts, Options *opts) {
+    PyObject *ret = PyObject_GetAttrString(py_opts, "input_parse_budget");
+    if (ret == NULL) return;
+    convert_from_python_input_parse_budget(ret, opts);
+    Py_DECREF(ret);
+}
+
+static void
+convert_from_python_io_backend(PyObject *val, Options *opts) {
+    opts->io_backend = io_backend(val);
+}
+
+static void
+convert_from_opts_io_backend(PyObject *py_opts, Options *opts) {
+    PyObject *ret = PyObject_GetAttrString(py_opts, "io_backend");
+    if (ret == NULL) return;
+    convert_from_python_io_backend(ret, opts);
+    Py_DECREF(ret);
+}
+
+static void
+convert_from_python_low_latency_echo(PyObject *val, Options *opts) {
+    opts->low_latency_echo = PyObject_IsTrue(val);
+}
+
+static void
+convert_from_opts_low_latency_echo(PyObject *py_opts, Options *opts) {
+    PyObject *ret = PyObject_GetAttrString(py_opts, "low_latency_echo");
+    if (ret == NULL) return;
+    convert_from_python_low_latency_echo(ret, opts);
+    Py_DECREF(ret);
+}
+
+static void
+convert_from_python_hidden_window_release_delay(PyObject *val, Options *opts) {
+    opts->hidden_window_release_delay = parse_s_double_to_monotonic_t(val);
+}
+
+static void
+convert_from_opts_hidden_window_release_delay(PyObject *py_opts, Options *opts) {
+    PyObject *ret = PyObject_GetAttrString(py_opts, "hidden_window_release_delay");
+    if (ret == NULL) return;
+    convert_from_python_hidden_window_release_delay(ret, opts);
+    Py_DECREF(ret);
+}
+
 static void
 convert_from_python_sync_to_monitor(PyObject *val, Options *opts) {
     opts->sync_to_monitor = PyObject_IsTrue(val);
@@ -676,6 +754,10 @@ convert_opts_from_python_opts(PyObject *py_opts, Options *opts) {
     if (PyErr_Occurred()) return false;
     convert_from_opts_modify_font(py_opts, opts);
     if (PyErr_Occurred()) return false;
+    convert_from_opts_box_drawing_scale(py_opts, opts);
+    if (PyErr_Occurred()) return false;
+    convert_from_opts_prewarm_glyphs(py_opts, opts);
+    if (PyErr_Occurred()) return false;
     convert_from_opts_text_composition_strategy(py_opts, opts);
     if (PyErr_Occurred()) return false;
     convert_from_opts_cursor_shape(py_opts, opts);
@@ -710,6 +792,14 @@ convert_opts_from_python_opts(PyObject *py_opts, Options *opts) {
     if (PyErr_Occurred()) return false;
     convert_from_opts_input_delay(py_opts, opts);
     if (PyErr_Occurred()) return false;
+    convert_from_opts_input_parse_budget(py_opts, opts);
+    if (PyErr_Occurred()) return false;
+    convert_from_opts_io_backend(py_opts, opts);
+    if (PyErr_Occurred()) return false;
+    convert_from_opts_low_latency_echo(py_opts, opts);
+    if (PyErr_Occurred()) return false;
+    convert_from_opts_hidden_window_release_delay(py_opts, opts);
+    if (PyErr_Occurred()) return false;
     convert_from_opts_sync_to_monitor(py_opts, opts);
     if (PyErr_Occurred()) return false;
     convert_from_opts_active_border_color(py_opts, opts);
@@ -8,6 +8,7 @@
 
 #include "../state.h"
 #include "../colors.h"
+#include "../io-poller.h"
 
 static inline float
 PyFloat_AsFloat(PyObject *o) {
@@ -76,6 +77,13 @@ modify_font(PyObject *mf, Options *opts) {
 #undef S
 }
 
+static int
+io_backend(PyObject *name) {
+    if (PyUnicode_CompareWithASCIIString(name, "poll") == 0) return IO_POLLER_POLL;
+    if (PyUnicode_CompareWithASCIIString(name, "io_uring") == 0) return IO_POLLER_URING;
+    return IO_POLLER_EPOLL;
+}
+
 static int
 macos_colorspace(PyObject *csname) {
     if (PyUnicode_CompareWithASCIIString(csname, "srgb") == 0) return 1;
@@ -198,6 +206,31 @@ tab_bar_margin_height(PyObject *val, Options *opts) {
     opts->tab_bar_margin_height.inner = PyFloat_AsDouble(PyTuple_GET_ITEM(val, 1));
 }
 
+static void
+box_drawing_scale(PyObject *val, Options *opts) {
+    if (!PyTuple_Check(val) || PyTuple_GET_SIZE(val) != (Py_ssize_t)arraysz(opts->box_drawing_scale)) {
+        PyErr_SetString(PyExc_TypeError, "box_drawing_scale is not a 4-item tuple");
+        return;
+    }
+    for (size_t i = 0; i < arraysz(opts->box_drawing_scale); i++) opts->box_drawing_scale[i] = PyFloat_AsDouble(PyTuple_GET_ITEM(val, i));
+}
+
+static void
+prewarm_glyphs(PyObject *val, Options *opts) {
+    if (!PyTuple_Check(val)) { PyErr_SetString(PyExc_TypeError, "prewarm_glyphs is not a tuple"); return; }
+    free(opts->prewarm_glyphs.ranges); opts->prewarm_glyphs.ranges = NULL; opts->prewarm_glyphs.count = 0;
+    const size_t count = PyTuple_GET_SIZE(val);
+    if (!count) return;
+    opts->prewarm_glyphs.ranges = malloc(2 * count * sizeof(opts->prewarm_glyphs.ranges[0]));
+    if (!opts->prewarm_glyphs.ranges) { PyErr_NoMemory(); return; }
+    for (size_t i = 0; i < count; i++) {
+        PyObject *r = PyTuple_GET_ITEM(val, i);
+        opts->prewarm_glyphs.ranges[2*i] = PyLong_AsUnsignedLong(PyTuple_GET_ITEM(r, 0));
+        opts->prewarm_glyphs.ranges[2*i + 1] = PyLong_AsUnsignedLong(PyTuple_GET_ITEM(r, 1));
+    }
+    opts->prewarm_glyphs.count = count;
+}
+
 static void
 resize_debounce_time(PyObject *src, Options *opts) {
     opts->resize_debounce_time.on_end = s_double_to_monotonic_t(PyFloat_AsDouble(PyTuple_GET_ITEM(src, 0)));
@@ -211,4 +244,5 @@ free_allocs_in_options(Options *opts) {
     F(select_by_word_characters); F(select_by_word_characters_forward);
     F(default_window_logo);
 #undef F
+    free(opts->prewarm_glyphs.ranges); opts->prewarm_glyphs.ranges = NULL; opts->prewarm_glyphs.count = 0;
 }
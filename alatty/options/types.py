@@ -13,6 +13,7 @@
 from alatty.types import FloatEdges
 import alatty.types
 
+choices_for_io_backend = typing.Literal['epoll', 'io_uring', 'poll']
 choices_for_linux_display_server = typing.Literal['auto', 'wayland', 'x11']
 choices_for_macos_colorspace = typing.Literal['srgb', 'default', 'displayp3']
 choices_for_strip_trailing_spaces = typing.Literal['always', 'never', 'smart']
@@ -72,6 +73,7 @@
  'force_ltr',
  'foreground',
  'forward_stdio',
+ 'hidden_window_release_delay',
  'hide_window_decorations',
  'inactive_border_color',
  'inactive_tab_background',
@@ -80,9 +82,12 @@
  'initial_window_height',
  'initial_window_width',
  'input_delay',
+ 'input_parse_budget',
+ 'io_backend',
  'kitten_alias',
  'alatty_mod',
  'linux_display_server',
+ 'low_latency_echo',
  'macos_colorspace',
  'macos_hide_from_tasks',
  'macos_option_as_alt',
@@ -98,6 +103,8 @@
  'mouse_map',
  'notify_on_cmd_finish',
  'paste_actions',
+ 'prewarm_glyphs',
+ 'pty_pool_size',
  'remember_window_size',
  'repaint_delay',
  'resize_debounce_time',
@@ -131,6 +138,7 @@
  'text_composition_strategy',
  'text_fg_override_threshold',
  'touch_scroll_multiplier',
+ 'use_zygote',
  'visual_window_select_characters',
  'watcher',
  'wayland_titlebar_color',
@@ -179,6 +187,7 @@ class Options:
     force_ltr: bool = False
     foreground: Color = Color(221, 221, 221)
     forward_stdio: bool = False
+    hidden_window_release_delay: float = 300.0
     hide_window_decorations: int = 0
     inactive_border_color: Color = Color(204, 204, 204)
     inactive_tab_background: Color = Color(153, 153, 153)
@@ -187,8 +196,11 @@ class Options:
     initial_window_height: typing.Tuple[int, str] = (400, 'px')
     initial_window_width: typing.Tuple[int, str] = (640, 'px')
     input_delay: int = 3
+    input_parse_budget: int = 4
+    io_backend: choices_for_io_backend = 'epoll'
     alatty_mod: int = 5
     linux_display_server: choices_for_linux_display_server = 'auto'
+    low_latency_echo: bool = True
     macos_colorspace: choices_for_macos_colorspace = 'srgb'
     macos_hide_from_tasks: bool = False
     macos_option_as_alt: int = 0
@@ -204,6 +216,8 @@ class Options:
     placement_strategy = 'center'
     pointer_shape_when_dragging = 'beam'
     pointer_shape_when_grabbed = 'arrow'
+    prewarm_glyphs: typing.Tuple[typing.Tuple[int, int], ...] = ((32, 126), (9472, 9631))
+    pty_pool_size: int = 4
     remember_window_size: bool = True
     repaint_delay: int = 10
     resize_debounce_time: typing.Tuple[float, float] = (0.1, 0.5)
@@ -241,6 +255,7 @@ class Options:
     text_fg_override_threshold: float = 0.0
     touch_scroll_multiplier: float = 1.0
     undercurl_style = 'thin-sparse'
+    use_zygote: bool = False
     visual_window_select_characters: str = '1234567890ABCDEFGHIJKLMNOPQRSTUVWXYZ'
     wayland_titlebar_color: int = 0
     wheel_scroll_min_lines: int = 1
@@ -4,6 +4,7 @@
 
 import enum
 import re
+import sys
 from collections import defaultdict
 from dataclasses import dataclass, fields
 from functools import lru_cache
@@ -207,7 +208,7 @@ def copy_to_buffer(func: str, rest: str) -> FuncArgsType:
     return func, [rest]
 
 
-@func_with_args('paste_from_buffer')
+@func_with_args('paste_from_buffer', 'paste_from_file')
 def paste_from_buffer(func: str, rest: str) -> FuncArgsType:
     return func, [rest]
 
@@ -441,6 +442,42 @@ def box_drawing_scale(x: str) -> Tuple[float, float, float, float]:
     return ans[0], ans[1], ans[2], ans[3]
 
 
+prewarm_glyph_sets = {'ascii': ((0x20, 0x7e),), 'box': ((0x2500, 0x259f),)}
+# Each prewarmed glyph goes into the sprite atlas, so keep the total well below
+# what the atlas can hold
+max_prewarm_glyphs = 4096
+
+
+def prewarm_glyphs(x: str) -> Tuple[Tuple[int, int], ...]:
+    ans: List[Tuple[int, int]] = []
+    for q in x.split():
+        q = q.lower()
+        if q == 'none':
+            ans = []
+        elif q in prewarm_glyph_sets:
+            ans.extend(prewarm_glyph_sets[q])
+        else:
+            start, sep, end = q.partition('-')
+            try:
+                a = int(start.removeprefix('u+'), 16)
+                b = int(end.removeprefix('u+'), 16) if sep else a
+            except ValueError:
+                log_error(f'Ignoring invalid prewarm_glyphs entry: {q}')
+                continue
+            if 0 < a <= b <= sys.maxunicode:
+                ans.append((a, b))
+            else:
+                log_error(f'Ignoring invalid prewarm_glyphs range: {q}')
+    total = 0
+    for i, (a, b) in enumerate(ans):
+        if total + b - a + 1 > max_prewarm_glyphs:
+            log_error(f'prewarm_glyphs has more than {max_prewarm_glyphs} characters, ignoring the rest')
+            ans = ans[:i] + ([(a, a + max_prewarm_glyphs - total - 1)] if total < max_prewarm_glyphs else [])
+            break
+        total += b - a + 1
+    return tuple(ans)
+
+
 def cursor_text_color(x: str) -> Optional[Color]:
     if x.lower() == 'background':
         return None
@@ -147,6 +147,17 @@ _report_params(PyObject *dump_callback, const char *name, int *params, unsigned
 #endif
 
 #define SET_STATE(state) screen->parser_state = state; screen->parser_buf_pos = 0;
+
+static void
+grow_parser_buf(Screen *screen) {
+    // The limit of PARSER_BUF_SZ is enforced by the accumulate functions,
+    // the extra entry is for the final byte of a CSI sequence
+    const unsigned int capacity = MIN(PARSER_BUF_SZ + 1u, MAX((unsigned)PARSER_BUF_MIN_SZ, 2 * screen->parser_buf_capacity));
+    if (capacity <= screen->parser_buf_capacity) return;
+    screen->parser_buf = realloc(screen->parser_buf, capacity * sizeof(screen->parser_buf[0]));
+    if (!screen->parser_buf) fatal("Out of memory");
+    screen->parser_buf_capacity = capacity;
+}
 // }}}
 
 // Normal mode {{{
@@ -1205,6 +1216,7 @@ END_ALLOW_CASE_RANGE
 }
 
 #define dispatch_unicode_char(codepoint, dispatch, watch_for_pending) { \
+    if (screen->parser_state && UNLIKELY(screen->parser_buf_pos + 2 > screen->parser_buf_capacity)) grow_parser_buf(screen); \
     switch(screen->parser_state) { \
         case ESC: \
             dispatch##_esc_mode_char(screen, codepoint, dump_callback); \
@@ -1486,15 +1498,20 @@ FNAME(parse_bytes)(PyObject UNUSED *self, PyObject *args) {
 }
 
 
-void
-FNAME(parse_worker)(Screen *screen, PyObject *dump_callback, monotonic_t now) {
+size_t
+FNAME(parse_worker)(Screen *screen, PyObject *dump_callback, monotonic_t now, size_t offset, size_t max_sz) {
+    // Parses at most max_sz bytes of the read buffer, starting at offset. The
+    // buffer is not compacted here, the caller drops everything it parsed in
+    // one go once it is done.
+    const uint8_t *data = screen->read_buf + offset;
+    const size_t sz = MIN(max_sz, screen->read_buf_sz - offset);
 #ifdef DUMP_COMMANDS
-    if (screen->read_buf_sz) {
-        Py_XDECREF(PyObject_CallFunction(dump_callback, "sy#", "bytes", screen->read_buf, screen->read_buf_sz)); PyErr_Clear();
+    if (sz) {
+        Py_XDECREF(PyObject_CallFunction(dump_callback, "sy#", "bytes", data, sz)); PyErr_Clear();
     }
 #endif
-    do_parse_bytes(screen, screen->read_buf, screen->read_buf_sz, now, dump_callback);
-    screen->read_buf_sz = 0;
+    do_parse_bytes(screen, data, sz, now, dump_callback);
+    return sz;
 }
 #undef FNAME
 // }}}
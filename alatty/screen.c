@@ -115,10 +115,7 @@ new(PyTypeObject *type, PyObject *args, PyObject UNUSED *kwds) {
         self->reload_all_gpu_data = true;
         self->cell_size.width = cell_width; self->cell_size.height = cell_height;
         self->columns = columns; self->lines = lines;
-        self->write_buf = PyMem_RawMalloc(BUFSIZ);
         self->window_id = window_id;
-        if (self->write_buf == NULL) { Py_CLEAR(self); return PyErr_NoMemory(); }
-        self->write_buf_sz = BUFSIZ;
         self->modes = empty_modes;
         self->is_dirty = true;
         self->scroll_changed = false;
@@ -424,7 +421,8 @@ dealloc(Screen* self) {
     pthread_mutex_destroy(&self->read_buf_lock);
     pthread_mutex_destroy(&self->write_buf_lock);
     Py_CLEAR(self->last_reported_cwd);
-    PyMem_RawFree(self->write_buf);
+    free_write_queue(&self->write_queue);
+    free(self->read_buf); free(self->parser_buf);
     Py_CLEAR(self->callbacks);
     Py_CLEAR(self->test_child);
     Py_CLEAR(self->cursor);
@@ -2110,9 +2108,10 @@ screen_update_cell_data(Screen *self, void *address, FONTS_DATA_HANDLE fonts_dat
         lnum = self->scrolled_by - 1 - y;
         historybuf_init_line(self->historybuf, lnum, self->historybuf->line);
         if (self->historybuf->line->attrs.has_dirty_text) {
-            render_line(fonts_data, self->historybuf->line, self->cursor);
+            const bool complete = render_line(fonts_data, self->historybuf->line, self->cursor);
             if (screen_has_marker(self)) mark_text_in_line(self->marker, self->historybuf->line);
-            historybuf_mark_line_clean(self->historybuf, lnum);
+            if (complete) historybuf_mark_line_clean(self->historybuf, lnum);
+            else self->is_dirty = true;
         }
         update_line_data(self->historybuf->line, y, address);
     }
@@ -2121,10 +2120,12 @@ screen_update_cell_data(Screen *self, void *address, FONTS_DATA_HANDLE fonts_dat
         linebuf_init_line(self->linebuf, lnum);
         if (self->linebuf->line->attrs.has_dirty_text ||
             (cursor_has_moved && (self->cursor->y == lnum || self->last_rendered.cursor_y == lnum))) {
-            render_line(fonts_data, self->linebuf->line, self->cursor);
+            const bool complete = render_line(fonts_data, self->linebuf->line, self->cursor);
             if (self->linebuf->line->attrs.has_dirty_text && screen_has_marker(self)) mark_text_in_line(self->marker, self->linebuf->line);
             if (is_overlay_active && lnum == self->overlay_line.ynum) render_overlay_line(self, self->linebuf->line, fonts_data);
-            linebuf_mark_line_clean(self->linebuf, lnum);
+            // lines waiting for glyphs are rendered again once they arrive
+            if (complete) linebuf_mark_line_clean(self->linebuf, lnum);
+            else { linebuf_mark_line_dirty(self->linebuf, lnum); self->is_dirty = true; }
         }
         update_line_data(self->linebuf->line, y, address);
     }
@@ -2584,10 +2585,11 @@ render_overlay_line(Screen *self, Line *line, FONTS_DATA_HANDLE fonts_data) {
 #define ol self->overlay_line
     line_save_cells(line, 0, line->xnum, ol.original_line.gpu_cells, ol.original_line.cpu_cells);
     screen_draw_overlay_line(self);
-    render_line(fonts_data, line, self->cursor);
+    const bool complete = render_line(fonts_data, line, self->cursor);
     line_save_cells(line, 0, line->xnum, ol.gpu_cells, ol.cpu_cells);
     line_reset_cells(line, 0, line->xnum, ol.original_line.gpu_cells, ol.original_line.cpu_cells);
-    ol.is_dirty = false;
+    ol.is_dirty = !complete;
+    if (!complete) self->is_dirty = true;
     const index_type y = MIN(ol.ynum + self->scrolled_by, self->lines - 1);
     if (ol.last_ime_pos.x != ol.cursor_x || ol.last_ime_pos.y != y) {
         ol.last_ime_pos.x = ol.cursor_x; ol.last_ime_pos.y = y;
@@ -3470,26 +3472,56 @@ marked_cells(Screen *self, PyObject *o UNUSED) {
     return ans;
 }
 
+#define PASTE_BORROW_THRESHOLD (64u * 1024u)
+
+static void
+write_paste_to_child(Screen *self, PyObject *owner, const char *data, size_t sz) {
+    // Large pastes are not copied, owner is kept alive until they are written
+    if (self->window_id) {
+        if (sz >= PASTE_BORROW_THRESHOLD) schedule_borrowed_write_to_child(self->window_id, owner, data, sz);
+        else schedule_write_to_child(self->window_id, 1, data, sz);
+    }
+    if (self->test_child != Py_None) { write_to_test_child(self, data, sz); }
+}
+
 static PyObject*
 paste_(Screen *self, PyObject *bytes, bool allow_bracketed_paste) {
     const char *data; Py_ssize_t sz;
+    RAII_PyObject(owner, NULL);
     if (PyBytes_Check(bytes)) {
         data = PyBytes_AS_STRING(bytes); sz = PyBytes_GET_SIZE(bytes);
+        owner = bytes; Py_INCREF(owner);
     } else if (PyMemoryView_Check(bytes)) {
-        RAII_PyObject(mv, PyMemoryView_GetContiguous(bytes, PyBUF_READ, PyBUF_C_CONTIGUOUS));
-        if (mv == NULL) return NULL;
-        Py_buffer *buf = PyMemoryView_GET_BUFFER(mv);
+        owner = PyMemoryView_GetContiguous(bytes, PyBUF_READ, PyBUF_C_CONTIGUOUS);
+        if (owner == NULL) return NULL;
+        Py_buffer *buf = PyMemoryView_GET_BUFFER(owner);
         data = buf->buf;
         sz = buf->len;
     } else {
         PyErr_SetString(PyExc_TypeError, "Must paste() bytes"); return NULL;
     }
     if (allow_bracketed_paste && self->modes.mBRACKETED_PASTE) write_escape_code_to_child(self, CSI, BRACKETED_PASTE_START);
-    write_to_child(self, data, sz);
+    write_paste_to_child(self, owner, data, sz);
     if (allow_bracketed_paste && self->modes.mBRACKETED_PASTE) write_escape_code_to_child(self, CSI, BRACKETED_PASTE_END);
     Py_RETURN_NONE;
 }
 
+static PyObject*
+paste_from_fd(Screen *self, PyObject *args) {
+    int fd;
+    if (!PyArg_ParseTuple(args, "i", &fd)) return NULL;
+    char prefix[32], suffix[32];
+    const bool bracketed = self->modes.mBRACKETED_PASTE;
+    if (bracketed) {
+        const char *csi, *unused;
+        get_prefix_and_suffix_for_escape_code(self, CSI, &csi, &unused);
+        snprintf(prefix, sizeof(prefix), "%s%s", csi, BRACKETED_PASTE_START);
+        snprintf(suffix, sizeof(suffix), "%s%s", csi, BRACKETED_PASTE_END);
+    }
+    if (self->window_id && stream_to_child(self->window_id, fd, bracketed ? prefix : NULL, bracketed ? suffix : NULL)) { Py_RETURN_TRUE; }
+    Py_RETURN_FALSE;
+}
+
 
 static PyObject*
 paste(Screen *self, PyObject *bytes) {
@@ -3564,6 +3596,16 @@ cursor_at_prompt(Screen *self, PyObject *args UNUSED) {
     Py_RETURN_FALSE;
 }
 
+static PyObject*
+parse_stats(Screen *self, PyObject *args UNUSED) {
+    // Only updated by the main thread, so no lock is needed
+    return Py_BuildValue("{sd sd sK sK sK}",
+        "time", monotonic_t_to_s_double(self->parse_stats.time),
+        "max_time", monotonic_t_to_s_double(self->parse_stats.max_time),
+        "bytes", self->parse_stats.bytes, "calls", self->parse_stats.calls,
+        "deferred", self->parse_stats.deferred);
+}
+
 static PyObject*
 line_edge_colors(Screen *self, PyObject *a UNUSED) {
     color_type left, right;
@@ -3579,6 +3621,7 @@ static PyMethodDef methods[] = {
     MND(line_edge_colors, METH_NOARGS)
     MND(line, METH_O)
     MND(cursor_at_prompt, METH_NOARGS)
+    MND(parse_stats, METH_NOARGS)
     MND(visual_line, METH_VARARGS)
     MND(draw, METH_O)
     MND(apply_sgr, METH_O)
@@ -3639,6 +3682,7 @@ static PyMethodDef methods[] = {
     MND(reset_callbacks, METH_NOARGS)
     MND(paste, METH_O)
     MND(paste_bytes, METH_O)
+    MND(paste_from_fd, METH_VARARGS)
     MND(focus_changed, METH_O)
     MND(has_focus, METH_NOARGS)
     MND(has_activity_since_last_focus, METH_NOARGS)
@@ -8,6 +8,7 @@
 
 #include "graphics.h"
 #include "monotonic.h"
+#include "write-queue.h"
 #define MAX_PARAMS 256
 
 typedef enum ScrollTypes { SCROLL_LINE = -999999, SCROLL_PAGE, SCROLL_FULL } ScrollType;
@@ -111,12 +112,24 @@ typedef struct {
     ScreenModes modes;
     ColorProfile *color_profile;
 
-    uint32_t parser_buf[PARSER_BUF_SZ];
-    unsigned int parser_state, parser_text_start, parser_buf_pos;
+    // Allocated when the first escape code is seen, grows to PARSER_BUF_SZ
+    uint32_t *parser_buf;
+    unsigned int parser_state, parser_text_start, parser_buf_pos, parser_buf_capacity;
     bool parser_has_pending_text;
-    uint8_t read_buf[READ_BUF_SZ], *write_buf;
-    monotonic_t new_input_at;
-    size_t read_buf_sz, write_buf_sz, write_buf_used;
+    // Allocated and resized only by the I/O thread, see ensure_read_buf_space()
+    uint8_t *read_buf;
+    WriteQueue write_queue;
+    monotonic_t new_input_at, last_key_input_at, last_read_at;
+    size_t read_buf_sz, read_buf_capacity;
+    // Set when a key is sent to the child, the next read from the child is
+    // then taken to be its echo and is shown without waiting for input_delay.
+    // echo_expected is shared by the threads, echo_received is protected by
+    // read_buf_lock.
+    bool echo_expected, echo_received;
+    struct {
+        monotonic_t time, max_time;
+        unsigned long long bytes, calls, deferred;
+    } parse_stats;
     pthread_mutex_t read_buf_lock, write_buf_lock;
 
     CursorRenderInfo cursor_render_info;
@@ -157,8 +170,8 @@ typedef struct {
 } Screen;
 
 
-void parse_worker(Screen *screen, PyObject *dump_callback, monotonic_t now);
-void parse_worker_dump(Screen *screen, PyObject *dump_callback, monotonic_t now);
+size_t parse_worker(Screen *screen, PyObject *dump_callback, monotonic_t now, size_t offset, size_t max_sz);
+size_t parse_worker_dump(Screen *screen, PyObject *dump_callback, monotonic_t now, size_t offset, size_t max_sz);
 void screen_align(Screen*);
 void screen_restore_cursor(Screen *);
 void screen_save_cursor(Screen *);
@@ -11,23 +11,41 @@
 #include <stddef.h>
 #include "srgb_gamma.h"
 #include "uniforms_generated.h"
+#include "safe-wrappers.h"
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define BLEND_ONTO_OPAQUE  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);  // blending onto opaque colors
 #define BLEND_ONTO_OPAQUE_WITH_OPAQUE_OUTPUT  glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ZERO, GL_ONE);  // blending onto opaque colors with final color having alpha 1
 #define BLEND_PREMULT glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);  // blending of pre-multiplied colors
 
 enum { CELL_PROGRAM, CELL_BG_PROGRAM, CELL_SPECIAL_PROGRAM, CELL_FG_PROGRAM, BORDERS_PROGRAM, BGIMAGE_PROGRAM, TINT_PROGRAM, NUM_PROGRAMS };
-enum { SPRITE_MAP_UNIT, GRAPHICS_UNIT, BGIMAGE_UNIT };
+enum { SPRITE_MAP_UNIT, GRAPHICS_UNIT, BGIMAGE_UNIT, COLOR_SPRITE_MAP_UNIT };
 
 // Sprites {{{
+// Grayscale glyphs only need coverage, so they live in a single channel
+// atlas, colored glyphs (emoji) get a separate RGBA atlas. Sprites in the
+// color atlas have COLORED_SPRITE_MASK set in their z co-ordinate.
 typedef struct {
-    unsigned int cell_width, cell_height;
-    int xnum, ynum, x, y, z, last_num_of_layers, last_ynum;
+    int last_num_of_layers, last_ynum;
     GLuint texture_id;
+    // New sprites are staged one atlas row at a time and uploaded with as
+    // few calls as possible when the row changes or the frame is flushed
+    struct {
+        uint8_t *buf;
+        bool *filled;
+        unsigned int xnum, y, z, num_filled;
+    } staging;
+} SpriteTexture;
+
+typedef struct {
+    unsigned int cell_width, cell_height;
+    SpriteTexture alpha, color;
+    struct { unsigned int uploads, sprites; } current_frame, last_frame;
     GLint max_texture_size, max_array_texture_layers;
 } SpriteMap;
 
-static const SpriteMap NEW_SPRITE_MAP = { .xnum = 1, .ynum = 1, .last_num_of_layers = 1, .last_ynum = -1 };
+static const SpriteTexture NEW_SPRITE_TEXTURE = { .last_num_of_layers = 1, .last_ynum = -1 };
 static GLint max_texture_size = 0, max_array_texture_layers = 0;
 
 static GLfloat
@@ -35,6 +53,11 @@ srgb_color(uint8_t color) {
     return srgb_lut[color];
 }
 
+static SpriteTexture*
+sprite_texture(SpriteMap *sprite_map, bool colored) {
+    return colored ? &sprite_map->color : &sprite_map->alpha;
+}
+
 SPRITE_MAP_HANDLE
 alloc_sprite_map(unsigned int cell_width, unsigned int cell_height) {
     if (!max_texture_size) {
@@ -50,7 +73,7 @@ alloc_sprite_map(unsigned int cell_width, unsigned int cell_height) {
     }
     SpriteMap *ans = calloc(1, sizeof(SpriteMap));
     if (!ans) fatal("Out of memory allocating a sprite map");
-    *ans = NEW_SPRITE_MAP;
+    ans->alpha = NEW_SPRITE_TEXTURE; ans->color = NEW_SPRITE_TEXTURE;
     ans->max_texture_size = max_texture_size;
     ans->max_array_texture_layers = max_array_texture_layers;
     ans->cell_width = cell_width; ans->cell_height = cell_height;
@@ -61,7 +84,10 @@ SPRITE_MAP_HANDLE
 free_sprite_map(SPRITE_MAP_HANDLE sm) {
     SpriteMap *sprite_map = (SpriteMap*)sm;
     if (sprite_map) {
-        if (sprite_map->texture_id) free_texture(&sprite_map->texture_id);
+        if (sprite_map->alpha.texture_id) free_texture(&sprite_map->alpha.texture_id);
+        if (sprite_map->color.texture_id) free_texture(&sprite_map->color.texture_id);
+        free(sprite_map->alpha.staging.buf); free(sprite_map->alpha.staging.filled);
+        free(sprite_map->color.staging.buf); free(sprite_map->color.staging.filled);
         free(sprite_map);
     }
     return NULL;
@@ -70,21 +96,24 @@ free_sprite_map(SPRITE_MAP_HANDLE sm) {
 static bool copy_image_warned = false;
 
 static void
-copy_image_sub_data(GLuint src_texture_id, GLuint dest_texture_id, unsigned int width, unsigned int height, unsigned int num_levels) {
+copy_image_sub_data(GLuint src_texture_id, GLuint dest_texture_id, unsigned int width, unsigned int height, unsigned int num_levels, bool colored) {
     if (!GLAD_GL_ARB_copy_image) {
         // ARB_copy_image not available, do a slow roundtrip copy
         if (!copy_image_warned) {
             copy_image_warned = true;
             log_error("WARNING: Your system's OpenGL implementation does not have glCopyImageSubData, falling back to a slower implementation");
         }
-        size_t sz = (size_t)width * height * num_levels;
-        pixel *src = malloc(sz * sizeof(pixel));
+        const GLenum format = colored ? GL_RGBA : GL_RED;
+        const GLint alignment = colored ? 4 : 1;
+        size_t sz = (size_t)width * height * num_levels * (colored ? sizeof(pixel) : 1);
+        uint8_t *src = malloc(sz);
         if (src == NULL) { fatal("Out of memory."); }
         glBindTexture(GL_TEXTURE_2D_ARRAY, src_texture_id);
-        glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, GL_UNSIGNED_BYTE, src);
+        glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+        glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, format, GL_UNSIGNED_BYTE, src);
         glBindTexture(GL_TEXTURE_2D_ARRAY, dest_texture_id);
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, width, height, num_levels, GL_RGBA, GL_UNSIGNED_BYTE, src);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, width, height, num_levels, format, GL_UNSIGNED_BYTE, src);
         free(src);
     } else {
         glCopyImageSubData(src_texture_id, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, dest_texture_id, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, width, height, num_levels);
@@ -93,7 +122,7 @@ copy_image_sub_data(GLuint src_texture_id, GLuint dest_texture_id, unsigned int
 
 
 static void
-realloc_sprite_texture(FONTS_DATA_HANDLE fg) {
+realloc_sprite_texture(FONTS_DATA_HANDLE fg, bool colored) {
     GLuint tex;
     glGenTextures(1, &tex);
     glBindTexture(GL_TEXTURE_2D_ARRAY, tex);
@@ -104,43 +133,158 @@ realloc_sprite_texture(FONTS_DATA_HANDLE fg) {
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     unsigned int xnum, ynum, z, znum, width, height, src_ynum;
-    sprite_tracker_current_layout(fg, &xnum, &ynum, &z);
+    sprite_tracker_current_layout(fg, colored, &xnum, &ynum, &z);
     znum = z + 1;
     SpriteMap *sprite_map = (SpriteMap*)fg->sprite_map;
+    SpriteTexture *st = sprite_texture(sprite_map, colored);
     width = xnum * sprite_map->cell_width; height = ynum * sprite_map->cell_height;
-    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_SRGB8_ALPHA8, width, height, znum);
-    if (sprite_map->texture_id) {
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, colored ? GL_SRGB8_ALPHA8 : GL_R8, width, height, znum);
+    if (st->texture_id) {
         // need to re-alloc
-        src_ynum = MAX(1, sprite_map->last_ynum);
-        copy_image_sub_data(sprite_map->texture_id, tex, width, src_ynum * sprite_map->cell_height, sprite_map->last_num_of_layers);
-        glDeleteTextures(1, &sprite_map->texture_id);
+        src_ynum = MAX(1, st->last_ynum);
+        copy_image_sub_data(st->texture_id, tex, width, src_ynum * sprite_map->cell_height, st->last_num_of_layers, colored);
+        glDeleteTextures(1, &st->texture_id);
     }
     glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
-    sprite_map->last_num_of_layers = znum;
-    sprite_map->last_ynum = ynum;
-    sprite_map->texture_id = tex;
+    st->last_num_of_layers = znum;
+    st->last_ynum = ynum;
+    st->texture_id = tex;
+}
+
+static void
+upload_staged_sprites(FONTS_DATA_HANDLE fg, bool colored) {
+    SpriteMap *sprite_map = (SpriteMap*)fg->sprite_map;
+    SpriteTexture *st = sprite_texture(sprite_map, colored);
+    if (!st->staging.num_filled) return;
+    unsigned int xnum, ynum, znum;
+    sprite_tracker_current_layout(fg, colored, &xnum, &ynum, &znum);
+    // keep the texture bound to its own unit, in case it is re-allocated
+    glActiveTexture(GL_TEXTURE0 + (colored ? COLOR_SPRITE_MAP_UNIT : SPRITE_MAP_UNIT));
+    if (!st->texture_id || (int)znum >= st->last_num_of_layers || (znum == 0 && (int)ynum > st->last_ynum)) realloc_sprite_texture(fg, colored);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, st->texture_id);
+    const unsigned int cw = sprite_map->cell_width, ch = sprite_map->cell_height;
+    const size_t bytes_per_pixel = colored ? sizeof(pixel) : 1;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, colored ? 4 : 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, st->staging.xnum * cw);
+    // upload each run of adjacent sprites in a single call
+    for (unsigned int x = 0; x < st->staging.xnum;) {
+        if (!st->staging.filled[x]) { x++; continue; }
+        unsigned int end = x;
+        while (end < st->staging.xnum && st->staging.filled[end]) st->staging.filled[end++] = false;
+        const uint8_t *src = st->staging.buf + (size_t)x * cw * bytes_per_pixel;
+        if (colored) glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x * cw, st->staging.y * ch, st->staging.z, (end - x) * cw, ch, 1, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8, src);
+        else glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x * cw, st->staging.y * ch, st->staging.z, (end - x) * cw, ch, 1, GL_RED, GL_UNSIGNED_BYTE, src);
+        sprite_map->current_frame.uploads++;
+        x = end;
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    st->staging.num_filled = 0;
+}
+
+void
+move_sprites_to_new_texture(FONTS_DATA_HANDLE fg, bool colored, const SpriteMove *moves, size_t num_moves) {
+    // Allocate a fresh texture sized for the current (compacted) layout and
+    // copy the surviving sprites into their new slots
+    SpriteMap *sprite_map = (SpriteMap*)fg->sprite_map;
+    SpriteTexture *st = sprite_texture(sprite_map, colored);
+    const GLuint old_texture_id = st->texture_id;
+    const unsigned int cw = sprite_map->cell_width, ch = sprite_map->cell_height;
+    unsigned int xnum, ynum, z;
+    sprite_tracker_current_layout(fg, colored, &xnum, &ynum, &z);
+    const unsigned int old_width = xnum * cw, old_height = MAX(1, st->last_ynum) * ch, old_layers = st->last_num_of_layers;
+    st->texture_id = 0;
+    realloc_sprite_texture(fg, colored);
+    if (!old_texture_id) return;
+    if (!GLAD_GL_ARB_copy_image) {
+        const GLenum format = colored ? GL_RGBA : GL_RED;
+        const size_t bytes_per_pixel = colored ? sizeof(pixel) : 1;
+        const GLint alignment = colored ? 4 : 1;
+        uint8_t *src = malloc((size_t)old_width * old_height * old_layers * bytes_per_pixel);
+        if (src == NULL) { fatal("Out of memory."); }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, old_texture_id);
+        glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+        glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, format, GL_UNSIGNED_BYTE, src);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, st->texture_id);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, old_width);
+        for (size_t i = 0; i < num_moves; i++) {
+            const SpriteMove *m = moves + i;
+            const uint8_t *p = src + (((size_t)m->src_z * old_height + (size_t)m->src_y * ch) * old_width + (size_t)m->src_x * cw) * bytes_per_pixel;
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, m->dest_x * cw, m->dest_y * ch, m->dest_z, cw, ch, 1, format, GL_UNSIGNED_BYTE, p);
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        free(src);
+    } else {
+        for (size_t i = 0; i < num_moves; i++) {
+            const SpriteMove *m = moves + i;
+            glCopyImageSubData(
+                old_texture_id, GL_TEXTURE_2D_ARRAY, 0, m->src_x * cw, m->src_y * ch, m->src_z,
+                st->texture_id, GL_TEXTURE_2D_ARRAY, 0, m->dest_x * cw, m->dest_y * ch, m->dest_z, cw, ch, 1);
+        }
+    }
+    glDeleteTextures(1, &old_texture_id);
 }
 
 static void
 ensure_sprite_map(FONTS_DATA_HANDLE fg) {
     SpriteMap *sprite_map = (SpriteMap*)fg->sprite_map;
-    if (!sprite_map->texture_id) realloc_sprite_texture(fg);
+    if (!sprite_map->alpha.texture_id) realloc_sprite_texture(fg, false);
+    if (!sprite_map->color.texture_id) realloc_sprite_texture(fg, true);
     // We have to rebind since we don't know if the texture was ever bound
     // in the context of the current OSWindow
     glActiveTexture(GL_TEXTURE0 + SPRITE_MAP_UNIT);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, sprite_map->texture_id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, sprite_map->alpha.texture_id);
+    glActiveTexture(GL_TEXTURE0 + COLOR_SPRITE_MAP_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, sprite_map->color.texture_id);
 }
 
 void
 send_sprite_to_gpu(FONTS_DATA_HANDLE fg, unsigned int x, unsigned int y, unsigned int z, pixel *buf) {
     SpriteMap *sprite_map = (SpriteMap*)fg->sprite_map;
-    unsigned int xnum, ynum, znum;
-    sprite_tracker_current_layout(fg, &xnum, &ynum, &znum);
-    if ((int)znum >= sprite_map->last_num_of_layers || (znum == 0 && (int)ynum > sprite_map->last_ynum)) realloc_sprite_texture(fg);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, sprite_map->texture_id);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-    x *= sprite_map->cell_width; y *= sprite_map->cell_height;
-    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x, y, z, sprite_map->cell_width, sprite_map->cell_height, 1, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8, buf);
+    const bool colored = (z & COLORED_SPRITE_MASK) != 0;
+    z &= ~COLORED_SPRITE_MASK;
+    SpriteTexture *st = sprite_texture(sprite_map, colored);
+    if (st->staging.num_filled && (y != st->staging.y || z != st->staging.z)) upload_staged_sprites(fg, colored);
+    if (!st->staging.buf) {
+        unsigned int ynum, znum;
+        sprite_tracker_current_layout(fg, colored, &st->staging.xnum, &ynum, &znum);
+        st->staging.buf = malloc((size_t)st->staging.xnum * sprite_map->cell_width * sprite_map->cell_height * (colored ? sizeof(pixel) : 1));
+        st->staging.filled = calloc(st->staging.xnum, sizeof(st->staging.filled[0]));
+        if (!st->staging.buf || !st->staging.filled) fatal("Out of memory allocating sprite staging buffer");
+    }
+    if (x >= st->staging.xnum) return;
+    st->staging.y = y; st->staging.z = z;
+    const size_t stride = (size_t)st->staging.xnum * sprite_map->cell_width;
+    for (size_t r = 0; r < sprite_map->cell_height; r++) {
+        const pixel *src = buf + r * sprite_map->cell_width;
+        const size_t offset = r * stride + (size_t)x * sprite_map->cell_width;
+        if (colored) memcpy((pixel*)st->staging.buf + offset, src, sprite_map->cell_width * sizeof(pixel));
+        else {
+            // the coverage is in the low byte of each pixel
+            uint8_t *dest = st->staging.buf + offset;
+            for (size_t c = 0; c < sprite_map->cell_width; c++) dest[c] = src[c] & 0xff;
+        }
+    }
+    if (!st->staging.filled[x]) { st->staging.filled[x] = true; st->staging.num_filled++; }
+    sprite_map->current_frame.sprites++;
+}
+
+void
+flush_sprite_uploads(FONTS_DATA_HANDLE fg) {
+    SpriteMap *sprite_map = (SpriteMap*)fg->sprite_map;
+    if (!sprite_map) return;
+    upload_staged_sprites(fg, false);
+    upload_staged_sprites(fg, true);
+    sprite_map->last_frame = sprite_map->current_frame;
+    zero_at_ptr(&sprite_map->current_frame);
+}
+
+void
+sprite_map_upload_stats(SPRITE_MAP_HANDLE sm, unsigned int *uploads, unsigned int *sprites) {
+    const SpriteMap *sprite_map = (const SpriteMap*)sm;
+    *uploads = sprite_map ? sprite_map->last_frame.uploads : 0;
+    *sprites = sprite_map ? sprite_map->last_frame.sprites : 0;
 }
 
 // }}}
@@ -227,7 +371,7 @@ pick_cursor_color(Line *line, ColorProfile *color_profile, color_type cell_fg, c
 static void
 cell_update_uniform_block(ssize_t vao_idx, Screen *screen, int uniform_buffer, const CellRenderData *crd, CursorRenderInfo *cursor, bool inverted, OSWindow *os_window) {
     struct GPUCellRenderData {
-        GLfloat xstart, ystart, dx, dy, sprite_dx, sprite_dy, background_opacity, use_cell_bg_for_selection_fg, use_cell_fg_for_selection_color, use_cell_for_selection_bg;
+        GLfloat xstart, ystart, dx, dy, sprite_dx, sprite_dy, color_sprite_dx, color_sprite_dy, background_opacity, use_cell_bg_for_selection_fg, use_cell_fg_for_selection_color, use_cell_for_selection_bg;
 
         GLuint default_fg, default_bg, highlight_fg, highlight_bg, cursor_fg, cursor_bg, inverted;
 
@@ -297,8 +441,10 @@ cell_update_uniform_block(ssize_t vao_idx, Screen *screen, int uniform_buffer, c
 
     rd->xstart = crd->gl.xstart; rd->ystart = crd->gl.ystart; rd->dx = crd->gl.dx; rd->dy = crd->gl.dy;
     unsigned int x, y, z;
-    sprite_tracker_current_layout(os_window->fonts_data, &x, &y, &z);
+    sprite_tracker_current_layout(os_window->fonts_data, false, &x, &y, &z);
     rd->sprite_dx = 1.0f / (float)x; rd->sprite_dy = 1.0f / (float)y;
+    sprite_tracker_current_layout(os_window->fonts_data, true, &x, &y, &z);
+    rd->color_sprite_dx = 1.0f / (float)x; rd->color_sprite_dy = 1.0f / (float)y;
     rd->inverted = inverted ? 1 : 0;
     rd->background_opacity = os_window->is_semi_transparent ? os_window->background_opacity : 1.0f;
 
@@ -361,6 +507,7 @@ set_cell_uniforms(float current_inactive_text_alpha, bool force) {
             switch(i) {
                 case CELL_PROGRAM: case CELL_FG_PROGRAM:
                     glUniform1i(cu->sprites, SPRITE_MAP_UNIT);
+                    glUniform1i(cu->color_sprites, COLOR_SPRITE_MAP_UNIT);
                     glUniform1f(cu->dim_opacity, OPT(dim_opacity));
                     glUniform1f(cu->text_contrast, text_contrast);
                     glUniform1f(cu->text_gamma_adjustment, text_gamma_adjustment);
@@ -485,6 +632,86 @@ draw_borders(ssize_t vao_idx, unsigned int num_border_rects, BorderRect *rect_bu
 
 // }}}
 
+// Program binary cache {{{
+// Linking is slow with some drivers, so linked programs are saved in the cache
+// directory and loaded from there on later runs. The key covers the driver
+// identification and the full shader sources, any change to either means the
+// program is compiled from source again.
+
+typedef struct {
+    char magic[8];
+    uint64_t key;
+    uint32_t format, size;
+} ProgramBinaryHeader;
+static const char PROGRAM_BINARY_MAGIC[8] = {'A', 'L', 'G', 'L', 'P', 'B', '0', '1'};
+
+static uint64_t
+hash_string(uint64_t h, const char *s) {
+    // FNV-1a including the trailing nul, so that adjacent strings are delimited
+    do { h = (h ^ (uint8_t)*s) * 0x100000001b3ull; } while (*s++);
+    return h;
+}
+
+static bool
+program_cache_key(PyObject *vertex_shaders, PyObject *fragment_shaders, uint64_t *ans) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    const GLenum driver_strings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION};
+    for (size_t i = 0; i < arraysz(driver_strings); i++) {
+        const char *s = (const char*)glGetString(driver_strings[i]);
+        h = hash_string(h, s ? s : "");
+    }
+    PyObject *stages[] = {vertex_shaders, fragment_shaders};
+    for (size_t s = 0; s < arraysz(stages); s++) {
+        for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(stages[s]); i++) {
+            PyObject *src = PyTuple_GET_ITEM(stages[s], i);
+            const char *text = PyUnicode_Check(src) ? PyUnicode_AsUTF8(src) : NULL;
+            if (!text) { PyErr_Clear(); return false; }
+            h = hash_string(h, text);
+        }
+        h = hash_string(h, "");
+    }
+    *ans = h;
+    return true;
+}
+
+static bool
+load_cached_program(GLuint program, const char *path, uint64_t key) {
+    int fd = safe_open(path, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) return false;
+    ProgramBinaryHeader header;
+    struct stat st;
+    bool ok = false;
+    if (
+        fstat(fd, &st) == 0 && read(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+        memcmp(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic)) == 0 && header.key == key &&
+        header.size && st.st_size == (off_t)(sizeof(header) + header.size)
+    ) {
+        RAII_ALLOC(uint8_t, data, malloc(header.size));
+        if (data && read(fd, data, header.size) == (ssize_t)header.size) ok = load_program_binary(program, header.format, data, header.size);
+    }
+    safe_close(fd, __FILE__, __LINE__);
+    return ok;
+}
+
+static void
+save_program_binary(GLuint program, const char *path, uint64_t key) {
+    ProgramBinaryHeader header = {.key=key};
+    memcpy(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic));
+    GLsizei sz = 0;
+    RAII_ALLOC(uint8_t, data, get_program_binary(program, &header.format, &sz));
+    if (!data) return;
+    header.size = sz;
+    // write to a temp file and rename so that concurrent instances never see partial files
+    char tpath[4096];
+    snprintf(tpath, sizeof(tpath), "%s.%d.tmp", path, (int)getpid());
+    int fd = safe_open(tpath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd < 0) return;
+    const bool ok = write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) && write(fd, data, header.size) == (ssize_t)header.size;
+    safe_close(fd, __FILE__, __LINE__);
+    if (!ok || rename(tpath, path) != 0) unlink(tpath);
+}
+// }}}
+
 // Python API {{{
 
 static bool
@@ -506,7 +733,8 @@ static PyObject*
 compile_program(PyObject UNUSED *self, PyObject *args) {
     PyObject *vertex_shaders, *fragment_shaders;
     int which, allow_recompile = 0;
-    if (!PyArg_ParseTuple(args, "iO!O!|p", &which, &PyTuple_Type, &vertex_shaders, &PyTuple_Type, &fragment_shaders, &allow_recompile)) return NULL;
+    const char *cache_dir = NULL;
+    if (!PyArg_ParseTuple(args, "iO!O!|pz", &which, &PyTuple_Type, &vertex_shaders, &PyTuple_Type, &fragment_shaders, &allow_recompile, &cache_dir)) return NULL;
     if (which < 0 || which >= NUM_PROGRAMS) { PyErr_Format(PyExc_ValueError, "Unknown program: %d", which); return NULL; }
     Program *program = program_ptr(which);
     if (program->id != 0) {
@@ -514,7 +742,23 @@ compile_program(PyObject UNUSED *self, PyObject *args) {
         else { PyErr_SetString(PyExc_ValueError, "program already compiled"); return NULL; }
     }
 #define fail_compile() { glDeleteProgram(program->id); return NULL; }
+    char cache_path[4096] = {0};
+    uint64_t cache_key = 0;
+    bool use_cache = false;
+    if (cache_dir && cache_dir[0] && gl_program_binaries_supported() && program_cache_key(vertex_shaders, fragment_shaders, &cache_key)) {
+        use_cache = snprintf(cache_path, sizeof(cache_path), "%s/%016llx.glprogram", cache_dir, (unsigned long long)cache_key) < (int)sizeof(cache_path);
+    }
     program->id = glCreateProgram();
+    if (use_cache) {
+        if (load_cached_program(program->id, cache_path, cache_key)) {
+            init_uniforms(which);
+            return Py_BuildValue("I", program->id);
+        }
+        // start afresh after a rejected binary, some drivers leave the program in a bad state
+        glDeleteProgram(program->id);
+        program->id = glCreateProgram();
+        mark_program_binary_retrievable(program->id);
+    }
     if (!attach_shaders(vertex_shaders, program->id, GL_VERTEX_SHADER)) fail_compile();
     if (!attach_shaders(fragment_shaders, program->id, GL_FRAGMENT_SHADER)) fail_compile();
     glLinkProgram(program->id);
@@ -528,6 +772,7 @@ compile_program(PyObject UNUSED *self, PyObject *args) {
         fail_compile();
     }
 #undef fail_compile
+    if (use_cache) save_program_binary(program->id, cache_path, cache_key);
     init_uniforms(which);
     return Py_BuildValue("I", program->id);
 }
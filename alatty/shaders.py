@@ -1,12 +1,13 @@
 #!/usr/bin/env python
 # License: GPLv3 Copyright: 2023, Kovid Goyal <kovid at kovidgoyal.net>
 
+import os
 import re
 from functools import lru_cache, partial
 from itertools import count
 from typing import Any, Callable, Dict, Iterator, Optional, Set
 
-from .constants import read_alatty_resource
+from .constants import cache_dir, read_alatty_resource
 from .fast_data_types import (
     CELL_BG_PROGRAM,
     CELL_FG_PROGRAM,
@@ -82,7 +83,7 @@ def apply_to_sources(self, vertex: Callable[[str], str] = identity, frag: Callab
     def compile(self, program_id: int, allow_recompile: bool = False) -> None:
         cerr: CompileError = CompileError()
         try:
-            compile_program(program_id, self.vertex_sources, self.fragment_sources, allow_recompile)
+            compile_program(program_id, self.vertex_sources, self.fragment_sources, allow_recompile, program_cache_dir())
             return
         except ValueError as err:
             lines = str(err).splitlines()
@@ -99,6 +100,16 @@ def sub(m: 're.Match[str]') -> str:
         raise cerr
 
 
+@lru_cache(maxsize=2)
+def program_cache_dir() -> Optional[str]:
+    ans = os.path.join(cache_dir(), 'shaders')
+    try:
+        os.makedirs(ans, exist_ok=True)
+    except OSError:
+        return None
+    return ans
+
+
 @lru_cache(maxsize=64)
 def program_for(name: str) -> Program:
     return Program(name)
@@ -191,12 +191,12 @@ add_tab(id_type os_window_id) {
     return 0;
 }
 
-static void
+void
 create_gpu_resources_for_window(Window *w) {
     w->render_data.vao_idx = create_cell_vao();
 }
 
-static void
+void
 release_gpu_resources_for_window(Window *w) {
     if (w->render_data.vao_idx > -1) remove_vao(w->render_data.vao_idx);
     w->render_data.vao_idx = -1;
@@ -206,6 +206,7 @@ static void
 initialize_window(Window *w, PyObject *title, bool init_gpu_resources) {
     w->id = ++global_state.window_id_counter;
     w->visible = true;
+    w->last_rendered_at = monotonic();
     w->title = title;
     Py_XINCREF(title);
     if (init_gpu_resources) create_gpu_resources_for_window(w);
@@ -307,6 +308,7 @@ attach_window(id_type os_window_id, id_type tab_id, id_type id) {
                 remove_i_from_array(detached_windows.windows, i, detached_windows.num_windows);
                 make_os_window_context_current(osw);
                 create_gpu_resources_for_window(w);
+                w->last_rendered_at = monotonic();
                 if (
                     w->render_data.screen->cell_size.width != osw->fonts_data->cell_width ||
                     w->render_data.screen->cell_size.height != osw->fonts_data->cell_height
@@ -52,7 +52,9 @@ typedef struct {
   color_type background, foreground, active_border_color,
       inactive_border_color, tab_bar_background,
       tab_bar_margin_color;
-  monotonic_t repaint_delay, input_delay;
+  monotonic_t repaint_delay, input_delay, input_parse_budget;
+  int io_backend;
+  monotonic_t hidden_window_release_delay;
   unsigned int hide_window_decorations;
   bool macos_hide_from_tasks, macos_quit_when_last_window_closed,
       macos_window_resizable, macos_traditional_fullscreen;
@@ -72,7 +74,7 @@ typedef struct {
   unsigned long tab_bar_min_tabs;
   bool force_ltr;
   bool resize_in_steps;
-  bool sync_to_monitor;
+  bool sync_to_monitor, low_latency_echo;
   bool close_on_child_death;
   struct {
     monotonic_t on_end, on_pause;
@@ -82,6 +84,12 @@ typedef struct {
   MouseShape pointer_shape_when_dragging;
   bool tab_bar_hidden;
   double font_size;
+  double box_drawing_scale[4];
+  struct {
+    // flattened pairs of inclusive [start, end] codepoints
+    char_type *ranges;
+    size_t count;
+  } prewarm_glyphs;
   struct {
     double outer, inner;
   } tab_bar_margin_height;
@@ -148,7 +156,7 @@ typedef struct {
   } padding;
   WindowGeometry geometry;
   ClickQueue click_queues[8];
-  monotonic_t last_drag_scroll_at;
+  monotonic_t last_drag_scroll_at, last_rendered_at;
   uint32_t last_special_key_pressed;
   WindowBarData title_bar_data;
 } Window;
@@ -283,6 +291,8 @@ extern GlobalState global_state;
 
 void gl_init(void);
 void remove_vao(ssize_t vao_idx);
+void create_gpu_resources_for_window(Window *w);
+void release_gpu_resources_for_window(Window *w);
 bool remove_os_window(id_type os_window_id);
 void *make_os_window_context_current(OSWindow *w);
 void set_os_window_size(OSWindow *os_window, int x, int y);
@@ -322,11 +332,22 @@ void free_texture(uint32_t *);
 void free_framebuffer(uint32_t *);
 void send_sprite_to_gpu(FONTS_DATA_HANDLE fg, unsigned int, unsigned int,
                         unsigned int, pixel *);
+void flush_sprite_uploads(FONTS_DATA_HANDLE fg);
+typedef struct SpriteMove {
+  sprite_index src_x, src_y, src_z, dest_x, dest_y, dest_z;
+} SpriteMove;
+void move_sprites_to_new_texture(FONTS_DATA_HANDLE fg, bool colored,
+                                 const SpriteMove *moves, size_t num_moves);
 void blank_canvas(float, color_type);
 void blank_os_window(OSWindow *);
 void set_os_window_chrome(OSWindow *w);
 FONTS_DATA_HANDLE load_fonts_data(double, double, double);
 void send_prerendered_sprites_for_window(OSWindow *w);
+bool compact_sprite_map_if_needed(FONTS_DATA_HANDLE, monotonic_t frame_started_at);
+void collect_rasterized_glyphs(FONTS_DATA_HANDLE);
+bool wait_for_rasterized_glyphs(FONTS_DATA_HANDLE, monotonic_t frame_started_at, monotonic_t timeout);
+void flush_glyph_disk_caches(FONTS_DATA_HANDLE);
+bool prewarm_sprite_atlas(FONTS_DATA_HANDLE);
 #ifdef __APPLE__
 void get_cocoa_key_equivalent(uint32_t, int, char *key, size_t key_sz, int *);
 typedef enum {
@@ -0,0 +1,43 @@
+#include "gl.h"
+
+typedef struct BorderUniforms {
+    GLint viewport;
+    GLint colors;
+    GLint background_opacity;
+    GLint tint_opacity;
+    GLint tint_premult;
+    GLint gamma_lut;
+} BorderUniforms;
+
+static inline void
+get_uniform_locations_border(int program, BorderUniforms *ans) {
+    ans->viewport = get_uniform_location(program, "viewport");
+    ans->colors = get_uniform_location(program, "colors");
+    ans->background_opacity = get_uniform_location(program, "background_opacity");
+    ans->tint_opacity = get_uniform_location(program, "tint_opacity");
+    ans->tint_premult = get_uniform_location(program, "tint_premult");
+    ans->gamma_lut = get_uniform_location(program, "gamma_lut");
+}
+
+typedef struct CellUniforms {
+    GLint sprites;
+    GLint color_sprites;
+    GLint text_contrast;
+    GLint text_gamma_adjustment;
+    GLint draw_bg_bitfield;
+    GLint gamma_lut;
+    GLint inactive_text_alpha;
+    GLint dim_opacity;
+} CellUniforms;
+
+static inline void
+get_uniform_locations_cell(int program, CellUniforms *ans) {
+    ans->sprites = get_uniform_location(program, "sprites");
+    ans->color_sprites = get_uniform_location(program, "color_sprites");
+    ans->text_contrast = get_uniform_location(program, "text_contrast");
+    ans->text_gamma_adjustment = get_uniform_location(program, "text_gamma_adjustment");
+    ans->draw_bg_bitfield = get_uniform_location(program, "draw_bg_bitfield");
+    ans->gamma_lut = get_uniform_location(program, "gamma_lut");
+    ans->inactive_text_alpha = get_uniform_location(program, "inactive_text_alpha");
+    ans->dim_opacity = get_uniform_location(program, "dim_opacity");
+}
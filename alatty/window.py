@@ -1097,6 +1097,20 @@ def paste_text(self, text: Union[str, bytes]) -> None:
                 text = text.replace(b'\r\n', b'\n').replace(b'\n', b'\r')
             self.screen.paste(text)
 
+    def paste_file(self, path: str) -> None:
+        # The file is streamed to the child a chunk at a time, so it is never
+        # loaded into memory, with the same processing as paste_text()
+        if self.destroyed:
+            return
+        try:
+            fd = os.open(path, os.O_RDONLY | os.O_CLOEXEC)
+        except OSError as err:
+            log_error(f'Failed to open {path} for pasting with error: {err}')
+            return
+        if not self.screen.paste_from_fd(fd):
+            os.close(fd)
+            log_error(f'Failed to paste {path} into window {self.id}, is another paste from a file still in progress?')
+
     def clear_screen(self, reset: bool = False, scrollback: bool = False) -> None:
         self.screen.cursor.x = self.screen.cursor.y = 0
         if reset:
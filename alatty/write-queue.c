@@ -0,0 +1,182 @@
+/*
+ * write-queue.c
+ *
+ * Distributed under terms of the GPL3 license.
+ */
+
+#include "write-queue.h"
+
+#define CHUNK_SZ ((size_t)BUFSIZ)
+#define MAX_CHUNK_SZ ((size_t)1024u * 1024u)
+
+static WriteQueueChunk*
+new_chunk(WriteQueue *q, size_t needed) {
+    WriteQueueChunk *c;
+    if (q->spare && needed <= q->spare->capacity) { c = q->spare; q->spare = NULL; }
+    else {
+        const size_t capacity = MAX(CHUNK_SZ, MIN(needed, MAX_CHUNK_SZ));
+        c = PyMem_RawMalloc(sizeof(WriteQueueChunk) + capacity);
+        if (!c) return NULL;
+        c->capacity = capacity;
+    }
+    c->next = NULL; c->start = 0; c->end = 0; c->owner = NULL; c->data = c->storage;
+    return c;
+}
+
+static void
+link_chunk(WriteQueueList *l, WriteQueueChunk *c) {
+    if (l->tail) l->tail->next = c;
+    else l->head = c;
+    l->tail = c;
+    l->used += c->end - c->start;
+}
+
+static bool
+append_to(WriteQueue *q, WriteQueueList *l, const uint8_t *data, size_t sz) {
+    WriteQueueChunk *t = l->tail;
+    if (t && !t->owner && t->end < t->capacity) {
+        const size_t n = MIN(sz, t->capacity - t->end);
+        memcpy(t->storage + t->end, data, n);
+        t->end += n; l->used += n; data += n; sz -= n;
+    }
+    while (sz) {
+        WriteQueueChunk *c = new_chunk(q, sz);
+        if (!c) return false;
+        const size_t n = MIN(sz, c->capacity);
+        memcpy(c->storage, data, n);
+        c->end = n;
+        link_chunk(l, c);
+        data += n; sz -= n;
+    }
+    return true;
+}
+
+static WriteQueueChunk*
+chunk_for_marker(WriteQueue *q, const char *marker) {
+    const size_t sz = strlen(marker);
+    WriteQueueChunk *c = new_chunk(q, sz);
+    if (!c) return NULL;
+    memcpy(c->storage, marker, sz);
+    c->end = sz;
+    return c;
+}
+
+static void
+interleave_held(WriteQueue *q) {
+    // The chunk at the head of pending may be partially written already, so
+    // held writes go after it, unless they can go after an earlier held write
+    if (!q->held.head) return;
+    WriteQueueList l = {0};
+    if (q->stream_pause[0] && q->stream_resume[0]) {
+        WriteQueueChunk *pause = chunk_for_marker(q, q->stream_pause), *resume = pause ? chunk_for_marker(q, q->stream_resume) : NULL;
+        // without memory for the markers the writes stay held until the stream ends
+        if (!resume) { PyMem_RawFree(pause); return; }
+        link_chunk(&l, pause);
+        l.tail->next = q->held.head; l.tail = q->held.tail; l.used += q->held.used;
+        l.tail->next = NULL;
+        link_chunk(&l, resume);
+    } else l = q->held;
+    WriteQueueChunk *after = q->interleaved_tail ? q->interleaved_tail : (q->pending.head && q->pending.head->start ? q->pending.head : NULL);
+    if (after) {
+        l.tail->next = after->next; after->next = l.head;
+        if (q->pending.tail == after) q->pending.tail = l.tail;
+    } else {
+        l.tail->next = q->pending.head; q->pending.head = l.head;
+        if (!q->pending.tail) q->pending.tail = l.tail;
+    }
+    q->pending.used += l.used;
+    q->interleaved_tail = l.tail;
+    zero_at_ptr(&q->held);
+}
+
+bool
+write_queue_append(WriteQueue *q, const void *data, size_t sz) {
+    if (!q->stream_active) return append_to(q, &q->pending, data, sz);
+    if (!append_to(q, &q->held, data, sz)) return false;
+    interleave_held(q);
+    return true;
+}
+
+bool
+write_queue_append_from_stream(WriteQueue *q, const void *data, size_t sz) {
+    return append_to(q, &q->pending, data, sz);
+}
+
+bool
+write_queue_append_borrowed(WriteQueue *q, PyObject *owner, const void *data, size_t sz) {
+    if (!sz) return true;
+    WriteQueueChunk *c = PyMem_RawMalloc(sizeof(WriteQueueChunk));
+    if (!c) return false;
+    zero_at_ptr(c);
+    c->data = data; c->end = sz; c->capacity = sz;
+    c->owner = owner; Py_INCREF(owner);
+    link_chunk(q->stream_active ? &q->held : &q->pending, c);
+    if (q->stream_active) interleave_held(q);
+    return true;
+}
+
+void
+write_queue_end_stream(WriteQueue *q) {
+    q->stream_active = false;
+    q->stream_pause[0] = 0; q->stream_resume[0] = 0; q->interleaved_tail = NULL;
+    if (!q->held.head) return;
+    if (q->pending.tail) q->pending.tail->next = q->held.head;
+    else q->pending.head = q->held.head;
+    q->pending.tail = q->held.tail;
+    q->pending.used += q->held.used;
+    zero_at_ptr(&q->held);
+}
+
+size_t
+write_queue_iovecs(const WriteQueue *q, struct iovec *iov, size_t max_iov) {
+    size_t n = 0;
+    for (const WriteQueueChunk *c = q->pending.head; c && n < max_iov; c = c->next, n++) {
+        iov[n].iov_base = (void*)(c->data + c->start);
+        iov[n].iov_len = c->end - c->start;
+    }
+    return n;
+}
+
+void
+write_queue_consume(WriteQueue *q, size_t sz) {
+    sz = MIN(sz, q->pending.used);
+    q->pending.used -= sz;
+    while (sz) {
+        WriteQueueChunk *c = q->pending.head;
+        const size_t n = MIN(sz, c->end - c->start);
+        c->start += n; sz -= n;
+        if (c->start < c->end) break;
+        q->pending.head = c->next;
+        if (!q->pending.head) q->pending.tail = NULL;
+        if (c == q->interleaved_tail) q->interleaved_tail = NULL;
+        if (c->owner) { c->next = q->consumed; q->consumed = c; }
+        else if (!q->spare && c->capacity == CHUNK_SZ) { c->next = NULL; q->spare = c; }
+        else PyMem_RawFree(c);
+    }
+}
+
+WriteQueueChunk*
+write_queue_take_consumed(WriteQueue *q) {
+    WriteQueueChunk *ans = q->consumed;
+    q->consumed = NULL;
+    return ans;
+}
+
+void
+free_write_queue_chunks(WriteQueueChunk *chunk) {
+    while (chunk) {
+        WriteQueueChunk *next = chunk->next;
+        Py_XDECREF(chunk->owner);
+        PyMem_RawFree(chunk);
+        chunk = next;
+    }
+}
+
+void
+free_write_queue(WriteQueue *q) {
+    free_write_queue_chunks(q->pending.head);
+    free_write_queue_chunks(q->held.head);
+    free_write_queue_chunks(q->consumed);
+    free_write_queue_chunks(q->spare);
+    zero_at_ptr(q);
+}
@@ -0,0 +1,53 @@
+/*
+ * Distributed under terms of the GPL3 license.
+ */
+
+#pragma once
+
+#include "data-types.h"
+#include <sys/uio.h>
+
+// The data waiting to be written to a child, as a list of chunks so that
+// appending and consuming never move queued bytes. A chunk either owns a
+// copy of its data or borrows it from a Python object, which is how large
+// pastes are queued without copying them.
+typedef struct WriteQueueChunk {
+    struct WriteQueueChunk *next;
+    const uint8_t *data;
+    size_t start, end, capacity;
+    PyObject *owner;
+    uint8_t storage[];
+} WriteQueueChunk;
+
+typedef struct WriteQueueList {
+    WriteQueueChunk *head, *tail;
+    size_t used;
+} WriteQueueList;
+
+typedef struct WriteQueue {
+    WriteQueueList pending;
+    // While a stream is filling pending from another thread, other writes
+    // are sent before the stream data that is not being written yet, so that
+    // typing stays responsive. They are staged here, surrounded by
+    // stream_pause and stream_resume if not empty, and inserted after
+    // interleaved_tail, the last chunk of the previous such write.
+    WriteQueueList held;
+    bool stream_active;
+    char stream_pause[32], stream_resume[32];
+    WriteQueueChunk *interleaved_tail;
+    // Fully written borrowed chunks, their owners can only be released with
+    // the GIL held
+    WriteQueueChunk *consumed, *spare;
+} WriteQueue;
+
+bool write_queue_append(WriteQueue *q, const void *data, size_t sz);
+// Needs the GIL, takes a reference to owner
+bool write_queue_append_borrowed(WriteQueue *q, PyObject *owner, const void *data, size_t sz);
+bool write_queue_append_from_stream(WriteQueue *q, const void *data, size_t sz);
+void write_queue_end_stream(WriteQueue *q);
+size_t write_queue_iovecs(const WriteQueue *q, struct iovec *iov, size_t max_iov);
+void write_queue_consume(WriteQueue *q, size_t sz);
+WriteQueueChunk* write_queue_take_consumed(WriteQueue *q);
+// Needs the GIL if any of the chunks are borrowed
+void free_write_queue_chunks(WriteQueueChunk *chunk);
+void free_write_queue(WriteQueue *q);
@@ -3,13 +3,62 @@
 package tool
 
 import (
+	"fmt"
+	"os"
+	"os/exec"
+	"strconv"
+	"strings"
+
 	"alatty/kittens/ask"
 	"alatty/tools/cli"
 	"alatty/tools/cmd/run_shell"
 	"alatty/tools/cmd/show_error"
 	"alatty/tools/tui"
+
+	"golang.org/x/sys/unix"
 )
 
+// Used by spawn() in child.c when the child is created with posix_spawn(),
+// as it cannot run any code between setsid() and exec. Makes the pty the
+// controlling terminal, changes to cwd, waits for alatty to close the write
+// end of the ready pipe and then execs the child.
+// args are: ready_fd cwd exe argv0 [args...]
+func wait_for_ready_and_exec(args []string) (rc int, err error) {
+	if len(args) < 4 {
+		return 1, fmt.Errorf("Usage: __wait_for_ready__ ready_fd cwd exe argv0 [args...]")
+	}
+	fd, err := strconv.Atoi(args[0])
+	if err != nil {
+		return 1, err
+	}
+	// stdout is always the pty, stdin may be a pipe. On BSD opening the pty
+	// would not have made it the controlling terminal either.
+	if err = unix.IoctlSetInt(1, unix.TIOCSCTTY, 0); err != nil {
+		return 1, fmt.Errorf("Failed to set controlling terminal with TIOCSCTTY: %w", err)
+	}
+	if os.Chdir(args[1]) != nil {
+		_ = os.Chdir("/")
+	}
+	buf := []byte{0}
+	for {
+		if _, err = unix.Read(fd, buf); err != unix.EINTR {
+			break
+		}
+	}
+	unix.Close(fd)
+	exe := args[2]
+	if !strings.Contains(exe, "/") {
+		if q, lerr := exec.LookPath(exe); lerr == nil {
+			exe = q
+		}
+	}
+	err = unix.Exec(exe, args[3:], os.Environ())
+	// Report the failure and hold, so that the window does not just vanish
+	fmt.Fprintf(os.Stderr, "Failed to launch child: %s\nWith error: %s\n", args[2], err)
+	tui.HoldTillEnter(false)
+	return 1, nil
+}
+
 func AlattyToolEntryPoints(root *cli.Command) {
 	root.Add(cli.OptionSpec{
 		Name: "--version", Type: "bool-set", Help: "The current kitten version."})
@@ -25,4 +74,12 @@ func AlattyToolEntryPoints(root *cli.Command) {
 			return
 		},
 	})
+	root.AddSubCommand(&cli.Command{
+		Name:          "__wait_for_ready__",
+		Hidden:        true,
+		IgnoreAllArgs: true,
+		Run: func(cmd *cli.Command, args []string) (rc int, err error) {
+			return wait_for_ready_and_exec(args)
+		},
+	})
 }